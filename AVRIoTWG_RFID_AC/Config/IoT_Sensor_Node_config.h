@@ -10,6 +10,52 @@
 // <id> rfid_scan_interval
 #define CFG_SCAN_INTERVAL 1
 
+// <q> Tag Detection
+// <i> Let the reader sleep in tag detection mode and scan as soon as a badge approaches
+// <i> instead of every scan interval. Needs a successful tag detector calibration at start-up.
+// <id> rfid_tag_detect
+#define CFG_TAG_DETECT 1
+
+// <o> Tag Detection Hold-off <0-60000>
+// <i> Time in milliseconds before tag detection is re-armed after a badge was read
+// <id> rfid_tag_detect_holdoff
+#define CFG_TAG_DETECT_HOLDOFF 1000
+
+// <o> Duplicate Tap Window <0-3600>
+// <i> Time in seconds a badge has to be away from the reader before it is published again.
+// <i> The door still opens on every read of a badge in the local allow-list.
+// <id> rfid_duplicate_window
+#define CFG_DUPLICATE_WINDOW 10
+
+// <o> RF Setting <0-5>
+// <i> ISO15693 data rate and subcarrier: 0 = 53k single, 1 = 53k dual, 2 = 26k single,
+// <i> 3 = 26k dual, 4 = 6k single, 5 = 6k dual
+// <id> rfid_rf_setting
+#define CFG_RF_SETTING 0
+
+// <q> Adaptive RF Setting
+// <i> Fall back to a slower RF setting when badge replies can not be decoded and keep the
+// <i> best known setting in EEPROM. The RF setting above is only the starting point.
+// <id> rfid_rf_adaptive
+#define CFG_RF_ADAPTIVE 1
+
+// <o> Latency Telemetry Interval <0-100000>
+// <i> Time in seconds between messages with the tap-to-unlock latency of every stage,
+// <i> 0 to only show them with the "latency" CLI command
+// <id> rfid_latency_interval
+#define CFG_LATENCY_INTERVAL 0
+
+// <q> Offline Event Log
+// <i> Keep the taps made while the cloud is unreachable in the WINC SPI flash and
+// <i> publish them once MQTT is connected again
+// <id> rfid_offline_log
+#define CFG_OFFLINE_LOG 1
+
+// <q> Sleep When Idle
+// <i> Put the CPU in idle sleep whenever no scheduler task is waiting for execution
+// <id> application_sleep
+#define CFG_SLEEP 1
+
 // <o> Timeout <0-100000>
 // <i> Timeout
 // <id> application_timeout
@@ -13,7 +13,8 @@
 #include "led.h"
 
 static absolutetime_t access_task( void *payload );
-static timer_struct_t access_timer = { access_task };
+// Relocking the door must not wait behind LED or CLI work
+static timer_struct_t access_timer = { .callback_ptr = access_task, .priority = SCHEDULER_PRIORITY_CRITICAL };
 
 static absolutetime_t access_task( void *payload )
 {
@@ -0,0 +1,222 @@
+/*
+ * access_list.c
+ *
+ * Local allow-list of ISO15693 badge UIDs.
+ *
+ * The cloud keeps the list up to date through the ".../commands/acl" topic:
+ *   "ADD <version> <UID>"   add one UID
+ *   "DEL <version> <UID>"   remove one UID
+ *   "SYNC <version>"        drop the whole list, a full sync follows as ADDs
+ * A command is only applied when <version> is newer than the stored version,
+ * so replayed or reordered commands can not undo a later change. UIDs are
+ * written MSB first, exactly as RFID_Scan() publishes them.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include "access_list.h"
+#include "debug_print.h"
+
+// The list lives in EEPROM right after the credentials_storage area
+#define EEPROM_ACL_MAGIC 64
+#define EEPROM_ACL_VERSION (EEPROM_ACL_MAGIC + 1)
+#define EEPROM_ACL_COUNT (EEPROM_ACL_VERSION + sizeof(uint32_t))
+#define EEPROM_ACL_ENTRIES (EEPROM_ACL_COUNT + sizeof(access_list_index_t))
+
+// The 256 byte EEPROM of the ATmega4809 holds fewer than 256 UIDs, so the count
+// is a single byte there. Only a larger EEPROM (a host build) needs 16 bits.
+#if EEPROM_SIZE / ACCESS_LIST_UID_LENGTH > UINT8_MAX
+typedef uint16_t access_list_index_t;
+#define eeprom_read_count( address ) eeprom_read_word( (uint16_t *)( address ) )
+#define eeprom_update_count( address, count ) eeprom_update_word( (uint16_t *)( address ), count )
+#else
+typedef uint8_t access_list_index_t;
+#define eeprom_read_count( address ) eeprom_read_byte( (uint8_t *)( address ) )
+#define eeprom_update_count( address, count ) eeprom_update_byte( (uint8_t *)( address ), count )
+#endif
+
+#define ACCESS_LIST_MAGIC 0xA5
+// The last EEPROM byte holds the RF setting of credentials_storage
+#define ACCESS_LIST_MAX_ENTRIES ((EEPROM_SIZE - 1 - EEPROM_ACL_ENTRIES) / ACCESS_LIST_UID_LENGTH)
+
+static uint8_t             accessList[ACCESS_LIST_MAX_ENTRIES][ACCESS_LIST_UID_LENGTH];
+static access_list_index_t accessListCount   = 0;
+static uint32_t            accessListVersion = 0;
+
+// Binary search, returns true if the UID is in the list. On return *index holds
+// the position of the UID, or the position it has to be inserted at.
+static bool accessListFind( const uint8_t *uid, access_list_index_t *index )
+{
+	access_list_index_t low  = 0;
+	access_list_index_t high = accessListCount;
+
+	while ( low < high )
+	{
+		access_list_index_t mid = low + ( high - low ) / 2;
+		int     cmp = memcmp( accessList[mid], uid, ACCESS_LIST_UID_LENGTH );
+
+		if ( cmp == 0 )
+		{
+			*index = mid;
+			return true;
+		}
+		else if ( cmp < 0 )
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+
+	*index = low;
+	return false;
+}
+
+static void accessListSave( void )
+{
+	// eeprom_update_* only rewrites the bytes that changed
+	eeprom_update_dword( (uint32_t *)EEPROM_ACL_VERSION, accessListVersion );
+	eeprom_update_count( EEPROM_ACL_COUNT, accessListCount );
+	eeprom_update_block( accessList, (void *)EEPROM_ACL_ENTRIES, accessListCount * ACCESS_LIST_UID_LENGTH );
+	eeprom_update_byte( (uint8_t *)EEPROM_ACL_MAGIC, ACCESS_LIST_MAGIC );
+}
+
+// Parse a UID printed MSB first into the reverse byte order used by ISO15693_GetUID()
+static bool accessListParseUID( const char *text, uint8_t *uid )
+{
+	uint8_t i;
+
+	if ( text == NULL || strlen( text ) != 2 * ACCESS_LIST_UID_LENGTH )
+	{
+		return false;
+	}
+
+	for ( i = 0 ; i < ACCESS_LIST_UID_LENGTH ; i++ )
+	{
+		char byte[3] = { text[2 * i], text[2 * i + 1], '\0' };
+
+		if ( !isxdigit( (unsigned char)byte[0] ) || !isxdigit( (unsigned char)byte[1] ) )
+		{
+			return false;
+		}
+		uid[ACCESS_LIST_UID_LENGTH - 1 - i] = (uint8_t)strtoul( byte, NULL, 16 );
+	}
+
+	return true;
+}
+
+void ACCESS_LIST_init( void )
+{
+	accessListCount   = 0;
+	accessListVersion = 0;
+
+	// A blank EEPROM reads 0xFF, start with an empty list in that case
+	if ( eeprom_read_byte( (uint8_t *)EEPROM_ACL_MAGIC ) != ACCESS_LIST_MAGIC )
+	{
+		return;
+	}
+
+	accessListVersion = eeprom_read_dword( (uint32_t *)EEPROM_ACL_VERSION );
+	accessListCount   = eeprom_read_count( EEPROM_ACL_COUNT );
+	if ( accessListCount > ACCESS_LIST_MAX_ENTRIES )
+	{
+		accessListCount = 0;
+	}
+	eeprom_read_block( accessList, (void *)EEPROM_ACL_ENTRIES, accessListCount * ACCESS_LIST_UID_LENGTH );
+
+	debug_printInfo( "ACL: %u UIDs, version %lu", accessListCount, accessListVersion );
+}
+
+bool ACCESS_LIST_contains( const uint8_t *uid )
+{
+	access_list_index_t index;
+
+	return accessListFind( uid, &index );
+}
+
+uint32_t ACCESS_LIST_getVersion( void )
+{
+	return accessListVersion;
+}
+
+uint16_t ACCESS_LIST_getCount( void )
+{
+	return accessListCount;
+}
+
+access_list_result_t ACCESS_LIST_processCommand( char *command )
+{
+	char *   operation = strtok( command, " " );
+	char *   versionText = strtok( NULL, " " );
+	char *   uidText = strtok( NULL, " " );
+	char *   end;
+	uint32_t version;
+	uint8_t             uid[ACCESS_LIST_UID_LENGTH];
+	access_list_index_t index;
+
+	if ( operation == NULL || versionText == NULL )
+	{
+		return ACCESS_LIST_INVALID;
+	}
+
+	version = strtoul( versionText, &end, 10 );
+	if ( *end != '\0' )
+	{
+		return ACCESS_LIST_INVALID;
+	}
+
+	if ( strcmp( operation, "SYNC" ) == 0 )
+	{
+		if ( version <= accessListVersion )
+		{
+			return ACCESS_LIST_STALE;
+		}
+		accessListCount = 0;
+	}
+	else if ( strcmp( operation, "ADD" ) == 0 || strcmp( operation, "DEL" ) == 0 )
+	{
+		if ( !accessListParseUID( uidText, uid ) )
+		{
+			return ACCESS_LIST_INVALID;
+		}
+		if ( version <= accessListVersion )
+		{
+			return ACCESS_LIST_STALE;
+		}
+
+		if ( accessListFind( uid, &index ) )
+		{
+			if ( operation[0] == 'D' )
+			{
+				memmove( accessList[index], accessList[index + 1],
+				         ( accessListCount - index - 1 ) * ACCESS_LIST_UID_LENGTH );
+				accessListCount--;
+			}
+		}
+		else if ( operation[0] == 'A' )
+		{
+			if ( accessListCount >= ACCESS_LIST_MAX_ENTRIES )
+			{
+				return ACCESS_LIST_FULL;
+			}
+			memmove( accessList[index + 1], accessList[index],
+			         ( accessListCount - index ) * ACCESS_LIST_UID_LENGTH );
+			memcpy( accessList[index], uid, ACCESS_LIST_UID_LENGTH );
+			accessListCount++;
+		}
+	}
+	else
+	{
+		return ACCESS_LIST_INVALID;
+	}
+
+	accessListVersion = version;
+	accessListSave();
+
+	return ACCESS_LIST_OK;
+}
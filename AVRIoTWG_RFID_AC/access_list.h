@@ -0,0 +1,33 @@
+/*
+ * access_list.h
+ *
+ * Local allow-list of ISO15693 badge UIDs. The list is kept sorted in RAM so
+ * RFID_Scan() can make the door decision without waiting for the cloud, and is
+ * mirrored to EEPROM so it survives a power cycle.
+ */
+
+
+#ifndef ACCESS_LIST_H_
+#define ACCESS_LIST_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ACCESS_LIST_UID_LENGTH 8 // ISO15693_NBBYTE_UID
+
+// Result codes of ACCESS_LIST_processCommand()
+typedef enum {
+	ACCESS_LIST_OK = 0,
+	ACCESS_LIST_STALE,   // version not newer than the stored one, ignored
+	ACCESS_LIST_FULL,    // no room left for another UID
+	ACCESS_LIST_INVALID  // malformed command
+} access_list_result_t;
+
+void     ACCESS_LIST_init( void );
+bool     ACCESS_LIST_contains( const uint8_t *uid );
+uint32_t ACCESS_LIST_getVersion( void );
+uint16_t ACCESS_LIST_getCount( void );
+
+access_list_result_t ACCESS_LIST_processCommand( char *command );
+
+#endif /* ACCESS_LIST_H_ */
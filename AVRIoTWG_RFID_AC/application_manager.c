@@ -24,6 +24,11 @@
 #include "debug_print.h"
 #include "cr95hf/lib_iso15693.h"
 #include "access_control.h"
+#include "access_list.h"
+#include "recent_uid.h"
+#include "latency.h"
+#include "event_log.h"
+#include "mqtt/mqtt_core/mqtt_core.h"
 #include "cloud/mqtt_packetPopulation/mqtt_packetPopulate.h"
 
 #define MAIN_DATATASK_INTERVAL 100
@@ -36,7 +41,17 @@ absolutetime_t MAIN_dataTask(void *payload);
 timer_struct_t MAIN_dataTasksTimer = {MAIN_dataTask};
 
 void wifiConnectionStateChanged(uint8_t status);
+
+absolutetime_t RFID_tagDetectTask(void *payload);
+timer_struct_t RFID_tagDetectTimer = {RFID_tagDetectTask};
+
+// True while the reader is driven by tag detection instead of the scan interval
+static bool tagDetectRunning = false;
+
 void RFID_Scan(void);
+void RFID_ScanComplete(int8_t status, uint8_t NbUID, const uint8_t *TagUIDs);
+void RFID_TagDetected(int8_t status, uint8_t *pResponse);
+void RFID_ReaderReset(int8_t status, uint8_t *pResponse);
 
 void application_init()
 {
@@ -67,6 +82,12 @@ void application_init()
 	CRYPTO_CLIENT_printSerialNumber(attDeviceID);
 
 	debug_init(attDeviceID);
+
+	ACCESS_LIST_init();
+	RECENT_UID_init();
+	EVENT_LOG_init();
+	scheduler_timeout_profile_name(&MAIN_dataTasksTimer, "MAIN");
+	scheduler_timeout_profile_name(&RFID_tagDetectTimer, "tagdetect");
 	// Default not to EEPROM value but to NONE
 	// debug_setSeverity(CREDENTIALS_STORAGE_getDebugSeverity());
 	// debug_setSeverity(SEVERITY_DEBUG); // Use this to start up in debug mode always, TODO: Do this via define we can
@@ -96,6 +117,11 @@ void wifiConnectionStateChanged(uint8_t status)
 void runScheduler(void)
 {
 	scheduler_timeout_call_next_callback();
+
+#if CFG_SLEEP
+	// Everything is driven by timers and interrupts, sleep until one of them fires
+	scheduler_timeout_sleep();
+#endif
 }
 
 // This gets called by the scheduler approximately every 100ms
@@ -106,17 +132,21 @@ absolutetime_t MAIN_dataTask(void *payload)
 	// Get the current time. This uses the C standard library time functions
 	time_t timeNow = time(NULL);
 
-	// Example of how to send data when MQTT is connected every 1 second based on the system clock
-	if (CLOUD_isConnected()) {
-		// How many seconds since the last time this loop ran?
-		int32_t delta = difftime(timeNow, previousTransmissionTime);
+	// Scan every CFG_SCAN_INTERVAL seconds based on the system clock. The local allow-list
+	// lets a badge open the door even while the cloud connection is down.
+	// How many seconds since the last time this loop ran?
+	int32_t delta = difftime(timeNow, previousTransmissionTime);
 
-		if (delta >= CFG_SCAN_INTERVAL) {
-			previousTransmissionTime = timeNow;
+	// Prefer tag detection, this fails right away if the tag detector is not calibrated
+	if (!tagDetectRunning && !ISO15693_IsBusy()
+	    && CR95HF_TagDetectAsync(RFID_TagDetected) == CR95HF_SUCCESS_CODE) {
+		tagDetectRunning = true;
+	}
 
-			// Call the data task in main.c
-			RFID_Scan();
-		}
+	if (!tagDetectRunning && delta >= CFG_SCAN_INTERVAL) {
+		previousTransmissionTime = timeNow;
+
+		RFID_Scan();
 	}
 
 	// Example of how to read the SW0 and SW1 buttons
@@ -131,30 +161,213 @@ absolutetime_t MAIN_dataTask(void *payload)
 
 	LED_BLUE_set_level(!shared_networking_params.haveAPConnection);
 
+#if CFG_LATENCY_INTERVAL
+	static time_t previousLatencyTime = 0;
+	static char   latencyJson[200];
+
+	// Never replace a tap that still waits for MQTT_TransmissionHandler()
+	if (difftime(timeNow, previousLatencyTime) >= CFG_LATENCY_INTERVAL && CLOUD_isConnected()
+	    && !MQTT_IsPublishPending()) {
+		uint16_t length = LATENCY_printJson(latencyJson, sizeof(latencyJson));
+
+		previousLatencyTime = timeNow;
+		if (length != 0) {
+			CLOUD_publishData((uint8_t *)latencyJson, length, NULL);
+		}
+	}
+#endif
+
+#if CFG_OFFLINE_LOG
+	// Publish the taps made while the cloud was unreachable, one message at a time.
+	// A WINC restart reads back EVENT_LOG_BATCH_ENTRIES more of them, it only
+	// comes once all taps read back by the last one were acknowledged.
+	if (CLOUD_isConnected() && !MQTT_IsPublishPending()) {
+		char     offlineJson[EVENT_LOG_JSON_SIZE];
+		uint8_t  count;
+		uint16_t length = EVENT_LOG_printJson(offlineJson, sizeof(offlineJson), &count);
+
+		if (length != 0) {
+			// Taps that were not queued are tried again next time
+			if (CLOUD_publishData((uint8_t *)offlineJson, length, EVENT_LOG_acknowledge)) {
+				EVENT_LOG_consume(count);
+			}
+		} else if (EVENT_LOG_needsSync()) {
+			// The rest of the log can only be read while the WINC is halted
+			debug_printInfo("LOG: reconnecting to read more taps");
+			CLOUD_reset();
+		}
+	}
+#endif
+
 	// This is milliseconds managed by the RTC and the scheduler, this return makes the
 	//      timer run another time, returning 0 will make it stop
 	return MAIN_DATATASK_INTERVAL;
 }
 
-// This will get called every 1 second only while we have a valid Cloud connection
+// This will get called every CFG_SCAN_INTERVAL seconds
 void RFID_Scan(void)
 {
-	static char json[30];
-	static uint8_t TagUID[ISO15693_NBBYTE_UID]; // this MUST be static
+	// The inventory completes from the scheduler, so cloud commands are still
+	// handled while the reader talks to the tags. The 16 slot inventory reads
+	// every badge in the field, so a wallet with several cards needs no retry.
+	if ( ISO15693_InventoryAsync( RFID_ScanComplete ) != RESULTOK )
+	{
+		debug_printError( "RFID: reader busy" );
+
+		// Fall back to the scan interval until MAIN_dataTask re-arms the tag detector
+		tagDetectRunning = false;
+	}
+}
+
+// Called from the scheduler when the reader wakes up from tag detection mode
+void RFID_TagDetected(int8_t status, uint8_t *pResponse)
+{
+	if ( status == CR95HF_POLLING_TIMEOUT )
+	{
+		// The chip did not wake up on its own, reset it like CR95HF_PORsequence() does.
+		// tagDetectRunning stays set until the reset sequence is done.
+		debug_printError( "RFID: tag detector timeout, resetting the reader" );
+		if ( CR95HF_Send_SPI_ResetSequenceAsync( RFID_ReaderReset ) == CR95HF_SUCCESS_CODE )
+		{
+			return;
+		}
+	}
+
+	if ( status != CR95HF_SUCCESS_CODE || CR95HF_IsReaderResultCodeOk( IDLE, pResponse ) != CR95HF_SUCCESS_CODE )
+	{
+		tagDetectRunning = false;
+		return;
+	}
+
+	if ( pResponse[IDLE_OFFSET_WAKEUPSOURCE] == IDLE_WAKEUP_TAGDETECT )
+	{
+		RFID_Scan();
+	}
+	else if ( CR95HF_TagDetectAsync( RFID_TagDetected ) != CR95HF_SUCCESS_CODE )
+	{
+		// Periodic wake up without a badge, go right back to sleep
+		tagDetectRunning = false;
+	}
+}
+
+// Called from the scheduler once the reset after a tag detector timeout is done
+void RFID_ReaderReset(int8_t status, uint8_t *pResponse)
+{
+	// MAIN_dataTask re-arms the tag detector
+	tagDetectRunning = false;
+}
+
+absolutetime_t RFID_tagDetectTask(void *payload)
+{
+	if ( CR95HF_TagDetectAsync( RFID_TagDetected ) != CR95HF_SUCCESS_CODE )
+	{
+		tagDetectRunning = false;
+	}
+
+	return 0;
+}
+
+// {"UIDs":[ + "0123456789ABCDEF", per UID + ]}
+#define RFID_JSON_SIZE (10 + ISO15693_MAX_INVENTORY_UIDS * (2 * ISO15693_NBBYTE_UID + 3) + 2)
+
+// Called from the scheduler when the inventory started by RFID_Scan() is done
+void RFID_ScanComplete(int8_t status, uint8_t NbUID, const uint8_t *TagUIDs)
+{
+	static char json[RFID_JSON_SIZE];
+	char *      pJson = json;
+	bool        repeat[ISO15693_MAX_INVENTORY_UIDS];
+	bool        granted[ISO15693_MAX_INVENTORY_UIDS];
+	uint8_t     nbNew = 0;
+	uint8_t     nbWritten = 0;
+	uint8_t     i;
 	
-	// This part runs every CFG_SCAN_INTERVAL seconds
-	if ( ISO15693_GetUID( TagUID ) == RESULTOK )
+	if ( status == RESULTOK )
 	{
-		// UID is stored in reverse byte order
-		sprintf( json, "{\"UID\":\"%02X%02X%02X%02X%02X%02X%02X%02X\"}",
-			TagUID[7], TagUID[6], TagUID[5], TagUID[4], TagUID[3], TagUID[2], TagUID[1], TagUID[0] );
+		for ( i = 0 ; i < NbUID ; i++ )
+		{
+			const uint8_t *TagUID = &TagUIDs[i * ISO15693_NBBYTE_UID];
+
+			// Known badges open the door right away, also when the tap is not published again
+			granted[i] = ACCESS_LIST_contains( TagUID );
+			if ( granted[i] )
+			{
+				Access_Granted();
+			}
+
+			// A badge left on the reader is only published once per CFG_DUPLICATE_WINDOW
+			repeat[i] = RECENT_UID_isRepeat( TagUID );
+			if ( !repeat[i] )
+			{
+				nbNew++;
+			}
+		}
+
+		// Time the way of a published tap to the cloud and back
+		if ( nbNew != 0 && CLOUD_isConnected() )
+		{
+			LATENCY_startTap( ISO15693_GetScanTiming()->LastTime );
+		}
+
+		// A single badge keeps the {"UID":"..."} message, several go out in one {"UIDs":[...]}
+		pJson += sprintf( pJson, ( nbNew == 1 ) ? "{\"UID\":" : "{\"UIDs\":[" );
+
+		for ( i = 0 ; i < NbUID ; i++ )
+		{
+			const uint8_t *TagUID = &TagUIDs[i * ISO15693_NBBYTE_UID];
+
+			if ( repeat[i] )
+			{
+				continue;
+			}
+
+			// UID is stored in reverse byte order
+			pJson += sprintf( pJson, "%s\"%02X%02X%02X%02X%02X%02X%02X%02X\"", ( nbWritten++ != 0 ) ? "," : "",
+				TagUID[7], TagUID[6], TagUID[5], TagUID[4], TagUID[3], TagUID[2], TagUID[1], TagUID[0] );
+		}
+
+		sprintf( pJson, ( nbNew == 1 ) ? "}" : "]}" );
+
+#if CFG_RF_ADAPTIVE
+		// Remember the RF setting these badges were read with
+		CREDENTIALS_STORAGE_setRfSetting( ISO15693_GetRFSetting() );
+#endif
 
-		CLOUD_publishData((uint8_t *)json, strlen(json));
-		
-		debug_printInfo( "RFID: %s", json );
+		if ( nbNew == 0 )
+		{
+			debug_printInfo( "RFID: repeated tap not published (%u so far)", RECENT_UID_getSuppressed() );
+		}
+		else
+		{
+			if ( CLOUD_isConnected() && CLOUD_publishData((uint8_t *)json, strlen(json), NULL) )
+			{
+				LATENCY_mark( LATENCY_PUBLISH );
+			}
+#if CFG_OFFLINE_LOG
+			else
+			{
+				// Keep the taps with the local decision until the cloud is back, or
+				// until the PUBLISH queue has room for them again
+				for ( i = 0 ; i < NbUID ; i++ )
+				{
+					if ( !repeat[i] && !EVENT_LOG_append( &TagUIDs[i * ISO15693_NBBYTE_UID], time( NULL ), granted[i] ) )
+					{
+						debug_printError( "RFID: offline tap not logged (%u so far)", EVENT_LOG_getDropped() );
+					}
+				}
+			}
+#endif
+
+			debug_printInfo( "RFID: %s", json );
+		}
 	}
 
 	LED_flashYellow();
+
+	if ( tagDetectRunning )
+	{
+		// Hold off after a read so a badge left on the reader is not scanned over and over
+		scheduler_timeout_create( &RFID_tagDetectTimer, ( status == RESULTOK ) ? CFG_TAG_DETECT_HOLDOFF : 1 );
+	}
 }
 
 void process_cloud_command( uint8_t* topic, uint8_t* payload )
@@ -163,6 +376,8 @@ void process_cloud_command( uint8_t* topic, uint8_t* payload )
 	// need to ignore the "/#" -> 37 bytes
 	if ( memcmp( topic, mqttSubscribe, 37 ) == 0 )
 	{
+		LATENCY_mark( LATENCY_COMMAND );
+
 		if ( strcmp( (char*)payload, "YES" ) == 0 )
 		{
 			Access_Granted();
@@ -171,5 +386,21 @@ void process_cloud_command( uint8_t* topic, uint8_t* payload )
 		{
 			LED_flashRed();
 		}
+
+		LATENCY_mark( LATENCY_ACTION );
 	}
-}
\ No newline at end of file
+}
+
+void process_acl_command( uint8_t* topic, uint8_t* payload )
+{
+	access_list_result_t result = ACCESS_LIST_processCommand( (char*)payload );
+
+	if ( result != ACCESS_LIST_OK )
+	{
+		debug_printError( "ACL: update rejected (%d)", result );
+	}
+	else
+	{
+		debug_printInfo( "ACL: %u UIDs, version %lu", ACCESS_LIST_getCount(), ACCESS_LIST_getVersion() );
+	}
+}
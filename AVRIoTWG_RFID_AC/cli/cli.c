@@ -36,6 +36,8 @@
 #include "../credentials_storage/credentials_storage.h"
 #include "../mqtt/mqtt_core/mqtt_core.h"
 #include "debug_print.h"
+#include "../cr95hf/lib_iso15693.h"
+#include "../latency.h"
 
 #define WIFI_PARAMS_OPEN_CNT 1
 #define WIFI_PARAMS_PSK_CNT 2
@@ -46,7 +48,8 @@
 #define UNKNOWN_CMD_MSG                                                                                                \
 	"--------------------------------------------" NEWLINE "Unknown command. List of available commands:" NEWLINE      \
 	"reset" NEWLINE "device" NEWLINE "key" NEWLINE "reconnect" NEWLINE "version" NEWLINE "cli_version" NEWLINE         \
-	"wifi <ssid>[,<pass>,[authType]]" NEWLINE "debug" NEWLINE "--------------------------------------------" NEWLINE   \
+	"wifi <ssid>[,<pass>,[authType]]" NEWLINE "debug" NEWLINE "tagdetect" NEWLINE "scantime" NEWLINE                   \
+	"rfstats" NEWLINE "latency" NEWLINE "sched [reset]" NEWLINE "--------------------------------------------" NEWLINE \
 	"\4"
 
 static char    command[MAX_COMMAND_SIZE];
@@ -66,14 +69,18 @@ static void get_device_id(char *pArg);
 static void get_cli_version(char *pArg);
 static void get_firmware_version(char *pArg);
 static void set_debug_level(char *pArg);
+static void get_tag_detector(char *pArg);
+static void get_scan_timing(char *pArg);
+static void get_rf_stats(char *pArg);
+static void get_latency(char *pArg);
+static void get_sched(char *pArg);
 
 static bool endOfLineTest(char c);
 static void enableUsartRxInterrupts(void);
-
-#define CLI_TASK_INTERVAL 50
+static void usartRxIsr(void);
 
 absolutetime_t CLI_task(void *);
-timer_struct_t CLI_task_timer = {CLI_task};
+timer_struct_t CLI_task_timer = {.callback_ptr = CLI_task, .priority = SCHEDULER_PRIORITY_BACKGROUND};
 
 struct cmd {
 	const char *const command;
@@ -87,12 +94,18 @@ const struct cmd commands[] = {{"reset", reset_cmd},
                                {"device", get_device_id},
                                {"cli_version", get_cli_version},
                                {"version", get_firmware_version},
-                               {"debug", set_debug_level}};
+                               {"debug", set_debug_level},
+                               {"tagdetect", get_tag_detector},
+                               {"scantime", get_scan_timing},
+                               {"rfstats", get_rf_stats},
+                               {"latency", get_latency},
+                               {"sched", get_sched}};
 
 void CLI_init(void)
 {
+	scheduler_timeout_profile_name(&CLI_task_timer, "CLI");
+	USART_0_set_ISR_cb(usartRxIsr, RX_CB);
 	enableUsartRxInterrupts();
-	scheduler_timeout_create(&CLI_task_timer, CLI_TASK_INTERVAL);
 }
 
 static bool endOfLineTest(char c)
@@ -109,6 +122,7 @@ static bool endOfLineTest(char c)
 	return retvalue;
 }
 
+// Queued by usartRxIsr() for every byte received
 absolutetime_t CLI_task(void *param)
 {
 	// read all the EUSART bytes in the queue
@@ -138,7 +152,7 @@ absolutetime_t CLI_task(void *param)
 		}
 	}
 
-	return CLI_TASK_INTERVAL;
+	return 0;
 }
 
 static void set_wifi_auth(char *ssid_pwd_auth)
@@ -207,6 +221,136 @@ static void set_debug_level(char *pArg)
 	}
 }
 
+static void get_tag_detector(char *pArg)
+{
+	uint8_t  dacRef, dacDataL, dacDataH;
+	uint16_t wakeUps;
+	(void)pArg;
+
+	if (CR95HF_GetTagDetector(&dacRef, &dacDataL, &dacDataH, &wakeUps)) {
+		printf("DAC reference 0x%02X, wake-up window 0x%02X-0x%02X, %u tag wake-ups\r\n\4",
+		       dacRef,
+		       dacDataL,
+		       dacDataH,
+		       wakeUps);
+	} else {
+		printf("Tag detector not calibrated.\r\n\4");
+	}
+}
+
+static void get_scan_timing(char *pArg)
+{
+	const ISO15693_ScanTimingStruct *timing = ISO15693_GetScanTiming();
+	(void)pArg;
+
+	printf("%u scans, %u protocol selects, last %u ms, max %u ms, average %lu ms\r\n\4",
+	       timing->Scans,
+	       timing->ProtocolSelects,
+	       timing->LastTime,
+	       timing->MaxTime,
+	       timing->Scans ? timing->TotalTime / timing->Scans : 0);
+}
+
+static void get_rf_stats(char *pArg)
+{
+	const ISO15693_RFStatsStruct *stats;
+	uint8_t                       setting, dataRate, subCarrier;
+	(void)pArg;
+
+	// '*' marks the best known setting, the one the next scan starts with
+	for (setting = 0; setting < ISO15693_NB_RFSETTINGS; setting++) {
+		stats = ISO15693_GetRFStats(setting);
+		ISO15693_GetRFSettingParameters(setting, &dataRate, &subCarrier);
+
+		printf("%c %2sk %-6s: %u/%u ok (%u%%), average air time %lu ms, %lu SPI bytes\r\n",
+		       (setting == ISO15693_GetRFSetting()) ? '*' : ' ',
+		       (dataRate == ISO15693_TRANSMISSION_53) ? "53" : (dataRate == ISO15693_TRANSMISSION_26) ? "26" : "6",
+		       (subCarrier == ISO15693_DUAL_SUBCARRIER) ? "dual" : "single",
+		       stats->Successes,
+		       stats->Attempts,
+		       stats->Attempts ? (uint16_t)((uint32_t)stats->Successes * 100 / stats->Attempts) : 0,
+		       stats->Attempts ? stats->AirTime / stats->Attempts : 0,
+		       stats->Attempts ? stats->SPIBytes / stats->Attempts : 0);
+	}
+	printf("\4");
+}
+
+static void get_latency(char *pArg)
+{
+	const latency_histogram_t *histogram;
+	uint8_t                    stage, bucket;
+	(void)pArg;
+
+	printf("stage   count   avg   max");
+	for (bucket = 0; bucket < LATENCY_BUCKETS - 1; bucket++) {
+		printf(" <%5u", LATENCY_FIRST_BUCKET << bucket);
+	}
+	printf(" >=%4u ms\r\n", LATENCY_FIRST_BUCKET << (LATENCY_BUCKETS - 2));
+
+	for (stage = 0; stage < LATENCY_STAGES; stage++) {
+		histogram = LATENCY_getHistogram(stage);
+
+		printf("%-7s %5u %5lu %5u",
+		       LATENCY_getStageName(stage),
+		       histogram->count,
+		       histogram->count ? histogram->total / histogram->count : 0,
+		       histogram->max);
+		for (bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+			printf(" %6u", histogram->buckets[bucket]);
+		}
+		printf("\r\n");
+	}
+	printf("%u PUBLISH dropped\r\n", MQTT_GetPublishDropCount());
+	printf("\4");
+}
+
+static void get_sched(char *pArg)
+{
+	const scheduler_sleep_stats_t *stats = scheduler_timeout_get_sleep_stats();
+
+	printf("%lu sleeps, %lu ticks asleep, %lu tasks, latency average %lu max %lu ticks, %lu timers lost\r\n",
+	       stats->sleeps,
+	       stats->sleep_time,
+	       stats->callbacks,
+	       stats->callbacks ? stats->total_latency / stats->callbacks : 0,
+	       stats->max_latency,
+	       stats->lost_timers);
+
+#if SCHEDULER_PROFILE
+	const scheduler_profile_t *profile;
+	uint8_t                    i;
+
+	if (pArg != NULL && strcmp(pArg, "reset") == 0) {
+		scheduler_timeout_profile_reset();
+		printf("Profile reset.\r\n\4");
+		return;
+	}
+
+	// Times in ticks, '!' marks tasks that ran longer than SCHEDULER_PROFILE_BUDGET
+	printf("task         calls   min   avg   max  lat avg  lat max overruns\r\n");
+	for (i = 0; (profile = scheduler_timeout_get_profile(i)) != NULL; i++) {
+		if (profile->name != NULL) {
+			printf("%-12s", profile->name);
+		} else {
+			printf("%-12p", (void *)profile->timer->callback_ptr);
+		}
+		printf(" %5u %5u %5lu %5u %8lu %8u %8u%s\r\n",
+		       profile->calls,
+		       profile->calls ? profile->min_time : 0,
+		       profile->calls ? profile->total_time / profile->calls : 0,
+		       profile->max_time,
+		       profile->calls ? profile->total_latency / profile->calls : 0,
+		       profile->max_latency,
+		       profile->overruns,
+		       profile->overruns ? " !" : "");
+	}
+#else
+	(void)pArg;
+	printf("Per-task profile disabled, build with SCHEDULER_PROFILE 1.\r\n");
+#endif
+	printf("\4");
+}
+
 static void get_public_key(char *pArg)
 {
 	char key_pem_format[MAX_PUB_KEY_LEN];
@@ -277,6 +421,13 @@ static void command_received(char *command_text)
 	printf(UNKNOWN_CMD_MSG);
 }
 
+// Stores the byte like the driver does and queues CLI_task() to read it
+static void usartRxIsr(void)
+{
+	USART_0_default_rx_isr_cb();
+	scheduler_timeout_enqueue_from_isr(&CLI_task_timer);
+}
+
 static void enableUsartRxInterrupts(void)
 {
 	// Empty RX buffer
@@ -564,15 +564,49 @@ socketState_t BSD_GetSocketState(int sock)
 }
 
 int BSD_send(int socket, const void *msg, size_t len, int flags)
+{
+	struct bsd_iovec iov;
+
+	iov.iov_base = (void *)msg;
+	iov.iov_len  = len;
+
+	return BSD_sendv(socket, &iov, 1, flags);
+}
+
+// Like writev(), the segments leave as one packet without being copied together first
+int BSD_sendv(int socket, const struct bsd_iovec *iov, int iovcnt, int flags)
 {
 	wincSocketResponses_t wincSendReturn;
+	tstrM2mDataSegment    segments[BSD_IOV_MAX];
+	size_t                len   = 0;
+	bool                  fault = false;
+	int                   i;
 
 	if (flags != 0) { // Flag Not Support by WINC implementation
 		bsd_setErrNo(EINVAL);
 		return BSD_ERROR;
 	}
+	if (iovcnt <= 0 || iovcnt > BSD_IOV_MAX) {
+		bsd_setErrNo(EINVAL);
+		return BSD_ERROR;
+	}
 
-	wincSendReturn = send((SOCKET)socket, (void *)msg, (uint16_t)len, (uint16_t)flags);
+	for (i = 0; i < iovcnt; i++) {
+		segments[i].pu8Data = (uint8_t *)iov[i].iov_base;
+		segments[i].u16Size = (uint16_t)iov[i].iov_len;
+		if (iov[i].iov_base == NULL) {
+			fault = true;
+		}
+		len += iov[i].iov_len;
+	}
+
+	// Checked here, the segment sizes passed on are only 16 bits
+	if (len > SOCKET_BUFFER_MAX_LENGTH) {
+		bsd_setErrNo(EMSGSIZE);
+		return BSD_ERROR;
+	}
+
+	wincSendReturn = sendv((SOCKET)socket, segments, (uint8_t)iovcnt, (uint16_t)flags);
 	if (wincSendReturn != WINC_SOCK_ERR_NO_ERROR) {
 		debug_printError("BSD: wincSendReturn (%d)", wincSendReturn);
 		// Most likely in this case we HAVE to update the socket state, especially if we get ENOTSOCK !!!
@@ -580,10 +614,8 @@ int BSD_send(int socket, const void *msg, size_t len, int flags)
 		case WINC_SOCK_ERR_INVALID_ARG:
 			if (socket < 0) {
 				bsd_setErrNo(ENOTSOCK);
-			} else if (msg == NULL) {
+			} else if (fault) {
 				bsd_setErrNo(EFAULT);
-			} else if (len > SOCKET_BUFFER_MAX_LENGTH) {
-				bsd_setErrNo(EMSGSIZE);
 			} else {
 				bsd_setErrNo(EINVAL);
 			}
@@ -37,6 +37,7 @@
 /***************** BSD Generic Defines **********************/
 #define BSD_SUCCESS 0
 #define BSD_ERROR -1
+#define BSD_IOV_MAX 12 // Most segments BSD_sendv() takes
 
 /************* (END) BSD Generic Defines (END) *****************/
 
@@ -203,6 +204,11 @@ struct bsd_sockaddr_in { /* Socket address internet style */
 	char               sin_zero[8];
 };
 
+struct bsd_iovec { /* One part of the data passed to BSD_sendv() */
+	void * iov_base;
+	size_t iov_len;
+};
+
 struct pollfd {
 	int   fd;      /* file descriptor */
 	short events;  /* events to look for	*/
@@ -243,6 +249,8 @@ int BSD_connect(int socket, const struct bsd_sockaddr *name, socklen_t namelen);
 
 int BSD_send(int socket, const void *msg, size_t len, int flags);
 
+int BSD_sendv(int socket, const struct bsd_iovec *iov, int iovcnt, int flags);
+
 int BSD_recv(int socket, const void *msg, size_t len, int flags);
 
 int BSD_close(int socket);
@@ -48,6 +48,8 @@
 
 #include "application_manager.h"
 #include "credentials_storage/credentials_storage.h"
+#include "latency.h"
+#include "event_log.h"
 
 static bool cloudInitialized = false;
 static bool waitingForMQTT   = false;
@@ -62,10 +64,12 @@ char       deviceId[CLOUD_MAX_DEVICEID_LENGTH];
 absolutetime_t CLOUD_task(void *param);
 absolutetime_t mqttTimeoutTask(void *payload);
 absolutetime_t cloudResetTask(void *payload);
+absolutetime_t mqttServiceTask(void *payload);
 
 static void dnsHandler(uint8 *domainName, uint32 serverIP);
 static void updateJWT(uint32_t epoch);
 
+static void    cloudReceive(uint8_t *data, uint8_t len);
 static int8_t  connectMQTTSocket(void);
 static void    connectMQTT();
 static uint8_t reInit(void);
@@ -83,6 +87,9 @@ timer_struct_t mqttTimeoutTaskTimer = {mqttTimeoutTask};
 
 timer_struct_t cloudResetTaskTimer = {cloudResetTask};
 
+// Never created, only posted when there is MQTT work to do
+timer_struct_t mqttServiceTaskTimer = {mqttServiceTask};
+
 uint32_t mqttGoogleApisComIP;
 
 packetReceptionHandler_t cloud_packetReceiveCallBackTable[CLOUD_PACKET_RECV_TABLE_SIZE];
@@ -115,8 +122,54 @@ absolutetime_t cloudResetTask(void *payload)
 	return 0;
 }
 
+// Runs the MQTT state machine as soon as a packet was created or data
+// arrived, CLOUD_task only posts it once per interval for the keep-alive
+absolutetime_t mqttServiceTask(void *payload)
+{
+	mqttContext *    mqttConnnectionInfo = MQTT_GetClientConnectionInfo();
+	mqttCurrentState connectionState     = MQTT_GetConnectionState();
+	bool             publishPending;
+
+	if (BSD_GetSocketState(*mqttConnnectionInfo->tcpClientSocket) != SOCKET_CONNECTED
+	    || MQTT_GetConnectionState() == DISCONNECTED) {
+		return 0;
+	}
+
+	publishPending = MQTT_IsPublishPending();
+
+	MQTT_ReceptionHandler(mqttConnnectionInfo);
+
+	// The CONNACK came in, CLOUD_task subscribes now instead of at its next interval
+	if (connectionState != CONNECTED && MQTT_GetConnectionState() == CONNECTED) {
+		scheduler_timeout_create(&CLOUD_taskTimer, 0);
+	}
+
+	MQTT_TransmissionHandler(mqttConnnectionInfo);
+
+	if (publishPending && !MQTT_IsPublishPending()) {
+		LATENCY_mark(LATENCY_SEND);
+	}
+
+	// Todo: We already processed the data in place using PEEK, this just flushes the buffer
+	BSD_recv(*mqttConnnectionInfo->tcpClientSocket, MQTTReceiveBuffer, sizeof(MQTTReceiveBuffer), 0);
+
+	return 0;
+}
+
+// Called from BSD_SocketHandler() on SOCKET_MSG_RECV
+static void cloudReceive(uint8_t *data, uint8_t len)
+{
+	MQTT_CLIENT_receive(data, len);
+	scheduler_timeout_post(&mqttServiceTaskTimer);
+}
+
 void CLOUD_init(char *attDeviceID)
 {
+	scheduler_timeout_profile_name(&CLOUD_taskTimer, "CLOUD");
+	scheduler_timeout_profile_name(&mqttTimeoutTaskTimer, "mqttTimeout");
+	scheduler_timeout_profile_name(&cloudResetTaskTimer, "cloudReset");
+	scheduler_timeout_profile_name(&mqttServiceTaskTimer, "mqttService");
+
 	// Create timers for the application scheduler
 	scheduler_timeout_create(&CLOUD_taskTimer, 500);
 }
@@ -260,14 +313,8 @@ absolutetime_t CLOUD_task(void *param)
 			if (MQTT_GetConnectionState() == DISCONNECTED) {
 				connectMQTT();
 				resubscribe = true; // after we (re)connect, we must (re)subscribe
+				scheduler_timeout_post(&mqttServiceTaskTimer);
 			} else {
-				MQTT_ReceptionHandler(mqttConnnectionInfo);
-				MQTT_TransmissionHandler(mqttConnnectionInfo);
-
-				// Todo: We already processed the data in place using PEEK, this just flushes the buffer
-				BSD_recv(
-				    *MQTT_GetClientConnectionInfo()->tcpClientSocket, MQTTReceiveBuffer, sizeof(MQTTReceiveBuffer), 0);
-
 				if (MQTT_GetConnectionState() == CONNECTED) {
 					shared_networking_params.haveERROR = 0;
 					scheduler_timeout_delete(&mqttTimeoutTaskTimer);
@@ -291,6 +338,9 @@ absolutetime_t CLOUD_task(void *param)
 						BSD_close(*mqttConnnectionInfo->tcpClientSocket);
 					}
 				}
+
+				// Keep-alive and anything the events missed, also sends the SUBSCRIBE
+				scheduler_timeout_post(&mqttServiceTaskTimer);
 			}
 			break;
 
@@ -311,9 +361,14 @@ bool CLOUD_isConnected(void)
 	}
 }
 
-void CLOUD_publishData(uint8_t *data, unsigned int len)
+// False if the PUBLISH could not be queued, the data is not sent then
+bool CLOUD_publishData(uint8_t *data, unsigned int len, void (*ackHandler)(void))
 {
-	MQTT_CLIENT_publish(data, len);
+	if (!MQTT_CLIENT_publish(data, len, ackHandler)) {
+		return false;
+	}
+	scheduler_timeout_post(&mqttServiceTaskTimer);
+	return true;
 }
 
 static void dnsHandler(uint8 *domainName, uint32 serverIP)
@@ -340,10 +395,12 @@ static void updateJWT(uint32_t epoch)
 	// we must be subscribed to /devices/{device-id}/commands/# (# is REQUIRED) to
 	// receive commands from Cloud IoT Core. 
 	sprintf(mqttSubscribe, "/devices/%s/commands/#", deviceId);
+	sprintf(mqttAclTopic, "/devices/%s/commands/acl", deviceId);
 
 	debug_printInfo("MQTT: cid=%s", cid);
 	debug_printInfo("MQTT: mqttTopic=%s", mqttTopic);
 	debug_printInfo("MQTT: mqttSubscribe=%s", mqttSubscribe);
+	debug_printInfo("MQTT: mqttAclTopic=%s", mqttAclTopic);
 	uint8_t res = CRYPTO_CLIENT_createJWT((char *)mqttPassword, PASSWORD_SPACE, epoch, projectId);
 	time_t  t   = time(NULL);
 	debug_printInfo("JWT: Result(%d) at %s", res, ctime(&t));
@@ -358,6 +415,11 @@ static uint8_t reInit(void)
 	waitingForMQTT                            = false;
 	isResetting                               = false;
 
+#if CFG_OFFLINE_LOG
+	// The WINC is restarted below anyway, until then its flash can take the taps made offline
+	EVENT_LOG_sync();
+#endif
+
 	// Re-init the WiFi
 	wifi_reinit();
 
@@ -368,13 +430,16 @@ static uint8_t reInit(void)
 	memset(&cloud_packetReceiveCallBackTable, 0, sizeof(cloud_packetReceiveCallBackTable));
 	BSD_SetRecvHandlerTable(cloud_packetReceiveCallBackTable);
 	cloud_packetReceiveCallBackTable[0].socket       = MQTT_GetClientConnectionInfo()->tcpClientSocket;
-	cloud_packetReceiveCallBackTable[0].recvCallBack = MQTT_CLIENT_receive;
+	cloud_packetReceiveCallBackTable[0].recvCallBack = cloudReceive;
 	
 	// set callback function to handle a received PUBLISH packet (only one subscription)
 	memset( &cloud_publishReceiveCallBackTable, 0, sizeof( cloud_publishReceiveCallBackTable ) );
 	MQTT_SetPublishReceptionHandlerTable( cloud_publishReceiveCallBackTable );
 	cloud_publishReceiveCallBackTable[0].mqttHandlePublishDataCallBack = process_cloud_command;
 	cloud_publishReceiveCallBackTable[0].topic = (uint8_t*)mqttSubscribe;
+	// the "/#" of entry 0 does not match a sub-folder, so allow-list updates get their own entry
+	cloud_publishReceiveCallBackTable[1].mqttHandlePublishDataCallBack = process_acl_command;
+	cloud_publishReceiveCallBackTable[1].topic = (uint8_t*)mqttAclTopic;
 
 	int8_t e;
 	debug_print("CLOUD: credentials %s, %s,%s", ssid, pass, authType);
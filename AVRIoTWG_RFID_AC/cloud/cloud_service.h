@@ -17,6 +17,7 @@ void CLOUD_reset(void);
 void CLOUD_init(char *deviceId);
 void CLOUD_disconnect(void);
 bool CLOUD_isConnected(void);
-void CLOUD_publishData(uint8_t *data, unsigned int len);
+// ackHandler is called when the broker acknowledged the message, it may be NULL
+bool CLOUD_publishData(uint8_t *data, unsigned int len, void (*ackHandler)(void));
 
 #endif /* CLOUD_SERVICE_H_ */
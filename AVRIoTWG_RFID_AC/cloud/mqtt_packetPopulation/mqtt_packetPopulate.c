@@ -37,21 +37,25 @@
 #define MQTT_CID_LENGTH 100
 #define MQTT_TOPIC_LENGTH 38
 #define MQTT_SUBSCRIBE_LENGTH 41
+#define MQTT_ACL_TOPIC_LENGTH 43
 #define MQTT_SUBSCRIBE_PACKET_ID 1234 // arbitrary value
 
 char mqttPassword[456];
 char cid[MQTT_CID_LENGTH];
 char mqttTopic[MQTT_TOPIC_LENGTH];
 char mqttSubscribe[MQTT_SUBSCRIBE_LENGTH]; // Note: set in updateJWT() - cloud_service.c
+char mqttAclTopic[MQTT_ACL_TOPIC_LENGTH];   // Note: set in updateJWT() - cloud_service.c
 char mqttHostName[] = "mqtt.googleapis.com";
 
-void MQTT_CLIENT_publish(uint8_t *data, uint16_t len)
+// Access events go out at QoS 1, the MQTT core sends them again until the broker acknowledges them
+// and then calls ackHandler, if there is one
+bool MQTT_CLIENT_publish(uint8_t *data, uint16_t len, void (*ackHandler)(void))
 {
 	mqttPublishPacket cloudPublishPacket;
 
 	// Fixed header
 	cloudPublishPacket.publishHeaderFlags.duplicate = 0;
-	cloudPublishPacket.publishHeaderFlags.qos       = 0;
+	cloudPublishPacket.publishHeaderFlags.qos       = 1;
 	cloudPublishPacket.publishHeaderFlags.retain    = 0;
 
 	// Variable header
@@ -61,10 +65,13 @@ void MQTT_CLIENT_publish(uint8_t *data, uint16_t len)
 	cloudPublishPacket.payload = data;
 	// ToDo Check whether sizeof can be used for integers and strings
 	cloudPublishPacket.payloadLength = len;
+	cloudPublishPacket.ackHandler    = ackHandler;
 
 	if (MQTT_CreatePublishPacket(&cloudPublishPacket) != true) {
-		debug_printError("MQTT: Connection lost PUBLISH failed");
+		debug_printError("MQTT: PUBLISH not queued");
+		return false;
 	}
+	return true;
 }
 
 // set parameters for subscribe packet and call the create() function
@@ -35,9 +35,10 @@ extern char mqttPassword[];
 extern char cid[];
 extern char mqttTopic[];
 extern char mqttSubscribe[]; // a topic we want to subscribe to 
+extern char mqttAclTopic[];  // allow-list updates, covered by the mqttSubscribe wildcard
 extern char mqttHostName[];
 
-void MQTT_CLIENT_publish(uint8_t *data, uint16_t len);
+bool MQTT_CLIENT_publish(uint8_t *data, uint16_t len, void (*ackHandler)(void));
 void MQTT_CLIENT_subscribe( void );
 void MQTT_CLIENT_receive(uint8_t *data, uint8_t len);
 void MQTT_CLIENT_connect(void);
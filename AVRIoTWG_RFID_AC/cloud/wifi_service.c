@@ -39,6 +39,12 @@ void (*wifiConnectionStateChangedCallback)(uint8_t status) = NULL;
 // Function to be called by WifiModule on status updates from below
 static void wifiCallback(uint8_t msgType, void *pMsg);
 
+// Called from the WINC interrupt, the events are handled right away instead of on the next poll
+static void wifiEventIsr(void)
+{
+	scheduler_timeout_enqueue_from_isr(&wifiHandlerTimer);
+}
+
 // This is a workaround to wifi_deinit being broken in the winc, so we can de-init without hanging up
 int8_t hif_deinit(void *arg);
 
@@ -57,8 +63,12 @@ void wifi_reinit()
 	wifiConnectionStateChangedCallback = callback_funcPtr;
 
 	nm_bsp_init();
+	nm_bsp_register_event_isr(wifiEventIsr);
 	m2m_wifi_init(&param);
 	socketInit();
+
+	// Handle whatever came in during the initialization, the interrupt queues the task from now on
+	scheduler_timeout_post(&wifiHandlerTimer);
 }
 
 // funcPtr passed in here will be called indicating AP state changes with the following values
@@ -69,6 +79,10 @@ void wifi_init(void (*funcPtr)(uint8_t), uint8_t mode)
 {
 	callback_funcPtr = funcPtr;
 
+	scheduler_timeout_profile_name(&ntpTimeFetchTimer, "ntp");
+	scheduler_timeout_profile_name(&wifiHandlerTimer, "wifi");
+	scheduler_timeout_profile_name(&checkBackTimer, "checkBack");
+
 	// This uses the global ptr set above
 	wifi_reinit();
 
@@ -79,8 +93,6 @@ void wifi_init(void (*funcPtr)(uint8_t), uint8_t mode)
 	} else {
 		scheduler_timeout_create(&ntpTimeFetchTimer, CLOUD_NTP_TASK_INTERVAL);
 	}
-
-	scheduler_timeout_create(&wifiHandlerTimer, CLOUD_WIFI_TASK_INTERVAL);
 }
 
 // Update the system time every CLOUD_NTP_TASK_INTERVAL milliseconds
@@ -90,10 +102,11 @@ absolutetime_t ntpTimeFetchTask(void *payload)
 	return CLOUD_NTP_TASK_INTERVAL;
 }
 
+// Queued by wifiEventIsr()
 absolutetime_t wifiHandlerTask(void *param)
 {
 	m2m_wifi_handle_events(NULL);
-	return CLOUD_WIFI_TASK_INTERVAL;
+	return 0;
 }
 
 absolutetime_t checkBackTask(void *param)
@@ -17,9 +17,16 @@ absolutetime_t CR95HF_TimeoutTask(void *payload);
 /*                            Private Variables                               */
 /******************************************************************************/
 volatile bool CR95HF_TimeOut;
+volatile bool CR95HF_DataReady;
 
 timer_struct_t CR95HF_TimeoutTaskTimer = { CR95HF_TimeoutTask };
 
+// Task queued by the IRQ_OUT interrupt, NULL when only the flag is used
+static timer_struct_t * volatile CR95HF_DataReadyTask = NULL;
+
+// Bytes clocked over SPI since reset, wraps around
+static uint32_t SPI_ByteCount = 0;
+
 
 /******************************************************************************/
 /*                           Function Definitions                             */
@@ -36,16 +43,39 @@ void delay_ms( uint32_t x )
 
 uint8_t SPI_exchange_byte(uint8_t data)
 {
+	SPI_ByteCount++;
 	return SPI_0_exchange_byte( data );
 }
 
 
 void SPI_exchange_block(void *block, uint8_t size)
 {
+	SPI_ByteCount += size;
 	SPI_0_exchange_block( block, size );
 }
 
 
+void SPI_write_block(const void *block, uint8_t size)
+{
+	SPI_ByteCount += size;
+	// SPI_0_write_block() only reads the buffer
+	SPI_0_write_block( (void *)block, size );
+}
+
+
+void SPI_read_block(void *block, uint8_t size)
+{
+	SPI_ByteCount += size;
+	SPI_0_read_block( block, size );
+}
+
+
+uint32_t SPI_GetByteCount( void )
+{
+	return SPI_ByteCount;
+}
+
+
 /**
  *	@brief  Starts the time out used to avoid the STM32 freeze
  *  @param  delay : delay in milliseconds
@@ -80,4 +110,52 @@ absolutetime_t CR95HF_TimeoutTask( void *payload )
 	CR95HF_TimeOut = false;
 
 	return 0;
-}
\ No newline at end of file
+}
+
+
+/**
+ *	@brief  Arm the falling edge interrupt on IRQ_OUT, the CR95HF pulls it low
+ *	@brief  once a response is ready. Must be called before the command is sent.
+ *  @param  task : task to queue on the scheduler when the response is ready, or NULL
+ *  @return None.
+ */
+void CR95HF_IRQOUT_Enable( timer_struct_t *task )
+{
+	CR95HF_DataReadyTask = task;
+	CR95HF_DataReady = false;
+
+	// Drop an edge latched while the interrupt was disabled
+	VPORTD_INTFLAGS = ( 1 << 6 );
+	RFID_CLICK_INT_O_set_isc( PORT_ISC_FALLING_gc );
+}
+
+
+/**
+ *	@brief  Disable the IRQ_OUT interrupt
+ *  @param  None.
+ *  @return None.
+ */
+void CR95HF_IRQOUT_Disable( void )
+{
+	RFID_CLICK_INT_O_set_isc( PORT_ISC_INTDISABLE_gc );
+	CR95HF_DataReadyTask = NULL;
+}
+
+
+ISR( PORTD_PORT_vect )
+{
+	if ( VPORTD_INTFLAGS & ( 1 << 6 ) )
+	{
+		// One edge per command, the response is read from task context
+		RFID_CLICK_INT_O_set_isc( PORT_ISC_INTDISABLE_gc );
+		CR95HF_DataReady = true;
+
+		if ( CR95HF_DataReadyTask != NULL )
+		{
+			scheduler_timeout_enqueue_from_isr( CR95HF_DataReadyTask );
+		}
+	}
+
+	/* Clear interrupt flags */
+	VPORTD_INTFLAGS = ( 1 << 6 );
+}
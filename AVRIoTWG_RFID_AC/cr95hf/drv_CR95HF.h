@@ -29,9 +29,12 @@
 /******************************************************************************/
 #include <string.h>
 #include <stdbool.h>
+#ifdef __AVR__
 #include "config/clock_config.h"
 #include <util/delay.h>
 #include "atmel_start_pins.h"
+#endif
+#include "include/timeout.h"
 
 
 /******************************************************************************/
@@ -43,12 +46,23 @@
 #define FALSE	true
 #define TRUE	false
 
+#ifdef __AVR__
 //Chip Select handle for SPI interface
 #define CR95HF_NSS_LOW()	RFID_CLICK_SPI_CS_set_level( 0 )
 #define CR95HF_NSS_HIGH()  	RFID_CLICK_SPI_CS_set_level( 1 )
 
 #define CR95HF_IRQIN_LOW() 	RFID_CLICK_INT_I_set_level( 0 )
 #define CR95HF_IRQIN_HIGH() RFID_CLICK_INT_I_set_level( 1 )
+#else
+// Host builds link drv_CR95HF_host.c, a model of the chip behind the same pins
+#define CR95HF_NSS_LOW()	CR95HF_HOST_SetNSS( false )
+#define CR95HF_NSS_HIGH()  	CR95HF_HOST_SetNSS( true )
+
+#define CR95HF_IRQIN_LOW() 	CR95HF_HOST_SetIRQIN( false )
+#define CR95HF_IRQIN_HIGH() CR95HF_HOST_SetIRQIN( true )
+
+#define _delay_us( us )		CR95HF_HOST_DelayUs( us )
+#endif
 
 
 /******************************************************************************/
@@ -71,11 +85,22 @@ typedef enum {
 /******************************************************************************/
 uint8_t SPI_exchange_byte(uint8_t data);
 void SPI_exchange_block(void *block, uint8_t size);
+void SPI_write_block(const void *block, uint8_t size);
+void SPI_read_block(void *block, uint8_t size);
+uint32_t SPI_GetByteCount( void );
 void StartTimeOut( uint16_t delay );
 void StopTimeOut( void );
+void CR95HF_IRQOUT_Enable( timer_struct_t *task );
+void CR95HF_IRQOUT_Disable( void );
 
 void delay_ms( uint32_t x ); 
 
+#ifndef __AVR__
+void CR95HF_HOST_SetNSS( bool level );
+void CR95HF_HOST_SetIRQIN( bool level );
+void CR95HF_HOST_DelayUs( uint32_t us );
+#endif
+
 
 #endif /* __CR95HF_H */
 
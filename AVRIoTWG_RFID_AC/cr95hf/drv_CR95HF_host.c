@@ -0,0 +1,851 @@
+/**
+ *	@file	drv_CR95HF_host.c
+ *	@brief	CR95HF driver for host builds, see drv_CR95HF_host.h.
+ *
+ *	The SPI frames are decoded like the chip does: the first byte after NSS
+ *	goes low is the control byte (send, reset, read or poll), a command is
+ *	run once NSS goes high again and its response becomes ready after the
+ *	time the chip and the RF exchange would take.
+ *
+ *	Timing model, the RF figures are the ones of ISO15693-2, the processing
+ *	times of the chip are estimates:
+ *	- an SPI byte takes 8 clocks at F_CPU / 4, 3.2 us
+ *	- a request is sent with 1 out of 4 coding, 37.76 us per bit
+ *	- a reply takes 37.76 us per bit at 26 kbps, half at 53 kbps and four
+ *	  times as long at 6 kbps, plus SOF and EOF
+ *	- no reply within CR95HF_HOST_FRAMEWAIT_US is a frame wait time out
+ *	- in Idle the chip wakes up every (WUPeriod + 2) * 8 ms, measures the
+ *	  field with the tag detector and goes back to sleep, up to MaxSleep + 1
+ *	  times before it wakes up on timeout
+ */
+
+#ifndef __AVR__
+
+/******************************************************************************/
+/*                                 Includes                                   */
+/******************************************************************************/
+#include "drv_CR95HF_host.h"
+#include "lib_CR95HF.h"
+#include "timeout_hal.h"
+#include "debug_print.h"
+
+
+/******************************************************************************/
+/*                                 Defines                                    */
+/******************************************************************************/
+/*** CR95HF SPI Control Bytes ***/
+#define CR95HF_COMMAND_SEND							0x00
+#define CR95HF_COMMAND_RESET						0x01
+#define CR95HF_COMMAND_RECEIVE						0x02
+#define CR95HF_COMMAND_POLLING						0x03
+#define CR95HF_COMMAND_NONE							0xFF	// NSS is high
+
+/*** Polling flags ***/
+#define CR95HF_FLAG_CAN_SEND						0x04
+#define CR95HF_FLAG_DATA_READY						0x08
+
+#define CR95HF_HOST_SPI_BYTE_NS						3200
+#define CR95HF_HOST_ECHO_NS							20000
+#define CR95HF_HOST_SELECT_NS						500000	// field on and settled
+#define CR95HF_HOST_SENDRECV_NS						50000
+#define CR95HF_HOST_REQUEST_BIT_NS					37760
+#define CR95HF_HOST_REQUEST_SOFEOF_NS				( 3 * CR95HF_HOST_REQUEST_BIT_NS )
+#define CR95HF_HOST_REPLY_SOFEOF_BITS				8
+#define CR95HF_HOST_FRAMEWAIT_US					4000
+#define CR95HF_HOST_DEFAULT_DELAY_US				320		// t1 of ISO15693-3
+
+#define CR95HF_HOST_MAX_COMMAND						( CR95HF_DATA_OFFSET + 255 )
+#define CR95HF_HOST_MAX_RESPONSE					( CR95HF_DATA_OFFSET + 255 )
+
+/*** ISO15693 ***/
+#define CR95HF_HOST_SELECT_APPENDCRC				0x01
+#define CR95HF_HOST_SELECT_SUBCARRIER				0x02
+#define CR95HF_HOST_SELECT_DATARATE_OFFSET			4
+#define CR95HF_HOST_DATARATE_6						2
+#define CR95HF_HOST_REQFLAG_SUBCARRIER				0x01
+#define CR95HF_HOST_REQFLAG_DATARATE				0x02
+#define CR95HF_HOST_REQFLAG_INVENTORY				0x04
+#define CR95HF_HOST_REQFLAG_AFI						0x10
+#define CR95HF_HOST_REQFLAG_1SLOT					0x20
+#define CR95HF_HOST_CMDCODE_INVENTORY				0x01
+#define CR95HF_HOST_NBSLOTS							16
+// Flags | DSFID | UID | CRC16
+#define CR95HF_HOST_INVENTORY_REPLY					( 2 + CR95HF_HOST_NBBYTE_UID + 2 )
+
+/*** Idle ***/
+#define CR95HF_HOST_IDLE_WUSOURCE					0		// offsets in the Idle parameters
+#define CR95HF_HOST_IDLE_WUPERIOD					7
+#define CR95HF_HOST_IDLE_DACDATAL					10
+#define CR95HF_HOST_IDLE_DACDATAH					11
+#define CR95HF_HOST_IDLE_MAXSLEEP					13
+#define CR95HF_HOST_IDLE_PERIOD_NS					8000000	// per WUPeriod unit
+
+
+/******************************************************************************/
+/*                            Global Variables                                */
+/******************************************************************************/
+volatile bool CR95HF_TimeOut;
+volatile bool CR95HF_DataReady;
+
+
+/******************************************************************************/
+/*                            Private Functions                               */
+/******************************************************************************/
+absolutetime_t CR95HF_TimeoutTask( void *payload );
+
+
+/******************************************************************************/
+/*                            Private Variables                               */
+/******************************************************************************/
+timer_struct_t CR95HF_TimeoutTaskTimer = { CR95HF_TimeoutTask };
+
+static timer_struct_t *CR95HF_DataReadyTask = NULL;
+static bool IRQOUTEnabled = false;
+
+static uint32_t SPI_ByteCount = 0;
+
+// Virtual clock, in ns since CR95HF_HOST_Init(), and the part already passed on to the scheduler
+static uint64_t HostTime;
+static uint32_t HostTicks;
+
+static CR95HF_HOST_Tag Tags[CR95HF_HOST_MAX_TAGS];
+static bool TagPresent[CR95HF_HOST_MAX_TAGS];
+static CR95HF_HOST_Stats Stats;
+static uint32_t RandomState;
+
+// Chip state
+static bool Awake;			// false until a pulse on IRQ_IN after power up or a reset
+static bool NSSLevel;
+static bool IRQINLevel;
+static uint8_t Control;		// control byte of the current SPI frame
+static uint16_t FrameBytes;	// bytes of the current SPI frame, control byte included
+static uint8_t Command[CR95HF_HOST_MAX_COMMAND];
+static uint16_t CommandLength;
+static uint8_t Response[CR95HF_HOST_MAX_RESPONSE];
+static uint16_t ResponseLength;	// 0 when there is no response
+static uint16_t ResponseRead;
+static uint64_t ResponseTime;	// HostTime when the response is ready
+static bool ResponseSignalled;	// IRQ_OUT went low for it
+static uint8_t QueuedResponse[CR95HF_HOST_MAX_RESPONSE];
+static uint16_t QueuedLength;
+static uint8_t Protocol;
+static uint8_t Parameters;
+
+// Idle in progress, the field is measured at IdleNextCheck
+static bool IdleActive;
+static uint8_t IdleWakeUpSources;
+static uint8_t IdleDacDataL;
+static uint8_t IdleDacDataH;
+static uint16_t IdleChecksLeft;	// before the wake up on timeout
+static uint64_t IdlePeriod;
+static uint64_t IdleNextCheck;
+
+// 16 slots inventory in progress, the EOF of a SendRecv without data moves to the next slot
+static bool SlotsActive;
+static uint8_t Slot;
+static uint8_t ReqFlags;
+static uint8_t MaskLength;
+static uint8_t Mask[CR95HF_HOST_NBBYTE_UID];
+
+
+/******************************************************************************/
+/*                           Function Definitions                             */
+/******************************************************************************/
+static uint32_t CR95HF_HOST_Random( void )
+{
+	RandomState ^= RandomState << 13;
+	RandomState ^= RandomState >> 17;
+	RandomState ^= RandomState << 5;
+	return RandomState;
+}
+
+
+static void CR95HF_HOST_IdleWakeUp( uint8_t Source, uint64_t Time )
+{
+	IdleActive = false;
+	Response[CR95HF_COMMAND_OFFSET] = PROTOCOLSELECT_RESULTSCODE_OK;
+	Response[CR95HF_LENGTH_OFFSET] = 0x01;
+	Response[IDLE_OFFSET_WAKEUPSOURCE] = Source;
+	ResponseLength = CR95HF_DATA_OFFSET + 1;
+	ResponseRead = 0;
+	ResponseTime = Time;
+	ResponseSignalled = false;
+}
+
+
+// Field amplitude seen by the tag detector, a tag in the field loads the antenna
+static uint8_t CR95HF_HOST_TagDetectorDac( void )
+{
+	uint8_t n;
+
+	for ( n = 0 ; n < CR95HF_HOST_MAX_TAGS ; n++ )
+	{
+		if ( TagPresent[n] )
+		{
+			return CR95HF_HOST_DAC_TAG;
+		}
+	}
+
+	return CR95HF_HOST_DAC_NOTAG;
+}
+
+
+// Run the tag detector measurements due by now, the tags present at each one are the current ones
+static void CR95HF_HOST_Idle( void )
+{
+	uint8_t Dac;
+
+	while ( IdleActive && HostTime >= IdleNextCheck )
+	{
+		Dac = CR95HF_HOST_TagDetectorDac();
+		if ( ( IdleWakeUpSources & IDLE_WAKEUP_TAGDETECT ) && ( Dac < IdleDacDataL || Dac > IdleDacDataH ) )
+		{
+			Stats.TagDetections++;
+			CR95HF_HOST_IdleWakeUp( IDLE_WAKEUP_TAGDETECT, IdleNextCheck );
+		}
+		else if ( IdleChecksLeft != 0 && --IdleChecksLeft == 0 && ( IdleWakeUpSources & IDLE_WAKEUP_TIMEOUT ) )
+		{
+			CR95HF_HOST_IdleWakeUp( IDLE_WAKEUP_TIMEOUT, IdleNextCheck );
+		}
+		IdleNextCheck += IdlePeriod;
+	}
+}
+
+
+// Move the virtual clock, the scheduler sees whole ticks and IRQ_OUT falls once a response is ready
+static void CR95HF_HOST_Elapse( uint64_t ns )
+{
+	uint32_t Ticks;
+
+	HostTime += ns;
+	Ticks = (uint32_t)( HostTime * SCHEDULER_TICKS_PER_SECOND / 1000000000 );
+	if ( Ticks != HostTicks )
+	{
+		timeout_hal_advance( Ticks - HostTicks );
+		HostTicks = Ticks;
+	}
+
+	CR95HF_HOST_Idle();
+
+	if ( ResponseLength != 0 && !ResponseSignalled && HostTime >= ResponseTime )
+	{
+		ResponseSignalled = true;
+		if ( IRQOUTEnabled )
+		{
+			IRQOUTEnabled = false;
+			CR95HF_DataReady = true;
+			if ( CR95HF_DataReadyTask != NULL )
+			{
+				scheduler_timeout_enqueue_from_isr( CR95HF_DataReadyTask );
+			}
+		}
+	}
+}
+
+
+static void CR95HF_HOST_Respond( uint64_t ns )
+{
+	if ( QueuedLength != 0 )
+	{
+		memcpy( Response, QueuedResponse, QueuedLength );
+		ResponseLength = QueuedLength;
+		QueuedLength = 0;
+	}
+
+	ResponseRead = 0;
+	ResponseTime = HostTime + ns;
+	ResponseSignalled = false;
+}
+
+
+static void CR95HF_HOST_RespondCode( uint8_t ResultCode, uint64_t ns )
+{
+	Response[CR95HF_COMMAND_OFFSET] = ResultCode;
+	Response[CR95HF_LENGTH_OFFSET] = 0x00;
+	ResponseLength = CR95HF_DATA_OFFSET;
+	CR95HF_HOST_Respond( ns );
+}
+
+
+// Bit by bit, the model does not depend on the implementation under test
+static uint16_t CR95HF_HOST_CRC16( const uint8_t *Data, uint8_t Length )
+{
+	uint16_t Crc = 0xFFFF;
+	uint8_t i, Bit;
+
+	for ( i = 0 ; i < Length ; i++ )
+	{
+		Crc ^= Data[i];
+		for ( Bit = 0 ; Bit < 8 ; Bit++ )
+		{
+			Crc = ( Crc & 0x0001 ) ? ( Crc >> 1 ) ^ 0x8408 : Crc >> 1;
+		}
+	}
+
+	return ~Crc;
+}
+
+
+// true if the first Length bits of the UID, LSB first, are the mask
+static bool CR95HF_HOST_MatchMask( const uint8_t *UID, uint8_t Length, const uint8_t *MaskValue )
+{
+	uint8_t i;
+
+	for ( i = 0 ; i < Length ; i++ )
+	{
+		if ( ( ( UID[i / 8] ^ MaskValue[i / 8] ) >> ( i % 8 ) ) & 0x01 )
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+// Answer the inventory request or slot in progress with the tags that reply in it
+static void CR95HF_HOST_InventorySlot( uint64_t RequestNs )
+{
+	uint8_t DataRate = ( Parameters >> CR95HF_HOST_SELECT_DATARATE_OFFSET ) & 0x03;
+	uint64_t BitNs = ( DataRate == CR95HF_HOST_DATARATE_6 ) ? 4 * CR95HF_HOST_REQUEST_BIT_NS :
+					 ( DataRate == 0 ) ? CR95HF_HOST_REQUEST_BIT_NS : CR95HF_HOST_REQUEST_BIT_NS / 2;
+	uint8_t *Reply = &Response[CR95HF_DATA_OFFSET];
+	uint8_t Frame[CR95HF_HOST_INVENTORY_REPLY];
+	uint8_t ControlByte = 0x00;
+	uint16_t Delay = 0;
+	uint16_t Crc;
+	uint8_t Nibble, NbReplies = 0;
+	uint8_t n, i;
+	bool Coherent;
+
+	Stats.Requests++;
+
+	for ( n = 0 ; n < CR95HF_HOST_MAX_TAGS ; n++ )
+	{
+		if ( !TagPresent[n] || Tags[n].ReplyDelay > CR95HF_HOST_FRAMEWAIT_US ||
+			 !CR95HF_HOST_MatchMask( Tags[n].UID, MaskLength, Mask ) )
+		{
+			continue;
+		}
+
+		if ( SlotsActive )
+		{
+			Nibble = ( Tags[n].UID[MaskLength / 8] >> ( MaskLength % 8 ) ) & 0x0F;
+			if ( MaskLength >= 8 * CR95HF_HOST_NBBYTE_UID || Nibble != Slot )
+			{
+				continue;
+			}
+		}
+
+		Frame[0] = 0x00;
+		Frame[1] = Tags[n].DSFID;
+		memcpy( &Frame[2], Tags[n].UID, CR95HF_HOST_NBBYTE_UID );
+		Crc = CR95HF_HOST_CRC16( Frame, 2 + CR95HF_HOST_NBBYTE_UID );
+		Frame[2 + CR95HF_HOST_NBBYTE_UID] = Crc & 0xFF;
+		Frame[3 + CR95HF_HOST_NBBYTE_UID] = Crc >> 8;
+
+		if ( DataRate < CR95HF_HOST_NB_DATARATES && CR95HF_HOST_Random() % 100 < Tags[n].CRCErrors[DataRate] )
+		{
+			Frame[2 + CR95HF_HOST_NBBYTE_UID] ^= 1 << ( CR95HF_HOST_Random() % 8 );
+			ControlByte |= CONTROL_15693_CRCMASK;
+			Stats.CRCErrors++;
+		}
+
+		// colliding replies are decoded as a mix of both
+		for ( i = 0 ; i < CR95HF_HOST_INVENTORY_REPLY ; i++ )
+		{
+			Reply[i] = ( NbReplies == 0 ) ? Frame[i] : Reply[i] | Frame[i];
+		}
+		if ( Tags[n].ReplyDelay > Delay )
+		{
+			Delay = Tags[n].ReplyDelay;
+		}
+		NbReplies++;
+	}
+
+	if ( NbReplies == 0 )
+	{
+		CR95HF_HOST_RespondCode( SENDRECV_ERRORCODE_FRAMEWAIT, CR95HF_HOST_SENDRECV_NS + RequestNs +
+								 (uint64_t)CR95HF_HOST_FRAMEWAIT_US * 1000 );
+		return;
+	}
+
+	// the tags answer with the data rate and subcarrier of the request, the chip expects the selected ones
+	Coherent = ( ( ReqFlags & CR95HF_HOST_REQFLAG_SUBCARRIER ) != 0 ) == ( ( Parameters & CR95HF_HOST_SELECT_SUBCARRIER ) != 0 ) &&
+			   ( ( ReqFlags & CR95HF_HOST_REQFLAG_DATARATE ) != 0 ) == ( DataRate != CR95HF_HOST_DATARATE_6 );
+
+	if ( NbReplies > 1 )
+	{
+		ControlByte |= CONTROL_15693_COLISIONMASK;
+		Stats.Collisions++;
+	}
+
+	Response[CR95HF_COMMAND_OFFSET] = SENDRECV_RESULTSCODE_OK;
+	Response[CR95HF_LENGTH_OFFSET] = CR95HF_HOST_INVENTORY_REPLY + CONTROL_15693_NBBYTE;
+	Reply[CR95HF_HOST_INVENTORY_REPLY] = ControlByte;
+	ResponseLength = CR95HF_DATA_OFFSET + CR95HF_HOST_INVENTORY_REPLY + CONTROL_15693_NBBYTE;
+	if ( !Coherent )
+	{
+		Response[CR95HF_COMMAND_OFFSET] = SENDRECV_ERRORCODE_COMERROR;
+		Response[CR95HF_LENGTH_OFFSET] = 0x00;
+		ResponseLength = CR95HF_DATA_OFFSET;
+	}
+
+	CR95HF_HOST_Respond( CR95HF_HOST_SENDRECV_NS + RequestNs + (uint64_t)Delay * 1000 +
+						 ( CR95HF_HOST_INVENTORY_REPLY * 8 + CR95HF_HOST_REPLY_SOFEOF_BITS ) * BitNs );
+}
+
+
+static void CR95HF_HOST_SendRecv( const uint8_t *Data, uint8_t Length )
+{
+	uint8_t FrameLength = Length;
+	uint8_t Index;
+
+	if ( Protocol != PROTOCOL_TAG_ISO15693 )
+	{
+		CR95HF_HOST_RespondCode( PROTOCOLSELECT_ERRORCODE_INVALID, CR95HF_HOST_SENDRECV_NS );
+		return;
+	}
+
+	if ( Length == SENDRECV_EOF_LENGTH )
+	{
+		if ( !SlotsActive || Slot + 1 >= CR95HF_HOST_NBSLOTS )
+		{
+			SlotsActive = false;
+			Stats.Requests++;
+			CR95HF_HOST_RespondCode( SENDRECV_ERRORCODE_FRAMEWAIT, CR95HF_HOST_SENDRECV_NS + CR95HF_HOST_REQUEST_BIT_NS +
+									 (uint64_t)CR95HF_HOST_FRAMEWAIT_US * 1000 );
+			return;
+		}
+
+		Slot++;
+		CR95HF_HOST_InventorySlot( CR95HF_HOST_REQUEST_BIT_NS );
+		return;
+	}
+
+	if ( Parameters & CR95HF_HOST_SELECT_APPENDCRC )
+	{
+		FrameLength += 2;
+	}
+
+	ReqFlags = Data[0];
+	SlotsActive = false;
+	Index = 2;
+	if ( ReqFlags & CR95HF_HOST_REQFLAG_AFI )
+	{
+		Index++;	// the tags have no AFI, they answer any
+	}
+
+	// only the inventory is modelled, nobody answers the other commands
+	if ( Length <= Index || !( ReqFlags & CR95HF_HOST_REQFLAG_INVENTORY ) || Data[1] != CR95HF_HOST_CMDCODE_INVENTORY ||
+		 Data[Index] > 8 * CR95HF_HOST_NBBYTE_UID )
+	{
+		Stats.Requests++;
+		CR95HF_HOST_RespondCode( SENDRECV_ERRORCODE_FRAMEWAIT, CR95HF_HOST_SENDRECV_NS +
+								 FrameLength * 8 * CR95HF_HOST_REQUEST_BIT_NS + CR95HF_HOST_REQUEST_SOFEOF_NS +
+								 (uint64_t)CR95HF_HOST_FRAMEWAIT_US * 1000 );
+		return;
+	}
+
+	MaskLength = Data[Index++];
+	memset( Mask, 0x00, sizeof( Mask ) );
+	memcpy( Mask, &Data[Index], ( MaskLength + 7 ) / 8 );
+	SlotsActive = !( ReqFlags & CR95HF_HOST_REQFLAG_1SLOT );
+	Slot = 0;
+
+	CR95HF_HOST_InventorySlot( FrameLength * 8 * CR95HF_HOST_REQUEST_BIT_NS + CR95HF_HOST_REQUEST_SOFEOF_NS );
+}
+
+
+// Run the command received in the SPI frame that just ended
+static void CR95HF_HOST_Command( void )
+{
+	uint8_t Length = Command[CR95HF_LENGTH_OFFSET];
+
+	Stats.Commands++;
+	ResponseLength = 0;
+
+	if ( Command[CR95HF_COMMAND_OFFSET] == ECHO )
+	{
+		Response[CR95HF_COMMAND_OFFSET] = ECHORESPONSE;
+		ResponseLength = ECHOREPLY_LENGTH;
+		CR95HF_HOST_Respond( CR95HF_HOST_ECHO_NS );
+		return;
+	}
+
+	if ( CommandLength < CR95HF_DATA_OFFSET || CommandLength != CR95HF_DATA_OFFSET + Length )
+	{
+		CR95HF_HOST_RespondCode( PROTOCOLSELECT_ERRORCODE_CMDLENGTH, CR95HF_HOST_ECHO_NS );
+		return;
+	}
+
+	switch ( Command[CR95HF_COMMAND_OFFSET] )
+	{
+		case PROTOCOL_SELECT:
+			SlotsActive = false;
+			if ( Length != PROTOCOLSELECT_LENGTH ||
+				 ( Command[CR95HF_DATA_OFFSET] != PROTOCOL_TAG_FIELDOFF && Command[CR95HF_DATA_OFFSET] != PROTOCOL_TAG_ISO15693 ) ||
+				 ( Command[CR95HF_DATA_OFFSET + 1] & CR95HF_SELECTMASK_DATARATE ) == CR95HF_SELECTMASK_DATARATE )
+			{
+				Protocol = PROTOCOL_TAG_FIELDOFF;
+				CR95HF_HOST_RespondCode( PROTOCOLSELECT_ERRORCODE_INVALID, CR95HF_HOST_ECHO_NS );
+				return;
+			}
+			Protocol = Command[CR95HF_DATA_OFFSET];
+			Parameters = Command[CR95HF_DATA_OFFSET + 1];
+			CR95HF_HOST_RespondCode( PROTOCOLSELECT_RESULTSCODE_OK, CR95HF_HOST_SELECT_NS );
+			break;
+
+		case SEND_RECEIVE:
+			CR95HF_HOST_SendRecv( &Command[CR95HF_DATA_OFFSET], Length );
+			break;
+
+		case IDLE:
+			if ( Length != IDLE_LENGTH )
+			{
+				CR95HF_HOST_RespondCode( PROTOCOLSELECT_ERRORCODE_CMDLENGTH, CR95HF_HOST_ECHO_NS );
+				return;
+			}
+			// no response until the chip wakes up, with the field off
+			Protocol = PROTOCOL_TAG_FIELDOFF;
+			SlotsActive = false;
+			IdleActive = true;
+			IdleWakeUpSources = Command[CR95HF_DATA_OFFSET + CR95HF_HOST_IDLE_WUSOURCE];
+			IdleDacDataL = Command[CR95HF_DATA_OFFSET + CR95HF_HOST_IDLE_DACDATAL];
+			IdleDacDataH = Command[CR95HF_DATA_OFFSET + CR95HF_HOST_IDLE_DACDATAH];
+			IdleChecksLeft = Command[CR95HF_DATA_OFFSET + CR95HF_HOST_IDLE_MAXSLEEP] + 1;
+			IdlePeriod = ( Command[CR95HF_DATA_OFFSET + CR95HF_HOST_IDLE_WUPERIOD] + 2 ) * (uint64_t)CR95HF_HOST_IDLE_PERIOD_NS;
+			IdleNextCheck = HostTime + IdlePeriod;
+			break;
+
+		default:
+			// not modelled, answered like a malformed command
+			CR95HF_HOST_RespondCode( PROTOCOLSELECT_ERRORCODE_CMDLENGTH, CR95HF_HOST_ECHO_NS );
+			break;
+	}
+}
+
+
+static uint8_t CR95HF_HOST_Exchange( uint8_t data )
+{
+	CR95HF_HOST_Elapse( CR95HF_HOST_SPI_BYTE_NS );
+	SPI_ByteCount++;
+
+	// MISO is pulled up while the chip is not selected or not started
+	if ( NSSLevel || !Awake )
+	{
+		return 0xFF;
+	}
+
+	if ( FrameBytes++ == 0 )
+	{
+		Control = data;
+		CommandLength = 0;
+		return 0x00;
+	}
+
+	switch ( Control )
+	{
+		case CR95HF_COMMAND_SEND:
+			if ( CommandLength < sizeof( Command ) )
+			{
+				Command[CommandLength++] = data;
+			}
+			return 0x00;
+
+		case CR95HF_COMMAND_POLLING:
+			return ( ResponseLength != 0 && HostTime >= ResponseTime ) ? CR95HF_FLAG_DATA_READY : CR95HF_FLAG_CAN_SEND;
+
+		case CR95HF_COMMAND_RECEIVE:
+			if ( ResponseLength == 0 || HostTime < ResponseTime || ResponseRead >= ResponseLength )
+			{
+				return 0xFF;
+			}
+			return Response[ResponseRead++];
+
+		default:
+			return 0xFF;
+	}
+}
+
+
+void CR95HF_HOST_SetNSS( bool level )
+{
+	if ( level == NSSLevel )
+	{
+		return;
+	}
+
+	NSSLevel = level;
+	if ( !level )
+	{
+		FrameBytes = 0;
+		Control = CR95HF_COMMAND_NONE;
+		return;
+	}
+
+	if ( !Awake || FrameBytes == 0 )
+	{
+		return;
+	}
+
+	switch ( Control )
+	{
+		case CR95HF_COMMAND_SEND:
+			CR95HF_HOST_Command();
+			break;
+
+		case CR95HF_COMMAND_RECEIVE:
+			// a response is read once, whatever the host did not clock out is lost
+			if ( ResponseRead != 0 )
+			{
+				ResponseLength = 0;
+			}
+			break;
+
+		case CR95HF_COMMAND_RESET:
+			Awake = false;
+			IdleActive = false;
+			Protocol = PROTOCOL_TAG_FIELDOFF;
+			SlotsActive = false;
+			ResponseLength = 0;
+			break;
+
+		default:
+			break;
+	}
+}
+
+
+void CR95HF_HOST_SetIRQIN( bool level )
+{
+	// the rising edge ending a negative pulse starts the chip
+	if ( level && !IRQINLevel )
+	{
+		Awake = true;
+	}
+
+	if ( !level && IRQINLevel && IdleActive && ( IdleWakeUpSources & IDLE_WAKEUP_IRQIN ) )
+	{
+		CR95HF_HOST_IdleWakeUp( IDLE_WAKEUP_IRQIN, HostTime );
+	}
+
+	IRQINLevel = level;
+}
+
+
+void CR95HF_HOST_DelayUs( uint32_t us )
+{
+	CR95HF_HOST_Elapse( (uint64_t)us * 1000 );
+}
+
+
+void delay_ms( uint32_t x )
+{
+	CR95HF_HOST_Elapse( (uint64_t)x * 1000000 );
+}
+
+
+uint8_t SPI_exchange_byte(uint8_t data)
+{
+	return CR95HF_HOST_Exchange( data );
+}
+
+
+void SPI_exchange_block(void *block, uint8_t size)
+{
+	uint8_t *b = block;
+
+	while ( size-- )
+	{
+		*b = CR95HF_HOST_Exchange( *b );
+		b++;
+	}
+}
+
+
+void SPI_write_block(const void *block, uint8_t size)
+{
+	const uint8_t *b = block;
+
+	while ( size-- )
+	{
+		CR95HF_HOST_Exchange( *b++ );
+	}
+}
+
+
+void SPI_read_block(void *block, uint8_t size)
+{
+	uint8_t *b = block;
+
+	while ( size-- )
+	{
+		*b++ = CR95HF_HOST_Exchange( DUMMY_BYTE );
+	}
+}
+
+
+uint32_t SPI_GetByteCount( void )
+{
+	return SPI_ByteCount;
+}
+
+
+void StartTimeOut( uint16_t delay )
+{
+	CR95HF_TimeOut = false;
+	scheduler_timeout_create( &CR95HF_TimeoutTaskTimer, delay );
+}
+
+
+void StopTimeOut( void )
+{
+	scheduler_timeout_delete( &CR95HF_TimeoutTaskTimer );
+}
+
+
+absolutetime_t CR95HF_TimeoutTask( void *payload )
+{
+	debug_printError( "READER: CR95HF Polling Timeout" );
+
+	CR95HF_TimeOut = false;
+
+	return 0;
+}
+
+
+void CR95HF_IRQOUT_Enable( timer_struct_t *task )
+{
+	CR95HF_DataReadyTask = task;
+	CR95HF_DataReady = false;
+
+	// like the AVR, an edge from before is dropped
+	IRQOUTEnabled = true;
+}
+
+
+void CR95HF_IRQOUT_Disable( void )
+{
+	IRQOUTEnabled = false;
+	CR95HF_DataReadyTask = NULL;
+}
+
+
+/**
+ *	@brief  Power up the chip with no tag in the field, the virtual clock restarts at 0
+ *  @param  None.
+ *  @return None.
+ */
+void CR95HF_HOST_Init( void )
+{
+	HostTime = 0;
+	HostTicks = 0;
+	RandomState = 2463534242U;
+	memset( &Stats, 0, sizeof( Stats ) );
+	memset( TagPresent, 0, sizeof( TagPresent ) );
+
+	Awake = false;
+	NSSLevel = true;
+	IRQINLevel = true;
+	Control = CR95HF_COMMAND_NONE;
+	ResponseLength = 0;
+	QueuedLength = 0;
+	Protocol = PROTOCOL_TAG_FIELDOFF;
+	Parameters = 0x00;
+	SlotsActive = false;
+	IdleActive = false;
+	IRQOUTEnabled = false;
+	CR95HF_DataReadyTask = NULL;
+}
+
+
+/**
+ *	@brief  Put a tag in the field. It answers after CR95HF_HOST_DEFAULT_DELAY_US
+ *	@brief  without errors, the fields of the returned tag can be changed at any time.
+ *  @param  UID : 8 bytes, LSB first
+ *  @return the tag, NULL if there are already CR95HF_HOST_MAX_TAGS
+ */
+CR95HF_HOST_Tag *CR95HF_HOST_AddTag( const uint8_t *UID )
+{
+	uint8_t n;
+
+	for ( n = 0 ; n < CR95HF_HOST_MAX_TAGS ; n++ )
+	{
+		if ( !TagPresent[n] )
+		{
+			memset( &Tags[n], 0, sizeof( Tags[n] ) );
+			memcpy( Tags[n].UID, UID, CR95HF_HOST_NBBYTE_UID );
+			Tags[n].ReplyDelay = CR95HF_HOST_DEFAULT_DELAY_US;
+			TagPresent[n] = true;
+			return &Tags[n];
+		}
+	}
+
+	return NULL;
+}
+
+
+/**
+ *	@brief  Take a tag out of the field
+ *  @param  Tag : returned by CR95HF_HOST_AddTag()
+ *  @return None.
+ */
+void CR95HF_HOST_RemoveTag( CR95HF_HOST_Tag *Tag )
+{
+	TagPresent[Tag - Tags] = false;
+}
+
+
+void CR95HF_HOST_RemoveTags( void )
+{
+	memset( TagPresent, 0, sizeof( TagPresent ) );
+}
+
+
+/**
+ *	@brief  Answer the next command with the given bytes instead of the modelled response,
+ *	@brief  e.g. a malformed or oversized one
+ *  @param  pResponse : Result code | Length | Data
+ *  @param  Length : number of bytes
+ *  @return None.
+ */
+void CR95HF_HOST_QueueResponse( const uint8_t *pResponse, uint16_t Length )
+{
+	if ( Length > sizeof( QueuedResponse ) )
+	{
+		Length = sizeof( QueuedResponse );
+	}
+
+	memcpy( QueuedResponse, pResponse, Length );
+	QueuedLength = Length;
+}
+
+
+/**
+ *	@brief  Let time pass, e.g. while the asynchronous commands wait for IRQ_OUT
+ *  @param  us : microseconds
+ *  @return None.
+ */
+void CR95HF_HOST_Advance( uint32_t us )
+{
+	CR95HF_HOST_Elapse( (uint64_t)us * 1000 );
+}
+
+
+/**
+ *	@brief  Get the virtual clock
+ *  @return microseconds since CR95HF_HOST_Init()
+ */
+uint64_t CR95HF_HOST_GetTime( void )
+{
+	return HostTime / 1000;
+}
+
+
+const CR95HF_HOST_Stats *CR95HF_HOST_GetStats( void )
+{
+	return &Stats;
+}
+
+#endif
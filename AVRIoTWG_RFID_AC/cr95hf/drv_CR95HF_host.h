@@ -0,0 +1,83 @@
+/**
+ *	@file	drv_CR95HF_host.h
+ *	@brief	Model of the CR95HF and of the ISO15693 tags in its field, for host builds.
+ *
+ *	drv_CR95HF_host.c takes the place of drv_CR95HF.c: the SPI bytes, NSS,
+ *	IRQ_IN and IRQ_OUT of drv_CR95HF.h go to a model of the chip instead of
+ *	the RFID click, so lib_CR95HF.c and lib_iso15693.c run unchanged in a
+ *	host process:
+ *
+ *	    gcc -Itest/stubs -I. -Iinclude -Iutils -IConfig -Icr95hf app.c cr95hf/lib_CR95HF.c
+ *	        cr95hf/lib_iso15693.c cr95hf/drv_CR95HF_host.c src/timeout.c src/timeout_hal_host.c debug_print.c
+ *
+ *	The model answers ECHO, ProtocolSelect, SendRecv and Idle, reports the
+ *	polling flags and pulls IRQ_OUT when a response is ready. The chip powers up
+ *	waiting for a pulse on IRQ_IN, like the real one, so the application
+ *	starts with CR95HF_PORsequence(). SendRecv handles the ISO15693 inventory
+ *	with 1 or 16 slots, the tags are added with CR95HF_HOST_AddTag(). In Idle
+ *	the tag detector reads CR95HF_HOST_DAC_NOTAG from an empty field and
+ *	CR95HF_HOST_DAC_TAG while a tag is in it, and wakes the chip up when the
+ *	reading is outside [DacDataL, DacDataH].
+ *
+ *	Time is simulated: every SPI byte, delay and RF frame moves the virtual
+ *	clock of timeout_hal_host.c, so a run is repeatable and a scan costs what
+ *	it would cost on the board, not what it costs on the host.
+ */
+
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __DRIVER_CR95HF_HOST_H
+#define __DRIVER_CR95HF_HOST_H
+
+
+/******************************************************************************/
+/*                                Includes                                    */
+/******************************************************************************/
+#include "drv_CR95HF.h"
+
+
+/******************************************************************************/
+/*                                 Defines                                    */
+/******************************************************************************/
+#define CR95HF_HOST_MAX_TAGS						16
+#define CR95HF_HOST_NBBYTE_UID						8
+// ProtocolSelect data rates (parameter bits 5:4) a tag can have its own error rate for
+#define CR95HF_HOST_NB_DATARATES					3
+// Tag detector readings
+#define CR95HF_HOST_DAC_NOTAG						0x74
+#define CR95HF_HOST_DAC_TAG							0x54
+
+
+/******************************************************************************/
+/*                             Typedefs/Enums                                 */
+/******************************************************************************/
+typedef struct {
+	uint8_t		UID[CR95HF_HOST_NBBYTE_UID];	// LSB first, as sent in the inventory reply
+	uint8_t		DSFID;
+	uint16_t	ReplyDelay;						// us from the end of the request to the reply
+	uint8_t		CRCErrors[CR95HF_HOST_NB_DATARATES];	// % of replies received with a bad CRC, per data rate
+} CR95HF_HOST_Tag;
+
+typedef struct {
+	uint32_t	Commands;		// commands sent to the chip
+	uint32_t	Requests;		// RF requests, including the EOF of each slot
+	uint32_t	Collisions;		// requests answered by more than one tag
+	uint32_t	CRCErrors;		// replies received with a bad CRC
+	uint32_t	TagDetections;	// wake ups from Idle on tag detection
+} CR95HF_HOST_Stats;
+
+
+/******************************************************************************/
+/*                             Public Functions                               */
+/******************************************************************************/
+void CR95HF_HOST_Init( void );
+CR95HF_HOST_Tag *CR95HF_HOST_AddTag( const uint8_t *UID );
+void CR95HF_HOST_RemoveTag( CR95HF_HOST_Tag *Tag );
+void CR95HF_HOST_RemoveTags( void );
+void CR95HF_HOST_QueueResponse( const uint8_t *pResponse, uint16_t Length );
+void CR95HF_HOST_Advance( uint32_t us );
+uint64_t CR95HF_HOST_GetTime( void );
+const CR95HF_HOST_Stats *CR95HF_HOST_GetStats( void );
+
+
+#endif /* __DRIVER_CR95HF_HOST_H */
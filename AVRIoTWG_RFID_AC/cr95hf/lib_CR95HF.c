@@ -2,6 +2,8 @@
 /*                                 Includes                                   */
 /******************************************************************************/
 #include "lib_CR95HF.h"
+#include "debug_print.h"
+#include "include/fine_timeout.h"
 
 
 /******************************************************************************/
@@ -17,17 +19,6 @@
 
 #define IDN_RESULTSCODE_OK							0x00
 
-//  send receive field status
-#define SENDRECV_RESULTSCODE_OK						0x80
-#define SENDRECV_ERRORCODE_COMERROR					0x86
-#define SENDRECV_ERRORCODE_FRAMEWAIT				0x87
-#define SENDRECV_ERRORCODE_SOF						0x88
-#define SENDRECV_ERRORCODE_OVERFLOW					0x89
-#define SENDRECV_ERRORCODE_FRAMING					0x8A
-#define SENDRECV_ERRORCODE_EGT						0x8B
-#define SENDRECV_ERRORCODE_LENGTH					0x8C
-#define SENDRECV_ERRORCODE_CRC						0x8D
-#define SENDRECV_ERRORCODE_RECEPTIONLOST			0x8E
 //  Idle command field status
 #define IDLE_RESULTSCODE_OK							0x00
 #define IDLE_ERRORCODE_LENGTH						0x82
@@ -54,6 +45,18 @@
 #define SLEEPMODE_BUFFER_SIZE						4
 /* Nb of bytes of reader response */
 #define CR95HF_RESPONSEBUFFER_SIZE		 			255
+#define IDLE_RESPONSE_SIZE							3
+
+/* Tag detector */
+#define TAGDETECT_OFFSET_DACDATAL					10	// offset in the Idle parameters, after DacStart
+#define TAGDETECT_OFFSET_DACDATAH					11
+#define TAGDETECT_DAC_MAX							0xFC
+#define TAGDETECT_DAC_GUARD							0x08	// half width of the wake up window around the reference
+#define TAGDETECT_TIMEOUT							4000	// ms, the chip wakes up on its own after ~3 s
+
+/* IRQ_IN pulse and reset sequence */
+#define IRQIN_PULSE_US								1000	// high before and low during the pulse
+#define RESET_WAIT_US								10000	// after the reset command, before the pulse
 
 
 
@@ -63,14 +66,56 @@
 /******************************************************************************/
 extern ReaderConfigStruct ReaderConfig;
 extern volatile bool CR95HF_TimeOut;
+extern volatile bool CR95HF_DataReady;
+
+
+/******************************************************************************/
+/*                            Private Variables                               */
+/******************************************************************************/
+static absolutetime_t CR95HF_AsyncDataReadyTask( void *payload );
+static absolutetime_t CR95HF_AsyncTimeoutTask( void *payload );
+
+static timer_struct_t CR95HF_AsyncDataReadyTimer = { CR95HF_AsyncDataReadyTask };
+static timer_struct_t CR95HF_AsyncTimeoutTimer = { CR95HF_AsyncTimeoutTask };
+
+static uint8_t *AsyncResponse;
+static uint16_t AsyncResponseSize;
+static CR95HF_Callback AsyncCallback = NULL;	// NULL when no command is pending
+static uint8_t AsyncCommandHeader[CR95HF_DATA_OFFSET + 2];	// Command | Length | Protocol | Parameters
+
+// Idle parameters: WU source | Enter ctrl (2) | WU ctrl (2) | Leave ctrl (2) | WU period |
+// Osc start | DAC start | DacDataL | DacDataH | Swings count | Max sleep
+// Calibration, wake up on tag detection or after (MaxSleep + 1) * (WUPeriod + 2) * 8 ms = 544 ms
+static const uint8_t TagDetectCalibration[IDLE_LENGTH] = { 0x03, 0xA1, 0x00, 0xB8, 0x01, 0x18, 0x00, 0x20, 0x60, 0x60, 0x00, 0x00, 0x3F, 0x01 };
+// Detection, check the field every 96 ms and wake up on its own after ~3 s
+static const uint8_t TagDetectIdle[IDLE_LENGTH] = { 0x03, 0x21, 0x00, 0x79, 0x01, 0x18, 0x00, 0x0A, 0x60, 0x60, 0x00, 0x00, 0x3F, 0x1F };
+
+static bool TagDetectorCalibrated = false;
+static uint8_t TagDetectorDac;
+static uint8_t TagDetectorDacDataL;
+static uint8_t TagDetectorDacDataH;
+static uint16_t TagDetectorWakeUps;
+static uint8_t TagDetectResponse[IDLE_RESPONSE_SIZE];
+static CR95HF_Callback TagDetectCallback;
+
+// Steps of CR95HF_Send_IRQIN_NegativePulseAsync(), each one after the wait of the previous one
+enum { PULSE_STEP_HIGH = 0, PULSE_STEP_LOW, PULSE_STEP_END };
+
+static absolutetime_t CR95HF_PulseTask( void *payload );
+
+static timer_struct_t CR95HF_PulseTimer = { CR95HF_PulseTask };
+static uint8_t PulseStep;
+static CR95HF_Callback PulseCallback = NULL;	// NULL when no pulse or reset sequence is running
 
 
 /******************************************************************************/
 /*                            Private Functions                               */
 /******************************************************************************/
-int8_t 	SPIUART_SendReceive( const uint8_t *pCommand, uint8_t *pResponse );
+int8_t 	SPIUART_SendReceive( const uint8_t *pCommand, uint8_t *pResponse, uint16_t ResponseSize );
+static int8_t SPIUART_SendReceiveFrame( const uint8_t *pHeader, const uint8_t *pData, uint8_t *pResponse, uint16_t ResponseSize );
 void CR95HF_Send_SPI_Command( const uint8_t *pData ); // TODO: static?
-static void CR95HF_Receive_SPI_Response(uint8_t *pData);
+static void CR95HF_Send_SPI_Frame( const uint8_t *pHeader, const uint8_t *pData );
+static void CR95HF_Receive_SPI_Response( uint8_t *pData, uint16_t Size );
 void CR95HF_Send_IRQIN_NegativePulse( void );
 void CR95HF_Send_SPI_ResetSequence( void );
 static int8_t CR95HF_PollingCommand( int timeout );
@@ -79,6 +124,7 @@ static uint8_t IsAnAvailableSelectLength( uint8_t Protocol, uint8_t Length );
 static uint8_t IsAnAvailableSelectParameters( const uint8_t Protocol, const uint8_t Length, const uint8_t *parameters );
 static uint8_t ForceSelectRFUBitsToNull( const uint8_t Protocol, const uint8_t Length, uint8_t *parameters );
 static int8_t GetNbControlByte( int8_t ProtocolSelected );
+static void CR95HF_TrackProtocol( const uint8_t *pHeader, const uint8_t *pData, const uint8_t *pResponse );
 
 
 /******************************************************************************/
@@ -88,33 +134,62 @@ static int8_t GetNbControlByte( int8_t ProtocolSelected );
  *	@brief  this function send a command to CR95HF device over SPI or UART bus and receive its response
  *  @param  *pCommand  : pointer on the buffer to send to the CR95HF ( Command | Length | Data)
  *  @param  *pResponse : pointer on the CR95HF response ( Command | Length | Data)
+ *  @param  ResponseSize : size of the pResponse buffer
+ *  @retval 
+ */
+int8_t SPIUART_SendReceive( const uint8_t *pCommand, uint8_t *pResponse, uint16_t ResponseSize )
+{
+	return SPIUART_SendReceiveFrame( pCommand, &pCommand[CR95HF_DATA_OFFSET], pResponse, ResponseSize );
+}
+
+
+/**
+ *	@brief  same as SPIUART_SendReceive(), the parameters are sent from their own buffer
+ *  @param  *pHeader   : pointer on the command header ( Command | Length )
+ *  @param  *pData     : pointer on the Length parameter bytes
+ *  @param  *pResponse : pointer on the CR95HF response ( Command | Length | Data)
+ *  @param  ResponseSize : size of the pResponse buffer
  *  @retval 
  */
-int8_t SPIUART_SendReceive(const uint8_t *pCommand, uint8_t *pResponse)
+static int8_t SPIUART_SendReceiveFrame( const uint8_t *pHeader, const uint8_t *pData, uint8_t *pResponse, uint16_t ResponseSize )
 {
 	int8_t i = 0;
 
 	*pResponse = CR95HF_ERRORCODE_DEFAULT;
 	*(pResponse + 1) = 0x00;
 
+	if ( CR95HF_IsBusy() )
+	{
+		// The reader is busy with an asynchronous command
+		return CR95HF_POLLING_CR95HF;
+	}
+
 	if ( ReaderConfig.Interface == CR95HF_INTERFACE_SPI )
 	{
+		if ( ReaderConfig.SpiMode == SPI_INTERRUPT )
+		{
+			// Arm IRQ_OUT first so a fast response can not be missed
+			CR95HF_IRQOUT_Enable( NULL );
+		}
+
 		// First step  - Sending command 
-		CR95HF_Send_SPI_Command( pCommand );
+		CR95HF_Send_SPI_Frame( pHeader, pData );
 		
 		for ( i = 0 ; i < 50 ; i++ );
 		
 		// Second step - Polling
-		if ( CR95HF_PollingCommand( 1000 ) != CR95HF_SUCCESS_CODE )
+		if ( CR95HF_PollingCommand( CR95HF_RESPONSE_TIMEOUT ) != CR95HF_SUCCESS_CODE )
 		{	
 			*pResponse = CR95HF_ERRORCODE_TIMEOUT;
+			CR95HF_TrackProtocol( pHeader, pData, pResponse );
 			return CR95HF_POLLING_CR95HF;	
 		}
 		
 		for ( i = 0 ; i < 50 ; i++ );
 		
 		// Third step  - Receiving bytes 
-		CR95HF_Receive_SPI_Response( pResponse );
+		CR95HF_Receive_SPI_Response( pResponse, ResponseSize );
+		CR95HF_TrackProtocol( pHeader, pData, pResponse );
 	}
 	else if ( ReaderConfig.Interface == CR95HF_INTERFACE_UART )
 	{/*** NOT IMPLEMENTED ***
@@ -136,25 +211,34 @@ int8_t SPIUART_SendReceive(const uint8_t *pCommand, uint8_t *pResponse)
 //static void CR95HF_Send_SPI_Command(uc8 *pData)
 void CR95HF_Send_SPI_Command( const uint8_t *pData )
 {
-	uint8_t Buffer[MAX_BUFFER_SIZE];
-	  
+	CR95HF_Send_SPI_Frame( pData, &pData[CR95HF_DATA_OFFSET] );
+}
+
+
+/**
+ *	@brief  this function send a command over SPI bus, header and parameters may be in different buffers
+ *  @param  *pHeader : pointer on the command header ( Command | Length )
+ *  @param  *pData   : pointer on the Length parameter bytes
+ *  @return None
+ */
+static void CR95HF_Send_SPI_Frame( const uint8_t *pHeader, const uint8_t *pData )
+{
 	// Select CR95HF over SPI 
 	CR95HF_NSS_LOW();
 
 	// Send a sending request to CR95HF 
 	SPI_exchange_byte( CR95HF_COMMAND_SEND );
 
-	if ( *pData == ECHO )
+	if ( pHeader[CR95HF_COMMAND_OFFSET] == ECHO )
 	{
 		// Send a sending request to CR95HF
 		SPI_exchange_byte( ECHO );
 	}
 	else
 	{
-		// TODO: Necessary? Can I just use pData? Should I?
-		memcpy( Buffer, pData, pData[CR95HF_LENGTH_OFFSET] + CR95HF_DATA_OFFSET );
-		// Transmit the buffer over SPI
-		SPI_exchange_block( Buffer, pData[CR95HF_LENGTH_OFFSET] + CR95HF_DATA_OFFSET );
+		// Transmit straight from the caller's buffers, the read back data is dropped
+		SPI_write_block( pHeader, CR95HF_DATA_OFFSET );
+		SPI_write_block( pData, pHeader[CR95HF_LENGTH_OFFSET] );
 	}
 
 	//De-select CR95HF over SPI 
@@ -163,13 +247,17 @@ void CR95HF_Send_SPI_Command( const uint8_t *pData )
 
 
 /**
- *	@brief  this function recovers a response from CR95HF device
+ *	@brief  this function recovers a response from CR95HF device. The length byte follows
+ *	@brief  whatever answered over RF, a response that does not fit is dropped and
+ *	@brief  replaced by CR95HF_ERRORCODE_FRAMING.
  *  @param  *pData : pointer on data received from CR95HF device
+ *  @param  Size   : size of the pData buffer, at least CR95HF_DATA_OFFSET
  *  @return None
  */
-static void CR95HF_Receive_SPI_Response(uint8_t *pData)
+static void CR95HF_Receive_SPI_Response( uint8_t *pData, uint16_t Size )
 {
-	uint8_t DummyBuffer[MAX_BUFFER_SIZE];
+	uint8_t Length;
+	uint16_t i;
 
 	// Select CR95HF over SPI 
 	CR95HF_NSS_LOW();
@@ -191,12 +279,26 @@ static void CR95HF_Receive_SPI_Response(uint8_t *pData)
 	else
 	{
 		// Recover the "Length" byte 
-		pData[CR95HF_LENGTH_OFFSET] = SPI_exchange_byte( DUMMY_BYTE );
+		Length = SPI_exchange_byte( DUMMY_BYTE );
+		pData[CR95HF_LENGTH_OFFSET] = Length;
 		// Checks the data length 
-		if ( pData[CR95HF_LENGTH_OFFSET] != 0x00 )
+		if ( Length > Size - CR95HF_DATA_OFFSET )
+		{
+			// Keep what fits, the rest has to be clocked out while the chip is still
+			// selected so the next command starts on a fresh frame
+			SPI_read_block( &pData[CR95HF_DATA_OFFSET], Size - CR95HF_DATA_OFFSET );
+			for ( i = Size - CR95HF_DATA_OFFSET ; i < Length ; i++ )
+			{
+				SPI_exchange_byte( DUMMY_BYTE );
+			}
+
+			pData[CR95HF_COMMAND_OFFSET] = CR95HF_ERRORCODE_FRAMING;
+			pData[CR95HF_LENGTH_OFFSET] = 0x00;
+		}
+		else if ( Length != 0x00 )
 		{
-			// Recover data TODO: TEST! remove DummyBuffer?
-			SPI_exchange_block( &pData[CR95HF_DATA_OFFSET], pData[CR95HF_LENGTH_OFFSET] );
+			// Recover data
+			SPI_read_block( &pData[CR95HF_DATA_OFFSET], Length );
 		}
 		
 	}
@@ -207,6 +309,65 @@ static void CR95HF_Receive_SPI_Response(uint8_t *pData)
 }
 
 
+/**
+ *	@brief  Keep ReaderConfig.CurrentProtocol in sync with the chip, so the protocol
+ *	@brief  is only selected again when it was lost
+ *  @param  *pHeader   : header of the command sent to the CR95HF ( Command | Length )
+ *  @param  *pData     : parameters of the command
+ *  @param  *pResponse : response of the CR95HF ( Command | Length | Data)
+ *  @return None
+ */
+static void CR95HF_TrackProtocol( const uint8_t *pHeader, const uint8_t *pData, const uint8_t *pResponse )
+{
+	uint8_t ResultCode = pResponse[READERREPLY_STATUSOFFSET];
+
+	switch ( pHeader[CR95HF_COMMAND_OFFSET] )
+	{
+		case PROTOCOL_SELECT:
+			if ( ResultCode == PROTOCOLSELECT_RESULTSCODE_OK )
+			{
+				ReaderConfig.CurrentProtocol = pData[0];
+				ReaderConfig.CurrentParameters = ( pHeader[CR95HF_LENGTH_OFFSET] > 1 ) ? pData[1] : 0x00;
+			}
+			else
+			{
+				ReaderConfig.CurrentProtocol = PROTOCOL_TAG_FIELDOFF;
+			}
+			break;
+
+		case IDLE:
+			// the field is off after the chip wakes up
+			ReaderConfig.CurrentProtocol = PROTOCOL_TAG_FIELDOFF;
+			break;
+
+		case SEND_RECEIVE:
+			// Tag errors (0x86 to 0x8E) leave the protocol selected. A command error,
+			// a timeout or no reply at all may mean the chip was reset.
+			if ( ResultCode != SENDRECV_RESULTSCODE_OK &&
+				 ( ResultCode < SENDRECV_ERRORCODE_COMERROR || ResultCode > SENDRECV_ERRORCODE_RECEPTIONLOST ) )
+			{
+				ReaderConfig.CurrentProtocol = PROTOCOL_TAG_FIELDOFF;
+			}
+			break;
+
+		default:
+			break;
+	}
+}
+
+
+/**
+ *	@brief  Returns true if the protocol is selected with the given parameters
+ *  @param  Protocol : RF protocol (ISO 14443 A or B or 15 693 or Fellica)
+ *  @param  Parameters : first parameter byte of the ProtocolSelect command
+ *  @return true if a ProtocolSelect command is not needed
+ */
+bool CR95HF_IsProtocolSelected( const uint8_t Protocol, const uint8_t Parameters )
+{
+	return ReaderConfig.CurrentProtocol == Protocol && ReaderConfig.CurrentParameters == Parameters;
+}
+
+
 /**
  *	@brief  Send a negative pulse on IRQin pin
  *  @param  none
@@ -230,6 +391,8 @@ void CR95HF_Send_IRQIN_NegativePulse( void )
  */
 void CR95HF_Send_SPI_ResetSequence( void )
 {
+	ReaderConfig.CurrentProtocol = PROTOCOL_TAG_FIELDOFF;
+
 	// Select CR95HF over SPI 
 	CR95HF_NSS_LOW();
 	// Send reset control byte
@@ -243,24 +406,143 @@ void CR95HF_Send_SPI_ResetSequence( void )
 }
 
 
+static void CR95HF_PulseWait( uint16_t us )
+{
+#if SCHEDULER_FINE_TIMEOUT
+	if ( scheduler_fine_timeout_create( &CR95HF_PulseTimer, us ) )
+	{
+		return;
+	}
+#endif
+	// The tick that already started may be almost over, wait one more
+	scheduler_timeout_create( &CR95HF_PulseTimer, scheduler_us_to_ticks( us ) + 1 );
+}
+
+
+static absolutetime_t CR95HF_PulseTask( void *payload )
+{
+	CR95HF_Callback callback = PulseCallback;
+
+	switch ( PulseStep++ )
+	{
+		case PULSE_STEP_HIGH:
+			CR95HF_IRQIN_HIGH();
+			CR95HF_PulseWait( IRQIN_PULSE_US );
+			break;
+
+		case PULSE_STEP_LOW:
+			CR95HF_IRQIN_LOW();
+			CR95HF_PulseWait( IRQIN_PULSE_US );
+			break;
+
+		default:
+			CR95HF_IRQIN_HIGH();
+			// Release the reader first, the callback may send the next command
+			PulseCallback = NULL;
+			callback( CR95HF_SUCCESS_CODE, NULL );
+			break;
+	}
+
+	return 0;
+}
+
+
+/**
+ *	@brief  Same as CR95HF_Send_IRQIN_NegativePulse() without blocking, the waits
+ *	@brief  run on the scheduler, on TCB0 with SCHEDULER_FINE_TIMEOUT.
+ *  @param  callback : function called from the scheduler once IRQ_IN is back high, pResponse is NULL
+ *  @return CR95HF_SUCCESS_CODE : the pulse started
+ *  @return CR95HF_ERROR_CODE : the reader is busy
+ */
+int8_t CR95HF_Send_IRQIN_NegativePulseAsync( CR95HF_Callback callback )
+{
+	if ( CR95HF_IsBusy() )
+	{
+		return CR95HF_ERROR_CODE;
+	}
+
+	PulseCallback = callback;
+	PulseStep = PULSE_STEP_HIGH;
+	CR95HF_PulseTask( NULL );
+
+	return CR95HF_SUCCESS_CODE;
+}
+
+
+/**
+ *	@brief  Same as CR95HF_Send_SPI_ResetSequence() without blocking.
+ *  @param  callback : function called from the scheduler once the sequence is done, pResponse is NULL
+ *  @return CR95HF_SUCCESS_CODE : the sequence started
+ *  @return CR95HF_ERROR_CODE : the reader is busy
+ */
+int8_t CR95HF_Send_SPI_ResetSequenceAsync( CR95HF_Callback callback )
+{
+	if ( CR95HF_IsBusy() )
+	{
+		return CR95HF_ERROR_CODE;
+	}
+
+	ReaderConfig.CurrentProtocol = PROTOCOL_TAG_FIELDOFF;
+
+	CR95HF_NSS_LOW();
+	SPI_exchange_byte( CR95HF_COMMAND_RESET );
+	CR95HF_NSS_HIGH();
+
+	PulseCallback = callback;
+	PulseStep = PULSE_STEP_HIGH;
+	CR95HF_PulseWait( RESET_WAIT_US );
+
+	return CR95HF_SUCCESS_CODE;
+}
+
+
 /**
  *	@brief  this function send a SendRecv command to CR95HF
  *  @param  Length 		: Number of bytes
  *  @param	Parameters 	: data depenps on protocl selected
  *  @param  pResponse : pointer on CR95HF response
+ *  @param  ResponseSize : size of the pResponse buffer
  *  @return CR95HF_SUCCESS_CODE : the command was succedfully sent
  *  @return CR95HF_ERROR_CODE : CR95HF returned an error code
  *  @return CR95HF_ERRORCODE_PARAMETERLENGTH : Length parameter is erroneous
  */
-int8_t CR95HF_SendRecv( const uint8_t Length, const uint8_t *Parameters, uint8_t *pResponse )
+int8_t CR95HF_SendRecv( const uint8_t Length, const uint8_t *Parameters, uint8_t *pResponse, uint16_t ResponseSize )
 {
-	uint8_t DataToSend[SENDRECV_BUFFER_SIZE];							  
-	uint8_t i = 0;
+	uint8_t Header[CR95HF_DATA_OFFSET] = { SEND_RECEIVE, Length };
 
 	// initialize the result code to 0xFF and length to 0
 	*pResponse = CR95HF_ERRORCODE_DEFAULT;
 	*(pResponse + 1) = 0x00;
 	
+	// check the function parameters
+	if ( Length < 1 )
+	{
+		return CR95HF_ERRORCODE_PARAMETERLENGTH; 
+	}
+
+	// the parameters are sent from the caller's buffer, no copy
+	SPIUART_SendReceiveFrame( Header, Parameters, pResponse, ResponseSize );
+
+	if ( CR95HF_IsReaderResultCodeOk( SEND_RECEIVE, pResponse ) != CR95HF_SUCCESS_CODE )
+	{
+		return CR95HF_ERROR_CODE;
+	}
+
+	return CR95HF_SUCCESS_CODE;
+}
+
+
+/**
+ *	@brief  this function builds a SendRecv command without sending it
+ *  @param  Length 		: Number of bytes
+ *  @param	Parameters 	: data depenps on protocl selected
+ *  @param  pCommand  : pointer on the command buffer, Length + 2 bytes ( Command | Length | Data)
+ *  @return CR95HF_SUCCESS_CODE : the command was built
+ *  @return CR95HF_ERRORCODE_PARAMETERLENGTH : Length parameter is erroneous
+ */
+int8_t CR95HF_BuildSendRecv( const uint8_t Length, const uint8_t *Parameters, uint8_t *pCommand )
+{
+	uint8_t i = 0;
 
 	// check the function parameters
 	if ( ( Length < 1 ) || ( Length > 255 ) )
@@ -268,37 +550,213 @@ int8_t CR95HF_SendRecv( const uint8_t Length, const uint8_t *Parameters, uint8_t
 		return CR95HF_ERRORCODE_PARAMETERLENGTH; 
 	}
 
-	DataToSend[CR95HF_COMMAND_OFFSET] = SEND_RECEIVE;
-	DataToSend[CR95HF_LENGTH_OFFSET] = Length;
+	pCommand[CR95HF_COMMAND_OFFSET] = SEND_RECEIVE;
+	pCommand[CR95HF_LENGTH_OFFSET] = Length;
 
-	// DataToSend CodeCmd Length Data
+	// pCommand CodeCmd Length Data
 	// Parameters[0] first byte to emit
 	for (i = 0 ; i < Length ; i++ )
 	{
-		DataToSend[CR95HF_DATA_OFFSET + i ] = Parameters[i];
+		pCommand[CR95HF_DATA_OFFSET + i ] = Parameters[i];
 	}
 
-	SPIUART_SendReceive( DataToSend, pResponse );
+	return CR95HF_SUCCESS_CODE;
+}
 
-	if ( CR95HF_IsReaderResultCodeOk( SEND_RECEIVE, pResponse ) != CR95HF_SUCCESS_CODE )
+
+/**
+ *	@brief  this function send an Idle command to CR95HF, the response comes once the chip wakes up
+ *  @param  Length 		: Number of bytes of Data
+ *  @param	Data 		: Idle parameters (see reader datasheet)
+ *  @param  pResponse : pointer on CR95HF response
+ *  @param  ResponseSize : size of the pResponse buffer
+ *  @return CR95HF_SUCCESS_CODE : the command was succedfully sent
+ *  @return CR95HF_ERROR_CODE : CR95HF returned an error code
+ *  @return CR95HF_ERRORCODE_PARAMETERLENGTH : Length parameter is erroneous
+ */
+int8_t CR95HF_Idle( const uint8_t Length, const uint8_t *Data, uint8_t *pResponse, uint16_t ResponseSize )
+{
+	uint8_t DataToSend[IDLE_BUFFER_SIZE];
+
+	// initialize the result code to 0xFF and length to 0
+	*pResponse = CR95HF_ERRORCODE_DEFAULT;
+	*(pResponse + 1) = 0x00;
+
+	if ( Length != IDLE_LENGTH )
+	{
+		return CR95HF_ERRORCODE_PARAMETERLENGTH;
+	}
+
+	DataToSend[CR95HF_COMMAND_OFFSET] = IDLE;
+	DataToSend[CR95HF_LENGTH_OFFSET] = Length;
+	memcpy( &DataToSend[CR95HF_DATA_OFFSET], Data, Length );
+
+	SPIUART_SendReceive( DataToSend, pResponse, ResponseSize );
+
+	if ( CR95HF_IsReaderResultCodeOk( IDLE, pResponse ) != CR95HF_SUCCESS_CODE )
+	{
+		return CR95HF_ERROR_CODE;
+	}
+
+	return CR95HF_SUCCESS_CODE;
+}
+
+
+/**
+ *	@brief  Send the calibration Idle command with the given DAC value
+ *  @param  DacDataH : upper limit of the wake up window
+ *  @return the wake up source, 0 if the command failed
+ */
+static uint8_t CR95HF_CalibrationWakeUp( uint8_t DacDataH )
+{
+	uint8_t Parameters[IDLE_LENGTH];
+	uint8_t pResponse[IDLE_RESPONSE_SIZE];
+
+	memcpy( Parameters, TagDetectCalibration, IDLE_LENGTH );
+	Parameters[TAGDETECT_OFFSET_DACDATAH] = DacDataH;
+
+	if ( CR95HF_Idle( IDLE_LENGTH, Parameters, pResponse, sizeof( pResponse ) ) != CR95HF_SUCCESS_CODE ||
+		 pResponse[CR95HF_LENGTH_OFFSET] < 1 )
+	{
+		return 0;
+	}
+
+	return pResponse[IDLE_OFFSET_WAKEUPSOURCE];
+}
+
+
+/**
+ *	@brief  Calibrate the tag detector, there must be no tag in the field. The DAC value
+ *	@brief  matching the field amplitude is found by successive approximation as described
+ *	@brief  in the CR95HF datasheet. Blocks for up to 5 s.
+ *  @param  none
+ *  @return CR95HF_SUCCESS_CODE : the tag detector is calibrated
+ *  @return CR95HF_ERROR_CODE : the CR95HF did not wake up as expected
+ */
+int8_t CR95HF_CalibrateTagDetector( void )
+{
+	uint8_t Dac = TAGDETECT_DAC_MAX;
+	uint8_t Step;
+	uint8_t WakeUp;
+
+	TagDetectorCalibrated = false;
+
+	// The lowest setting must wake up on tag detection and the highest on timeout
+	if ( CR95HF_CalibrationWakeUp( 0x00 ) != IDLE_WAKEUP_TAGDETECT ||
+		 CR95HF_CalibrationWakeUp( TAGDETECT_DAC_MAX ) != IDLE_WAKEUP_TIMEOUT )
 	{
+		debug_printError( "READER: Tag detector calibration failed" );
 		return CR95HF_ERROR_CODE;
 	}
 
+	WakeUp = IDLE_WAKEUP_TIMEOUT;
+	for ( Step = 0x80 ; Step >= 0x04 ; Step >>= 1 )
+	{
+		if ( WakeUp == IDLE_WAKEUP_TIMEOUT )
+		{
+			Dac -= Step;
+		}
+		else
+		{
+			Dac += Step;
+		}
+
+		WakeUp = CR95HF_CalibrationWakeUp( Dac );
+		if ( WakeUp == 0 )
+		{
+			debug_printError( "READER: Tag detector calibration failed" );
+			return CR95HF_ERROR_CODE;
+		}
+	}
+
+	if ( WakeUp == IDLE_WAKEUP_TIMEOUT )
+	{
+		Dac -= 0x04;
+	}
+
+	TagDetectorDac = Dac;
+	TagDetectorDacDataL = ( Dac > TAGDETECT_DAC_GUARD ) ? Dac - TAGDETECT_DAC_GUARD : 0x00;
+	TagDetectorDacDataH = ( Dac < TAGDETECT_DAC_MAX - TAGDETECT_DAC_GUARD ) ? Dac + TAGDETECT_DAC_GUARD : TAGDETECT_DAC_MAX;
+	TagDetectorWakeUps = 0;
+	TagDetectorCalibrated = true;
+
+	debug_printInfo( "READER: Tag detector DAC 0x%02X", Dac );
+
 	return CR95HF_SUCCESS_CODE;
 }
 
 
+/**
+ *	@brief  Get the tag detector calibration
+ *  @param  pDacRef   : DAC value matching the field without tag
+ *  @param  pDacDataL : lower limit of the wake up window
+ *  @param  pDacDataH : upper limit of the wake up window
+ *  @param  pWakeUps  : number of wake ups on tag detection since the calibration
+ *  @return true if the tag detector is calibrated
+ */
+bool CR95HF_GetTagDetector( uint8_t *pDacRef, uint8_t *pDacDataL, uint8_t *pDacDataH, uint16_t *pWakeUps )
+{
+	*pDacRef = TagDetectorDac;
+	*pDacDataL = TagDetectorDacDataL;
+	*pDacDataH = TagDetectorDacDataH;
+	*pWakeUps = TagDetectorWakeUps;
+
+	return TagDetectorCalibrated;
+}
+
+
+static void CR95HF_TagDetectDone( int8_t status, uint8_t *pResponse )
+{
+	if ( status == CR95HF_SUCCESS_CODE && pResponse[IDLE_OFFSET_WAKEUPSOURCE] == IDLE_WAKEUP_TAGDETECT )
+	{
+		TagDetectorWakeUps++;
+	}
+
+	TagDetectCallback( status, pResponse );
+}
+
+
+/**
+ *	@brief  Put the CR95HF in low power tag detection mode. The callback is called from the
+ *	@brief  scheduler once the chip wakes up, pResponse[IDLE_OFFSET_WAKEUPSOURCE] tells if a
+ *	@brief  tag approached (IDLE_WAKEUP_TAGDETECT) or the chip woke up on its own.
+ *  @param  callback : function called on wake up
+ *  @return CR95HF_SUCCESS_CODE : the CR95HF is in tag detection mode
+ *  @return CR95HF_ERROR_CODE : the tag detector is not calibrated or the reader is busy
+ */
+int8_t CR95HF_TagDetectAsync( CR95HF_Callback callback )
+{
+	uint8_t DataToSend[IDLE_BUFFER_SIZE];
+
+	if ( !TagDetectorCalibrated )
+	{
+		return CR95HF_ERROR_CODE;
+	}
+
+	DataToSend[CR95HF_COMMAND_OFFSET] = IDLE;
+	DataToSend[CR95HF_LENGTH_OFFSET] = IDLE_LENGTH;
+	memcpy( &DataToSend[CR95HF_DATA_OFFSET], TagDetectIdle, IDLE_LENGTH );
+	DataToSend[CR95HF_DATA_OFFSET + TAGDETECT_OFFSET_DACDATAL] = TagDetectorDacDataL;
+	DataToSend[CR95HF_DATA_OFFSET + TAGDETECT_OFFSET_DACDATAH] = TagDetectorDacDataH;
+
+	TagDetectCallback = callback;
+
+	return CR95HF_SendReceiveAsync( DataToSend, TagDetectResponse, sizeof( TagDetectResponse ), TAGDETECT_TIMEOUT, CR95HF_TagDetectDone );
+}
+
+
 /**
  *	@brief  Send Echo command
 *  @param  pResponse : pointer on CR95HF response
+ *  @param  ResponseSize : size of the pResponse buffer
  *  @retval CR95HF_SUCCESS_CODE : the command was successfully sent
  */
-int8_t CR95HF_Echo(uint8_t *pResponse)
+int8_t CR95HF_Echo( uint8_t *pResponse, uint16_t ResponseSize )
 {
-	const uint8_t command[] = { ECHO };
+	// a whole header, SPIUART_SendReceive() takes the address right after it
+	const uint8_t command[CR95HF_DATA_OFFSET] = { ECHO, 0x00 };
 
-	SPIUART_SendReceive( command, pResponse );
+	SPIUART_SendReceive( command, pResponse, ResponseSize );
 
 	return CR95HF_SUCCESS_CODE;
 }
@@ -344,23 +802,24 @@ static int8_t CR95HF_PollingCommand( int timeout )
 		CR95HF_NSS_HIGH();
 	}	
 	else if ( ReaderConfig.SpiMode == SPI_INTERRUPT )
-	{/*** NOT IMPLEMENTED ***
-		// reset the CR95HF data status 
-		CR95HF_DataReady = FALSE;
-		
-		// Enable Interrupt on the falling edge on the IRQ pin of CR95HF 
-		EXTI_ClearITPendingBit( EXTI_CR95HF_LINE );
-		EXTI->IMR |= EXTI_CR95HF_LINE;
+	{
+		// IRQ_OUT was armed before the command was sent, wait for the falling
+		// edge without any SPI traffic and with the CR95HF deselected
+		uint32_t waitSteps = (uint32_t)timeout * 10;	// 100us steps
 
-		// Wait a low level on the IRQ pin or the timeout 
-		//while( (CR95HF_DataReady != TRUE) && CR95HF_TimeOut != TRUE );
-		while( ( CR95HF_DataReady == FALSE ) & ( CR95HF_TimeOut == FALSE ) );
+		while ( CR95HF_DataReady == false && CR95HF_TimeOut != TRUE )
+		{
+			if ( waitSteps-- == 0 )
+			{
+				CR95HF_TimeOut = TRUE;
+			}
+			else
+			{
+				_delay_us( 100 );
+			}
+		}
 
-		if ( CR95HF_TimeOut == TRUE )
-		{		
-			// Disable CR95HF EXTI 
-			EXTI->IMR &= ~EXTI_CR95HF_LINE;
-		} */
+		CR95HF_IRQOUT_Disable();
 	}
 
 	//StopTimeOut();
@@ -374,6 +833,110 @@ static int8_t CR95HF_PollingCommand( int timeout )
 }
 
 
+/**
+ *	@brief  Send a command to the CR95HF and return without waiting for the response.
+ *	@brief  The callback is called from the scheduler once IRQ_OUT signals the response
+ *	@brief  or the timeout expires. Only one command can be pending at a time.
+ *  @param  *pCommand  : pointer on the buffer to send to the CR95HF ( Command | Length | Data)
+ *  @param  *pResponse : pointer on the buffer receiving the response, must stay valid until the callback
+ *  @param  ResponseSize : size of the pResponse buffer
+ *  @param  timeout    : timeout in milliseconds
+ *  @param  callback   : function called on completion
+ *  @return CR95HF_SUCCESS_CODE : the command was sent
+ *  @return CR95HF_ERROR_CODE : another command is pending or the interface is not SPI
+ */
+int8_t CR95HF_SendReceiveAsync( const uint8_t *pCommand, uint8_t *pResponse, uint16_t ResponseSize, uint16_t timeout, CR95HF_Callback callback )
+{
+	if ( CR95HF_IsBusy() || ReaderConfig.Interface != CR95HF_INTERFACE_SPI )
+	{
+		return CR95HF_ERROR_CODE;
+	}
+
+	*pResponse = CR95HF_ERRORCODE_DEFAULT;
+	*(pResponse + 1) = 0x00;
+
+	AsyncResponse = pResponse;
+	AsyncResponseSize = ResponseSize;
+	AsyncCallback = callback;
+
+	AsyncCommandHeader[CR95HF_COMMAND_OFFSET] = pCommand[CR95HF_COMMAND_OFFSET];
+	if ( pCommand[CR95HF_COMMAND_OFFSET] != ECHO )
+	{
+		memcpy( AsyncCommandHeader, pCommand, sizeof( AsyncCommandHeader ) );
+	}
+
+	CR95HF_IRQOUT_Enable( &CR95HF_AsyncDataReadyTimer );
+	CR95HF_Send_SPI_Command( pCommand );
+	scheduler_timeout_create( &CR95HF_AsyncTimeoutTimer, timeout );
+
+	return CR95HF_SUCCESS_CODE;
+}
+
+
+/**
+ *	@brief  Check if an asynchronous command is pending
+ *  @param  none
+ *  @return true while CR95HF_SendReceiveAsync() waits for the response or an
+ *  @return IRQ_IN pulse or reset sequence is running
+ */
+bool CR95HF_IsBusy( void )
+{
+	return AsyncCallback != NULL || PulseCallback != NULL;
+}
+
+
+static void CR95HF_AsyncComplete( int8_t status )
+{
+	CR95HF_Callback callback = AsyncCallback;
+
+	// Release the reader first, the callback may send the next command
+	AsyncCallback = NULL;
+	callback( status, AsyncResponse );
+}
+
+
+static absolutetime_t CR95HF_AsyncDataReadyTask( void *payload )
+{
+	// Ignore a completion that arrives after the timeout
+	if ( AsyncCallback == NULL )
+	{
+		return 0;
+	}
+
+	scheduler_timeout_delete( &CR95HF_AsyncTimeoutTimer );
+	CR95HF_Receive_SPI_Response( AsyncResponse, AsyncResponseSize );
+	CR95HF_TrackProtocol( AsyncCommandHeader, &AsyncCommandHeader[CR95HF_DATA_OFFSET], AsyncResponse );
+	CR95HF_AsyncComplete( CR95HF_SUCCESS_CODE );
+
+	return 0;
+}
+
+
+static absolutetime_t CR95HF_AsyncTimeoutTask( void *payload )
+{
+	if ( AsyncCallback == NULL )
+	{
+		return 0;
+	}
+
+	CR95HF_IRQOUT_Disable();
+
+	// The response made it just before the timeout, CR95HF_AsyncDataReadyTask() is queued
+	if ( CR95HF_DataReady )
+	{
+		return 0;
+	}
+
+	debug_printError( "READER: CR95HF Response Timeout" );
+
+	*AsyncResponse = CR95HF_ERRORCODE_TIMEOUT;
+	CR95HF_TrackProtocol( AsyncCommandHeader, &AsyncCommandHeader[CR95HF_DATA_OFFSET], AsyncResponse );
+	CR95HF_AsyncComplete( CR95HF_POLLING_TIMEOUT );
+
+	return 0;
+}
+
+
 /**
  *	@brief  This function send POR sequence. It might be use to initialize CR95HF after a POR.
  *  @param  none
@@ -384,10 +947,12 @@ int8_t CR95HF_PORsequence( void )
 {
 	uint8_t pResponse[10], NthAttempt = 1;
 
+	ReaderConfig.CurrentProtocol = PROTOCOL_TAG_FIELDOFF;
+
 	do
 	{
 		// send an ECHO command and checks CR95HF response 		
-		CR95HF_Echo( pResponse );
+		CR95HF_Echo( pResponse, sizeof( pResponse ) );
 		if ( pResponse[0] == ECHORESPONSE )
 		{
 			return CR95HF_SUCCESS_CODE;
@@ -422,15 +987,15 @@ int8_t CR95HF_PORsequence( void )
  *  @param  Protocol : RF protocol (ISO 14443 A or B or 15 693 or Fellica)
  *  @param  Parameters: protocol parameters (see reader datasheet)
  *  @param  pResponse : pointer on CR95HF response
+ *  @param  ResponseSize : size of the pResponse buffer
  *  @return CR95HF_SUCCESS_CODE : the command was successfully sent
  *  @return CR95HF_ERRORCODE_PARAMETERLENGTH : the Length parameter is erroneous
  *  @return CR95HF_ERRORCODE_PARAMETER : a parameter is erroneous
  */
-int8_t CR95HF_ProtocolSelect( const uint8_t Length, const uint8_t Protocol, const uint8_t *Parameters, uint8_t *pResponse )
+int8_t CR95HF_ProtocolSelect( const uint8_t Length, const uint8_t Protocol, const uint8_t *Parameters, uint8_t *pResponse, uint16_t ResponseSize )
 {
 	uint8_t DataToSend[SELECT_BUFFER_SIZE];
-	uint8_t SelectParameters[SELECT_BUFFER_SIZE];
-	int8_t i = 0; 
+	int8_t status;
 
 	if ( ( Length < 1 ) || ( Length > SELECT_BUFFER_SIZE ) )
 	{
@@ -441,6 +1006,38 @@ int8_t CR95HF_ProtocolSelect( const uint8_t Length, const uint8_t Protocol, cons
 	*pResponse = CR95HF_ERRORCODE_DEFAULT;
 	*(pResponse + 1) = 0x00;
 
+	status = CR95HF_BuildProtocolSelect( Length, Protocol, Parameters, DataToSend );
+	if ( status != CR95HF_SUCCESS_CODE )
+	{
+		return status;
+	}
+
+  	SPIUART_SendReceive( DataToSend, pResponse, ResponseSize );
+
+	return CR95HF_SUCCESS_CODE;	
+}
+
+
+/**
+ *	@brief  this function builds a ProtocolSelect command without sending it
+ *  @param  Length  : number of byte of protocol select command parameters
+ *  @param  Protocol : RF protocol (ISO 14443 A or B or 15 693 or Fellica)
+ *  @param  Parameters: protocol parameters (see reader datasheet)
+ *  @param  pCommand  : pointer on the command buffer, Length + 2 bytes ( Command | Length | Data)
+ *  @return CR95HF_SUCCESS_CODE : the command was built
+ *  @return CR95HF_ERRORCODE_PARAMETERLENGTH : the Length parameter is erroneous
+ *  @return CR95HF_ERRORCODE_PARAMETER : a parameter is erroneous
+ */
+int8_t CR95HF_BuildProtocolSelect( const uint8_t Length, const uint8_t Protocol, const uint8_t *Parameters, uint8_t *pCommand )
+{
+	uint8_t SelectParameters[SELECT_BUFFER_SIZE];
+	int8_t i = 0; 
+
+	if ( ( Length < 1 ) || ( Length > SELECT_BUFFER_SIZE ) )
+	{
+		return CR95HF_ERRORCODE_PARAMETERLENGTH;
+	}
+
 	// check the function parameters
 	if ( ( IsAnAvailableProtocol( Protocol ) != CR95HF_SUCCESS_CODE ) ||
 		 ( IsAnAvailableSelectLength( Protocol, Length ) != CR95HF_SUCCESS_CODE ) ||
@@ -457,19 +1054,17 @@ int8_t CR95HF_ProtocolSelect( const uint8_t Length, const uint8_t Protocol, cons
 		return CR95HF_ERRORCODE_PARAMETER;
 	}
 
-	DataToSend[CR95HF_COMMAND_OFFSET] = PROTOCOL_SELECT;
-	DataToSend[CR95HF_LENGTH_OFFSET] = Length;
-	DataToSend[CR95HF_DATA_OFFSET] = Protocol;
+	pCommand[CR95HF_COMMAND_OFFSET] = PROTOCOL_SELECT;
+	pCommand[CR95HF_LENGTH_OFFSET] = Length;
+	pCommand[CR95HF_DATA_OFFSET] = Protocol;
 
-	// DataToSend CodeCmd Length Data
+	// pCommand CodeCmd Length Data
 	// Parameters[0] first byte to emit
 	for ( i = 0 ; i < Length - 1 ; i++ )
 	{
-		DataToSend[CR95HF_DATA_OFFSET + 1 + i] = SelectParameters[i];
+		pCommand[CR95HF_DATA_OFFSET + 1 + i] = SelectParameters[i];
 	}
 
-  	SPIUART_SendReceive( DataToSend, pResponse );
-
 	return CR95HF_SUCCESS_CODE;	
 }
 
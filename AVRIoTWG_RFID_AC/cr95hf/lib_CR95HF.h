@@ -45,11 +45,15 @@
 
 #define SENDRECV_ERRORCODE_SOFT						0xFF
 
+// Maximum time in ms the CR95HF takes to answer a command
+#define CR95HF_RESPONSE_TIMEOUT						1000
+
 /*** Error Codes ***/
 #define	CR95HF_ERRORCODE_DEFAULT					0xFE
 #define	CR95HF_ERRORCODE_TIMEOUT					0xFD
 #define	CR95HF_ERRORCODE_UARTDATARATEUNCHANGED		0xFC
 #define	CR95HF_ERRORCODE_UARTDATARATEPROCESS		0xFB
+#define	CR95HF_ERRORCODE_FRAMING					0xFA	// response longer than the buffer, dropped
 #define CR95HF_ERROR_CODE							0x40
 #define CR95HF_ERRORCODE_PARAMETERLENGTH			0x41
 #define CR95HF_ERRORCODE_PARAMETER					0x42
@@ -67,6 +71,20 @@
 #define PROTOCOLSELECT_ERRORCODE_CMDLENGTH			0x82
 #define PROTOCOLSELECT_ERRORCODE_INVALID			0x83
 
+/*** send receive field status ***/
+#define SENDRECV_RESULTSCODE_OK						0x80
+#define SENDRECV_ERRORCODE_COMERROR					0x86
+#define SENDRECV_ERRORCODE_FRAMEWAIT				0x87
+#define SENDRECV_ERRORCODE_SOF						0x88
+#define SENDRECV_ERRORCODE_OVERFLOW					0x89
+#define SENDRECV_ERRORCODE_FRAMING					0x8A
+#define SENDRECV_ERRORCODE_EGT						0x8B
+#define SENDRECV_ERRORCODE_LENGTH					0x8C
+#define SENDRECV_ERRORCODE_CRC						0x8D
+#define SENDRECV_ERRORCODE_RECEPTIONLOST			0x8E
+// a SendRecv without data sends an EOF (ISO15693 slot marker)
+#define SENDRECV_EOF_LENGTH							0x00
+
 /*** CR95HF Command Codes ***/
 #define IDN											0x01
 #define PROTOCOL_SELECT 							0x02
@@ -78,6 +96,14 @@
 #define BAUD_RATE									0x0A
 #define ECHO										0x55
 
+/*** Idle command ***/
+#define IDLE_LENGTH									0x0E
+// wake up sources, also returned in the Idle response
+#define IDLE_WAKEUP_TIMEOUT							0x01
+#define IDLE_WAKEUP_TAGDETECT						0x02
+#define IDLE_WAKEUP_IRQIN							0x08
+#define IDLE_OFFSET_WAKEUPSOURCE					CR95HF_DATA_OFFSET
+
 /*** Offset Definitions for Buffers ***/
 #define CR95HF_COMMAND_OFFSET						0x00
 #define CR95HF_LENGTH_OFFSET						0x01
@@ -129,9 +155,13 @@
 typedef struct {
 	CR95HF_INTERFACE 		Interface;
 	SPI_MODE 				SpiMode;
-	int8_t					CurrentProtocol;
+	int8_t					CurrentProtocol;	// PROTOCOL_TAG_FIELDOFF after a reset or Idle command
+	uint8_t					CurrentParameters;	// first ProtocolSelect parameter byte
 } ReaderConfigStruct;
 
+// Completion of CR95HF_SendReceiveAsync(), status is CR95HF_SUCCESS_CODE or CR95HF_POLLING_TIMEOUT
+typedef void (*CR95HF_Callback)( int8_t status, uint8_t *pResponse );
+
 
 /******************************************************************************/
 /*                             Public Functions                               */
@@ -139,15 +169,19 @@ typedef struct {
 /*** Available CR95HF Commands ***/
 //int8_t CR95HF_IDN( uint8_t *pResponse );
 //int8_t CR95HF_ProtocolSelect( const uint8_t Length, const uint8_t Protocol, const uint8_t *Parameters, uint8_t *pResponse );
-int8_t CR95HF_SendRecv( const uint8_t Length, const uint8_t *Parameters, uint8_t *pResponse);
-//int8_t CR95HF_Idle( const uint8_t Length, const uint8_t *Data, uint8_t *pResponse);
+int8_t CR95HF_SendRecv( const uint8_t Length, const uint8_t *Parameters, uint8_t *pResponse, uint16_t ResponseSize );
+int8_t CR95HF_Idle( const uint8_t Length, const uint8_t *Data, uint8_t *pResponse, uint16_t ResponseSize );
 //int8_t CR95HF_RdReg( const uint8_t Length, const uint8_t Address, const uint8_t RegCount, const uint8_t Flags, uint8_t *pResponse);
 //int8_t CR95HF_WrReg( const uint8_t Length, const uint8_t Address, const uint8_t Flags, const uint8_t *pData, uint8_t *pResponse);
 //int8_t CR95HF_BaudRate( const uint8_t BaudRate, uint8_t *pResponse );
-int8_t CR95HF_Echo( uint8_t *pResponse );
+int8_t CR95HF_Echo( uint8_t *pResponse, uint16_t ResponseSize );
 
 int8_t CR95HF_PORsequence( void );
-int8_t CR95HF_ProtocolSelect( const uint8_t Length, const uint8_t Protocol, const uint8_t *Parameters, uint8_t *pResponse );
+int8_t CR95HF_ProtocolSelect( const uint8_t Length, const uint8_t Protocol, const uint8_t *Parameters, uint8_t *pResponse, uint16_t ResponseSize );
+
+bool CR95HF_IsProtocolSelected( const uint8_t Protocol, const uint8_t Parameters );
+int8_t CR95HF_BuildSendRecv( const uint8_t Length, const uint8_t *Parameters, uint8_t *pCommand );
+int8_t CR95HF_BuildProtocolSelect( const uint8_t Length, const uint8_t Protocol, const uint8_t *Parameters, uint8_t *pCommand );
 
 int8_t SplitReaderReply( uint8_t CmdCodeToReader, uint8_t ProtocolSelected,
 					  	 const uint8_t *ReaderReply, uint8_t *ResultCode,
@@ -155,6 +189,15 @@ int8_t SplitReaderReply( uint8_t CmdCodeToReader, uint8_t ProtocolSelected,
 						 uint8_t *NbControlByte, uint8_t *ControlIndex );
 
 int8_t CR95HF_IsReaderResultCodeOk( uint8_t CmdCode, const uint8_t *ReaderReply );
+
+int8_t CR95HF_SendReceiveAsync( const uint8_t *pCommand, uint8_t *pResponse, uint16_t ResponseSize, uint16_t timeout, CR95HF_Callback callback );
+bool CR95HF_IsBusy( void );
+
+int8_t CR95HF_CalibrateTagDetector( void );
+bool CR95HF_GetTagDetector( uint8_t *pDacRef, uint8_t *pDacDataL, uint8_t *pDacDataH, uint16_t *pWakeUps );
+int8_t CR95HF_TagDetectAsync( CR95HF_Callback callback );
+int8_t CR95HF_Send_IRQIN_NegativePulseAsync( CR95HF_Callback callback );
+int8_t CR95HF_Send_SPI_ResetSequenceAsync( CR95HF_Callback callback );
 int8_t CR95HF_IsCommandExists( uint8_t CmdCode );
 
 #endif /* __CR95HF_H */
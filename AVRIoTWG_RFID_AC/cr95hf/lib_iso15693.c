@@ -1,6 +1,7 @@
 /******************************************************************************/
 /*                                 Includes                                   */
 /******************************************************************************/
+#include <avr/pgmspace.h>
 #include "lib_iso15693.h"
 
 
@@ -33,6 +34,8 @@
 
 // command length
 #define ISO15693_MAXLENGTH_INVENTORY 				13	 	// 8 + 8 + 8 + 64 + 16 = 104bits => 13 bytes
+// 1 slot inventory reply: Result | Length | Flags | DSFID | UID | CRC16 | Collision byte
+#define ISO15693_LENGTH_INVENTORYREPLY				( CR95HF_DATA_OFFSET + 2 + ISO15693_NBBYTE_UID + ISO15693_NBBYTE_CRC16 + 1 )
 
 #define ISO15693_NBBITS_MASKPARAMETER   			64
 
@@ -59,6 +62,127 @@ extern uint8_t GloParameterSelected;
 /*                            Private Functions                               */
 /******************************************************************************/
 static int8_t ISO15693_IsAnAvailableDataRate( const uint8_t DataRate );
+static uint8_t ISO15693_SelectParameters( const uint8_t DataRate, const uint8_t TimeOrSOF, 
+										  const uint8_t Modulation, const uint8_t SubCarrier, 
+										  const uint8_t AppendCRC );
+static int8_t ISO15693_BuildInventory( const uint8_t Flags, const uint8_t AFI, 
+									   const uint8_t MaskLength, const uint8_t *MaskValue, 
+									   const uint8_t AppendCRC, const uint8_t *CRC16, 
+									   uint8_t *InventoryBuf, uint8_t *Length );
+static void ISO15693_GetUIDAsyncStep( int8_t status, uint8_t *pResponse );
+static void ISO15693_GetUIDAsyncDone( int8_t status );
+static int8_t ISO15693_GetUIDAsyncInventory( void );
+static int8_t ISO15693_StartAsync( void );
+static int8_t ISO15693_StartAttempt( void );
+static uint8_t ISO15693_RFSettingParameters( const uint8_t Setting );
+static int8_t ISO15693_RFSettingFlags( const uint8_t Setting, const uint8_t NbSlotFlag );
+static bool ISO15693_IsRFError( const uint8_t *pResponse );
+static int8_t ISO15693_AnticollisionRequest( void );
+static void ISO15693_AnticollisionSlot( const uint8_t *pResponse );
+static void ISO15693_AnticollisionNext( void );
+static absolutetime_t ISO15693_ScanStopwatchExpired( void *payload );
+
+
+/******************************************************************************/
+/*                            Private Variables                               */
+/******************************************************************************/
+typedef enum {
+	ISO15693_ASYNC_IDLE = 0,
+	ISO15693_ASYNC_SELECT,
+	ISO15693_ASYNC_INVENTORY,
+	ISO15693_ASYNC_ANTICOLLISION
+} ISO15693_ASYNC_STATE;
+
+static ISO15693_ASYNC_STATE AsyncState = ISO15693_ASYNC_IDLE;
+static ISO15693_UIDCallback AsyncUIDCallback;
+static ISO15693_InventoryCallback AsyncInventoryCallback;	// NULL for a 1 slot inventory
+static uint8_t AsyncParametersByte;
+static uint8_t AsyncCommand[CR95HF_DATA_OFFSET + ISO15693_MAXLENGTH_INVENTORY];
+static uint8_t AsyncReply[ISO15693_LENGTH_INVENTORYREPLY];
+static uint8_t AsyncUID[ISO15693_MAX_INVENTORY_UIDS][ISO15693_NBBYTE_UID];
+static uint8_t AsyncNbUID;
+
+// 16 slots anticollision, one level per mask nibble. The mask of a level is the
+// mask of the level above plus the slot that collided there.
+#define ISO15693_NBLEVELS_ANTICOLLISION		( ISO15693_NBBITS_MASKPARAMETER / 4 )
+static uint8_t AsyncMask[ISO15693_NBBYTE_UID];
+static uint8_t AsyncLevel;
+static uint8_t AsyncSlot;
+static uint16_t AsyncCollisions[ISO15693_NBLEVELS_ANTICOLLISION];	// one bit per slot that collided
+
+static timer_struct_t ScanStopwatch = { ISO15693_ScanStopwatchExpired };
+static ISO15693_ScanTimingStruct ScanTiming;
+
+// Data rate / subcarrier of each RF setting, fastest first
+typedef struct {
+	uint8_t		DataRate;
+	uint8_t		SubCarrier;
+} ISO15693_RFSettingStruct;
+
+static const ISO15693_RFSettingStruct RFSettings[ISO15693_NB_RFSETTINGS] = {
+	{ ISO15693_TRANSMISSION_53, ISO15693_SINGLE_SUBCARRIER },
+	{ ISO15693_TRANSMISSION_53, ISO15693_DUAL_SUBCARRIER },
+	{ ISO15693_TRANSMISSION_26, ISO15693_SINGLE_SUBCARRIER },
+	{ ISO15693_TRANSMISSION_26, ISO15693_DUAL_SUBCARRIER },
+	{ ISO15693_TRANSMISSION_6, ISO15693_SINGLE_SUBCARRIER },
+	{ ISO15693_TRANSMISSION_6, ISO15693_DUAL_SUBCARRIER }
+};
+
+static uint8_t RFSetting = ISO15693_RFSETTING_53_SINGLE;	// best known setting
+static bool RFAdaptive = true;
+static uint8_t RFSuccessRun;		// successful scans since the last probe or fall back
+static ISO15693_RFStatsStruct RFStats[ISO15693_NB_RFSETTINGS];
+
+// RF setting of the current attempt of an asynchronous scan
+static uint8_t AsyncSetting;
+static bool AsyncProbe;			// trying one step faster than RFSetting
+static uint8_t AsyncRFErrors;	// replies that were there but could not be decoded
+static timer_struct_t AttemptStopwatch = { ISO15693_ScanStopwatchExpired };
+static uint32_t AttemptSPIBytes;	// SPI_GetByteCount() when the attempt started
+
+#if ISO15693_CRC16_METHOD == ISO15693_CRC16_NIBBLE
+// CRC16 of the 16 nibble values, ISO15693_POLYCRC16 reflected
+static const uint16_t ISO15693_CRC16Table[16] PROGMEM = {
+	0x0000, 0x1081, 0x2102, 0x3183, 0x4204, 0x5285, 0x6306, 0x7387,
+	0x8408, 0x9489, 0xA50A, 0xB58B, 0xC60C, 0xD68D, 0xE70E, 0xF78F
+};
+#elif ISO15693_CRC16_METHOD == ISO15693_CRC16_BYTE
+// CRC16 of the 256 byte values, ISO15693_POLYCRC16 reflected
+static const uint16_t ISO15693_CRC16Table[256] PROGMEM = {
+	0x0000, 0x1189, 0x2312, 0x329B, 0x4624, 0x57AD, 0x6536, 0x74BF,
+	0x8C48, 0x9DC1, 0xAF5A, 0xBED3, 0xCA6C, 0xDBE5, 0xE97E, 0xF8F7,
+	0x1081, 0x0108, 0x3393, 0x221A, 0x56A5, 0x472C, 0x75B7, 0x643E,
+	0x9CC9, 0x8D40, 0xBFDB, 0xAE52, 0xDAED, 0xCB64, 0xF9FF, 0xE876,
+	0x2102, 0x308B, 0x0210, 0x1399, 0x6726, 0x76AF, 0x4434, 0x55BD,
+	0xAD4A, 0xBCC3, 0x8E58, 0x9FD1, 0xEB6E, 0xFAE7, 0xC87C, 0xD9F5,
+	0x3183, 0x200A, 0x1291, 0x0318, 0x77A7, 0x662E, 0x54B5, 0x453C,
+	0xBDCB, 0xAC42, 0x9ED9, 0x8F50, 0xFBEF, 0xEA66, 0xD8FD, 0xC974,
+	0x4204, 0x538D, 0x6116, 0x709F, 0x0420, 0x15A9, 0x2732, 0x36BB,
+	0xCE4C, 0xDFC5, 0xED5E, 0xFCD7, 0x8868, 0x99E1, 0xAB7A, 0xBAF3,
+	0x5285, 0x430C, 0x7197, 0x601E, 0x14A1, 0x0528, 0x37B3, 0x263A,
+	0xDECD, 0xCF44, 0xFDDF, 0xEC56, 0x98E9, 0x8960, 0xBBFB, 0xAA72,
+	0x6306, 0x728F, 0x4014, 0x519D, 0x2522, 0x34AB, 0x0630, 0x17B9,
+	0xEF4E, 0xFEC7, 0xCC5C, 0xDDD5, 0xA96A, 0xB8E3, 0x8A78, 0x9BF1,
+	0x7387, 0x620E, 0x5095, 0x411C, 0x35A3, 0x242A, 0x16B1, 0x0738,
+	0xFFCF, 0xEE46, 0xDCDD, 0xCD54, 0xB9EB, 0xA862, 0x9AF9, 0x8B70,
+	0x8408, 0x9581, 0xA71A, 0xB693, 0xC22C, 0xD3A5, 0xE13E, 0xF0B7,
+	0x0840, 0x19C9, 0x2B52, 0x3ADB, 0x4E64, 0x5FED, 0x6D76, 0x7CFF,
+	0x9489, 0x8500, 0xB79B, 0xA612, 0xD2AD, 0xC324, 0xF1BF, 0xE036,
+	0x18C1, 0x0948, 0x3BD3, 0x2A5A, 0x5EE5, 0x4F6C, 0x7DF7, 0x6C7E,
+	0xA50A, 0xB483, 0x8618, 0x9791, 0xE32E, 0xF2A7, 0xC03C, 0xD1B5,
+	0x2942, 0x38CB, 0x0A50, 0x1BD9, 0x6F66, 0x7EEF, 0x4C74, 0x5DFD,
+	0xB58B, 0xA402, 0x9699, 0x8710, 0xF3AF, 0xE226, 0xD0BD, 0xC134,
+	0x39C3, 0x284A, 0x1AD1, 0x0B58, 0x7FE7, 0x6E6E, 0x5CF5, 0x4D7C,
+	0xC60C, 0xD785, 0xE51E, 0xF497, 0x8028, 0x91A1, 0xA33A, 0xB2B3,
+	0x4A44, 0x5BCD, 0x6956, 0x78DF, 0x0C60, 0x1DE9, 0x2F72, 0x3EFB,
+	0xD68D, 0xC704, 0xF59F, 0xE416, 0x90A9, 0x8120, 0xB3BB, 0xA232,
+	0x5AC5, 0x4B4C, 0x79D7, 0x685E, 0x1CE1, 0x0D68, 0x3FF3, 0x2E7A,
+	0xE70E, 0xF687, 0xC41C, 0xD595, 0xA12A, 0xB0A3, 0x8238, 0x93B1,
+	0x6B46, 0x7ACF, 0x4854, 0x59DD, 0x2D62, 0x3CEB, 0x0E70, 0x1FF9,
+	0xF78F, 0xE606, 0xD49D, 0xC514, 0xB1AB, 0xA022, 0x92B9, 0x8330,
+	0x7BC7, 0x6A4E, 0x58D5, 0x495C, 0x3DE3, 0x2C6A, 0x1EF1, 0x0F78
+};
+#endif
 
 
 /******************************************************************************/
@@ -121,13 +245,9 @@ int8_t ISO15693_SelectProtocol( const uint8_t DataRate, const uint8_t TimeOrSOF,
 		return ERRORCODE_GENERIC;
 	}
 	 
-	ParametersByte = ( ( AppendCRC  << ISO15693_OFFSET_APPENDCRC ) 	&  ISO15693_MASK_APPENDCRC ) |
-					 ( ( SubCarrier << ISO15693_OFFSET_SUBCARRIER ) & ISO15693_MASK_SUBCARRIER ) |
-					 ( ( Modulation << ISO15693_OFFSET_MODULATION ) & ISO15693_MASK_MODULATION ) |
-					 ( ( TimeOrSOF  << ISO15693_OFFSET_WAITORSOF )  & ISO15693_MASK_WAITORSOF )  |
-					 ( ( DataRate   << ISO15693_OFFSET_DATARATE )   & ISO15693_MASK_DATARATE );
+	ParametersByte = ISO15693_SelectParameters( DataRate, TimeOrSOF, Modulation, SubCarrier, AppendCRC );
 	 
-	if ( CR95HF_ProtocolSelect( ISO15693_SELECTLENGTH, ISO15693_PROTOCOL, &ParametersByte, pResponse ) != CR95HF_SUCCESS_CODE )
+	if ( CR95HF_ProtocolSelect( ISO15693_SELECTLENGTH, ISO15693_PROTOCOL, &ParametersByte, pResponse, sizeof( pResponse ) ) != CR95HF_SUCCESS_CODE )
 	{
 		return ERRORCODE_GENERIC;
 	}
@@ -145,6 +265,27 @@ int8_t ISO15693_SelectProtocol( const uint8_t DataRate, const uint8_t TimeOrSOF,
 }
  
  
+/**
+* @brief  	this function returns the parameter byte of the 15693 ProtocolSelect command
+* @param  	DataRate	:  	tag data rate ( 6 or 26 or 52k)
+* @param 	TimeOrSOF	: 	wait for SOF or respect 312 s delay
+* @param	Modulation	: 	10 or 100% modulation depth
+* @param	SubCarrier	: 	single or double sub-carrier
+* @param	AppendCRC	: 	if = 1 CR95HF computes the CRC command
+* @retval 	parameter byte
+*/
+static uint8_t ISO15693_SelectParameters( const uint8_t DataRate, const uint8_t TimeOrSOF, 
+										  const uint8_t Modulation, const uint8_t SubCarrier, 
+										  const uint8_t AppendCRC )
+{
+	return ( ( AppendCRC  << ISO15693_OFFSET_APPENDCRC ) 	&  ISO15693_MASK_APPENDCRC ) |
+		   ( ( SubCarrier << ISO15693_OFFSET_SUBCARRIER ) & ISO15693_MASK_SUBCARRIER ) |
+		   ( ( Modulation << ISO15693_OFFSET_MODULATION ) & ISO15693_MASK_MODULATION ) |
+		   ( ( TimeOrSOF  << ISO15693_OFFSET_WAITORSOF )  & ISO15693_MASK_WAITORSOF )  |
+		   ( ( DataRate   << ISO15693_OFFSET_DATARATE )   & ISO15693_MASK_DATARATE );
+}
+
+
 /**
 * @brief  this function returns RESULTOK if the data rate is available, otherwise ERRORCODE_GENERIC
 * @param  	DataRate	:  	reader Data Rate
@@ -176,6 +317,7 @@ static int8_t ISO15693_IsAnAvailableDataRate( const uint8_t DataRate )
 * @param	AppendCRC	:  	CRC16 management. If set CR95HF appends CRC16.
 * @param	CRC16		: 	pointer on CRC16 (optional) in case of user has chosen to manage CRC16 (see ProtocolSelect command CR95HF layer)
 * @param	pResponse	: 	pointer on CR95HF response
+* @param	ResponseSize	: 	size of the pResponse buffer
 * @retval 	RESULTOK	: 	CR95HF returns a successful code
 * @retval 	ISO15693_ERRORCODE_PARAMETERLENGTH	: 	MaskLength value is erroneous
 * @retval 	ERRORCODE_GENERIC	: 	 CR95HF returns an error code
@@ -183,19 +325,61 @@ static int8_t ISO15693_IsAnAvailableDataRate( const uint8_t DataRate )
 int8_t ISO15693_Inventory( const uint8_t Flags, const uint8_t AFI, 
 						   const uint8_t MaskLength, const uint8_t *MaskValue, 
 						   const uint8_t AppendCRC, const uint8_t *CRC16, 
-						   uint8_t *pResponse )
+						   uint8_t *pResponse, uint16_t ResponseSize )
 {
 	uint8_t NthByte = 0;
 	uint8_t InventoryBuf[ISO15693_MAXLENGTH_INVENTORY];
-	uint8_t NbMaskBytes = 0;
-	uint8_t NbSignificantBits = 0;
-	int8_t FirstByteMask;
-	int8_t NthMaskByte = 0;
+	int8_t status;
 	
 	// initialize the result code to 0xFF and length to 0  in case of error
 	*pResponse = SENDRECV_ERRORCODE_SOFT;
 	*(pResponse + 1) = 0x00;
 
+	status = ISO15693_BuildInventory( Flags, AFI, MaskLength, MaskValue, AppendCRC, CRC16, InventoryBuf, &NthByte );
+	if ( status != RESULTOK )
+	{
+		return status;
+	}
+
+	if ( CR95HF_SendRecv( NthByte, InventoryBuf, pResponse, ResponseSize ) != CR95HF_SUCCESS_CODE )
+	{
+		return ERRORCODE_GENERIC;
+	}
+
+	if ( CR95HF_IsReaderResultCodeOk( SEND_RECEIVE, pResponse ) == ERRORCODE_GENERIC )
+	{
+		return ERRORCODE_GENERIC;
+	}
+
+	return RESULTOK;
+}
+
+
+/**
+* @brief  	this function builds the frame of an inventory command without sending it
+* @param  	Flags		:  	Request flags
+* @param	AFI			:	AFI byte (optional)
+* @param	MaskLength 	: 	Number of bits of mask value
+* @param	MaskValue	:  	mask value which is compare to Contact-less tag UID
+* @param	AppendCRC	:  	CRC16 management. If set CR95HF appends CRC16.
+* @param	CRC16		: 	pointer on CRC16 (optional) in case of user has chosen to manage CRC16 (see ProtocolSelect command CR95HF layer)
+* @param	InventoryBuf: 	pointer on the frame, ISO15693_MAXLENGTH_INVENTORY bytes
+* @param	Length		: 	Number of bytes of the frame
+* @retval 	RESULTOK	: 	the frame was built
+* @retval 	ISO15693_ERRORCODE_PARAMETERLENGTH	: 	MaskLength value is erroneous
+* @retval 	ERRORCODE_GENERIC	: 	 Flags don't match the selected protocol
+*/
+static int8_t ISO15693_BuildInventory( const uint8_t Flags, const uint8_t AFI, 
+									   const uint8_t MaskLength, const uint8_t *MaskValue, 
+									   const uint8_t AppendCRC, const uint8_t *CRC16, 
+									   uint8_t *InventoryBuf, uint8_t *Length )
+{
+	uint8_t NthByte = 0;
+	uint8_t NbMaskBytes = 0;
+	uint8_t NbSignificantBits = 0;
+	int8_t FirstByteMask;
+	int8_t NthMaskByte = 0;
+
 	if ( MaskLength > ISO15693_NBBITS_MASKPARAMETER )
 	{
 		return ISO15693_ERRORCODE_PARAMETERLENGTH;
@@ -259,15 +443,8 @@ int8_t ISO15693_Inventory( const uint8_t Flags, const uint8_t AFI,
 		InventoryBuf[NthByte++] = CRC16[0];
 		InventoryBuf[NthByte++] = CRC16[1];
 	}
-	if ( CR95HF_SendRecv( NthByte, InventoryBuf, pResponse ) != CR95HF_SUCCESS_CODE )
-	{
-		return ERRORCODE_GENERIC;
-	}
 
-	if ( CR95HF_IsReaderResultCodeOk( SEND_RECEIVE, pResponse ) == ERRORCODE_GENERIC )
-	{
-		return ERRORCODE_GENERIC;
-	}
+	*Length = NthByte;
 
 	return RESULTOK;
 }
@@ -310,9 +487,10 @@ int8_t ISO15693_IsReaderConfigMatchWithFlag( const uint8_t ParameterSelected, co
 	}
 	
 	// (acc to ISO spec) Data rate flag = 1 => high data rates
-	// (acc to reader datasheet) Data rate value = 0b00 => 26k (high data rate)
+	// (acc to reader datasheet) Data rate value = 0b00 => 26k, 0b01 => 53k (high data rates)
 	if ( ( ISO15693_GetDataRateFlag( Flags ) == TRUE ) & 
-	   ( ( ParameterSelected & CR95HF_SELECTMASK_DATARATE ) != ISO15693_TRANSMISSION_26 ) )
+	   ( ( ParameterSelected & CR95HF_SELECTMASK_DATARATE ) != ( ISO15693_TRANSMISSION_26 << 4 ) ) &
+	   ( ( ParameterSelected & CR95HF_SELECTMASK_DATARATE ) != ( ISO15693_TRANSMISSION_53 << 4 ) ) )
 	{
 		return ERRORCODE_GENERIC;
 	}
@@ -457,13 +635,38 @@ int8_t ISO15693_IsCorrectCRC16Residue( const uint8_t *DataIn, const uint8_t Leng
 
 /**
 * @brief  	this function computes the CRC16 as defined by CRC ISO/IEC 13239
+* @brief  	ISO15693_CRC16_METHOD picks the bit by bit loop or a nibble / byte table in flash
 * @param  	DataIn		:	input data
 * @param	NbByte 		: 	Number of byte of DataIn
 * @retval	ResCrc		: 	CRC16 computed
 */
 int16_t ISO15693_CRC16( const uint8_t *DataIn, const uint8_t NbByte )
 {
-	int8_t i, j;
+#if ISO15693_CRC16_METHOD == ISO15693_CRC16_NIBBLE
+	uint8_t i;
+	uint16_t ResCrc = ISO15693_PRELOADCRC16;
+
+	// low nibble first, the CRC is reflected
+	for ( i = 0 ; i < NbByte ; i++ )
+	{
+		ResCrc ^= DataIn[i];
+		ResCrc = ( ResCrc >> 4 ) ^ pgm_read_word( &ISO15693_CRC16Table[ResCrc & 0x0F] );
+		ResCrc = ( ResCrc >> 4 ) ^ pgm_read_word( &ISO15693_CRC16Table[ResCrc & 0x0F] );
+	}
+
+	return ( ~ResCrc & 0xFFFF );
+#elif ISO15693_CRC16_METHOD == ISO15693_CRC16_BYTE
+	uint8_t i;
+	uint16_t ResCrc = ISO15693_PRELOADCRC16;
+
+	for ( i = 0 ; i < NbByte ; i++ )
+	{
+		ResCrc = ( ResCrc >> 8 ) ^ pgm_read_word( &ISO15693_CRC16Table[(uint8_t)ResCrc ^ DataIn[i]] );
+	}
+
+	return ( ~ResCrc & 0xFFFF );
+#else
+	uint8_t i, j;
 	int32_t ResCrc = ISO15693_PRELOADCRC16;
 	
 	for ( i = 0 ; i < NbByte ; i++ )
@@ -483,6 +686,7 @@ int16_t ISO15693_CRC16( const uint8_t *DataIn, const uint8_t NbByte )
 	}
 
 	return ( ~ResCrc & 0xFFFF );
+#endif
 }
 
 
@@ -495,35 +699,538 @@ int16_t ISO15693_CRC16( const uint8_t *DataIn, const uint8_t NbByte )
 int8_t ISO15693_GetUID( uint8_t *UIDout )
 {
 	int8_t FlagsByteData;
-	uint8_t	TagReply[ISO15693_NBBYTE_UID + 5];
+	uint8_t	TagReply[ISO15693_LENGTH_INVENTORYREPLY];
+	uint8_t ParametersByte = ISO15693_RFSettingParameters( RFSetting );
 
 	memset( UIDout, 0x00, ISO15693_NBBYTE_UID );
 	
-	// select 15693 protocol
-	if ( ISO15693_SelectProtocol( ISO15693_TRANSMISSION_26,
+	// select 15693 protocol with the best known RF setting, unless the chip still has it selected
+	if ( !CR95HF_IsProtocolSelected( PROTOCOL_TAG_ISO15693, ParametersByte ) &&
+		 ISO15693_SelectProtocol( RFSettings[RFSetting].DataRate,
 									ISO15693_WAIT_FOR_SOF,
 									ISO15693_MODULATION_100,
-									ISO15693_SINGLE_SUBCARRIER,
+									RFSettings[RFSetting].SubCarrier,
 									ISO15693_APPENDCRC ) != CR95HF_SUCCESS_CODE )
 	{
 		return ERRORCODE_GENERIC;
 	}
 							
-	FlagsByteData = ISO15693_CreateRequestFlag( ISO15693_REQFLAG_SINGLESUBCARRIER,
-												ISO15693_REQFLAG_HIGHDATARATE,
-												ISO15693_REQFLAG_INVENTORYFLAGSET,
-												ISO15693_REQFLAG_NOPROTOCOLEXTENSION,
-												ISO15693_REQFLAG_NOTAFI,
-												ISO15693_REQFLAG_1SLOT,
-												ISO15693_REQFLAG_OPTIONFLAGNOTSET,
-												ISO15693_REQFLAG_RFUNOTSET );
+	FlagsByteData = ISO15693_RFSettingFlags( RFSetting, ISO15693_REQFLAG_1SLOT );
 	
-	if ( ISO15693_Inventory( FlagsByteData, 0x00, 0x00, 0x00, ISO15693_APPENDCRC, 0x00, TagReply ) != RESULTOK )
+	if ( ISO15693_Inventory( FlagsByteData, 0x00, 0x00, 0x00, ISO15693_APPENDCRC, 0x00, TagReply, sizeof( TagReply ) ) != RESULTOK ||
+		 ISO15693_IsRFError( TagReply ) )
 	{
+		// a collision or a bad CRC is no UID
 		return ERRORCODE_GENERIC;
 	}
 
 	memcpy( UIDout, &(TagReply[TAGREPPLY_OFFSET_UID]), ISO15693_NBBYTE_UID );
 
 	return RESULTOK;
+}
+
+
+/**
+* @brief  	this function starts the same inventory as ISO15693_GetUID() and returns at once.
+* @brief  	Each CR95HF command completes from the scheduler, so other tasks keep running
+* @brief  	while the reader talks to the tag.
+* @param  	callback	: 	called with RESULTOK and the UID, or ERRORCODE_GENERIC and NULL
+* @retval 	RESULTOK	: 	the inventory was started
+* @retval 	ERRORCODE_GENERIC	: 	 the reader is busy
+*/
+int8_t ISO15693_GetUIDAsync( ISO15693_UIDCallback callback )
+{
+	if ( AsyncState != ISO15693_ASYNC_IDLE || CR95HF_IsBusy() )
+	{
+		return ERRORCODE_GENERIC;
+	}
+
+	AsyncUIDCallback = callback;
+	AsyncInventoryCallback = NULL;
+
+	return ISO15693_StartAsync();
+}
+
+
+/**
+* @brief  	this function starts a 16 slots inventory with anticollision and returns at once.
+* @brief  	Colliding slots are resolved by extending the mask one nibble at a time until
+* @brief  	every tag answered alone, or ISO15693_MAX_INVENTORY_UIDS UIDs were found.
+* @param  	callback	: 	called with RESULTOK and the UIDs found, or ERRORCODE_GENERIC if none
+* @retval 	RESULTOK	: 	the inventory was started
+* @retval 	ERRORCODE_GENERIC	: 	 the reader is busy
+*/
+int8_t ISO15693_InventoryAsync( ISO15693_InventoryCallback callback )
+{
+	if ( AsyncState != ISO15693_ASYNC_IDLE || CR95HF_IsBusy() )
+	{
+		return ERRORCODE_GENERIC;
+	}
+
+	AsyncUIDCallback = NULL;
+	AsyncInventoryCallback = callback;
+
+	return ISO15693_StartAsync();
+}
+
+
+// Select the protocol if needed, then send the first inventory request
+static int8_t ISO15693_StartAsync( void )
+{
+	AsyncNbUID = 0;
+	scheduler_timeout_start_timer( &ScanStopwatch );
+
+	AsyncSetting = RFSetting;
+	AsyncProbe = false;
+
+	// Once in a while see if the badges in use got along with a faster setting
+	if ( RFAdaptive && RFSetting > 0 && RFSuccessRun >= ISO15693_RFPROBE_INTERVAL )
+	{
+		AsyncSetting = RFSetting - 1;
+		AsyncProbe = true;
+		RFSuccessRun = 0;
+	}
+
+	if ( ISO15693_StartAttempt() != RESULTOK )
+	{
+		scheduler_timeout_stop_timer( &ScanStopwatch );
+		AsyncState = ISO15693_ASYNC_IDLE;
+		return ERRORCODE_GENERIC;
+	}
+
+	return RESULTOK;
+}
+
+
+// Run the inventory with the RF setting AsyncSetting
+static int8_t ISO15693_StartAttempt( void )
+{
+	AsyncParametersByte = ISO15693_RFSettingParameters( AsyncSetting );
+	AsyncRFErrors = 0;
+	AttemptSPIBytes = SPI_GetByteCount();
+	scheduler_timeout_start_timer( &AttemptStopwatch );
+
+	// One RF transaction per scan while the chip keeps the protocol selected
+	if ( CR95HF_IsProtocolSelected( PROTOCOL_TAG_ISO15693, AsyncParametersByte ) )
+	{
+		if ( ISO15693_GetUIDAsyncInventory() != RESULTOK )
+		{
+			scheduler_timeout_stop_timer( &AttemptStopwatch );
+			return ERRORCODE_GENERIC;
+		}
+
+		return RESULTOK;
+	}
+
+	CR95HF_BuildProtocolSelect( ISO15693_SELECTLENGTH, ISO15693_PROTOCOL, &AsyncParametersByte, AsyncCommand );
+
+	AsyncState = ISO15693_ASYNC_SELECT;
+	ScanTiming.ProtocolSelects++;
+
+	if ( CR95HF_SendReceiveAsync( AsyncCommand, AsyncReply, sizeof( AsyncReply ), CR95HF_RESPONSE_TIMEOUT, ISO15693_GetUIDAsyncStep ) != CR95HF_SUCCESS_CODE )
+	{
+		scheduler_timeout_stop_timer( &AttemptStopwatch );
+		return ERRORCODE_GENERIC;
+	}
+
+	return RESULTOK;
+}
+
+
+/**
+* @brief  	this function sets the data rate / subcarrier used by the inventories
+* @param  	Setting		: 	ISO15693_RFSETTING_xxx, the last setting that worked (e.g. saved in EEPROM)
+* @param  	Adaptive	: 	if true the setting moves to a slower one when the replies can not be
+* @brief  	decoded, and every ISO15693_RFPROBE_INTERVAL good scans one step faster is tried
+*/
+void ISO15693_SetRFSetting( const uint8_t Setting, const bool Adaptive )
+{
+	if ( Setting < ISO15693_NB_RFSETTINGS )
+	{
+		RFSetting = Setting;
+	}
+	RFAdaptive = Adaptive;
+	RFSuccessRun = 0;
+}
+
+
+/**
+* @brief  	this function returns the best known RF setting
+* @retval 	ISO15693_RFSETTING_xxx
+*/
+uint8_t ISO15693_GetRFSetting( void )
+{
+	return RFSetting;
+}
+
+
+/**
+* @brief  	this function returns the data rate and subcarrier of an RF setting
+* @param  	Setting		: 	ISO15693_RFSETTING_xxx
+* @param  	DataRate	: 	ISO15693_TRANSMISSION_xxx
+* @param  	SubCarrier	: 	ISO15693_SINGLE_SUBCARRIER or ISO15693_DUAL_SUBCARRIER
+*/
+void ISO15693_GetRFSettingParameters( const uint8_t Setting, uint8_t *DataRate, uint8_t *SubCarrier )
+{
+	*DataRate = RFSettings[Setting].DataRate;
+	*SubCarrier = RFSettings[Setting].SubCarrier;
+}
+
+
+/**
+* @brief  	this function returns the results of the asynchronous inventories run with an RF setting
+* @param  	Setting		: 	ISO15693_RFSETTING_xxx
+* @retval 	pointer on the counters
+*/
+const ISO15693_RFStatsStruct *ISO15693_GetRFStats( const uint8_t Setting )
+{
+	return &RFStats[Setting];
+}
+
+
+// ProtocolSelect parameter byte of an RF setting
+static uint8_t ISO15693_RFSettingParameters( const uint8_t Setting )
+{
+	return ISO15693_SelectParameters( RFSettings[Setting].DataRate,
+									  ISO15693_WAIT_FOR_SOF,
+									  ISO15693_MODULATION_100,
+									  RFSettings[Setting].SubCarrier,
+									  ISO15693_APPENDCRC );
+}
+
+
+// Inventory request flags matching the ProtocolSelect of an RF setting
+static int8_t ISO15693_RFSettingFlags( const uint8_t Setting, const uint8_t NbSlotFlag )
+{
+	return ISO15693_CreateRequestFlag( ( RFSettings[Setting].SubCarrier == ISO15693_DUAL_SUBCARRIER ) ?
+										ISO15693_REQFLAG_TWOSUBCARRIER : ISO15693_REQFLAG_SINGLESUBCARRIER,
+									   ( RFSettings[Setting].DataRate == ISO15693_TRANSMISSION_6 ) ?
+										ISO15693_REQFLAG_LOWDATARATE : ISO15693_REQFLAG_HIGHDATARATE,
+									   ISO15693_REQFLAG_INVENTORYFLAGSET,
+									   ISO15693_REQFLAG_NOPROTOCOLEXTENSION,
+									   ISO15693_REQFLAG_NOTAFI,
+									   NbSlotFlag,
+									   ISO15693_REQFLAG_OPTIONFLAGNOTSET,
+									   ISO15693_REQFLAG_RFUNOTSET );
+}
+
+
+// true if a tag answered but its reply could not be decoded, a hint the RF setting is too fast
+static bool ISO15693_IsRFError( const uint8_t *pResponse )
+{
+	uint8_t ResultCode = pResponse[READERREPLY_STATUSOFFSET];
+	uint8_t Length = pResponse[CR95HF_LENGTH_OFFSET];
+
+	if ( ResultCode == SENDRECV_RESULTSCODE_OK )
+	{
+		// the last byte is the control byte
+		return ( Length != 0 ) &&
+			   ( pResponse[CR95HF_DATA_OFFSET + Length - 1] & ( CONTROL_15693_COLISIONMASK | CONTROL_15693_CRCMASK ) );
+	}
+
+	// no reply at all (frame wait time out) is an empty field
+	return ( ResultCode >= SENDRECV_ERRORCODE_COMERROR ) && ( ResultCode <= SENDRECV_ERRORCODE_RECEPTIONLOST ) &&
+		   ( ResultCode != SENDRECV_ERRORCODE_FRAMEWAIT );
+}
+
+
+/**
+* @brief  	this function returns the duration of the scans run by ISO15693_GetUIDAsync()
+* @retval 	pointer on the scan timing counters
+*/
+const ISO15693_ScanTimingStruct *ISO15693_GetScanTiming( void )
+{
+	return &ScanTiming;
+}
+
+
+static absolutetime_t ISO15693_ScanStopwatchExpired( void *payload )
+{
+	return 0;
+}
+
+
+// Send the 1 slot inventory of ISO15693_GetUIDAsync(), or the first 16 slots request of ISO15693_InventoryAsync()
+static int8_t ISO15693_GetUIDAsyncInventory( void )
+{
+	int8_t FlagsByteData;
+	uint8_t NbByte;
+
+	if ( AsyncInventoryCallback != NULL )
+	{
+		AsyncLevel = 0;
+		return ISO15693_AnticollisionRequest();
+	}
+
+	FlagsByteData = ISO15693_RFSettingFlags( AsyncSetting, ISO15693_REQFLAG_1SLOT );
+
+	// the frame is built in place, after the command and length bytes
+	if ( ISO15693_BuildInventory( FlagsByteData, 0x00, 0x00, 0x00, ISO15693_APPENDCRC, 0x00,
+								  &AsyncCommand[CR95HF_DATA_OFFSET], &NbByte ) != RESULTOK )
+	{
+		return ERRORCODE_GENERIC;
+	}
+	AsyncCommand[CR95HF_COMMAND_OFFSET] = SEND_RECEIVE;
+	AsyncCommand[CR95HF_LENGTH_OFFSET] = NbByte;
+
+	AsyncState = ISO15693_ASYNC_INVENTORY;
+	if ( CR95HF_SendReceiveAsync( AsyncCommand, AsyncReply, sizeof( AsyncReply ), CR95HF_RESPONSE_TIMEOUT, ISO15693_GetUIDAsyncStep ) != CR95HF_SUCCESS_CODE )
+	{
+		return ERRORCODE_GENERIC;
+	}
+
+	return RESULTOK;
+}
+
+
+/**
+* @brief  	this function returns true while ISO15693_GetUIDAsync() is running
+*/
+bool ISO15693_IsBusy( void )
+{
+	return AsyncState != ISO15693_ASYNC_IDLE;
+}
+
+
+static void ISO15693_GetUIDAsyncDone( int8_t status )
+{
+	bool Found = ( AsyncInventoryCallback != NULL ) ? ( AsyncNbUID != 0 ) : ( status == RESULTOK );
+	uint8_t Retry;
+	absolutetime_t elapsed;
+
+	// RTC ticks of 1/1024 s, close enough to ms
+	RFStats[AsyncSetting].Attempts++;
+	RFStats[AsyncSetting].AirTime += scheduler_timeout_stop_timer( &AttemptStopwatch );
+	RFStats[AsyncSetting].SPIBytes += SPI_GetByteCount() - AttemptSPIBytes;
+
+	if ( Found )
+	{
+		RFStats[AsyncSetting].Successes++;
+		RFSetting = AsyncSetting;
+		if ( RFSuccessRun < ISO15693_RFPROBE_INTERVAL )
+		{
+			RFSuccessRun++;
+		}
+	}
+	else if ( RFAdaptive && ( AsyncRFErrors != 0 || AsyncProbe ) )
+	{
+		// The tag was there but could not be read, or the faster setting got no answer:
+		// try again at once one step slower, so the badge does not have to be presented again
+		Retry = AsyncProbe ? RFSetting : AsyncSetting + 1;
+		if ( Retry < ISO15693_NB_RFSETTINGS )
+		{
+			AsyncSetting = Retry;
+			AsyncProbe = false;
+			RFSuccessRun = 0;
+			if ( ISO15693_StartAttempt() == RESULTOK )
+			{
+				return;
+			}
+		}
+	}
+
+	elapsed = scheduler_timeout_stop_timer( &ScanStopwatch );
+
+	ScanTiming.Scans++;
+	ScanTiming.LastTime = ( elapsed > UINT16_MAX ) ? UINT16_MAX : elapsed;
+	ScanTiming.TotalTime += ScanTiming.LastTime;
+	if ( ScanTiming.LastTime > ScanTiming.MaxTime )
+	{
+		ScanTiming.MaxTime = ScanTiming.LastTime;
+	}
+
+	AsyncState = ISO15693_ASYNC_IDLE;
+
+	if ( AsyncInventoryCallback != NULL )
+	{
+		// UIDs found before an error are still reported
+		if ( AsyncNbUID != 0 )
+		{
+			status = RESULTOK;
+		}
+		else if ( status == RESULTOK )
+		{
+			status = ERRORCODE_GENERIC;
+		}
+		AsyncInventoryCallback( status, AsyncNbUID, AsyncUID[0] );
+	}
+	else
+	{
+		AsyncUIDCallback( status, ( status == RESULTOK ) ? AsyncUID[0] : NULL );
+	}
+}
+
+
+// Send the 16 slots inventory request of the current anticollision level
+static int8_t ISO15693_AnticollisionRequest( void )
+{
+	int8_t FlagsByteData;
+	uint8_t NbByte;
+
+	FlagsByteData = ISO15693_RFSettingFlags( AsyncSetting, ISO15693_REQFLAG_16SLOTS );
+
+	if ( ISO15693_BuildInventory( FlagsByteData, 0x00, AsyncLevel * 4, AsyncMask, ISO15693_APPENDCRC, 0x00,
+								  &AsyncCommand[CR95HF_DATA_OFFSET], &NbByte ) != RESULTOK )
+	{
+		return ERRORCODE_GENERIC;
+	}
+	AsyncCommand[CR95HF_COMMAND_OFFSET] = SEND_RECEIVE;
+	AsyncCommand[CR95HF_LENGTH_OFFSET] = NbByte;
+
+	AsyncSlot = 0;
+	AsyncCollisions[AsyncLevel] = 0;
+
+	AsyncState = ISO15693_ASYNC_ANTICOLLISION;
+	if ( CR95HF_SendReceiveAsync( AsyncCommand, AsyncReply, sizeof( AsyncReply ), CR95HF_RESPONSE_TIMEOUT, ISO15693_GetUIDAsyncStep ) != CR95HF_SUCCESS_CODE )
+	{
+		return ERRORCODE_GENERIC;
+	}
+
+	return RESULTOK;
+}
+
+
+// Sort the reply of one slot: no tag, one tag or a collision
+static void ISO15693_AnticollisionSlot( const uint8_t *pResponse )
+{
+	const uint8_t *TagReply = &pResponse[CR95HF_DATA_OFFSET];
+	uint8_t NthUID;
+
+	if ( pResponse[READERREPLY_STATUSOFFSET] == SENDRECV_ERRORCODE_FRAMEWAIT )
+	{
+		// no tag in this slot
+		return;
+	}
+
+	if ( ( pResponse[READERREPLY_STATUSOFFSET] != SENDRECV_RESULTSCODE_OK ) ||
+		 ( pResponse[CR95HF_LENGTH_OFFSET] != ISO15693_LENGTH_INVENTORYREPLY - CR95HF_DATA_OFFSET ) ||
+		 ( TagReply[ISO15693_OFFSET_FLAGS] & ISO15693_MASK_ERRORFLAG ) ||
+		 ( TagReply[ISO15693_LENGTH_INVENTORYREPLY - CR95HF_DATA_OFFSET - 1] & ( CONTROL_15693_COLISIONMASK | CONTROL_15693_CRCMASK ) ) )
+	{
+		// several tags answered in this slot, or a reply got garbled: look again with a longer mask
+		AsyncCollisions[AsyncLevel] |= ( 1U << AsyncSlot );
+		AsyncRFErrors++;
+		return;
+	}
+
+	for ( NthUID = 0 ; NthUID < AsyncNbUID ; NthUID++ )
+	{
+		if ( memcmp( AsyncUID[NthUID], &pResponse[TAGREPPLY_OFFSET_UID], ISO15693_NBBYTE_UID ) == 0 )
+		{
+			return;
+		}
+	}
+
+	if ( AsyncNbUID < ISO15693_MAX_INVENTORY_UIDS )
+	{
+		memcpy( AsyncUID[AsyncNbUID++], &pResponse[TAGREPPLY_OFFSET_UID], ISO15693_NBBYTE_UID );
+	}
+}
+
+
+// Send the EOF of the next slot, or start the next level once the 16 slots are done
+static void ISO15693_AnticollisionNext( void )
+{
+	uint8_t Slot;
+
+	if ( ++AsyncSlot < ISO15693_NBSLOTS_ANTICOLLISION )
+	{
+		AsyncCommand[CR95HF_COMMAND_OFFSET] = SEND_RECEIVE;
+		AsyncCommand[CR95HF_LENGTH_OFFSET] = SENDRECV_EOF_LENGTH;
+
+		if ( CR95HF_SendReceiveAsync( AsyncCommand, AsyncReply, sizeof( AsyncReply ), CR95HF_RESPONSE_TIMEOUT, ISO15693_GetUIDAsyncStep ) != CR95HF_SUCCESS_CODE )
+		{
+			ISO15693_GetUIDAsyncDone( ERRORCODE_GENERIC );
+		}
+		return;
+	}
+
+	// depth first: go down into the first slot that collided, climb back up when a level is done
+	while ( AsyncCollisions[AsyncLevel] == 0 || AsyncNbUID >= ISO15693_MAX_INVENTORY_UIDS ||
+			AsyncLevel + 1 >= ISO15693_NBLEVELS_ANTICOLLISION )
+	{
+		if ( AsyncLevel == 0 )
+		{
+			ISO15693_GetUIDAsyncDone( RESULTOK );
+			return;
+		}
+		AsyncLevel--;
+	}
+
+	for ( Slot = 0 ; ( AsyncCollisions[AsyncLevel] & ( 1U << Slot ) ) == 0 ; Slot++ );
+	AsyncCollisions[AsyncLevel] &= ~( 1U << Slot );
+
+	// the UID goes out LSB first, so level n is nibble n of the mask
+	if ( AsyncLevel & 0x01 )
+	{
+		AsyncMask[AsyncLevel / 2] = ( AsyncMask[AsyncLevel / 2] & 0x0F ) | ( Slot << 4 );
+	}
+	else
+	{
+		AsyncMask[AsyncLevel / 2] = ( AsyncMask[AsyncLevel / 2] & 0xF0 ) | Slot;
+	}
+	AsyncLevel++;
+
+	if ( ISO15693_AnticollisionRequest() != RESULTOK )
+	{
+		ISO15693_GetUIDAsyncDone( ERRORCODE_GENERIC );
+	}
+}
+
+
+// Called from the scheduler each time the CR95HF answers one command of the inventory
+static void ISO15693_GetUIDAsyncStep( int8_t status, uint8_t *pResponse )
+{
+	if ( status != CR95HF_SUCCESS_CODE )
+	{
+		ISO15693_GetUIDAsyncDone( ERRORCODE_GENERIC );
+		return;
+	}
+
+	switch ( AsyncState )
+	{
+		case ISO15693_ASYNC_SELECT:
+			if ( CR95HF_IsReaderResultCodeOk( PROTOCOL_SELECT, pResponse ) != CR95HF_SUCCESS_CODE )
+			{
+				// the chip refused this RF setting, let the adaptive setting move on
+				AsyncRFErrors++;
+				ISO15693_GetUIDAsyncDone( ERRORCODE_GENERIC );
+				return;
+			}
+
+			// save the parameter of protocol in order to check coherence with request flag
+			GloParameterSelected = AsyncParametersByte;
+
+			if ( ISO15693_GetUIDAsyncInventory() != RESULTOK )
+			{
+				ISO15693_GetUIDAsyncDone( ERRORCODE_GENERIC );
+			}
+			break;
+
+		case ISO15693_ASYNC_INVENTORY:
+			if ( ISO15693_IsRFError( pResponse ) )
+			{
+				AsyncRFErrors++;
+			}
+
+			if ( ( CR95HF_IsReaderResultCodeOk( SEND_RECEIVE, pResponse ) != CR95HF_SUCCESS_CODE ) ||
+				 ( pResponse[CR95HF_LENGTH_OFFSET] < TAGREPPLY_OFFSET_UID - CR95HF_DATA_OFFSET + ISO15693_NBBYTE_UID ) ||
+				 ( AsyncRFErrors != 0 ) )
+			{
+				ISO15693_GetUIDAsyncDone( ERRORCODE_GENERIC );
+				return;
+			}
+
+			memcpy( AsyncUID[0], &(pResponse[TAGREPPLY_OFFSET_UID]), ISO15693_NBBYTE_UID );
+			ISO15693_GetUIDAsyncDone( RESULTOK );
+			break;
+
+		case ISO15693_ASYNC_ANTICOLLISION:
+			ISO15693_AnticollisionSlot( pResponse );
+			ISO15693_AnticollisionNext();
+			break;
+
+		default:
+			break;
+	}
 }
\ No newline at end of file
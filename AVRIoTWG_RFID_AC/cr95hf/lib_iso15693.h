@@ -59,6 +59,13 @@
 #define ISO15693_POLYCRC16 						0x8408
 #define ISO15693_MASKCRC16 						0x0001
 #define ISO15693_RESIDUECRC16 					0xF0B8
+// ISO15693_CRC16() implementation: bit by bit (no table), 32 bytes or 512 bytes of table in flash
+#define ISO15693_CRC16_BITWISE 					0
+#define ISO15693_CRC16_NIBBLE 					1
+#define ISO15693_CRC16_BYTE 					2
+#ifndef ISO15693_CRC16_METHOD
+#define ISO15693_CRC16_METHOD 					ISO15693_CRC16_BYTE
+#endif
 
 // byte offset for tag responses
 #define ISO15693_OFFSET_FLAGS			 			0x00
@@ -111,6 +118,17 @@
 #define ISO15693_APPENDCRC  					1
 #define ISO15693_DONTAPPENDCRC     				0
 
+// data rate / subcarrier settings used by the inventories, fastest first
+#define ISO15693_RFSETTING_53_SINGLE			0
+#define ISO15693_RFSETTING_53_DUAL				1
+#define ISO15693_RFSETTING_26_SINGLE			2
+#define ISO15693_RFSETTING_26_DUAL				3
+#define ISO15693_RFSETTING_6_SINGLE				4
+#define ISO15693_RFSETTING_6_DUAL				5
+#define ISO15693_NB_RFSETTINGS					6
+// successful scans before the adaptive setting tries one step faster again
+#define ISO15693_RFPROBE_INTERVAL				32
+
 // 	number of byte of parameters
 #define ISO15693_NBBYTE_UID	 						0x08
 #define ISO15693_NBBYTE_CRC16	 					0x02
@@ -123,6 +141,39 @@
 #define ISO15693_NBBYTE_ICREF			   			0x01
 #define ISO15693_NBBYTE_REQUESTFLAG					0x01
 
+// anticollision
+#define ISO15693_NBSLOTS_ANTICOLLISION				16
+#ifndef ISO15693_MAX_INVENTORY_UIDS
+#define ISO15693_MAX_INVENTORY_UIDS					8		// UIDs kept by ISO15693_InventoryAsync()
+#endif
+
+
+/******************************************************************************/
+/*                             Typedefs/Enums                                 */
+/******************************************************************************/
+// Completion of ISO15693_GetUIDAsync(), UIDout is NULL unless status is RESULTOK
+typedef void (*ISO15693_UIDCallback)( int8_t status, const uint8_t *UIDout );
+
+// Completion of ISO15693_InventoryAsync(), UIDs holds NbUID UIDs of ISO15693_NBBYTE_UID bytes each
+typedef void (*ISO15693_InventoryCallback)( int8_t status, uint8_t NbUID, const uint8_t *UIDs );
+
+// Duration of the scans run by ISO15693_GetUIDAsync(), times in ms
+typedef struct {
+	uint16_t	Scans;
+	uint16_t	ProtocolSelects;	// scans that had to select the protocol first
+	uint16_t	LastTime;
+	uint16_t	MaxTime;
+	uint32_t	TotalTime;
+} ISO15693_ScanTimingStruct;
+
+// Inventories run with one data rate / subcarrier setting, air time in ms
+typedef struct {
+	uint16_t	Attempts;
+	uint16_t	Successes;		// attempts that read at least one UID
+	uint32_t	AirTime;
+	uint32_t	SPIBytes;		// bytes exchanged with the CR95HF
+} ISO15693_RFStatsStruct;
+
 
 /******************************************************************************/
 /*                             Public Functions                               */
@@ -137,10 +188,18 @@ int8_t ISO15693_SelectProtocol( const uint8_t DataRate, const uint8_t TimeOrSOF,
 int8_t ISO15693_Inventory( const uint8_t Flags, const uint8_t AFI,
 						   const uint8_t MaskLength, const uint8_t *MaskValue,
 						   const uint8_t AppendCRC, const uint8_t *CRC16,
-						   uint8_t *pResponse );
+						   uint8_t *pResponse, uint16_t ResponseSize );
 int8_t ISO15693_SplitInventoryResponse( const uint8_t *ReaderResponse, const uint8_t Length,
 										uint8_t *Flags, uint8_t *DSFIDextract, uint8_t *UIDoutIndex );
 int8_t ISO15693_GetUID( uint8_t *UIDout );
+int8_t ISO15693_GetUIDAsync( ISO15693_UIDCallback callback );
+int8_t ISO15693_InventoryAsync( ISO15693_InventoryCallback callback );
+bool ISO15693_IsBusy( void );
+const ISO15693_ScanTimingStruct *ISO15693_GetScanTiming( void );
+void ISO15693_SetRFSetting( const uint8_t Setting, const bool Adaptive );
+uint8_t ISO15693_GetRFSetting( void );
+void ISO15693_GetRFSettingParameters( const uint8_t Setting, uint8_t *DataRate, uint8_t *SubCarrier );
+const ISO15693_RFStatsStruct *ISO15693_GetRFStats( const uint8_t Setting );
 
 int8_t ISO15693_IsInventoryFlag( const uint8_t FlagsByte );
 int8_t ISO15693_GetSubCarrierFlag( const uint8_t FlagsByte );
@@ -27,6 +27,7 @@
 
 #include <stdint.h>
 #include <string.h>
+#include <avr/io.h>
 #include <avr/eeprom.h>
 #include <string.h>
 #include <stdlib.h>
@@ -37,6 +38,7 @@
 #define EEPROM_PSW EEPROM_SSID + MAX_WIFI_CREDENTIALS_LENGTH
 #define EEPROM_SEC EEPROM_PSW + MAX_WIFI_CREDENTIALS_LENGTH
 #define EEPROM_DBG EEPROM_SEC + 1
+#define EEPROM_RF (EEPROM_SIZE - 1) // last byte, after the access list
 
 char ssid[MAX_WIFI_CREDENTIALS_LENGTH];
 char pass[MAX_WIFI_CREDENTIALS_LENGTH];
@@ -52,6 +54,17 @@ void CREDENTIALS_STORAGE_setDebugSeverity(uint8_t s)
 	eeprom_write_byte((uint8_t *)EEPROM_DBG, s);
 }
 
+uint8_t CREDENTIALS_STORAGE_getRfSetting(void)
+{
+	return eeprom_read_byte((uint8_t *)EEPROM_RF);
+}
+
+void CREDENTIALS_STORAGE_setRfSetting(uint8_t s)
+{
+	// Called after every scan, only write when the setting changed
+	eeprom_update_byte((uint8_t *)EEPROM_RF, s);
+}
+
 /**
  * \brief Read WiFi SSID and password from EEPROM
  *
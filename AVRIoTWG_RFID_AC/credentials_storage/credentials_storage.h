@@ -38,5 +38,7 @@ void    CREDENTIALS_STORAGE_read(char *ssidbuf, char *passwordbuf, char *sec);
 void    CREDENTIALS_STORAGE_save(char *ssidbuf, char *passwordbuf, char *sec);
 uint8_t CREDENTIALS_STORAGE_getDebugSeverity(void);
 void    CREDENTIALS_STORAGE_setDebugSeverity(uint8_t s);
+uint8_t CREDENTIALS_STORAGE_getRfSetting(void);
+void    CREDENTIALS_STORAGE_setRfSetting(uint8_t s);
 
 #endif /* CREDENTIALS_STORAGE_H */
@@ -0,0 +1,610 @@
+/*
+ * event_log.c
+ *
+ * The flash is an append-only log of 16 byte slots. The first slot of every
+ * sector holds a header with a sequence number, the others one tap each.
+ * Taps are written at the head and published from the tail, in order. A
+ * published tap is marked by clearing its state byte, which needs no erase.
+ *
+ * When the head runs out of a sector it moves on to the next one and erases
+ * it, the oldest sector once the log went around. That way every sector is
+ * erased once per round, and taps not published by then are lost. After a
+ * reset the sector with the highest sequence number holds the head and the
+ * first tap that is not marked is the tail. A tap cut short by a reset fails
+ * its check byte and is skipped.
+ *
+ * Published taps are in flight until the PUBACK of their message, only then
+ * do they count as sent and get marked by the next sync. Taps in flight are
+ * always the oldest ones not sent, the stored ones in front of those from
+ * RAM, so a count of each is enough to know which taps a PUBACK is for.
+ */
+
+#include <string.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "event_log.h"
+#include "event_log_flash.h"
+#include "debug_print.h"
+
+#ifdef UNIX_OFFSET
+#define EVENT_LOG_UNIX_OFFSET UNIX_OFFSET // avr-libc counts from 2000
+#else
+#define EVENT_LOG_UNIX_OFFSET 0
+#endif
+
+#define EVENT_LOG_MAGIC 0x474F4C45 // "ELOG"
+#define EVENT_LOG_STORED 0xA5
+#define EVENT_LOG_SENT 0x00
+
+typedef struct {
+	uint8_t  uid[ACCESS_LIST_UID_LENGTH];
+	uint32_t time;
+	uint8_t  granted;
+} event_log_entry_t;
+
+typedef struct {
+	uint8_t  uid[ACCESS_LIST_UID_LENGTH];
+	uint32_t time;
+	uint8_t  granted;
+	uint8_t  check;
+	uint8_t  state;
+	uint8_t  reserved;
+} event_log_record_t;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t sequence;
+	uint8_t  reserved[8];
+} event_log_header_t;
+
+#define EVENT_LOG_RECORD_SIZE sizeof( event_log_record_t )
+#define EVENT_LOG_SECTOR_SLOTS ( EVENT_LOG_FLASH_SECTOR_SIZE / EVENT_LOG_RECORD_SIZE )
+#define EVENT_LOG_SLOTS ( EVENT_LOG_FLASH_SECTORS * EVENT_LOG_SECTOR_SLOTS )
+
+static event_log_entry_t eventLogPending[EVENT_LOG_PENDING_ENTRIES];
+static event_log_entry_t eventLogBatch[EVENT_LOG_BATCH_ENTRIES];
+static uint8_t           eventLogPendingCount    = 0;
+static uint8_t           eventLogBatchCount      = 0;
+static uint8_t           eventLogBatchSent       = 0; // acknowledged, marked in flash by the next sync
+static uint8_t           eventLogInFlightStored  = 0; // published from the batch, behind the ones sent
+static uint8_t           eventLogInFlightPending = 0; // published from RAM, at the start of eventLogPending
+static uint8_t           eventLogInFlight[EVENT_LOG_INFLIGHT_MESSAGES]; // taps per message, oldest first
+static uint8_t           eventLogInFlightHead    = 0;
+static uint8_t           eventLogInFlightCount   = 0;
+static bool              eventLogMore            = false; // taps left in flash after the batch
+static bool              eventLogReadRequested   = false; // by EVENT_LOG_needsSync(), until the sync
+static bool              eventLogMounted         = false;
+static uint16_t          eventLogHead; // slot written next
+static uint16_t          eventLogTail; // oldest slot not marked as published
+static uint32_t          eventLogSequence; // of the sector holding the head
+static uint16_t          eventLogDropped = 0;
+
+static uint16_t eventLogNext( uint16_t slot )
+{
+	slot = ( slot + 1 ) % EVENT_LOG_SLOTS;
+
+	// Skip the sector header
+	if ( slot % EVENT_LOG_SECTOR_SLOTS == 0 )
+	{
+		slot++;
+	}
+	return slot;
+}
+
+static uint8_t eventLogCheck( const event_log_record_t *record )
+{
+	const uint8_t *data  = (const uint8_t *)record;
+	uint8_t        check = 0x5A;
+	uint8_t        i;
+
+	for ( i = 0 ; i < offsetof( event_log_record_t, check ) ; i++ )
+	{
+		check += data[i];
+	}
+	return check;
+}
+
+static bool eventLogIsFree( const event_log_record_t *record )
+{
+	const uint8_t *data = (const uint8_t *)record;
+	uint8_t        i;
+
+	for ( i = 0 ; i < EVENT_LOG_RECORD_SIZE ; i++ )
+	{
+		if ( data[i] != 0xFF )
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool eventLogIsStored( const event_log_record_t *record )
+{
+	return record->state == EVENT_LOG_STORED && record->check == eventLogCheck( record );
+}
+
+static bool eventLogRead( uint16_t slot, void *data )
+{
+	return event_log_flash_read( (uint32_t)slot * EVENT_LOG_RECORD_SIZE, data, EVENT_LOG_RECORD_SIZE );
+}
+
+static bool eventLogStartSector( uint8_t sector )
+{
+	event_log_header_t header;
+	uint32_t           offset = sector * EVENT_LOG_FLASH_SECTOR_SIZE;
+
+	memset( &header, 0xFF, sizeof( header ) );
+	header.magic    = EVENT_LOG_MAGIC;
+	header.sequence = ++eventLogSequence;
+
+	return event_log_flash_erase( offset ) && event_log_flash_write( offset, (uint8_t *)&header, sizeof( header ) );
+}
+
+// Move the head past the slot just written
+static bool eventLogAdvanceHead( void )
+{
+	uint16_t next   = eventLogNext( eventLogHead );
+	uint8_t  sector = next / EVENT_LOG_SECTOR_SLOTS;
+
+	if ( next % EVENT_LOG_SECTOR_SLOTS == 1 )
+	{
+		// The log went around, taps still waiting in the oldest sector are lost
+		if ( eventLogTail / EVENT_LOG_SECTOR_SLOTS == sector )
+		{
+			uint32_t dropped = eventLogDropped + EVENT_LOG_SECTOR_SLOTS - eventLogTail % EVENT_LOG_SECTOR_SLOTS;
+
+			eventLogDropped = ( dropped > UINT16_MAX ) ? UINT16_MAX : dropped;
+			eventLogTail    = ( ( sector + 1 ) % EVENT_LOG_FLASH_SECTORS ) * EVENT_LOG_SECTOR_SLOTS + 1;
+		}
+
+		if ( !eventLogStartSector( sector ) )
+		{
+			return false;
+		}
+	}
+
+	eventLogHead = next;
+	return true;
+}
+
+static bool eventLogMount( void )
+{
+	event_log_header_t header;
+	event_log_record_t record;
+	uint16_t           validSectors = 0;
+	uint8_t            headSector   = 0;
+	uint16_t           headEnd;
+	uint16_t           slot;
+	uint8_t            sector;
+	uint8_t            i;
+	bool               found = false;
+
+	eventLogSequence = 0;
+	for ( sector = 0 ; sector < EVENT_LOG_FLASH_SECTORS ; sector++ )
+	{
+		if ( !eventLogRead( sector * EVENT_LOG_SECTOR_SLOTS, &header ) )
+		{
+			return false;
+		}
+		if ( header.magic == EVENT_LOG_MAGIC )
+		{
+			validSectors |= 1U << sector;
+			if ( header.sequence > eventLogSequence )
+			{
+				eventLogSequence = header.sequence;
+				headSector       = sector;
+			}
+		}
+	}
+
+	if ( validSectors == 0 )
+	{
+		// Blank flash, start with the first sector
+		eventLogHead = 1;
+		eventLogTail = 1;
+		return eventLogStartSector( 0 );
+	}
+
+	// The head is the first free slot of the newest sector
+	for ( headEnd = headSector * EVENT_LOG_SECTOR_SLOTS + 1 ; headEnd % EVENT_LOG_SECTOR_SLOTS != 0 ; headEnd++ )
+	{
+		if ( !eventLogRead( headEnd, &record ) )
+		{
+			return false;
+		}
+		if ( eventLogIsFree( &record ) )
+		{
+			break;
+		}
+	}
+
+	// Starting from the oldest sector, skip the ones whose last tap was published already
+	for ( i = 1 ; i <= EVENT_LOG_FLASH_SECTORS && !found ; i++ )
+	{
+		uint16_t end;
+
+		sector = ( headSector + i ) % EVENT_LOG_FLASH_SECTORS;
+		end    = ( sector == headSector ) ? headEnd : ( sector + 1 ) * EVENT_LOG_SECTOR_SLOTS;
+
+		if ( ( validSectors & ( 1U << sector ) ) == 0 )
+		{
+			continue;
+		}
+		if ( sector != headSector )
+		{
+			if ( !eventLogRead( end - 1, &record ) )
+			{
+				return false;
+			}
+			if ( record.state == EVENT_LOG_SENT && record.check == eventLogCheck( &record ) )
+			{
+				continue;
+			}
+		}
+
+		for ( slot = sector * EVENT_LOG_SECTOR_SLOTS + 1 ; slot < end && !found ; slot++ )
+		{
+			if ( !eventLogRead( slot, &record ) )
+			{
+				return false;
+			}
+			if ( eventLogIsStored( &record ) )
+			{
+				eventLogTail = slot;
+				found        = true;
+			}
+		}
+	}
+
+	if ( headEnd % EVENT_LOG_SECTOR_SLOTS != 0 )
+	{
+		eventLogHead = headEnd;
+		if ( !found )
+		{
+			eventLogTail = eventLogHead;
+		}
+		return true;
+	}
+
+	// The newest sector is full, move on to the next one
+	eventLogHead = headEnd - 1;
+	if ( !found )
+	{
+		eventLogTail = eventLogHead;
+	}
+	if ( !eventLogAdvanceHead() )
+	{
+		return false;
+	}
+	if ( !found )
+	{
+		eventLogTail = eventLogHead;
+	}
+	return true;
+}
+
+static bool eventLogWrite( const event_log_entry_t *entry )
+{
+	event_log_record_t record;
+
+	memcpy( record.uid, entry->uid, ACCESS_LIST_UID_LENGTH );
+	record.time     = entry->time;
+	record.granted  = entry->granted;
+	record.check    = eventLogCheck( &record );
+	record.state    = EVENT_LOG_STORED;
+	record.reserved = 0xFF;
+
+	return event_log_flash_write( (uint32_t)eventLogHead * EVENT_LOG_RECORD_SIZE, (uint8_t *)&record,
+	                              EVENT_LOG_RECORD_SIZE )
+	       && eventLogAdvanceHead();
+}
+
+// Mark the taps of the batch that were published since the last sync
+static bool eventLogMarkSent( void )
+{
+	event_log_record_t record;
+	uint8_t            sent = EVENT_LOG_SENT;
+
+	while ( eventLogBatchSent != 0 && eventLogTail != eventLogHead )
+	{
+		if ( !eventLogRead( eventLogTail, &record ) )
+		{
+			return false;
+		}
+		if ( eventLogIsStored( &record ) )
+		{
+			if ( !event_log_flash_write( (uint32_t)eventLogTail * EVENT_LOG_RECORD_SIZE
+			                                 + offsetof( event_log_record_t, state ),
+			                             &sent, 1 ) )
+			{
+				return false;
+			}
+			eventLogBatchSent--;
+		}
+		eventLogTail = eventLogNext( eventLogTail );
+	}
+
+	eventLogBatchSent = 0;
+	return true;
+}
+
+static bool eventLogLoadBatch( void )
+{
+	event_log_record_t record;
+	uint16_t           slot = eventLogTail;
+
+	eventLogBatchCount = 0;
+	while ( slot != eventLogHead && eventLogBatchCount < EVENT_LOG_BATCH_ENTRIES )
+	{
+		if ( !eventLogRead( slot, &record ) )
+		{
+			return false;
+		}
+		slot = eventLogNext( slot );
+
+		if ( eventLogIsStored( &record ) )
+		{
+			event_log_entry_t *entry = &eventLogBatch[eventLogBatchCount++];
+
+			memcpy( entry->uid, record.uid, ACCESS_LIST_UID_LENGTH );
+			entry->time    = record.time;
+			entry->granted = record.granted;
+		}
+		else if ( eventLogBatchCount == 0 )
+		{
+			// Nothing to publish in front of it, the tail can move on
+			eventLogTail = slot;
+		}
+	}
+
+	eventLogMore = slot != eventLogHead;
+	return true;
+}
+
+static uint16_t eventLogGetStored( void )
+{
+	uint16_t slots   = ( eventLogHead + EVENT_LOG_SLOTS - eventLogTail ) % EVENT_LOG_SLOTS;
+	uint8_t  headers = ( eventLogHead / EVENT_LOG_SECTOR_SLOTS + EVENT_LOG_FLASH_SECTORS
+	                    - eventLogTail / EVENT_LOG_SECTOR_SLOTS )
+	                  % EVENT_LOG_FLASH_SECTORS;
+
+	return slots - headers;
+}
+
+void EVENT_LOG_init( void )
+{
+	eventLogPendingCount    = 0;
+	eventLogBatchCount      = 0;
+	eventLogBatchSent       = 0;
+	eventLogInFlightStored  = 0;
+	eventLogInFlightPending = 0;
+	eventLogInFlightHead    = 0;
+	eventLogInFlightCount   = 0;
+	eventLogMore            = false;
+	eventLogReadRequested   = false;
+	eventLogMounted         = false;
+	eventLogDropped         = 0;
+}
+
+// Keep a tap made while the cloud is unreachable, returns false if it was dropped
+bool EVENT_LOG_append( const uint8_t *uid, time_t timestamp, bool granted )
+{
+	event_log_entry_t *entry;
+
+	if ( eventLogPendingCount == EVENT_LOG_PENDING_ENTRIES )
+	{
+		if ( eventLogDropped < UINT16_MAX )
+		{
+			eventLogDropped++;
+		}
+		return false;
+	}
+
+	entry = &eventLogPending[eventLogPendingCount++];
+	memcpy( entry->uid, uid, ACCESS_LIST_UID_LENGTH );
+	entry->time    = timestamp;
+	entry->granted = granted;
+
+	return true;
+}
+
+// Write the pending taps to flash and read back the next batch. Halts the
+// WINC, only call this right before wifi_reinit().
+void EVENT_LOG_sync( void )
+{
+	uint8_t written = 0;
+	uint8_t moved;
+	bool    opened;
+	bool    ok;
+
+	// Nothing to write and everything stored is in RAM already
+	if ( eventLogMounted && eventLogPendingCount == 0 && eventLogBatchSent == 0 && !eventLogMore )
+	{
+		return;
+	}
+
+	// The taps of the batch that were not published are read back again
+	eventLogBatchCount    = eventLogBatchSent + eventLogInFlightStored;
+	eventLogMore          = false;
+	eventLogReadRequested = false;
+
+	opened = event_log_flash_open();
+	ok     = opened;
+	if ( ok && !eventLogMounted )
+	{
+		ok = eventLogMount();
+	}
+	if ( ok )
+	{
+		ok = eventLogMarkSent();
+	}
+	while ( ok && written < eventLogPendingCount )
+	{
+		ok = eventLogWrite( &eventLogPending[written] );
+		if ( ok )
+		{
+			written++;
+		}
+	}
+	if ( ok )
+	{
+		ok = eventLogLoadBatch();
+	}
+	if ( opened )
+	{
+		event_log_flash_close();
+	}
+
+	eventLogPendingCount -= written;
+	memmove( eventLogPending, &eventLogPending[written], eventLogPendingCount * sizeof( event_log_entry_t ) );
+
+	// Taps in flight from RAM are stored right behind the ones in flight from the batch
+	moved = ( written < eventLogInFlightPending ) ? written : eventLogInFlightPending;
+	eventLogInFlightStored += moved;
+	eventLogInFlightPending -= moved;
+
+	// Find the head and tail again next time
+	eventLogMounted = ok;
+	if ( !ok )
+	{
+		eventLogBatchCount = eventLogBatchSent + eventLogInFlightStored;
+		debug_printError( "LOG: flash access failed" );
+		return;
+	}
+
+	debug_printInfo( "LOG: %u taps stored, %u lost", eventLogGetStored(), eventLogDropped );
+}
+
+// First tap of the batch that was not published, and how many follow it
+static uint8_t eventLogBatchAvailable( uint8_t *first )
+{
+	*first = eventLogBatchSent + eventLogInFlightStored;
+	return ( *first < eventLogBatchCount ) ? eventLogBatchCount - *first : 0;
+}
+
+// {"offline":[["0123456789ABCDEF",time,granted],...]}, the batch read back
+// from flash goes first. Returns the length or 0 if there is nothing to publish,
+// *count is the number of taps in the message.
+uint16_t EVENT_LOG_printJson( char *json, uint16_t size, uint8_t *count )
+{
+	uint8_t  first;
+	uint8_t  fromBatch = eventLogBatchAvailable( &first );
+	uint8_t  available = fromBatch;
+	uint16_t length;
+
+	*count = 0;
+
+	// Every message in flight has to be told apart by its PUBACK
+	if ( eventLogInFlightCount == EVENT_LOG_INFLIGHT_MESSAGES )
+	{
+		return 0;
+	}
+
+	// The taps in RAM are newer than the ones left in flash, they wait for those
+	if ( !eventLogMore )
+	{
+		available += eventLogPendingCount - eventLogInFlightPending;
+	}
+
+	length = snprintf( json, size, "{\"offline\":[" );
+	while ( *count < available && length < size )
+	{
+		const event_log_entry_t *entry = ( *count < fromBatch )
+		                                     ? &eventLogBatch[first + *count]
+		                                     : &eventLogPending[eventLogInFlightPending + *count - fromBatch];
+		uint16_t entryLength;
+
+		// UID is stored in reverse byte order
+		entryLength = snprintf( json + length, size - length, "%s[\"%02X%02X%02X%02X%02X%02X%02X%02X\",%lu,%u]",
+		                        ( *count != 0 ) ? "," : "", entry->uid[7], entry->uid[6], entry->uid[5],
+		                        entry->uid[4], entry->uid[3], entry->uid[2], entry->uid[1], entry->uid[0],
+		                        (unsigned long)( entry->time + EVENT_LOG_UNIX_OFFSET ), entry->granted );
+
+		// Leave room for the closing ]}
+		if ( length + entryLength + 2 >= size )
+		{
+			break;
+		}
+		length += entryLength;
+		( *count )++;
+	}
+
+	if ( *count == 0 )
+	{
+		return 0;
+	}
+
+	return length + snprintf( json + length, size - length, "]}" );
+}
+
+// The count taps of EVENT_LOG_printJson() were published, they are in flight
+// until EVENT_LOG_acknowledge()
+void EVENT_LOG_consume( uint8_t count )
+{
+	uint8_t first;
+	uint8_t fromBatch = eventLogBatchAvailable( &first );
+
+	if ( count == 0 || eventLogInFlightCount == EVENT_LOG_INFLIGHT_MESSAGES )
+	{
+		return;
+	}
+	if ( fromBatch > count )
+	{
+		fromBatch = count;
+	}
+
+	eventLogInFlightStored += fromBatch;
+	eventLogInFlightPending += count - fromBatch;
+	eventLogInFlight[( eventLogInFlightHead + eventLogInFlightCount ) % EVENT_LOG_INFLIGHT_MESSAGES] = count;
+	eventLogInFlightCount++;
+}
+
+// PUBACK handler of the messages of EVENT_LOG_printJson(), the broker
+// acknowledges them in the order they were published
+void EVENT_LOG_acknowledge( void )
+{
+	uint8_t count;
+	uint8_t stored;
+
+	if ( eventLogInFlightCount == 0 )
+	{
+		return;
+	}
+	count                = eventLogInFlight[eventLogInFlightHead];
+	eventLogInFlightHead = ( eventLogInFlightHead + 1 ) % EVENT_LOG_INFLIGHT_MESSAGES;
+	eventLogInFlightCount--;
+
+	stored = ( count < eventLogInFlightStored ) ? count : eventLogInFlightStored;
+	eventLogInFlightStored -= stored;
+	eventLogBatchSent += stored;
+
+	// Published before they got to the flash, they are done
+	count -= stored;
+	if ( count > eventLogInFlightPending )
+	{
+		count = eventLogInFlightPending;
+	}
+	eventLogInFlightPending -= count;
+	eventLogPendingCount -= count;
+	memmove( eventLogPending, &eventLogPending[count], eventLogPendingCount * sizeof( event_log_entry_t ) );
+}
+
+// True once, when the batch was published and acknowledged while more taps
+// wait in flash. Reading them needs another EVENT_LOG_sync(), i.e. a WINC
+// restart, which also ends the connection.
+bool EVENT_LOG_needsSync( void )
+{
+	if ( eventLogMore && !eventLogReadRequested && eventLogInFlightCount == 0
+	     && eventLogBatchSent >= eventLogBatchCount )
+	{
+		eventLogReadRequested = true;
+		return true;
+	}
+	return false;
+}
+
+uint16_t EVENT_LOG_getDropped( void )
+{
+	return eventLogDropped;
+}
@@ -0,0 +1,43 @@
+/*
+ * event_log.h
+ *
+ * Badge reads made while the cloud is unreachable. The door decision is made
+ * locally by the access list, the log keeps each tap (UID, time, decision)
+ * in the WINC flash so the cloud still hears about it once MQTT is back, also
+ * after a reset.
+ *
+ * The WINC flash can only be reached while the WINC is halted, so taps wait
+ * in RAM until EVENT_LOG_sync() runs during the next WINC restart. The same
+ * sync reads back the oldest stored taps, which are published a few per
+ * message after the reconnect. A tap is only marked as published once the
+ * broker acknowledged its message, EVENT_LOG_acknowledge() is the PUBACK
+ * handler of these messages.
+ */
+
+
+#ifndef EVENT_LOG_H_
+#define EVENT_LOG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include "access_list.h"
+
+#define EVENT_LOG_PENDING_ENTRIES 8   // taps waiting in RAM for the next EVENT_LOG_sync()
+#define EVENT_LOG_BATCH_ENTRIES 32    // stored taps read back by one EVENT_LOG_sync(), i.e. per WINC restart
+#define EVENT_LOG_INFLIGHT_MESSAGES 4 // messages published and waiting for their PUBACK
+
+// {"offline":[ + ["0123456789ABCDEF",4294967295,1] per tap, comma separated + ]}
+#define EVENT_LOG_JSON_ENTRIES 4
+#define EVENT_LOG_JSON_SIZE (12 + EVENT_LOG_JSON_ENTRIES * (2 * ACCESS_LIST_UID_LENGTH + 18) + 3)
+
+void     EVENT_LOG_init( void );
+bool     EVENT_LOG_append( const uint8_t *uid, time_t timestamp, bool granted );
+void     EVENT_LOG_sync( void );
+uint16_t EVENT_LOG_printJson( char *json, uint16_t size, uint8_t *count );
+void     EVENT_LOG_consume( uint8_t count );
+void     EVENT_LOG_acknowledge( void );
+bool     EVENT_LOG_needsSync( void );
+uint16_t EVENT_LOG_getDropped( void );
+
+#endif /* EVENT_LOG_H_ */
@@ -0,0 +1,40 @@
+/*
+ * event_log_flash.h
+ *
+ * Storage of the event log: a few sectors of NOR flash. Erasing a sector
+ * sets all of its bytes to 0xFF, writing can only clear bits. On the AVR
+ * this is a reserved region of the WINC SPI flash, which is only reachable
+ * while the WINC is halted in download mode (event_log_flash_winc.c). Built
+ * for any other target the flash is an array in RAM (event_log_flash_host.c),
+ * so the log can run in a host process:
+ *
+ *     gcc -I. -Iinclude -Iutils app.c event_log.c event_log_flash_host.c debug_print.c
+ *
+ * Offsets are relative to the start of the region.
+ */
+
+
+#ifndef EVENT_LOG_FLASH_H_
+#define EVENT_LOG_FLASH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define EVENT_LOG_FLASH_SECTOR_SIZE 4096UL // FLASH_SECTOR_SZ
+#define EVENT_LOG_FLASH_SECTORS 16
+
+// Halts the WINC, wifi_reinit() has to start it again after event_log_flash_close()
+bool event_log_flash_open( void );
+void event_log_flash_close( void );
+bool event_log_flash_read( uint32_t offset, uint8_t *data, uint16_t length );
+bool event_log_flash_write( uint32_t offset, const uint8_t *data, uint16_t length );
+bool event_log_flash_erase( uint32_t offset );
+
+#ifndef __AVR__
+
+// Number of times a sector was erased, to check the wear leveling
+uint32_t event_log_flash_get_erase_count( uint8_t sector );
+
+#endif
+
+#endif /* EVENT_LOG_FLASH_H_ */
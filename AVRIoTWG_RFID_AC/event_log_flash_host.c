@@ -0,0 +1,82 @@
+/*
+ * event_log_flash_host.c
+ *
+ * Flash of the event log for host builds. Behaves like the WINC flash: the
+ * region starts out erased, a write can only clear bits and nothing can be
+ * accessed unless the flash was opened.
+ */
+
+#ifndef __AVR__
+
+#include <string.h>
+#include "event_log_flash.h"
+
+#define EVENT_LOG_FLASH_SIZE ( EVENT_LOG_FLASH_SECTORS * EVENT_LOG_FLASH_SECTOR_SIZE )
+
+static uint8_t  eventLogFlash[EVENT_LOG_FLASH_SIZE];
+static uint32_t eventLogFlashErases[EVENT_LOG_FLASH_SECTORS];
+static bool     eventLogFlashErased = false;
+static bool     eventLogFlashOpen   = false;
+
+bool event_log_flash_open( void )
+{
+	if ( !eventLogFlashErased )
+	{
+		memset( eventLogFlash, 0xFF, sizeof( eventLogFlash ) );
+		eventLogFlashErased = true;
+	}
+
+	eventLogFlashOpen = true;
+	return true;
+}
+
+void event_log_flash_close( void )
+{
+	eventLogFlashOpen = false;
+}
+
+bool event_log_flash_read( uint32_t offset, uint8_t *data, uint16_t length )
+{
+	if ( !eventLogFlashOpen || offset + length > EVENT_LOG_FLASH_SIZE )
+	{
+		return false;
+	}
+
+	memcpy( data, &eventLogFlash[offset], length );
+	return true;
+}
+
+bool event_log_flash_write( uint32_t offset, const uint8_t *data, uint16_t length )
+{
+	uint16_t i;
+
+	if ( !eventLogFlashOpen || offset + length > EVENT_LOG_FLASH_SIZE )
+	{
+		return false;
+	}
+
+	for ( i = 0 ; i < length ; i++ )
+	{
+		eventLogFlash[offset + i] &= data[i];
+	}
+	return true;
+}
+
+bool event_log_flash_erase( uint32_t offset )
+{
+	if ( !eventLogFlashOpen || offset % EVENT_LOG_FLASH_SECTOR_SIZE != 0 || offset >= EVENT_LOG_FLASH_SIZE )
+	{
+		return false;
+	}
+
+	memset( &eventLogFlash[offset], 0xFF, EVENT_LOG_FLASH_SECTOR_SIZE );
+	eventLogFlashErases[offset / EVENT_LOG_FLASH_SECTOR_SIZE]++;
+	return true;
+}
+
+uint32_t event_log_flash_get_erase_count( uint8_t sector )
+{
+	return eventLogFlashErases[sector];
+}
+
+#endif
@@ -0,0 +1,53 @@
+/*
+ * event_log_flash_winc.c
+ *
+ * The event log lives in the last 16 sectors of the application region of the
+ * 8 Mbit WINC flash, which the WINC firmware does not use. The host can only
+ * access the flash while the WINC CPU is halted in download mode, so the log
+ * is only written while the cloud layer restarts the WINC anyway.
+ */
+
+#ifdef __AVR__
+
+#include "event_log_flash.h"
+#include "winc/driver/include/m2m_wifi.h"
+#include "winc/spi_flash/include/spi_flash.h"
+#include "winc/spi_flash/include/spi_flash_map.h"
+
+#define EVENT_LOG_FLASH_OFFSET \
+	( M2M_APP_8M_MEM_FLASH_OFFSET + M2M_APP_8M_MEM_FLASH_SZ - EVENT_LOG_FLASH_SECTORS * FLASH_SECTOR_SZ )
+
+bool event_log_flash_open( void )
+{
+	if ( m2m_wifi_download_mode() != M2M_SUCCESS )
+	{
+		return false;
+	}
+
+	spi_flash_enable( 1 );
+
+	// In Mbit, the region does not exist on the 4 Mbit ATWINC1500
+	return spi_flash_get_size() >= 8;
+}
+
+void event_log_flash_close( void )
+{
+	spi_flash_enable( 0 );
+}
+
+bool event_log_flash_read( uint32_t offset, uint8_t *data, uint16_t length )
+{
+	return spi_flash_read( data, EVENT_LOG_FLASH_OFFSET + offset, length ) == M2M_SUCCESS;
+}
+
+bool event_log_flash_write( uint32_t offset, const uint8_t *data, uint16_t length )
+{
+	return spi_flash_write( (uint8_t *)data, EVENT_LOG_FLASH_OFFSET + offset, length ) == M2M_SUCCESS;
+}
+
+bool event_log_flash_erase( uint32_t offset )
+{
+	return spi_flash_erase( EVENT_LOG_FLASH_OFFSET + offset, FLASH_SECTOR_SZ ) == M2M_SUCCESS;
+}
+
+#endif
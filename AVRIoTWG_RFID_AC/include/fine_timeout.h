@@ -0,0 +1,53 @@
+/**
+ *\file
+ *
+ *\brief Timeouts below the resolution of the RTC
+ *
+ * The scheduler ticks at 1.024 kHz. For shorter waits, like the pulses and
+ * turnaround times of the reader, TCB0 counts CLK_PER / 2 and queues the task
+ * of a timer for execution once the time is up, like an expired scheduler
+ * timer. TCB0 has a single channel, so only one fine timeout can be pending.
+ *
+ * Only built with SCHEDULER_FINE_TIMEOUT set to 1.
+ */
+
+#ifndef FINE_TIMEOUT_H
+#define FINE_TIMEOUT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "clock_config.h"
+#include "timeout.h"
+
+/** TCB0 ticks per microsecond */
+#define FINE_TIMEOUT_TICKS_PER_US (F_CPU / 2 / 1000000)
+
+/** Longest fine timeout in microseconds */
+#define FINE_TIMEOUT_MAX_US (65535 / FINE_TIMEOUT_TICKS_PER_US)
+
+#if SCHEDULER_FINE_TIMEOUT
+/**
+ * \brief Execute the task of the timer once the time is up
+ *
+ * The task runs from scheduler_timeout_call_next_callback(). A timer still
+ * scheduled with scheduler_timeout_create() is deleted first. If the task
+ * returns a value other than 0, it is rescheduled in ticks of the scheduler.
+ *
+ * \param[in] timer Pointer to struct describing the task to execute
+ * \param[in] us Microseconds until execution, at most FINE_TIMEOUT_MAX_US
+ *
+ * \return false if the time is too long or another timer is pending
+ */
+bool scheduler_fine_timeout_create(timer_struct_t *timer, uint16_t us);
+
+/**
+ * \brief Delete a fine timeout, also if its task is already waiting for execution
+ *
+ * \param[in] timer Pointer to struct describing the task
+ *
+ * \return Nothing
+ */
+void scheduler_fine_timeout_delete(timer_struct_t *timer);
+#endif
+
+#endif /* FINE_TIMEOUT_H */
@@ -35,6 +35,7 @@ extern "C" {
 #endif
 
 int8_t SLPCTRL_init();
+void   SLPCTRL_sleep(void);
 
 #ifdef __cplusplus
 }
@@ -30,13 +30,99 @@
 #ifndef TIMEOUTDRIVER_H
 #define TIMEOUTDRIVER_H
 
+#ifdef __AVR__
 #include <compiler.h>
+#endif
 #include <stdint.h>
 #include <stdbool.h>
 
+/** Keep the pending timers in a binary min-heap (1) instead of a sorted linked list (0) */
+#ifndef SCHEDULER_TIMER_HEAP
+#define SCHEDULER_TIMER_HEAP 0
+#endif
+
+/** Heap slots when SCHEDULER_TIMER_HEAP is 1, at most 255. One is kept for the scheduler, the
+ * tasks can have SCHEDULER_HEAP_SIZE - 1 timers pending at the same time. */
+#ifndef SCHEDULER_HEAP_SIZE
+#define SCHEDULER_HEAP_SIZE 32
+#endif
+
+/** Number of background tasks executed per call of scheduler_timeout_call_next_callback() */
+#ifndef SCHEDULER_BACKGROUND_BUDGET
+#define SCHEDULER_BACKGROUND_BUDGET 1
+#endif
+
+/** Record the run time and lateness of every task, see scheduler_timeout_get_profile() */
+#ifndef SCHEDULER_PROFILE
+#define SCHEDULER_PROFILE 0
+#endif
+
+/** Number of different tasks the profiler keeps track of */
+#ifndef SCHEDULER_PROFILE_SLOTS
+#define SCHEDULER_PROFILE_SLOTS 24
+#endif
+
+/** Ticks a task may run before it is counted as an overrun */
+#ifndef SCHEDULER_PROFILE_BUDGET
+#define SCHEDULER_PROFILE_BUDGET 10
+#endif
+
+/** Use TCB0 for timeouts below a tick, see fine_timeout.h */
+#ifndef SCHEDULER_FINE_TIMEOUT
+#define SCHEDULER_FINE_TIMEOUT 0
+#endif
+
 /** Datatype used to hold the number of ticks until a timer expires */
 typedef uint32_t absolutetime_t;
 
+/** The RTC runs from the 1.024 kHz oscillator output, most code treats a tick as a millisecond */
+#define SCHEDULER_TICKS_PER_SECOND 1024
+
+// Conversions between ticks and time. None of them overflows on the way,
+// results that do not fit saturate at UINT32_MAX.
+
+/** Milliseconds to ticks, rounded down */
+static inline absolutetime_t scheduler_ms_to_ticks(uint32_t ms)
+{
+	// ms * 1024 / 1000 = ms * 128 / 125
+	if (ms / 125 > (UINT32_MAX >> 7))
+		return UINT32_MAX;
+	return (ms / 125) * 128 + (ms % 125) * 128 / 125;
+}
+
+/** Ticks to milliseconds, rounded down */
+static inline uint32_t scheduler_ticks_to_ms(absolutetime_t ticks)
+{
+	// ticks * 1000 / 1024 = ticks * 125 / 128
+	return (ticks >> 7) * 125 + (ticks & 127) * 125 / 128;
+}
+
+/** Microseconds to ticks, rounded up so a timeout never expires early */
+static inline absolutetime_t scheduler_us_to_ticks(uint32_t us)
+{
+	// us * 1024 / 1000000 = us * 16 / 15625
+	return (us / 15625) * 16 + ((us % 15625) * 16 + 15624) / 15625;
+}
+
+/** Ticks to microseconds, rounded down */
+static inline uint32_t scheduler_ticks_to_us(absolutetime_t ticks)
+{
+	// ticks * 1000000 / 1024 = ticks * 15625 / 16
+	uint32_t fraction = (ticks & 15) * 15625 / 16;
+
+	if ((ticks >> 4) > (UINT32_MAX - fraction) / 15625)
+		return UINT32_MAX;
+	return (ticks >> 4) * 15625 + fraction;
+}
+
+/** Order in which expired tasks are executed, a timer that does not set it is normal */
+typedef enum {
+	SCHEDULER_PRIORITY_NORMAL = 0, ///< Network and reader handling
+	SCHEDULER_PRIORITY_CRITICAL,   ///< Short tasks that must not wait for anything else, like relocking the door
+	SCHEDULER_PRIORITY_BACKGROUND, ///< Work that may wait, like LEDs and the CLI
+	SCHEDULER_PRIORITIES
+} scheduler_priority_t;
+
 /** Typedef for the function pointer for the timeout callback function */
 typedef absolutetime_t (*timercallback_ptr_t)(void *payload);
 
@@ -47,8 +133,35 @@ typedef struct timer_struct_s {
 	struct timer_struct_s *next;    ///< Pointer to a linked list of all timers that have expired and whose callback
 	                                ///< functions are due to be called
 	absolutetime_t absolute_time;   ///< The number of ticks the timer will count before it expires
+	uint8_t        priority;        ///< scheduler_priority_t, must not change while the timer is in use
+#if SCHEDULER_TIMER_HEAP
+	uint8_t heap_index; ///< Position of the timer in the heap of pending timers
+#endif
 } timer_struct_t;
 
+/** Run time and lateness of one task, in ticks */
+typedef struct {
+	const struct timer_struct_s *timer;
+	const char *                 name;          ///< NULL unless set with scheduler_timeout_profile_name()
+	uint16_t                     calls;         ///< Number of times the task was executed, saturates
+	uint16_t                     overruns;      ///< Calls that ran longer than SCHEDULER_PROFILE_BUDGET
+	uint16_t                     min_time;      ///< Shortest run time
+	uint16_t                     max_time;      ///< Longest run time
+	uint32_t                     total_time;    ///< Sum of the run times
+	uint16_t                     max_latency;   ///< Longest time between becoming due and starting
+	uint32_t                     total_latency; ///< Sum of the times between becoming due and starting
+} scheduler_profile_t;
+
+/** Time spent in scheduler_timeout_sleep() and how late tasks started, in ticks */
+typedef struct {
+	uint32_t       sleeps;        ///< Number of times the CPU went to sleep
+	absolutetime_t sleep_time;    ///< Ticks spent sleeping
+	uint32_t       callbacks;     ///< Number of tasks executed
+	absolutetime_t total_latency; ///< Sum of the time between each task becoming due and its start
+	absolutetime_t max_latency;   ///< Longest time between a task becoming due and its start
+	uint32_t       lost_timers;   ///< Timers scheduler_timeout_create() had no room for
+} scheduler_sleep_stats_t;
+
 /**
  * \brief Initialize the Timeout driver
  *
@@ -66,9 +179,9 @@ void scheduler_timeout_init(void);
  * \param[in] timer Pointer to struct describing the task to execute
  * \param[in] timeout Number of ticks to wait before executing the task
  *
- * \return Nothing
+ * \return false if the heap of pending timers is full, the task is then not scheduled
  */
-void scheduler_timeout_create(timer_struct_t *timer, absolutetime_t timeout);
+bool scheduler_timeout_create(timer_struct_t *timer, absolutetime_t timeout);
 
 /**
  * \brief Delete the specified timer task so it won't be executed
@@ -87,8 +200,11 @@ void scheduler_timeout_delete(timer_struct_t *timer);
 void scheduler_timeout_flush_all(void);
 
 /**
- * \brief Execute the next timer task that has been scheduled for execution.
+ * \brief Execute the timer tasks that have been scheduled for execution.
  *
+ * All critical and normal tasks waiting for execution are run, critical ones
+ * first, followed by at most SCHEDULER_BACKGROUND_BUDGET background tasks.
+ * A critical task that becomes due meanwhile runs before the next task.
  * If no task has been scheduled for execution, the function
  * returns immediately, so there is no need for any polling.
  *
@@ -96,6 +212,79 @@ void scheduler_timeout_flush_all(void);
  */
 void scheduler_timeout_call_next_callback(void);
 
+/**
+ * \brief Queue the specified timer task for execution from an interrupt handler
+ *
+ * The task runs from the main loop on the next call to
+ * scheduler_timeout_call_next_callback(). The task must not be scheduled with
+ * scheduler_timeout_create() at the same time. Queueing a task that is already
+ * waiting for execution has no effect.
+ *
+ * \param[in] timer Pointer to struct describing the task to execute
+ *
+ * \return Nothing
+ */
+void scheduler_timeout_enqueue_from_isr(timer_struct_t *timer);
+
+/**
+ * \brief Queue the specified timer task for execution from the main loop
+ *
+ * Same as scheduler_timeout_enqueue_from_isr() with interrupts enabled, for
+ * the first run of a task that is otherwise only queued by an interrupt.
+ *
+ * \param[in] timer Pointer to struct describing the task to execute
+ *
+ * \return Nothing
+ */
+void scheduler_timeout_post(timer_struct_t *timer);
+
+/**
+ * \brief Put the CPU to sleep until the next interrupt if no task is waiting for execution
+ *
+ * The RTC keeps running in idle sleep, so expiring timers as well as the other
+ * peripheral interrupts wake the CPU up again.
+ *
+ * \return Nothing
+ */
+void scheduler_timeout_sleep(void);
+
+/**
+ * \brief Get the sleep and task latency statistics
+ *
+ * \return Pointer to the statistics, updated by the scheduler
+ */
+const scheduler_sleep_stats_t *scheduler_timeout_get_sleep_stats(void);
+
+#if SCHEDULER_PROFILE
+/**
+ * \brief Name a task in the profile, tasks without a name are shown by their callback
+ *
+ * \param[in] timer Struct describing the task
+ * \param[in] name String that must stay valid, usually a literal
+ *
+ * \return Nothing
+ */
+void scheduler_timeout_profile_name(timer_struct_t *timer, const char *name);
+
+/**
+ * \brief Get the profile of one of the tasks executed so far
+ *
+ * \param[in] index Number of the task, starting at 0
+ *
+ * \return Pointer to the profile, NULL if there are no more tasks
+ */
+const scheduler_profile_t *scheduler_timeout_get_profile(uint8_t index);
+
+/**
+ * \brief Clear the profiles of all tasks, the names are kept
+ *
+ * \return Nothing
+ */
+void scheduler_timeout_profile_reset(void);
+#else
+#define scheduler_timeout_profile_name(timer, name)
+#endif
+
 //********************************************************
 // The following functions form the API for stopwatch mode.
 //********************************************************
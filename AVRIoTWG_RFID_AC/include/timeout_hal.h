@@ -0,0 +1,138 @@
+/**
+ *\file
+ *
+ *\brief Clock used by the timeout driver
+ *
+ * The scheduler in timeout.c only needs a free running 16-bit tick counter
+ * that can be reloaded, an interrupt when it overflows and a way to wait for
+ * that interrupt. On the AVR this is the RTC, clocked at 1024 Hz. Built for
+ * any other target the counter is a virtual clock in timeout_hal_host.c, so
+ * the scheduler can run in a host process:
+ *
+ *     gcc -Iinclude -Iutils app.c src/timeout.c src/timeout_hal_host.c
+ *
+ * The virtual clock only moves when timeout_hal_advance() or
+ * timeout_hal_sleep() is called, which makes every run repeatable. With
+ * timeout_hal_set_realtime() it follows the host clock instead.
+ */
+
+#ifndef TIMEOUT_HAL_H
+#define TIMEOUT_HAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * \brief Handle a counter overflow, implemented by timeout.c
+ *
+ * Called by the backend with interrupts disabled, the backend clears the
+ * overflow flag itself afterwards.
+ *
+ * \return Nothing
+ */
+void scheduler_timeout_isr(void);
+
+/**
+ * \brief Set up the counter, the overflow interrupt is left enabled
+ *
+ * \return Nothing
+ */
+void timeout_hal_init(void);
+
+#ifdef __AVR__
+
+#include <avr/io.h>
+#include "atomic.h"
+#include "slpctrl.h"
+
+static inline uint16_t timeout_hal_get_counter(void)
+{
+	return RTC.CNT;
+}
+
+static inline void timeout_hal_set_counter(uint16_t value)
+{
+	// Wait for clock domain synchronization
+	while (RTC.STATUS & RTC_CNTBUSY_bm)
+		;
+	RTC.CNT = value;
+}
+
+static inline void timeout_hal_enable_overflow(void)
+{
+	RTC.INTCTRL |= RTC_OVF_bm;
+}
+
+static inline void timeout_hal_disable_overflow(void)
+{
+	RTC.INTCTRL &= ~RTC_OVF_bm;
+}
+
+static inline void timeout_hal_clear_overflow(void)
+{
+	RTC.INTFLAGS = RTC_OVF_bm;
+}
+
+// Must be called with interrupts disabled, returns with interrupts enabled
+static inline void timeout_hal_sleep(void)
+{
+	SLPCTRL_sleep();
+}
+
+#else
+
+uint16_t timeout_hal_get_counter(void);
+void     timeout_hal_set_counter(uint16_t value);
+void     timeout_hal_enable_overflow(void);
+void     timeout_hal_disable_overflow(void);
+void     timeout_hal_clear_overflow(void);
+void     timeout_hal_sleep(void);
+
+/**
+ * \brief Move the virtual clock forward, running the overflow interrupts that fall in between
+ *
+ * \param[in] ticks Number of ticks of 1/1024 s
+ *
+ * \return Nothing
+ */
+void timeout_hal_advance(uint32_t ticks);
+
+/**
+ * \brief Get the number of ticks the clock moved since timeout_hal_init()
+ *
+ * \return Ticks of 1/1024 s, independent of the counter reloads done by the scheduler
+ */
+uint32_t timeout_hal_get_ticks(void);
+
+/**
+ * \brief Let the clock follow the host monotonic clock instead of timeout_hal_advance()
+ *
+ * The clock still only moves in timeout_hal_poll() and timeout_hal_sleep(),
+ * the scheduler is never interrupted from another thread.
+ *
+ * \param[in] realtime true to follow the host clock, false for the virtual clock
+ *
+ * \return Nothing
+ */
+void timeout_hal_set_realtime(bool realtime);
+
+/**
+ * \brief Catch up with the host clock when running in real time
+ *
+ * \return Nothing
+ */
+void timeout_hal_poll(void);
+
+// There is only one thread, the critical sections just hold back the
+// overflow interrupt like the AVR does with interrupts disabled
+void timeout_hal_lock(void);
+void timeout_hal_unlock(void);
+
+#define ENTER_CRITICAL(UNUSED) timeout_hal_lock()
+#define EXIT_CRITICAL(UNUSED) timeout_hal_unlock()
+#define DISABLE_INTERRUPTS() timeout_hal_lock()
+#define ENABLE_INTERRUPTS() timeout_hal_unlock()
+
+#endif
+
+#endif /* TIMEOUT_HAL_H */
@@ -72,6 +72,8 @@ void USART_0_write(const uint8_t data);
 
 void USART_0_set_ISR_cb(usart_cb_t cb, usart_cb_type_t type);
 
+void USART_0_default_rx_isr_cb(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,127 @@
+/*
+ * latency.c
+ *
+ * A tap is timed from the moment RFID_ScanComplete() decides to publish it.
+ * The scan itself is already timed by lib_iso15693, its duration is passed in.
+ * Each later stage is measured with the scheduler stopwatch from the previous
+ * mark. Only one tap is timed at a time, a newer tap drops the one in flight,
+ * and marks that arrive out of order (no tap, or a stage already passed) are
+ * ignored.
+ */
+
+#include <stdio.h>
+#include "latency.h"
+
+static absolutetime_t latencyStopwatchExpired( void *payload );
+
+static timer_struct_t      latencyStopwatch = { latencyStopwatchExpired };
+static latency_histogram_t latencyHistogram[LATENCY_STAGES];
+static bool                latencyTapRunning = false;
+static latency_stage_t     latencyLastStage;
+static absolutetime_t      latencyTapTime; // sum of the stages marked so far
+
+static const char *const latencyStageName[LATENCY_STAGES] = { "scan", "publish", "send", "command", "action", "total" };
+
+// A tap still running after the stopwatch range is lost, nothing to do
+static absolutetime_t latencyStopwatchExpired( void *payload )
+{
+	latencyTapRunning = false;
+	return 0;
+}
+
+static void latencyRecord( latency_stage_t stage, absolutetime_t elapsed )
+{
+	latency_histogram_t *histogram = &latencyHistogram[stage];
+	uint16_t             ms        = ( elapsed > UINT16_MAX ) ? UINT16_MAX : elapsed;
+	uint16_t             limit     = ms / LATENCY_FIRST_BUCKET;
+	uint8_t              bucket    = 0;
+
+	while ( limit != 0 && bucket < LATENCY_BUCKETS - 1 )
+	{
+		limit >>= 1;
+		bucket++;
+	}
+
+	// Saturate instead of wrapping, the histogram only ever grows
+	if ( histogram->buckets[bucket] < UINT16_MAX )
+	{
+		histogram->buckets[bucket]++;
+	}
+	if ( histogram->count < UINT16_MAX )
+	{
+		histogram->count++;
+		histogram->total += ms;
+	}
+	if ( ms > histogram->max )
+	{
+		histogram->max = ms;
+	}
+}
+
+void LATENCY_startTap( absolutetime_t scanTime )
+{
+	latencyRecord( LATENCY_SCAN, scanTime );
+
+	latencyTapRunning = true;
+	latencyLastStage  = LATENCY_SCAN;
+	latencyTapTime    = scanTime;
+	scheduler_timeout_start_timer( &latencyStopwatch );
+}
+
+void LATENCY_mark( latency_stage_t stage )
+{
+	absolutetime_t elapsed;
+
+	if ( !latencyTapRunning || stage <= latencyLastStage || stage >= LATENCY_TOTAL )
+	{
+		return;
+	}
+
+	elapsed = scheduler_timeout_stop_timer( &latencyStopwatch );
+	latencyRecord( stage, elapsed );
+	latencyTapTime += elapsed;
+	latencyLastStage = stage;
+
+	if ( stage == LATENCY_ACTION )
+	{
+		latencyRecord( LATENCY_TOTAL, latencyTapTime );
+		latencyTapRunning = false;
+	}
+	else
+	{
+		scheduler_timeout_start_timer( &latencyStopwatch );
+	}
+}
+
+const latency_histogram_t *LATENCY_getHistogram( latency_stage_t stage )
+{
+	return &latencyHistogram[stage];
+}
+
+const char *LATENCY_getStageName( latency_stage_t stage )
+{
+	return latencyStageName[stage];
+}
+
+// {"latency":{"scan":[count,average,max],...}}, returns the length or 0 if it does not fit
+uint16_t LATENCY_printJson( char *json, uint16_t size )
+{
+	uint16_t length = snprintf( json, size, "{\"latency\":{" );
+	uint8_t  stage;
+
+	for ( stage = 0 ; stage < LATENCY_STAGES && length < size ; stage++ )
+	{
+		const latency_histogram_t *histogram = &latencyHistogram[stage];
+
+		length += snprintf( json + length, size - length, "%s\"%s\":[%u,%lu,%u]", ( stage != 0 ) ? "," : "",
+		                    latencyStageName[stage], histogram->count,
+		                    histogram->count ? histogram->total / histogram->count : 0, histogram->max );
+	}
+
+	if ( length < size )
+	{
+		length += snprintf( json + length, size - length, "}}" );
+	}
+
+	return ( length < size ) ? length : 0;
+}
@@ -0,0 +1,46 @@
+/*
+ * latency.h
+ *
+ * Tap-to-unlock latency, split into the stages a badge read goes through on
+ * its way to the cloud and back. Every stage keeps a histogram of its duration
+ * so the CLI and the telemetry message show where the time goes.
+ */
+
+
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "timeout.h"
+
+// Stages of a published tap, in the order they are marked
+typedef enum {
+	LATENCY_SCAN = 0, // inventory started -> UIDs read
+	LATENCY_PUBLISH,  // UIDs read -> CLOUD_publishData()
+	LATENCY_SEND,     // CLOUD_publishData() -> PUBLISH left through MQTT_TransmissionHandler()
+	LATENCY_COMMAND,  // PUBLISH sent -> command in process_cloud_command()
+	LATENCY_ACTION,   // command received -> door unlocked or denied
+	LATENCY_TOTAL,    // inventory started -> door unlocked or denied
+	LATENCY_STAGES
+} latency_stage_t;
+
+// Bucket i counts durations below (LATENCY_FIRST_BUCKET << i) ms, the last one everything above
+#define LATENCY_FIRST_BUCKET 16
+#define LATENCY_BUCKETS 10
+
+// Durations in ms (RTC ticks of 1/1024 s)
+typedef struct {
+	uint16_t count;
+	uint16_t max;
+	uint32_t total;
+	uint16_t buckets[LATENCY_BUCKETS];
+} latency_histogram_t;
+
+void                       LATENCY_startTap( absolutetime_t scanTime );
+void                       LATENCY_mark( latency_stage_t stage );
+const latency_histogram_t *LATENCY_getHistogram( latency_stage_t stage );
+const char *               LATENCY_getStageName( latency_stage_t stage );
+uint16_t                   LATENCY_printJson( char *json, uint16_t size );
+
+#endif /* LATENCY_H_ */
@@ -54,7 +54,7 @@ void LED_test(void)
 }
 
 static absolutetime_t yellow_task(void *payload);
-static timer_struct_t yellow_timer = {yellow_task};
+static timer_struct_t yellow_timer = {.callback_ptr = yellow_task, .priority = SCHEDULER_PRIORITY_BACKGROUND};
 
 static absolutetime_t yellow_task(void *payload)
 {
@@ -69,7 +69,7 @@ void LED_flashYellow(void)
 }
 
 static absolutetime_t red_task(void *payload);
-static timer_struct_t red_timer = {red_task};
+static timer_struct_t red_timer = {.callback_ptr = red_task, .priority = SCHEDULER_PRIORITY_BACKGROUND};
 
 static absolutetime_t red_task(void *payload)
 {
@@ -30,13 +30,17 @@ SOFTWARE.
 #include <stdlib.h>
 #include "application_manager.h"
 #include "led.h"
+#include "Config/IoT_Sensor_Node_config.h"
 #include "cr95hf/lib_iso15693.h"
+#include "credentials_storage/credentials_storage.h"
 
 ReaderConfigStruct ReaderConfig; 
 uint8_t GloParameterSelected;	   	// select parameter
 
 int8_t rfid_click_init( ReaderConfigStruct* ReaderConfig, CR95HF_INTERFACE bus )
 {
+	uint8_t rfSetting = CREDENTIALS_STORAGE_getRfSetting();
+
 	// initialize pins
 	RFID_CLICK_SPI_CS_set_level( 1 );
 	RFID_CLICK_INT_I_set_level( 1 );
@@ -46,10 +50,28 @@ int8_t rfid_click_init( ReaderConfigStruct* ReaderConfig, CR95HF_INTERFACE bus )
 	RFID_CLICK_SSI1_set_level( 0 );
 	
 	ReaderConfig->Interface = bus;
+	ReaderConfig->SpiMode = SPI_INTERRUPT;	// wait for IRQ_OUT instead of polling over SPI
 	
 	// TODO: is SPI bus initialized?
 	
-	return CR95HF_PORsequence();
+	if ( CR95HF_PORsequence() != CR95HF_SUCCESS_CODE )
+	{
+		return CR95HF_ERRORCODE_PORERROR;
+	}
+
+	// Start with the setting that worked last time, a blank EEPROM reads 0xFF
+	if ( !CFG_RF_ADAPTIVE || rfSetting >= ISO15693_NB_RFSETTINGS )
+	{
+		rfSetting = CFG_RF_SETTING;
+	}
+	ISO15693_SetRFSetting( rfSetting, CFG_RF_ADAPTIVE );
+
+#if CFG_TAG_DETECT
+	// No badge may be in the field now. Without calibration RFID_Scan() polls every CFG_SCAN_INTERVAL
+	CR95HF_CalibrateTagDetector();
+#endif
+
+	return CR95HF_SUCCESS_CODE;
 }
 
 int main(void)
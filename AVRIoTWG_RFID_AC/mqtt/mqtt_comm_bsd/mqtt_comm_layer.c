@@ -66,13 +66,39 @@ mqttContext *MQTT_GetClientConnectionInfo()
 
 bool MQTT_Send(mqttContext *connectionPtr)
 {
-	bool ret = false;
-	int  sendRet;
-	if ((sendRet = BSD_send(*connectionPtr->tcpClientSocket,
-	                        connectionPtr->mqttDataExchangeBuffers.txbuff.start,
-	                        connectionPtr->mqttDataExchangeBuffers.txbuff.dataLength,
-	                        0))
-	    > BSD_SUCCESS) {
+	exchangeBuffer *txbuff = &connectionPtr->mqttDataExchangeBuffers.txbuff;
+	mqttSegment     segments[2];
+	uint8_t         count = 1;
+
+	// Sent straight out of the Tx buffer, in two parts if the data wraps
+	segments[0].length = MQTT_ExchangeBufferGetReadSpan(txbuff, &segments[0].data);
+	if (segments[0].length < txbuff->dataLength) {
+		segments[1].data   = txbuff->start;
+		segments[1].length = txbuff->dataLength - segments[0].length;
+		count++;
+	}
+
+	return MQTT_SendSegments(connectionPtr, segments, count);
+}
+
+// Sends the segments as one packet, the WINC reads them straight from where they are
+bool MQTT_SendSegments(mqttContext *connectionPtr, const mqttSegment *segments, uint8_t count)
+{
+	struct bsd_iovec iov[MQTT_MAX_SEGMENTS];
+	bool             ret = false;
+	int              sendRet;
+	uint8_t          i;
+
+	if (count > MQTT_MAX_SEGMENTS) {
+		return false;
+	}
+
+	for (i = 0; i < count; i++) {
+		iov[i].iov_base = segments[i].data;
+		iov[i].iov_len  = segments[i].length;
+	}
+
+	if ((sendRet = BSD_sendv(*connectionPtr->tcpClientSocket, iov, count, 0)) > BSD_SUCCESS) {
 		ret = true;
 	}
 
@@ -89,8 +115,8 @@ bool MQTT_Close(mqttContext *connectionPtr)
 	return ret;
 }
 
+// Appends to what was not processed yet, e.g. the start of a packet
 void MQTT_GetReceivedData(uint8_t *pData, uint8_t len)
 {
-	MQTT_ExchangeBufferInit(&mqttConn.mqttDataExchangeBuffers.rxbuff);
 	MQTT_ExchangeBufferWrite(&mqttConn.mqttDataExchangeBuffers.rxbuff, pData, len);
 }
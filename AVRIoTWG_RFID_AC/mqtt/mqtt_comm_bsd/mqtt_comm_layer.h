@@ -46,10 +46,19 @@ typedef struct {
 	int8_t *    tcpClientSocket;
 } mqttContext;
 
+#define MQTT_MAX_SEGMENTS 12 // Enough for several queued PUBLISH packets in one send
+
+// One part of a packet passed to MQTT_SendSegments()
+typedef struct {
+	uint8_t *data;
+	uint16_t length;
+} mqttSegment;
+
 void         MQTT_ClientInitialise(void);
 mqttContext *MQTT_GetClientConnectionInfo();
 
 bool MQTT_Send(mqttContext *connectionPtr);
+bool MQTT_SendSegments(mqttContext *connectionPtr, const mqttSegment *segments, uint8_t count);
 bool MQTT_Close(mqttContext *connectionPtr);
 void MQTT_GetReceivedData(uint8_t *pData, uint8_t len);
 #endif /* MQTT_COMM_LAYER_H */
@@ -32,4 +32,8 @@
 #define PAYLOAD_SIZE 200       // Defines the payload size that is supported when we process a published packet
 #define NUM_TOPICS_SUBSCRIBE 2 // Defines number of topics which can be subscribed
 
+#define MQTT_PUBLISH_QUEUE_SIZE 6    // Defines number of PUBLISH packets that can wait for transmission or PUBACK
+#define MQTT_PUBLISH_QUEUE_BYTES 384 // Defines the space for the payloads of all waiting PUBLISH packets together
+#define MQTT_PUBLISH_INFLIGHT 4      // Defines number of QoS 1 PUBLISH packets that can wait for their PUBACK
+
 #endif /* MQTT_CONFIG_H */
@@ -47,6 +47,7 @@ IN NO EVENT WILL MICROCHIP BE LIABLE FOR ANY INDIRECT, SPECIAL, PUNITIVE,
 #define MQTT_TX_PACKET_DECISION_CONSTANT 0x01
 #define KEEP_ALIVE_CALCULATION_CONSTANT 0x01
 #define CONNECT_CLEAN_SESSION_MASK 0x02
+#define MQTT_PUBLISH_HEADER_SIZE 7 // Fixed header, up to 4 bytes remaining length and the topic length
 
 // MQTT packet transmission flags. The creation and transmission processes of
 // MQTT control packets uses a set of flags to indicate that a new packet is
@@ -97,6 +98,15 @@ typedef enum {
 	SENDPINGREQ     = 32,
 } mqttConnectCurrentTxSubstate;
 
+// States of a queued PUBLISH packet. Packets are freed in queue order, so a
+// packet that is done waits for the ones in front of it.
+
+typedef enum {
+	PUBLISH_WAITING = 0, // Not sent yet, or to be sent again
+	PUBLISH_INFLIGHT,    // QoS 1 packet sent, waiting for its PUBACK
+	PUBLISH_DONE         // QoS 0 packet sent or QoS 1 packet acknowledged
+} mqttPublishState;
+
 // Function pointer for handling QoS levels.
 typedef void (*qosLevelHandler)(uint8_t);
 
@@ -124,8 +134,33 @@ static newRxDataFlags mqttRxFlags;
 /** \brief CONNECT packet to be transmitted. */
 static mqttConnectPacket txConnectPacket;
 
-/** \brief PUBLISH packet to be transmitted. */
-static mqttPublishPacket txPublishPacket;
+/** \brief PUBLISH packets waiting for transmission or PUBACK, the oldest at publishQueueHead.
+ *
+ * The payloads are copied to publishQueueData in the same order, so the caller
+ * can reuse its buffer as soon as MQTT_CreatePublishPacket() returns. Packets
+ * are sent and freed in order, which frees their payloads in order as well. A
+ * QoS 1 packet stays queued until its PUBACK, also across a reconnect. The
+ * topic is not copied, it has to stay valid until the packet is freed.
+ */
+static mqttPublishPacket publishQueue[MQTT_PUBLISH_QUEUE_SIZE];
+static mqttPublishState  publishQueueState[MQTT_PUBLISH_QUEUE_SIZE];
+static uint8_t           publishQueueHead  = 0;
+static uint8_t           publishQueueCount = 0;
+static uint8_t           publishQueueBuffer[MQTT_PUBLISH_QUEUE_BYTES];
+static exchangeBuffer    publishQueueData = {publishQueueBuffer, publishQueueBuffer, sizeof(publishQueueBuffer), 0};
+
+/** \brief Number of queued PUBLISH packets in state PUBLISH_WAITING and PUBLISH_INFLIGHT. */
+static uint8_t publishWaitingCount  = 0;
+static uint8_t publishInFlightCount = 0;
+
+/** \brief Packet identifier of the last QoS 1 PUBLISH packet. */
+static uint16_t publishPacketIdentifier = 0;
+
+/** \brief PUBLISH packets lost because the queue was full. */
+static uint16_t publishDropCount = 0;
+
+/** \brief Bytes still to come of a received packet too long for the Rx buffer, they are skipped. */
+static uint32_t rxDiscardLength = 0;
 
 /** \brief SUBSCRIBE packet to be transmitted. */
 static mqttSubscribePacket txSubscribePacket;
@@ -139,6 +174,9 @@ static volatile bool pingreqTimeoutOccured = false;
 /** \brief PINGRESP packet timeout indicator. */
 static volatile bool pingrespTimeoutOccured = false;
 
+/** \brief PUBACK packet timeout indicator. */
+static volatile bool pubackTimeoutOccured = false;
+
 /** \brief Store the timestamp at the last CONNACK. */
 time_t connectTime = 0;
 
@@ -188,6 +226,19 @@ static uint8_t mqttEncodeLength(uint16_t length, uint8_t *output);
  */
 static uint32_t mqttDecodeLength(uint8_t *encodedData);
 
+/** \brief Length of the received packet at the start of the Rx buffer.
+ *
+ * This function decodes the fixed header of the packet waiting in the Rx
+buffer, the packet itself may not have arrived completely yet.
+ *
+ * @param *rxbuff
+ *
+ * @return
+ *  - The length of the packet including its fixed header, 0 if the fixed
+header did not arrive completely
+ */
+static uint32_t mqttPeekPacketLength(exchangeBuffer *rxbuff);
+
 /** \brief Send the MQTT CONNECT packet.
  *
  * This function sends the MQTT CONNECT packet using the underlying
@@ -299,6 +350,18 @@ broker.
  */
 static mqttCurrentState mqttProcessPublish(mqttContext *mqttConnectionPtr);
 
+/** \brief Process one received MQTT packet.
+ *
+ * This function processes the complete packet at the start of the Rx buffer
+according to the state of the client.
+ *
+ * @param mqttConnectionPtr
+ *
+ * @return
+ *  - The state of MQTT Tx and Rx handlers after the packet was processed.
+ */
+static mqttCurrentState mqttReceivePacket(mqttContext *mqttConnectionPtr);
+
 /** \brief Check whether timeout has occurred after sending CONNECT
 packet.
  *
@@ -345,6 +408,21 @@ packet.
 static absolutetime_t checkPingrespTimeoutState();
 timerstruct_t         pingrespTimer = {checkPingrespTimeoutState, NULL};
 
+/** \brief Check whether timeout has occurred after sending QoS 1 PUBLISH
+packets.
+ *
+ * This function checks whether a timeout (10s) has occurred without a PUBACK
+packet for the PUBLISH packets in flight. The timer restarts with every
+PUBACK packet, on a timeout all packets in flight are sent again.
+ *
+ * @param none
+ *
+ * @return
+ *  - 0, the timer is created again when packets are sent
+ */
+static absolutetime_t checkPubackTimeoutState();
+timerstruct_t         pubackTimer = {checkPubackTimeoutState, NULL};
+
 /**********************Local function definitions*(END)************************/
 
 /**********************Function implementations********************************/
@@ -375,6 +453,12 @@ static absolutetime_t checkPingrespTimeoutState()
 	return (WAITFORPINGRESP_TIMEOUT);
 }
 
+static absolutetime_t checkPubackTimeoutState()
+{
+	pubackTimeoutOccured = true; // Mark that timer has executed
+	return 0;                    // Stop the timer
+}
+
 void MQTT_initialiseState(void)
 {
 	mqttState = DISCONNECTED;
@@ -385,6 +469,54 @@ mqttCurrentState MQTT_GetConnectionState(void)
 	return mqttState;
 }
 
+// True while a PUBLISH created by MQTT_CreatePublishPacket() waits for MQTT_TransmissionHandler()
+bool MQTT_IsPublishPending(void)
+{
+	return publishWaitingCount != 0;
+}
+
+uint16_t MQTT_GetPublishDropCount(void)
+{
+	return publishDropCount;
+}
+
+// Packets behind a QoS 1 packet outside the window wait as well, they have to leave in order
+static void mqttPublishUpdateTxFlag(void)
+{
+	mqttTxFlags.newTxPublishPacket = (publishWaitingCount != 0) && (publishInFlightCount < MQTT_PUBLISH_INFLIGHT);
+}
+
+// Frees the packets at the head of the queue that are done
+static void mqttPublishQueueRelease(void)
+{
+	while ((publishQueueCount != 0) && (publishQueueState[publishQueueHead] == PUBLISH_DONE)) {
+		MQTT_ExchangeBufferConsume(&publishQueueData, publishQueue[publishQueueHead].payloadLength);
+		publishQueueHead = (publishQueueHead + 1) % MQTT_PUBLISH_QUEUE_SIZE;
+		publishQueueCount--;
+	}
+}
+
+// Sends all packets in flight again, they have the DUP flag set already
+static void mqttPublishRetry(void)
+{
+	uint8_t position;
+	uint8_t index;
+
+	timeout_delete(&pubackTimer);
+	pubackTimeoutOccured = false;
+
+	for (position = 0; position < publishQueueCount; position++) {
+		index = (publishQueueHead + position) % MQTT_PUBLISH_QUEUE_SIZE;
+		if (publishQueueState[index] == PUBLISH_INFLIGHT) {
+			publishQueueState[index] = PUBLISH_WAITING;
+			publishWaitingCount++;
+		}
+	}
+	publishInFlightCount          = 0;
+	mqttRxFlags.newRxPubackPacket = 0;
+	mqttPublishUpdateTxFlag();
+}
+
 bool MQTT_CreateConnectPacket(mqttConnectPacket *newConnectPacket)
 {
 	uint16_t payloadLength = 0;
@@ -437,8 +569,9 @@ bool MQTT_CreateConnectPacket(mqttConnectPacket *newConnectPacket)
 	}
 	txConnectPacket.clientIDLength = htons(txConnectPacket.clientIDLength);
 
-	// Clear all pending transmissions first
+	// Clear all pending transmissions first, the PUBLISH packets not acknowledged yet are sent again
 	mqttTxFlags.All = 0;
+	mqttPublishRetry();
 
 	// Now mark the Connect for sending
 	mqttTxFlags.newTxConnectPacket = 1;
@@ -447,46 +580,68 @@ bool MQTT_CreateConnectPacket(mqttConnectPacket *newConnectPacket)
 	return true;
 }
 
+// Queues the packet behind the ones not freed yet, false if it was not queued.
+// The packet identifier of a QoS 1 packet is assigned here.
 bool MQTT_CreatePublishPacket(mqttPublishPacket *newPublishPacket)
 {
-	bool ret;
+	mqttPublishPacket *queuedPacket;
+	uint8_t            index;
 
-	ret = false;
+	if (mqttState != CONNECTED) {
+		return false;
+	}
+
+	if ((publishQueueCount == MQTT_PUBLISH_QUEUE_SIZE)
+	    || (newPublishPacket->payloadLength > publishQueueData.bufferLength - publishQueueData.dataLength)) {
+		publishDropCount++;
+		debug_printError("MQTT: PUBLISH queue full");
+		return false;
+	}
 
-	memset(&txPublishPacket, 0, sizeof(txPublishPacket));
+	debug_printInfo("MQTT: PublishBuild");
+	index        = (publishQueueHead + publishQueueCount) % MQTT_PUBLISH_QUEUE_SIZE;
+	queuedPacket = &publishQueue[index];
+	memset(queuedPacket, 0, sizeof(*queuedPacket));
 
-	if (mqttState == CONNECTED) {
-		debug_printInfo("MQTT: PublishBuild");
-		// Fixed header
-		txPublishPacket.publishHeaderFlags.controlPacketType = PUBLISH;
-		txPublishPacket.publishHeaderFlags.duplicate         = newPublishPacket->publishHeaderFlags.duplicate;
-		txPublishPacket.publishHeaderFlags.qos               = newPublishPacket->publishHeaderFlags.qos;
-		if ((txPublishPacket.publishHeaderFlags.qos == 0) && (txPublishPacket.publishHeaderFlags.duplicate != 0)) {
-			txPublishPacket.publishHeaderFlags.duplicate = 0;
-		}
-		txPublishPacket.publishHeaderFlags.retain = newPublishPacket->publishHeaderFlags.retain;
+	// Fixed header
+	queuedPacket->publishHeaderFlags.controlPacketType = PUBLISH;
+	queuedPacket->publishHeaderFlags.duplicate         = newPublishPacket->publishHeaderFlags.duplicate;
+	queuedPacket->publishHeaderFlags.qos               = newPublishPacket->publishHeaderFlags.qos;
+	if ((queuedPacket->publishHeaderFlags.qos == 0) && (queuedPacket->publishHeaderFlags.duplicate != 0)) {
+		queuedPacket->publishHeaderFlags.duplicate = 0;
+	}
+	queuedPacket->publishHeaderFlags.retain = newPublishPacket->publishHeaderFlags.retain;
 
-		// Variable header
-		txPublishPacket.topic       = newPublishPacket->topic;
-		txPublishPacket.topicLength = strlen((char *)newPublishPacket->topic);
-		if (newPublishPacket->publishHeaderFlags.qos > 0) {
-			txPublishPacket.packetIdentifierLSB = newPublishPacket->packetIdentifierLSB;
-			txPublishPacket.packetIdentifierMSB = newPublishPacket->packetIdentifierMSB;
-			txPublishPacket.totalLength
-			    += sizeof(txPublishPacket.packetIdentifierLSB) + sizeof(txPublishPacket.packetIdentifierMSB);
+	// Variable header
+	queuedPacket->topic       = newPublishPacket->topic;
+	queuedPacket->topicLength = strlen((char *)newPublishPacket->topic);
+	if (newPublishPacket->publishHeaderFlags.qos > 0) {
+		// Assigned here so the identifiers in flight are unique, 0 is not a valid identifier
+		if (++publishPacketIdentifier == 0) {
+			publishPacketIdentifier = 1;
 		}
+		queuedPacket->packetIdentifierLSB = publishPacketIdentifier & 0xFF;
+		queuedPacket->packetIdentifierMSB = publishPacketIdentifier >> 8;
+		queuedPacket->totalLength
+		    += sizeof(queuedPacket->packetIdentifierLSB) + sizeof(queuedPacket->packetIdentifierMSB);
+		queuedPacket->ackHandler = newPublishPacket->ackHandler;
+	}
 
-		// Payload
-		txPublishPacket.payload       = newPublishPacket->payload;
-		txPublishPacket.payloadLength = newPublishPacket->payloadLength;
-		txPublishPacket.totalLength
-		    += sizeof(txPublishPacket.topicLength) + txPublishPacket.topicLength + txPublishPacket.payloadLength;
-		txPublishPacket.topicLength = htons(txPublishPacket.topicLength);
-
-		mqttTxFlags.newTxPublishPacket = 1;
-		ret                            = true;
+	// Payload, kept in publishQueueData until the packet is sent
+	queuedPacket->payloadLength = newPublishPacket->payloadLength;
+	queuedPacket->totalLength
+	    += sizeof(queuedPacket->topicLength) + queuedPacket->topicLength + queuedPacket->payloadLength;
+	queuedPacket->topicLength = htons(queuedPacket->topicLength);
+	if (queuedPacket->payloadLength > 0) {
+		MQTT_ExchangeBufferWrite(&publishQueueData, newPublishPacket->payload, queuedPacket->payloadLength);
 	}
-	return ret;
+
+	publishQueueState[index] = PUBLISH_WAITING;
+	publishQueueCount++;
+	publishWaitingCount++;
+	mqttPublishUpdateTxFlag();
+
+	return true;
 }
 
 bool MQTT_CreateSubscribePacket(mqttSubscribePacket *newSubscribePacket)
@@ -540,6 +695,7 @@ static bool mqttSendConnect(mqttContext *mqttConnectionPtr)
 
 	MQTT_ExchangeBufferInit(&mqttConnectionPtr->mqttDataExchangeBuffers.txbuff);
 	MQTT_ExchangeBufferInit(&mqttConnectionPtr->mqttDataExchangeBuffers.rxbuff);
+	rxDiscardLength = 0;
 
 	MQTT_ExchangeBufferWrite(&mqttConnectionPtr->mqttDataExchangeBuffers.txbuff,
 	                         (uint8_t *)&txConnectPacket.connectFixedHeaderFlags.All,
@@ -583,46 +739,153 @@ static bool mqttSendConnect(mqttContext *mqttConnectionPtr)
 	return ret;
 }
 
-static bool mqttSendPublish(mqttContext *mqttConnectionPtr)
+// Segments of one queued packet, payloadOffset is where its payload starts in publishQueueData.
+// Returns the number of segments, 0 if they do not fit in 'space'.
+static uint8_t mqttGatherPublish(mqttPublishPacket *packet, uint8_t *header, uint8_t *packetIdentifier,
+                                 uint16_t payloadOffset, mqttSegment *segments, uint8_t space)
 {
-	bool ret = false;
+	uint8_t  headerLength;
+	uint8_t  segmentCount = 0;
+	uint8_t *payload;
+	uint16_t payloadSpan = MQTT_ExchangeBufferGetReadSpanAt(&publishQueueData, payloadOffset, &payload);
+	uint8_t  needed      = 2;
+
+	if (packet->publishHeaderFlags.qos == 1) {
+		needed++;
+	}
+	if (packet->payloadLength > 0) {
+		needed += (payloadSpan < packet->payloadLength) ? 2 : 1;
+	}
+	if (needed > space) {
+		return 0;
+	}
 
-	MQTT_ExchangeBufferInit(&mqttConnectionPtr->mqttDataExchangeBuffers.txbuff);
-	MQTT_ExchangeBufferInit(&mqttConnectionPtr->mqttDataExchangeBuffers.rxbuff);
+	// Only the few header bytes are built here, the topic and the payload are
+	// taken from where they are
+	header[0]    = packet->publishHeaderFlags.All;
+	headerLength = mqttEncodeLength(packet->totalLength, packet->remainingLength);
+	memcpy(&header[1], packet->remainingLength, headerLength);
+	headerLength++;
+	memcpy(&header[headerLength], &packet->topicLength, sizeof(packet->topicLength));
+	headerLength += sizeof(packet->topicLength);
+
+	segments[segmentCount].data     = header;
+	segments[segmentCount++].length = headerLength;
+	segments[segmentCount].data     = packet->topic;
+	segments[segmentCount++].length = ntohs(packet->topicLength);
+
+	if (packet->publishHeaderFlags.qos == 1) {
+		packetIdentifier[0]             = packet->packetIdentifierMSB;
+		packetIdentifier[1]             = packet->packetIdentifierLSB;
+		segments[segmentCount].data     = packetIdentifier;
+		segments[segmentCount++].length = 2;
+	}
+	if (packet->payloadLength > 0) {
+		// The payload may wrap around the end of publishQueueData
+		if (payloadSpan > packet->payloadLength) {
+			payloadSpan = packet->payloadLength;
+		}
+		segments[segmentCount].data     = payload;
+		segments[segmentCount++].length = payloadSpan;
+		if (payloadSpan < packet->payloadLength) {
+			segments[segmentCount].data     = publishQueueData.start;
+			segments[segmentCount++].length = packet->payloadLength - payloadSpan;
+		}
+	}
 
-	// Copy the txPublishPacket data in TCP Tx buffer
-	MQTT_ExchangeBufferWrite(&mqttConnectionPtr->mqttDataExchangeBuffers.txbuff,
-	                         &txPublishPacket.publishHeaderFlags.All,
-	                         sizeof(txPublishPacket.publishHeaderFlags.All));
-	MQTT_ExchangeBufferWrite(&mqttConnectionPtr->mqttDataExchangeBuffers.txbuff,
-	                         txPublishPacket.remainingLength,
-	                         mqttEncodeLength(txPublishPacket.totalLength, txPublishPacket.remainingLength));
-	MQTT_ExchangeBufferWrite(&mqttConnectionPtr->mqttDataExchangeBuffers.txbuff,
-	                         (uint8_t *)&txPublishPacket.topicLength,
-	                         sizeof(txPublishPacket.topicLength));
-	MQTT_ExchangeBufferWrite(
-	    &mqttConnectionPtr->mqttDataExchangeBuffers.txbuff, txPublishPacket.topic, ntohs(txPublishPacket.topicLength));
+	return segmentCount;
+}
 
-	if (txPublishPacket.publishHeaderFlags.qos == 1) {
-		MQTT_ExchangeBufferWrite(&mqttConnectionPtr->mqttDataExchangeBuffers.txbuff,
-		                         &txPublishPacket.packetIdentifierMSB,
-		                         sizeof(txPublishPacket.packetIdentifierMSB));
-		MQTT_ExchangeBufferWrite(&mqttConnectionPtr->mqttDataExchangeBuffers.txbuff,
-		                         &txPublishPacket.packetIdentifierLSB,
-		                         sizeof(txPublishPacket.packetIdentifierLSB));
+// Sends the gathered packets. The WINC writes every segment of a send over SPI with a
+// command of its own, so when they fit the Tx buffer they are copied into it and go out
+// as one block. Only a send larger than the Tx buffer is handed over in segments.
+static bool mqttSendGathered(mqttContext *mqttConnectionPtr, const mqttSegment *segments, uint8_t segmentCount)
+{
+	exchangeBuffer *txbuff = &mqttConnectionPtr->mqttDataExchangeBuffers.txbuff;
+	uint16_t        length = 0;
+	uint8_t         i;
+
+	for (i = 0; i < segmentCount; i++) {
+		length += segments[i].length;
+	}
+	if (length > txbuff->bufferLength) {
+		return MQTT_SendSegments(mqttConnectionPtr, segments, segmentCount);
+	}
+
+	MQTT_ExchangeBufferInit(txbuff);
+	for (i = 0; i < segmentCount; i++) {
+		MQTT_ExchangeBufferWrite(txbuff, segments[i].data, segments[i].length);
+	}
+	return MQTT_Send(mqttConnectionPtr);
+}
+
+// Sends the waiting packets, as many as there are segments for go out in one TCP send.
+// QoS 1 packets only go out while there is room in the window of MQTT_PUBLISH_INFLIGHT.
+static bool mqttSendPublish(mqttContext *mqttConnectionPtr)
+{
+	bool               ret = false;
+	uint8_t            header[MQTT_PUBLISH_QUEUE_SIZE][MQTT_PUBLISH_HEADER_SIZE];
+	uint8_t            packetIdentifier[MQTT_PUBLISH_QUEUE_SIZE][2];
+	uint8_t            sent[MQTT_PUBLISH_QUEUE_SIZE]; // queue index of every packet gathered
+	mqttSegment        segments[MQTT_MAX_SEGMENTS];
+	uint8_t            segmentCount = 0;
+	uint8_t            sentCount    = 0;
+	uint8_t            inFlight     = publishInFlightCount;
+	uint8_t            position;
+	uint8_t            index;
+	uint8_t            added;
+	uint16_t           payloadOffset = 0;
+	mqttPublishPacket *packet;
+
+	for (position = 0; position < publishQueueCount; position++) {
+		index  = (publishQueueHead + position) % MQTT_PUBLISH_QUEUE_SIZE;
+		packet = &publishQueue[index];
+		if (publishQueueState[index] == PUBLISH_WAITING) {
+			if ((packet->publishHeaderFlags.qos == 1) && (inFlight == MQTT_PUBLISH_INFLIGHT)) {
+				break;
+			}
+			added = mqttGatherPublish(packet,
+			                          header[sentCount],
+			                          packetIdentifier[sentCount],
+			                          payloadOffset,
+			                          &segments[segmentCount],
+			                          MQTT_MAX_SEGMENTS - segmentCount);
+			if (added == 0) {
+				break;
+			}
+			segmentCount += added;
+			sent[sentCount++] = index;
+			if (packet->publishHeaderFlags.qos == 1) {
+				inFlight++;
+			}
+		}
+		payloadOffset += packet->payloadLength;
 	}
-	MQTT_ExchangeBufferWrite(
-	    &mqttConnectionPtr->mqttDataExchangeBuffers.txbuff, txPublishPacket.payload, txPublishPacket.payloadLength);
 
 	// Function call to TCP_Send() is abstracted
-	if (mqttTxFlags.newTxPublishPacket == 1 || txPublishPacket.publishHeaderFlags.duplicate == 1) {
-		ret = MQTT_Send(mqttConnectionPtr);
-		if (ret == true) {
-			mqttTxFlags.newTxPublishPacket = 0;
-			if (txPublishPacket.publishHeaderFlags.qos == 1) {
-				mqttRxFlags.newRxPubackPacket = 1;
+	if (sentCount > 0) {
+		ret = mqttSendGathered(mqttConnectionPtr, segments, segmentCount);
+	}
+	if (ret == true) {
+		// The socket has its own copy now. QoS 1 packets stay queued until their
+		// PUBACK, marked as duplicates in case they have to be sent again.
+		for (position = 0; position < sentCount; position++) {
+			packet = &publishQueue[sent[position]];
+			if (packet->publishHeaderFlags.qos == 1) {
+				packet->publishHeaderFlags.duplicate = 1;
+				publishQueueState[sent[position]]    = PUBLISH_INFLIGHT;
+			} else {
+				publishQueueState[sent[position]] = PUBLISH_DONE;
 			}
 		}
+		if ((publishInFlightCount == 0) && (inFlight != 0)) {
+			timeout_create(&pubackTimer, WAITFORPUBACK_TIMEOUT);
+		}
+		publishWaitingCount -= sentCount;
+		publishInFlightCount          = inFlight;
+		mqttRxFlags.newRxPubackPacket = (inFlight != 0);
+		mqttPublishQueueRelease();
+		mqttPublishUpdateTxFlag();
 	}
 	return ret;
 }
@@ -663,6 +926,25 @@ static uint32_t mqttDecodeLength(uint8_t *encodedData)
 	return value;
 }
 
+static uint32_t mqttPeekPacketLength(exchangeBuffer *rxbuff)
+{
+	uint8_t  header[5];
+	uint16_t length = MQTT_ExchangeBufferPeek(rxbuff, header, sizeof(header));
+	uint8_t  i;
+
+	// The remaining length takes up to four bytes, the last one without the top bit
+	for (i = 1; i < length; i++) {
+		if ((header[i] & 0x80) == 0) {
+			return 1 + i + mqttDecodeLength(&header[1]);
+		}
+	}
+	if (length == sizeof(header)) {
+		// Malformed, nothing after it can be told apart any more
+		return UINT32_MAX;
+	}
+	return 0;
+}
+
 mqttCurrentState MQTT_Disconnect(mqttContext *connectionInfo)
 {
 	if ((mqttState == CONNECTED) || (mqttState == WAITFORCONNACK)) {
@@ -684,15 +966,15 @@ static void mqttProcessPingresp(mqttContext *mqttConnectionPtr)
 	MQTT_ExchangeBufferRead(&mqttConnectionPtr->mqttDataExchangeBuffers.rxbuff,
 	                        &txPingrespPacket.pingFixedHeader.All,
 	                        sizeof(txPingrespPacket.pingFixedHeader.All));
+	MQTT_ExchangeBufferRead(&mqttConnectionPtr->mqttDataExchangeBuffers.rxbuff,
+	                        &txPingrespPacket.remainingLength,
+	                        sizeof(txPingrespPacket.remainingLength));
 	// Reload timeout for keepAliveTimer
 	// The timeout should be reloaded only if the keepAliveTimer is set
 	// to a non-zero value.
 	if (ntohs(txConnectPacket.connectVariableHeader.keepAliveTimer) != 0) {
 		mqttTxFlags.newTxPingreqPacket = 1;
 	}
-	// Re-initialise the RX exchange buffer to be able to process the
-	// next incoming MQTT packet
-	MQTT_ExchangeBufferInit(&mqttConnectionPtr->mqttDataExchangeBuffers.rxbuff);
 }
 
 static mqttCurrentState mqttProcessSuback(mqttContext *mqttConnectionPtr)
@@ -750,9 +1032,6 @@ static mqttCurrentState mqttProcessSuback(mqttContext *mqttConnectionPtr)
 	}
 
 	mqttRxFlags.newRxSubackPacket = 0;
-	// Re-initialize the RX exchange buffer to be able to process the
-	// next incoming MQTT packet
-	MQTT_ExchangeBufferInit(&mqttConnectionPtr->mqttDataExchangeBuffers.rxbuff);
 	return ret;
 }
 
@@ -815,20 +1094,21 @@ static mqttCurrentState mqttProcessPublish(mqttContext *mqttConnectionPtr)
 		publishRecvHandlerInfo++;
 	}
 
-	// Re-initialize the RX exchange buffer to be able to process the
-	// next incoming MQTT packet
-	MQTT_ExchangeBufferInit(&mqttConnectionPtr->mqttDataExchangeBuffers.rxbuff);
 	ret = CONNECTED;
 	return ret;
 }
 
 static void mqttProcessPuback(mqttContext *mqttConnectionPtr)
 {
-	mqttPubackPacket rxPubackPacket;
+	mqttPubackPacket      rxPubackPacket;
+	mqttPublishAckHandler ackHandler = NULL;
+	uint8_t               position;
+	uint8_t               index;
+
 	memset(&rxPubackPacket, 0, sizeof(rxPubackPacket));
 	MQTT_ExchangeBufferRead(&mqttConnectionPtr->mqttDataExchangeBuffers.rxbuff,
-	                        (uint8_t *)&rxPubackPacket.pubackFixedHeader,
-	                        sizeof(rxPubackPacket.pubackFixedHeader));
+	                        &rxPubackPacket.pubackFixedHeader.All,
+	                        sizeof(rxPubackPacket.pubackFixedHeader.All));
 	MQTT_ExchangeBufferRead(&mqttConnectionPtr->mqttDataExchangeBuffers.rxbuff,
 	                        &rxPubackPacket.remainingLength,
 	                        sizeof(rxPubackPacket.remainingLength));
@@ -838,9 +1118,36 @@ static void mqttProcessPuback(mqttContext *mqttConnectionPtr)
 	MQTT_ExchangeBufferRead(&mqttConnectionPtr->mqttDataExchangeBuffers.rxbuff,
 	                        &rxPubackPacket.packetIdentifierLSB,
 	                        sizeof(rxPubackPacket.packetIdentifierLSB));
-	if (rxPubackPacket.packetIdentifierLSB == txPublishPacket.packetIdentifierLSB
-	    && rxPubackPacket.packetIdentifierMSB == txPublishPacket.packetIdentifierMSB) {
-		mqttRxFlags.newRxPubackPacket = 0;
+
+	// Match the packet in flight by its identifier. A packet that was sent again
+	// may be acknowledged twice, the second PUBACK finds nothing.
+	for (position = 0; position < publishQueueCount; position++) {
+		index = (publishQueueHead + position) % MQTT_PUBLISH_QUEUE_SIZE;
+		if ((publishQueueState[index] == PUBLISH_INFLIGHT)
+		    && (rxPubackPacket.packetIdentifierLSB == publishQueue[index].packetIdentifierLSB)
+		    && (rxPubackPacket.packetIdentifierMSB == publishQueue[index].packetIdentifierMSB)) {
+			publishQueueState[index] = PUBLISH_DONE;
+			publishInFlightCount--;
+			ackHandler = publishQueue[index].ackHandler;
+			break;
+		}
+	}
+	if (position == publishQueueCount) {
+		return;
+	}
+
+	// Give the packets still in flight a new timeout, this one made progress
+	timeout_delete(&pubackTimer);
+	if (publishInFlightCount != 0) {
+		timeout_create(&pubackTimer, WAITFORPUBACK_TIMEOUT);
+	}
+	mqttRxFlags.newRxPubackPacket = (publishInFlightCount != 0);
+	mqttPublishQueueRelease();
+	mqttPublishUpdateTxFlag();
+
+	// Last, the handler may queue the next packet
+	if (ackHandler != NULL) {
+		ackHandler();
 	}
 }
 
@@ -866,6 +1173,12 @@ mqttCurrentState MQTT_TransmissionHandler(mqttContext *mqttConnectionPtr)
 		break;
 
 	case CONNECTED:
+		// Send the PUBLISH packets again that were not acknowledged in time
+		if (pubackTimeoutOccured == true) {
+			debug_printError("MQTT: PUBACK TIMEOUT");
+			mqttPublishRetry();
+		}
+
 		// ToDo Find out ways to improve this logic
 		if (mqttTxFlags.All > 0) {
 			while ((mqttTxFlags.All & (MQTT_TX_PACKET_DECISION_CONSTANT << getSetFlag)) == 0) {
@@ -911,7 +1224,7 @@ mqttCurrentState MQTT_TransmissionHandler(mqttContext *mqttConnectionPtr)
 	return mqttState;
 }
 
-mqttCurrentState MQTT_ReceptionHandler(mqttContext *mqttConnectionPtr)
+static mqttCurrentState mqttReceivePacket(mqttContext *mqttConnectionPtr)
 {
 	uint16_t        keepAliveTimeout;
 	mqttHeaderFlags receivedPacketHeader;
@@ -919,10 +1232,6 @@ mqttCurrentState MQTT_ReceptionHandler(mqttContext *mqttConnectionPtr)
 	keepAliveTimeout         = 0;
 	receivedPacketHeader.All = 0;
 
-	// If nothing to process
-	if (mqttConnectionPtr->mqttDataExchangeBuffers.rxbuff.dataLength == 0)
-		return mqttState;
-
 	switch (mqttState) {
 	case WAITFORCONNACK:
 		keepAliveTimeout = ntohs(txConnectPacket.connectVariableHeader.keepAliveTimer);
@@ -1013,12 +1322,51 @@ mqttCurrentState MQTT_ReceptionHandler(mqttContext *mqttConnectionPtr)
 	return mqttState;
 }
 
+mqttCurrentState MQTT_ReceptionHandler(mqttContext *mqttConnectionPtr)
+{
+	exchangeBuffer *rxbuff = &mqttConnectionPtr->mqttDataExchangeBuffers.rxbuff;
+	uint32_t        packetLength;
+	uint16_t        dataLength;
+	uint16_t        skipped;
+
+	// The rest of a packet that did not fit
+	if (rxDiscardLength != 0) {
+		skipped = (rxDiscardLength < rxbuff->dataLength) ? rxDiscardLength : rxbuff->dataLength;
+		MQTT_ExchangeBufferConsume(rxbuff, skipped);
+		rxDiscardLength -= skipped;
+	}
+
+	// One TCP segment may carry several packets, e.g. the PUBACKs of a burst,
+	// and a packet may come in several. Only complete packets are processed.
+	while ((rxbuff->dataLength != 0) && ((mqttState == WAITFORCONNACK) || (mqttState == CONNECTED))) {
+		packetLength = mqttPeekPacketLength(rxbuff);
+		if (packetLength > rxbuff->bufferLength) {
+			debug_printError("MQTT: %lu byte packet dropped", (unsigned long)packetLength);
+			rxDiscardLength = (packetLength == UINT32_MAX) ? UINT32_MAX : packetLength - rxbuff->dataLength;
+			MQTT_ExchangeBufferInit(rxbuff);
+			break;
+		}
+		if ((packetLength == 0) || (packetLength > rxbuff->dataLength)) {
+			break;
+		}
+
+		dataLength = rxbuff->dataLength;
+		mqttReceivePacket(mqttConnectionPtr);
+
+		// Skip what was not read of the packet, e.g. of a type the client ignores
+		if (dataLength - rxbuff->dataLength < packetLength) {
+			MQTT_ExchangeBufferConsume(rxbuff, packetLength - (dataLength - rxbuff->dataLength));
+		}
+	}
+
+	return mqttState;
+}
+
 static bool mqttSendSubscribe(mqttContext *mqttConnectionPtr)
 {
 	bool ret = false;
 
 	MQTT_ExchangeBufferInit(&mqttConnectionPtr->mqttDataExchangeBuffers.txbuff);
-	MQTT_ExchangeBufferInit(&mqttConnectionPtr->mqttDataExchangeBuffers.rxbuff);
 
 	// Copy the txSubscribePacket data in TCP Tx buffer
 	MQTT_ExchangeBufferWrite(&mqttConnectionPtr->mqttDataExchangeBuffers.txbuff,
@@ -1064,7 +1412,6 @@ static bool mqttSendPingreq(mqttContext *mqttConnectionPtr)
 	ret = false;
 	memset(&txPingreqPacket, 0, sizeof(txPingreqPacket));
 	MQTT_ExchangeBufferInit(&mqttConnectionPtr->mqttDataExchangeBuffers.txbuff);
-	MQTT_ExchangeBufferInit(&mqttConnectionPtr->mqttDataExchangeBuffers.rxbuff);
 
 	// Send a PINGREQ packet here
 	txPingreqPacket.pingFixedHeader.controlPacketType = PINGREQ;
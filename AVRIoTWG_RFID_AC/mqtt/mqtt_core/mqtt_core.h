@@ -66,6 +66,7 @@
 
 #define WAITFORCONNACK_TIMEOUT (30 * SECONDS)
 #define WAITFORPINGRESP_TIMEOUT (30 * SECONDS)
+#define WAITFORPUBACK_TIMEOUT (10 * SECONDS)
 
 /*******************Timeout Driver for MQTT definitions*(END)******************/
 
@@ -202,6 +203,9 @@ typedef struct {
 
 } mqttConnackPacket_t;
 
+/** \brief Called by the MQTT core when the PUBACK of a QoS 1 PUBLISH packet arrived. */
+typedef void (*mqttPublishAckHandler)(void);
+
 /** \brief MQTT PUBLISH packet
  *
  * This is used by the application to form and process a PUBLISH packet.
@@ -224,6 +228,9 @@ typedef struct {
 	uint8_t *payload;
 
 	uint16_t totalLength;
+
+	// Not part of the packet, NULL if the application does not wait for the PUBACK
+	mqttPublishAckHandler ackHandler;
 } mqttPublishPacket;
 
 /** \brief MQTT PUBACK packet
@@ -321,5 +328,7 @@ mqttCurrentState MQTT_TransmissionHandler(mqttContext *mqttContextPtr);
 mqttCurrentState MQTT_ReceptionHandler(mqttContext *mqttContextPtr);
 
 mqttCurrentState MQTT_GetConnectionState(void);
+bool             MQTT_IsPublishPending(void);
+uint16_t         MQTT_GetPublishDropCount(void);
 
 #endif /* MQTT_CORE_H */
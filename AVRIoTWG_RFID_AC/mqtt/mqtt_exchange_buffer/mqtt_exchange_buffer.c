@@ -25,66 +25,148 @@
     SOFTWARE.
 */
 
+#include <string.h>
 #include "mqtt_exchange_buffer.h"
 #include "../../debug_print.h"
 
+// The data is the dataLength bytes from currentLocation on, wrapping at the
+// end of the buffer. Copies in and out are split into at most two memcpy(),
+// up to the end of the buffer and on from its start.
+
+// Index of the byte 'offset' bytes after currentLocation, offset <= bufferLength
+static uint16_t exchangeBufferIndex(exchangeBuffer *buffer, uint16_t offset)
+{
+	uint16_t index   = buffer->currentLocation - buffer->start;
+	uint16_t tailLen = buffer->bufferLength - index;
+
+	return (offset < tailLen) ? index + offset : offset - tailLen;
+}
+
+static void exchangeBufferCopyIn(exchangeBuffer *buffer, uint16_t index, uint8_t *data, uint16_t length)
+{
+	uint16_t first = buffer->bufferLength - index;
+
+	if (first > length) {
+		first = length;
+	}
+	memcpy(buffer->start + index, data, first);
+	memcpy(buffer->start, data + first, length - first);
+}
+
+static void exchangeBufferCopyOut(exchangeBuffer *buffer, uint16_t index, uint8_t *data, uint16_t length)
+{
+	uint16_t first = buffer->bufferLength - index;
+
+	if (first > length) {
+		first = length;
+	}
+	memcpy(data, buffer->start + index, first);
+	memcpy(data + first, buffer->start, length - first);
+}
+
 void MQTT_ExchangeBufferInit(exchangeBuffer *buffer)
 {
 	buffer->currentLocation = buffer->start;
 	buffer->dataLength      = 0;
 }
 
+// Returns the number of bytes written, less than length if the buffer is full
 uint16_t MQTT_ExchangeBufferWrite(exchangeBuffer *buffer, uint8_t *data, uint16_t length)
 {
-	uint8_t *bend = buffer->start + buffer->bufferLength - 1;
-	uint8_t *dend
-	    = (buffer->currentLocation - buffer->start + buffer->dataLength) % buffer->bufferLength + buffer->start;
-	uint16_t i = 0;
-
-	for (i = length; i > 0; i--) {
-		if (dend > bend) {
-			dend = buffer->start;
-		}
-		if (buffer->dataLength != 0 && dend == buffer->currentLocation) {
-			break;
-		}
-		*dend = *data;
-		dend++;
-		data++;
-		buffer->dataLength++;
+	uint16_t space = buffer->bufferLength - buffer->dataLength;
+
+	if (length > space) {
+		length = space;
 	}
+	exchangeBufferCopyIn(buffer, exchangeBufferIndex(buffer, buffer->dataLength), data, length);
+	buffer->dataLength += length;
 
 	return length;
 }
 
 uint16_t MQTT_ExchangeBufferPeek(exchangeBuffer *buffer, uint8_t *data, uint16_t length)
 {
-	uint8_t *ptr  = buffer->currentLocation;
-	uint8_t *bend = buffer->start + buffer->bufferLength - 1;
-	uint16_t i    = 0;
-
-	for (i = 0; i < length && i < buffer->dataLength; i++) {
-		data[i] = ptr[i];
-		if (ptr > bend) {
-			ptr = buffer->start;
-		}
+	return MQTT_ExchangeBufferPeekAt(buffer, 0, data, length);
+}
+
+// Copies data starting 'offset' bytes into the buffer without consuming it
+uint16_t MQTT_ExchangeBufferPeekAt(exchangeBuffer *buffer, uint16_t offset, uint8_t *data, uint16_t length)
+{
+	if (offset >= buffer->dataLength) {
+		return 0;
+	}
+	if (length > buffer->dataLength - offset) {
+		length = buffer->dataLength - offset;
 	}
+	exchangeBufferCopyOut(buffer, exchangeBufferIndex(buffer, offset), data, length);
 
-	return i;
+	return length;
 }
 
 uint16_t MQTT_ExchangeBufferRead(exchangeBuffer *buffer, uint8_t *data, uint16_t length)
 {
-	uint8_t *bend = buffer->start + buffer->bufferLength - 1;
-	uint16_t i    = 0;
-
-	for (i = 0; i < length && buffer->dataLength > 0; i++) {
-		data[i] = *buffer->currentLocation;
-		buffer->currentLocation++;
-		buffer->dataLength--;
-		if (buffer->currentLocation > bend) {
-			buffer->currentLocation = buffer->start;
-		}
+	length = MQTT_ExchangeBufferPeekAt(buffer, 0, data, length);
+	MQTT_ExchangeBufferConsume(buffer, length);
+
+	return length;
+}
+
+// Contiguous free space behind the data. The caller fills up to the returned
+// number of bytes at *span and hands them over with MQTT_ExchangeBufferCommit().
+uint16_t MQTT_ExchangeBufferGetWriteSpan(exchangeBuffer *buffer, uint8_t **span)
+{
+	uint16_t index = exchangeBufferIndex(buffer, buffer->dataLength);
+	uint16_t space = buffer->bufferLength - buffer->dataLength;
+
+	*span = buffer->start + index;
+
+	// Before the wrap only up to the end of the buffer
+	if (space > buffer->bufferLength - index) {
+		space = buffer->bufferLength - index;
+	}
+	return space;
+}
+
+void MQTT_ExchangeBufferCommit(exchangeBuffer *buffer, uint16_t length)
+{
+	uint16_t space = buffer->bufferLength - buffer->dataLength;
+
+	buffer->dataLength += (length > space) ? space : length;
+}
+
+// Contiguous data at the head of the buffer. The caller uses up to the
+// returned number of bytes at *span and drops them with MQTT_ExchangeBufferConsume().
+// If less than dataLength is returned the rest follows at buffer->start.
+uint16_t MQTT_ExchangeBufferGetReadSpan(exchangeBuffer *buffer, uint8_t **span)
+{
+	return MQTT_ExchangeBufferGetReadSpanAt(buffer, 0, span);
+}
+
+// Same as MQTT_ExchangeBufferGetReadSpan() for the data 'offset' bytes into the buffer
+uint16_t MQTT_ExchangeBufferGetReadSpanAt(exchangeBuffer *buffer, uint16_t offset, uint8_t **span)
+{
+	uint16_t index;
+	uint16_t length;
+
+	if (offset >= buffer->dataLength) {
+		*span = buffer->currentLocation;
+		return 0;
+	}
+
+	index  = exchangeBufferIndex(buffer, offset);
+	length = buffer->dataLength - offset;
+	*span  = buffer->start + index;
+
+	return (length > buffer->bufferLength - index) ? buffer->bufferLength - index : length;
+}
+
+void MQTT_ExchangeBufferConsume(exchangeBuffer *buffer, uint16_t length)
+{
+	if (length >= buffer->dataLength) {
+		// Start over at the beginning, this keeps the next write span as long as possible
+		MQTT_ExchangeBufferInit(buffer);
+		return;
 	}
-	return i;
+	buffer->currentLocation = buffer->start + exchangeBufferIndex(buffer, length);
+	buffer->dataLength -= length;
 }
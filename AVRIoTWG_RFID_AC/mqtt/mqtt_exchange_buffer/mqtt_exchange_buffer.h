@@ -44,3 +44,11 @@ void     MQTT_ExchangeBufferInit(exchangeBuffer *buffer);
 uint16_t MQTT_ExchangeBufferPeek(exchangeBuffer *buffer, uint8_t *data, uint16_t length);
 uint16_t MQTT_ExchangeBufferWrite(exchangeBuffer *buffer, uint8_t *data, uint16_t length);
 uint16_t MQTT_ExchangeBufferRead(exchangeBuffer *buffer, uint8_t *data, uint16_t length);
+uint16_t MQTT_ExchangeBufferPeekAt(exchangeBuffer *buffer, uint16_t offset, uint8_t *data, uint16_t length);
+
+// Zero-copy access, see mqtt_exchange_buffer.c
+uint16_t MQTT_ExchangeBufferGetWriteSpan(exchangeBuffer *buffer, uint8_t **span);
+void     MQTT_ExchangeBufferCommit(exchangeBuffer *buffer, uint16_t length);
+uint16_t MQTT_ExchangeBufferGetReadSpan(exchangeBuffer *buffer, uint8_t **span);
+uint16_t MQTT_ExchangeBufferGetReadSpanAt(exchangeBuffer *buffer, uint16_t offset, uint8_t **span);
+void     MQTT_ExchangeBufferConsume(exchangeBuffer *buffer, uint16_t length);
@@ -0,0 +1,73 @@
+/*
+ * recent_uid.c
+ *
+ * Ring of recently read badge UIDs with the time they were last seen. Once
+ * the ring is full the oldest entry is reused. UIDs are kept in the byte
+ * order of ISO15693_GetUID(), ACCESS_LIST_UID_LENGTH bytes each.
+ */
+
+#include <string.h>
+#include <time.h>
+#include "recent_uid.h"
+#include "Config/IoT_Sensor_Node_config.h"
+
+typedef struct {
+	uint8_t uid[ACCESS_LIST_UID_LENGTH];
+	time_t  lastSeen;
+} recent_uid_t;
+
+static recent_uid_t recentUID[RECENT_UID_ENTRIES];
+static uint8_t      recentUIDCount = 0;
+static uint8_t      recentUIDNext  = 0; // entry written next once the ring is full
+static uint16_t     suppressedCount = 0;
+
+void RECENT_UID_init( void )
+{
+	recentUIDCount  = 0;
+	recentUIDNext   = 0;
+	suppressedCount = 0;
+}
+
+// Returns true if the UID was seen less than CFG_DUPLICATE_WINDOW seconds ago.
+// Either way the UID is (re)stamped with the current time, so a badge that
+// stays on the reader is only reported again once it was away for the window.
+bool RECENT_UID_isRepeat( const uint8_t *uid )
+{
+	time_t  timeNow = time( NULL );
+	uint8_t i;
+
+	for ( i = 0 ; i < recentUIDCount ; i++ )
+	{
+		if ( memcmp( recentUID[i].uid, uid, ACCESS_LIST_UID_LENGTH ) == 0 )
+		{
+			bool repeat = difftime( timeNow, recentUID[i].lastSeen ) < CFG_DUPLICATE_WINDOW;
+
+			recentUID[i].lastSeen = timeNow;
+			if ( repeat )
+			{
+				suppressedCount++;
+			}
+			return repeat;
+		}
+	}
+
+	if ( recentUIDCount < RECENT_UID_ENTRIES )
+	{
+		i = recentUIDCount++;
+	}
+	else
+	{
+		i = recentUIDNext;
+		recentUIDNext = ( recentUIDNext + 1 ) % RECENT_UID_ENTRIES;
+	}
+
+	memcpy( recentUID[i].uid, uid, ACCESS_LIST_UID_LENGTH );
+	recentUID[i].lastSeen = timeNow;
+
+	return false;
+}
+
+uint16_t RECENT_UID_getSuppressed( void )
+{
+	return suppressedCount;
+}
@@ -0,0 +1,23 @@
+/*
+ * recent_uid.h
+ *
+ * Ring of the badge UIDs read in the last few seconds. A badge left on the
+ * reader is scanned over and over, RFID_ScanComplete() uses the ring so the
+ * cloud only hears about it once per CFG_DUPLICATE_WINDOW.
+ */
+
+
+#ifndef RECENT_UID_H_
+#define RECENT_UID_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "access_list.h"
+
+#define RECENT_UID_ENTRIES 8
+
+void     RECENT_UID_init( void );
+bool     RECENT_UID_isRepeat( const uint8_t *uid );
+uint16_t RECENT_UID_getSuppressed( void );
+
+#endif /* RECENT_UID_H_ */
@@ -0,0 +1,89 @@
+/**
+ * \file
+ *
+ * \brief TCB0 one-shot timeouts for the scheduler.
+ *
+ * TCB0 runs in periodic interrupt mode and is stopped from its first
+ * interrupt, the task of the timer is then queued like an expired timer.
+ */
+
+#include <avr/interrupt.h>
+#include "fine_timeout.h"
+#include "atomic.h"
+
+#if SCHEDULER_FINE_TIMEOUT
+
+// Timer waiting for TCB0, NULL while TCB0 is stopped
+static timer_struct_t *volatile fine_timeout_pending = NULL;
+
+static void fine_timeout_stop(void)
+{
+	TCB0.CTRLA    = 0;
+	TCB0.INTCTRL  = 0;
+	TCB0.INTFLAGS = TCB_CAPT_bm;
+}
+
+bool scheduler_fine_timeout_create(timer_struct_t *timer, uint16_t us)
+{
+	uint16_t ticks;
+
+	if (us > FINE_TIMEOUT_MAX_US) {
+		return false;
+	}
+
+	ENTER_CRITICAL(F);
+	if (fine_timeout_pending != NULL && fine_timeout_pending != timer) {
+		EXIT_CRITICAL(F);
+		return false;
+	}
+	fine_timeout_stop();
+	fine_timeout_pending = NULL;
+	EXIT_CRITICAL(F);
+
+	// The task must not be pending or queued twice
+	scheduler_timeout_delete(timer);
+
+	// The interrupt comes when CNT matches CCMP, one tick at the least
+	ticks = us * FINE_TIMEOUT_TICKS_PER_US;
+	if (ticks == 0) {
+		ticks = 1;
+	}
+
+	ENTER_CRITICAL(S);
+	fine_timeout_pending = timer;
+	TCB0.CTRLB           = TCB_CNTMODE_INT_gc;
+	TCB0.CNT             = 0;
+	TCB0.CCMP            = ticks;
+	TCB0.INTCTRL         = TCB_CAPT_bm;
+	TCB0.CTRLA           = TCB_CLKSEL_CLKDIV2_gc | TCB_ENABLE_bm;
+	EXIT_CRITICAL(S);
+
+	return true;
+}
+
+void scheduler_fine_timeout_delete(timer_struct_t *timer)
+{
+	ENTER_CRITICAL(F);
+	if (fine_timeout_pending == timer) {
+		fine_timeout_stop();
+		fine_timeout_pending = NULL;
+	}
+	EXIT_CRITICAL(F);
+
+	// The task may have been queued already
+	scheduler_timeout_delete(timer);
+}
+
+ISR(TCB0_INT_vect)
+{
+	timer_struct_t *expired = fine_timeout_pending;
+
+	fine_timeout_stop();
+	fine_timeout_pending = NULL;
+
+	if (expired != NULL) {
+		scheduler_timeout_enqueue_from_isr(expired);
+	}
+}
+
+#endif
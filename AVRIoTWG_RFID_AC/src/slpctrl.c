@@ -35,6 +35,8 @@
  *@{
  */
 #include <slpctrl.h>
+#include <avr/sleep.h>
+#include <avr/interrupt.h>
 
 /**
  * \brief Initialize Sleep Controller
@@ -44,8 +46,25 @@
 int8_t SLPCTRL_init()
 {
 
-	// SLPCTRL.CTRLA = 0 << SLPCTRL_SEN_bp /* Sleep enable: disabled */
-	//		 | SLPCTRL_SMODE_IDLE_gc; /* Idle mode */
+	SLPCTRL.CTRLA = 0 << SLPCTRL_SEN_bp /* Sleep enable: disabled */
+	                | SLPCTRL_SMODE_IDLE_gc; /* Idle mode */
 
 	return 0;
 }
+
+/**
+ * \brief Sleep until the next interrupt
+ *
+ * Must be called with interrupts disabled. They are enabled right before the
+ * sleep instruction, which still executes before any pending interrupt, so an
+ * interrupt can not slip in between the caller's last check and the sleep.
+ *
+ * \return Nothing
+ */
+void SLPCTRL_sleep(void)
+{
+	sleep_enable();
+	sei();
+	sleep_cpu();
+	sleep_disable();
+}
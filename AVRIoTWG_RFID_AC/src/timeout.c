@@ -36,7 +36,7 @@
 */
 #include <stdio.h>
 #include "timeout.h"
-#include "atomic.h"
+#include "timeout_hal.h"
 
 absolutetime_t scheduler_dummy_handler(void *payload)
 {
@@ -49,68 +49,186 @@ void           scheduler_set_timer_duration(absolutetime_t duration);
 absolutetime_t scheduler_make_absolute(absolutetime_t timeout);
 absolutetime_t scheduler_rebase_list(void);
 
-timer_struct_t *scheduler_list_head          = NULL;
-timer_struct_t *scheduler_execute_queue_head = NULL;
+#if SCHEDULER_TIMER_HEAP
+#if SCHEDULER_HEAP_SIZE < 2 || SCHEDULER_HEAP_SIZE > 255
+#error "SCHEDULER_HEAP_SIZE must be from 2 to 255"
+#endif
+
+// Pending timers, scheduler_heap[0] expires first
+timer_struct_t *scheduler_heap[SCHEDULER_HEAP_SIZE];
+uint8_t         scheduler_heap_count = 0;
+#else
+timer_struct_t *scheduler_list_head = NULL;
+#endif
+
+// Expired timers waiting for scheduler_timeout_call_next_callback(), one queue
+// per priority, each in order of expiry
+timer_struct_t *scheduler_execute_queue_head[SCHEDULER_PRIORITIES];
+timer_struct_t *scheduler_execute_queue_tail[SCHEDULER_PRIORITIES];
+
+static const uint8_t scheduler_dispatch_order[SCHEDULER_PRIORITIES]
+    = {SCHEDULER_PRIORITY_CRITICAL, SCHEDULER_PRIORITY_NORMAL, SCHEDULER_PRIORITY_BACKGROUND};
 
 timer_struct_t          scheduler_dummy                         = {scheduler_dummy_handler};
 volatile absolutetime_t scheduler_absolute_time_of_last_timeout = 0;
 volatile absolutetime_t scheduler_last_timer_load               = 0;
 volatile bool           scheduler_is_running                    = false;
 
+scheduler_sleep_stats_t scheduler_sleep_stats;
+
+#if SCHEDULER_PROFILE
+// One entry per task, in the order the tasks were named or first executed
+static scheduler_profile_t scheduler_profile[SCHEDULER_PROFILE_SLOTS];
+static uint8_t             scheduler_profile_count = 0;
+#endif
+
 void scheduler_timeout_init(void)
 {
+	timeout_hal_init();
+}
 
-	while (RTC.STATUS > 0) { /* Wait for all register to be synchronized */
-	}
+void scheduler_stop_timeouts(void)
+{
+	timeout_hal_disable_overflow();
 
-	// RTC.CMP = 0x0; /* Compare: 0x0 */
+	// The time base stays, a sleep or a task that started before is still measured from it
+	scheduler_is_running = 0;
+}
 
-	// RTC.CNT = 0x0; /* Counter: 0x0 */
+inline void scheduler_set_timer_duration(absolutetime_t duration)
+{
+	// The overflow comes on the tick after CNT reached 65535, a duration of 0 is one tick
+	if (duration == 0)
+		duration = 1;
+	scheduler_last_timer_load = 65536 - duration;
+	timeout_hal_set_counter(scheduler_last_timer_load);
+}
 
-	RTC.CTRLA = RTC_PRESCALER_DIV1_gc   /* 1 */
-	            | 1 << RTC_RTCEN_bp     /* Enable: enabled */
-	            | 0 << RTC_RUNSTDBY_bp; /* Run In Standby: disabled */
+inline absolutetime_t scheduler_make_absolute(absolutetime_t timeout)
+{
+	timeout += scheduler_absolute_time_of_last_timeout;
+	timeout += scheduler_is_running ? timeout_hal_get_counter() - scheduler_last_timer_load : 0;
 
-	// RTC.PER = 0xffff; /* Period: 0xffff */
+	return timeout;
+}
 
-	RTC.CLKSEL = RTC_CLKSEL_INT1K_gc; /* 32KHz divided by 32 */
+#if SCHEDULER_TIMER_HEAP
 
-	// RTC.DBGCTRL = 0 << RTC_DBGRUN_bp; /* Run in debug: disabled */
+// The heap is intrusive: every pending timer keeps its own index, so deleting
+// any timer costs O(log n) like inserting it and expiring the first one.
 
-	RTC.INTCTRL = 0 << RTC_CMP_bp    /* Compare Match Interrupt enable: disabled */
-	              | 1 << RTC_OVF_bp; /* Overflow Interrupt enable: enabled */
+static inline void scheduler_heap_place(timer_struct_t *timer, uint8_t index)
+{
+	scheduler_heap[index] = timer;
+	timer->heap_index     = index;
+}
 
-	// RTC.PITCTRLA = RTC_PERIOD_OFF_gc /* Off */
-	//		 | 0 << RTC_PITEN_bp; /* Enable: disabled */
+static inline bool scheduler_heap_contains(timer_struct_t *timer)
+{
+	return timer->heap_index < scheduler_heap_count && scheduler_heap[timer->heap_index] == timer;
+}
 
-	// RTC.PITDBGCTRL = 0 << RTC_DBGRUN_bp; /* Run in debug: disabled */
+// Unlike the sorted list, timers with the same expiry time may expire in any order
+static void scheduler_heap_sift_up(uint8_t index)
+{
+	timer_struct_t *timer = scheduler_heap[index];
+
+	while (index > 0) {
+		uint8_t parent = (index - 1) / 2;
 
-	// RTC.PITINTCTRL = 0 << RTC_PI_bp; /* Periodic Interrupt: disabled */
+		if (scheduler_heap[parent]->absolute_time <= timer->absolute_time)
+			break;
+		scheduler_heap_place(scheduler_heap[parent], index);
+		index = parent;
+	}
+	scheduler_heap_place(timer, index);
 }
 
-void scheduler_stop_timeouts(void)
+static void scheduler_heap_sift_down(uint8_t index)
 {
-	RTC.INTCTRL &= ~RTC_OVF_bm;
-	scheduler_absolute_time_of_last_timeout = 0;
-	scheduler_is_running                    = 0;
+	timer_struct_t *timer = scheduler_heap[index];
+	uint16_t        child;
+
+	while ((child = 2 * (uint16_t)index + 1) < scheduler_heap_count) {
+		if (child + 1 < scheduler_heap_count
+		    && scheduler_heap[child + 1]->absolute_time < scheduler_heap[child]->absolute_time)
+			child++;
+		if (timer->absolute_time <= scheduler_heap[child]->absolute_time)
+			break;
+		scheduler_heap_place(scheduler_heap[child], index);
+		index = child;
+	}
+	scheduler_heap_place(timer, index);
 }
 
-inline void scheduler_set_timer_duration(absolutetime_t duration)
+// The last slot is kept for the dummy, so a timer too far for one period can always be armed
+static inline bool scheduler_heap_full(void)
 {
-	scheduler_last_timer_load = 65535 - duration;
+	return scheduler_heap_count - scheduler_heap_contains(&scheduler_dummy) >= SCHEDULER_HEAP_SIZE - 1;
+}
 
-	// Wait for clock domain synchronization
-	while (RTC.STATUS & RTC_CNTBUSY_bm)
-		;
-	RTC.CNT = scheduler_last_timer_load;
+// Timers other than the dummy are only pushed after checking scheduler_heap_full()
+static void scheduler_heap_push(timer_struct_t *timer)
+{
+	scheduler_heap_place(timer, scheduler_heap_count++);
+	scheduler_heap_sift_up(timer->heap_index);
 }
 
-inline absolutetime_t scheduler_make_absolute(absolutetime_t timeout)
+static void scheduler_heap_remove(uint8_t index)
 {
-	timeout += scheduler_absolute_time_of_last_timeout;
-	timeout += scheduler_is_running ? RTC.CNT - scheduler_last_timer_load : 0;
+	timer_struct_t *last = scheduler_heap[--scheduler_heap_count];
 
-	return timeout;
+	if (index < scheduler_heap_count) {
+		scheduler_heap_place(last, index);
+		scheduler_heap_sift_down(index);
+		scheduler_heap_sift_up(last->heap_index);
+	}
+}
+
+static inline timer_struct_t *scheduler_pending_head(void)
+{
+	return scheduler_heap_count ? scheduler_heap[0] : NULL;
+}
+
+static inline void scheduler_pending_remove_head(void)
+{
+	scheduler_heap_remove(0);
+}
+
+inline absolutetime_t scheduler_rebase_list(void)
+{
+	absolutetime_t base = scheduler_heap[0]->absolute_time;
+	uint8_t        i;
+
+	// Subtracting the same value from every timer keeps the heap order
+	for (i = 0; i < scheduler_heap_count; i++) {
+		scheduler_heap[i]->absolute_time -= base;
+	}
+
+	scheduler_absolute_time_of_last_timeout -= base;
+	return base;
+}
+
+inline void scheduler_print_list(void)
+{
+	uint8_t i;
+
+	for (i = 0; i < scheduler_heap_count; i++) {
+		printf("%ld -> ", (uint32_t)scheduler_heap[i]->absolute_time);
+	}
+	printf("NULL\n");
+}
+
+#else
+
+static inline timer_struct_t *scheduler_pending_head(void)
+{
+	return scheduler_list_head;
+}
+
+static inline void scheduler_pending_remove_head(void)
+{
+	scheduler_list_head = scheduler_list_head->next;
 }
 
 inline absolutetime_t scheduler_rebase_list(void)
@@ -137,20 +255,34 @@ inline void scheduler_print_list(void)
 	printf("NULL\n");
 }
 
+#endif
+
 // Returns true if the insert was at the head, false if not
 bool scheduler_sorted_insert(timer_struct_t *timer)
 {
-	absolutetime_t  timer_absolute_time = timer->absolute_time;
-	uint8_t         at_head             = 1;
-	timer_struct_t *insert_point        = scheduler_list_head;
-	timer_struct_t *prev_point          = NULL;
-	timer->next                         = NULL;
+	absolutetime_t timer_absolute_time = timer->absolute_time;
+	timer->next                        = NULL;
 
 	if (timer_absolute_time < scheduler_absolute_time_of_last_timeout) {
 		timer_absolute_time += 65535 - scheduler_rebase_list() + 1;
 		timer->absolute_time = timer_absolute_time;
 	}
 
+#if SCHEDULER_TIMER_HEAP
+	scheduler_heap_push(timer);
+	if (scheduler_heap[0] != timer) {
+		return false;
+	}
+
+	// The new head replaces the dummy, scheduler_start_timer_at_head() adds it again if needed
+	if (scheduler_heap_contains(&scheduler_dummy)) {
+		scheduler_heap_remove(scheduler_dummy.heap_index);
+	}
+#else
+	uint8_t         at_head      = 1;
+	timer_struct_t *insert_point = scheduler_list_head;
+	timer_struct_t *prev_point   = NULL;
+
 	while (insert_point != NULL) {
 		if (insert_point->absolute_time > timer_absolute_time) {
 			break; // found the spot
@@ -160,98 +292,158 @@ bool scheduler_sorted_insert(timer_struct_t *timer)
 		at_head      = 0;
 	}
 
-	if (at_head == 1) // the front of the list.
+	if (at_head == 0) // middle of the list
 	{
-		scheduler_set_timer_duration(65535);
-		RTC.INTFLAGS = RTC_OVF_bm;
-
-		timer->next         = (scheduler_list_head == &scheduler_dummy) ? scheduler_dummy.next : scheduler_list_head;
-		scheduler_list_head = timer;
-		return true;
-	} else // middle of the list
-	{
-		timer->next = prev_point->next;
+		timer->next      = prev_point->next;
+		prev_point->next = timer;
+		return false;
 	}
-	prev_point->next = timer;
-	return false;
+
+	// The front of the list
+	timer->next         = (scheduler_list_head == &scheduler_dummy) ? scheduler_dummy.next : scheduler_list_head;
+	scheduler_list_head = timer;
+#endif
+
+	// Keep the ticks counted since the last timeout, the counter is reloaded now
+	scheduler_absolute_time_of_last_timeout = scheduler_make_absolute(0);
+	scheduler_set_timer_duration(65535);
+	timeout_hal_clear_overflow();
+	return true;
 }
 
 void scheduler_start_timer_at_head(void)
 {
-	RTC.INTCTRL &= ~RTC_OVF_bm;
+	timer_struct_t *head = scheduler_pending_head();
+
+	timeout_hal_disable_overflow();
 
-	if (scheduler_list_head == NULL) // no timeouts left
+	if (head == NULL) // no timeouts left
 	{
 		scheduler_stop_timeouts();
 		return;
 	}
 
-	absolutetime_t period = ((scheduler_list_head != NULL) ? (scheduler_list_head->absolute_time) : 0)
-	                        - scheduler_absolute_time_of_last_timeout;
+	// Reloading the counter below would lose the ticks counted since the last timeout
+	scheduler_absolute_time_of_last_timeout = scheduler_make_absolute(0);
+
+	absolutetime_t period = head->absolute_time - scheduler_absolute_time_of_last_timeout;
+
+	// The head may already be due, let it expire on the next tick
+	if ((int32_t)period < 0) {
+		period = 0;
+	}
 
 	// Timer is too far, insert dummy and schedule timer after the dummy
 	if (period > 65535) {
 		scheduler_dummy.absolute_time = scheduler_absolute_time_of_last_timeout + 65535;
-		scheduler_dummy.next          = scheduler_list_head;
-		scheduler_list_head           = &scheduler_dummy;
-		period                        = 65535;
+#if SCHEDULER_TIMER_HEAP
+		// Never fails, scheduler_heap_full() keeps a slot for the dummy
+		scheduler_heap_push(&scheduler_dummy);
+#else
+		scheduler_dummy.next = scheduler_list_head;
+		scheduler_list_head  = &scheduler_dummy;
+#endif
+		period = 65535;
 	}
 
 	scheduler_set_timer_duration(period);
 
-	RTC.INTCTRL |= RTC_OVF_bm;
+	timeout_hal_enable_overflow();
 	scheduler_is_running = 1;
 }
 
 void scheduler_timeout_flush_all(void)
 {
+	timer_struct_t *timer;
+
 	scheduler_stop_timeouts();
 
-	while (scheduler_list_head != NULL) {
-		scheduler_timeout_delete(scheduler_list_head);
+	// Deleting the head one by one would arm the counter, and the dummy, for each next head
+	while ((timer = scheduler_pending_head()) != NULL) {
+		scheduler_pending_remove_head();
+		timer->next = NULL;
 	}
 
-	while (scheduler_execute_queue_head != NULL) {
-		scheduler_timeout_delete(scheduler_execute_queue_head);
+	for (uint8_t priority = 0; priority < SCHEDULER_PRIORITIES; priority++) {
+		while (scheduler_execute_queue_head[priority] != NULL) {
+			scheduler_timeout_delete(scheduler_execute_queue_head[priority]);
+		}
 	}
 }
 
-bool scheduler_timeout_delete_helper(timer_struct_t **list, timer_struct_t *timer)
+// Returns true if the timer was pending
+bool scheduler_pending_delete(timer_struct_t *timer)
 {
-	bool retVal = false;
-	if (*list == NULL)
-		return retVal;
+	if (scheduler_pending_head() == NULL)
+		return false;
 
 	// Guard in case we get interrupted, we cannot safely compare/search and get interrupted
-	RTC.INTCTRL &= ~RTC_OVF_bm;
+	timeout_hal_disable_overflow();
 
 	// Special case, the head is the one we are deleting
-	if (timer == *list) {
-		*list  = (*list)->next; // Delete the head
-		retVal = true;
+	if (timer == scheduler_pending_head()) {
+		scheduler_pending_remove_head();
 		scheduler_start_timer_at_head(); // Start the new timer at the head
-	} else {                             // More than one timer in the list, search the list.
-		timer_struct_t *find_timer = *list;
-		timer_struct_t *prev_timer = NULL;
-		while (find_timer != NULL) {
-			if (find_timer == timer) {
-				prev_timer->next = find_timer->next;
-				retVal           = true;
-				break;
-			}
-			prev_timer = find_timer;
-			find_timer = find_timer->next;
+		return true;
+	}
+
+#if SCHEDULER_TIMER_HEAP
+	bool retVal = scheduler_heap_contains(timer);
+	if (retVal) {
+		scheduler_heap_remove(timer->heap_index);
+	}
+#else
+	bool            retVal     = false;
+	timer_struct_t *find_timer = scheduler_list_head;
+	timer_struct_t *prev_timer = NULL;
+	while (find_timer != NULL) {
+		if (find_timer == timer) {
+			prev_timer->next = find_timer->next;
+			retVal           = true;
+			break;
 		}
-		RTC.INTCTRL |= RTC_OVF_bm;
+		prev_timer = find_timer;
+		find_timer = find_timer->next;
 	}
+#endif
+	timeout_hal_enable_overflow();
 
 	return retVal;
 }
 
+// Must be called with interrupts disabled, returns true if the timer was waiting for execution
+bool scheduler_execute_queue_delete(timer_struct_t *timer)
+{
+	uint8_t         priority   = timer->priority;
+	timer_struct_t *find_timer = scheduler_execute_queue_head[priority];
+	timer_struct_t *prev_timer = NULL;
+
+	while (find_timer != NULL) {
+		if (find_timer == timer) {
+			if (prev_timer == NULL) {
+				scheduler_execute_queue_head[priority] = timer->next;
+			} else {
+				prev_timer->next = timer->next;
+			}
+			if (scheduler_execute_queue_tail[priority] == timer) {
+				scheduler_execute_queue_tail[priority] = prev_timer;
+			}
+			return true;
+		}
+		prev_timer = find_timer;
+		find_timer = find_timer->next;
+	}
+
+	return false;
+}
+
 void scheduler_timeout_delete(timer_struct_t *timer)
 {
-	if (!scheduler_timeout_delete_helper(&scheduler_list_head, timer)) {
-		scheduler_timeout_delete_helper(&scheduler_execute_queue_head, timer);
+	if (!scheduler_pending_delete(timer)) {
+		// Interrupt handlers other than the RTC may append to the execute queue
+		ENTER_CRITICAL(D);
+		scheduler_execute_queue_delete(timer);
+		EXIT_CRITICAL(D);
 	}
 
 	timer->next = NULL;
@@ -259,57 +451,244 @@ void scheduler_timeout_delete(timer_struct_t *timer)
 
 inline void scheduler_enqueue_callback(timer_struct_t *timer)
 {
-	timer_struct_t *tmp;
-	timer->next = NULL;
+	uint8_t priority = timer->priority;
+	timer->next      = NULL;
 
 	// Special case for empty list
-	if (scheduler_execute_queue_head == NULL) {
-		scheduler_execute_queue_head = timer;
-		return;
+	if (scheduler_execute_queue_head[priority] == NULL) {
+		scheduler_execute_queue_head[priority] = timer;
+	} else {
+		scheduler_execute_queue_tail[priority]->next = timer;
+	}
+
+	scheduler_execute_queue_tail[priority] = timer;
+}
+
+// Returns the priority of the next task to execute, SCHEDULER_PRIORITIES if there is none
+static inline uint8_t scheduler_next_priority(void)
+{
+	for (uint8_t i = 0; i < SCHEDULER_PRIORITIES; i++) {
+		if (scheduler_execute_queue_head[scheduler_dispatch_order[i]] != NULL)
+			return scheduler_dispatch_order[i];
 	}
 
-	// Find the end of the list and insert the next expired timer at the back of the queue
-	tmp = scheduler_execute_queue_head;
-	while (tmp->next != NULL)
+	return SCHEDULER_PRIORITIES;
+}
+
+// Must only be called with interrupts disabled, i.e. from an ISR. The task is
+// stamped with the current time so its start latency is accounted like a timer's.
+void scheduler_timeout_enqueue_from_isr(timer_struct_t *timer)
+{
+	timer_struct_t *tmp = scheduler_execute_queue_head[timer->priority];
+
+	// Nothing to do if the task is already waiting for execution
+	while (tmp != NULL) {
+		if (tmp == timer)
+			return;
 		tmp = tmp->next;
+	}
 
-	tmp->next = timer;
+	timer->absolute_time = scheduler_make_absolute(0);
+	scheduler_enqueue_callback(timer);
 }
 
-void scheduler_timeout_call_next_callback(void)
+void scheduler_timeout_post(timer_struct_t *timer)
+{
+	ENTER_CRITICAL(Q);
+	scheduler_timeout_enqueue_from_isr(timer);
+	EXIT_CRITICAL(Q);
+}
+
+void scheduler_timeout_sleep(void)
 {
+	absolutetime_t sleep_start;
+
+	DISABLE_INTERRUPTS();
 
-	if (scheduler_execute_queue_head == NULL)
+	if (scheduler_next_priority() != SCHEDULER_PRIORITIES) {
+		ENABLE_INTERRUPTS();
 		return;
+	}
+
+	sleep_start = scheduler_make_absolute(0);
+	timeout_hal_sleep(); // Returns with interrupts enabled, after the ISR that woke us up
+
+	scheduler_sleep_stats.sleeps++;
+	scheduler_sleep_stats.sleep_time += scheduler_make_absolute(0) - sleep_start;
+}
+
+const scheduler_sleep_stats_t *scheduler_timeout_get_sleep_stats(void)
+{
+	return &scheduler_sleep_stats;
+}
+
+#if SCHEDULER_PROFILE
+
+// Returns the profile of the timer, a new one if it has none yet, or NULL if the table is full
+static scheduler_profile_t *scheduler_profile_find(timer_struct_t *timer)
+{
+	scheduler_profile_t *profile;
+	uint8_t              i;
+
+	for (i = 0; i < scheduler_profile_count; i++) {
+		if (scheduler_profile[i].timer == timer)
+			return &scheduler_profile[i];
+	}
+
+	if (scheduler_profile_count == SCHEDULER_PROFILE_SLOTS)
+		return NULL;
+
+	profile           = &scheduler_profile[scheduler_profile_count++];
+	profile->timer    = timer;
+	profile->name     = NULL;
+	profile->min_time = UINT16_MAX;
+
+	return profile;
+}
+
+void scheduler_timeout_profile_name(timer_struct_t *timer, const char *name)
+{
+	scheduler_profile_t *profile = scheduler_profile_find(timer);
+
+	if (profile != NULL)
+		profile->name = name;
+}
+
+const scheduler_profile_t *scheduler_timeout_get_profile(uint8_t index)
+{
+	return index < scheduler_profile_count ? &scheduler_profile[index] : NULL;
+}
+
+void scheduler_timeout_profile_reset(void)
+{
+	uint8_t i;
+
+	for (i = 0; i < scheduler_profile_count; i++) {
+		scheduler_profile_t *profile = &scheduler_profile[i];
+
+		profile->calls         = 0;
+		profile->overruns      = 0;
+		profile->min_time      = UINT16_MAX;
+		profile->max_time      = 0;
+		profile->total_time    = 0;
+		profile->max_latency   = 0;
+		profile->total_latency = 0;
+	}
+}
+
+static void scheduler_profile_record(timer_struct_t *timer, absolutetime_t latency, absolutetime_t time)
+{
+	scheduler_profile_t *profile = scheduler_profile_find(timer);
+
+	// Counters saturate, a reset starts over
+	if (profile == NULL || profile->calls == UINT16_MAX)
+		return;
+
+	if (time > UINT16_MAX)
+		time = UINT16_MAX;
+	if (latency > UINT16_MAX)
+		latency = UINT16_MAX;
+
+	profile->calls++;
+	profile->total_time += time;
+	profile->total_latency += latency;
+	if (time < profile->min_time)
+		profile->min_time = time;
+	if (time > profile->max_time)
+		profile->max_time = time;
+	if (latency > profile->max_latency)
+		profile->max_latency = latency;
+	if (time > SCHEDULER_PROFILE_BUDGET)
+		profile->overruns++;
+}
+
+#endif
+
+static void scheduler_execute_next(uint8_t priority)
+{
+	absolutetime_t latency;
+	absolutetime_t start;
 
 	// Critical section needed if scheduler_timeout_call_next_callback()
 	// was called from polling loop, and not called from ISR.
 	ENTER_CRITICAL(T);
-	timer_struct_t *callback_timer = scheduler_execute_queue_head;
+	timer_struct_t *callback_timer = scheduler_execute_queue_head[priority];
 
 	// Done, remove from list
-	scheduler_execute_queue_head = scheduler_execute_queue_head->next;
+	scheduler_execute_queue_head[priority] = callback_timer->next;
+	if (scheduler_execute_queue_head[priority] == NULL) {
+		scheduler_execute_queue_tail[priority] = NULL;
+	}
 
 	// Mark the timer as not in use
 	callback_timer->next = NULL;
 
+	// absolute_time is when the timer expired or the ISR queued the task
+	start   = scheduler_make_absolute(0);
+	latency = start - callback_timer->absolute_time;
+
 	EXIT_CRITICAL(T); // End critical section
 
+	// A negative latency means the time base was rebased while the task waited
+	if (latency < ((absolutetime_t)-1 >> 1)) {
+		scheduler_sleep_stats.callbacks++;
+		scheduler_sleep_stats.total_latency += latency;
+		if (latency > scheduler_sleep_stats.max_latency)
+			scheduler_sleep_stats.max_latency = latency;
+	} else {
+		latency = 0;
+	}
+
 	absolutetime_t reschedule = callback_timer->callback_ptr(callback_timer->payload);
 
+#if SCHEDULER_PROFILE
+	ENTER_CRITICAL(P);
+	start = scheduler_make_absolute(0) - start;
+	EXIT_CRITICAL(P);
+
+	// Same for the run time, the callback may have rebased the time base
+	scheduler_profile_record(callback_timer, latency, (start < ((absolutetime_t)-1 >> 1)) ? start : 0);
+#else
+	(void)start;
+#endif
+
 	// Do we have to reschedule it? If yes then add delta to absolute for reschedule
 	if (reschedule) {
 		scheduler_timeout_create(callback_timer, reschedule);
 	}
 }
 
-void scheduler_timeout_create(timer_struct_t *timer, absolutetime_t timeout)
+void scheduler_timeout_call_next_callback(void)
 {
-	RTC.INTCTRL &= ~RTC_OVF_bm;
+	uint8_t background = 0;
+	uint8_t priority;
+
+	// The queues are checked again after every task, critical tasks that became due meanwhile go first
+	while ((priority = scheduler_next_priority()) != SCHEDULER_PRIORITIES) {
+		if (priority == SCHEDULER_PRIORITY_BACKGROUND && background++ == SCHEDULER_BACKGROUND_BUDGET)
+			return;
+
+		scheduler_execute_next(priority);
+	}
+}
+
+bool scheduler_timeout_create(timer_struct_t *timer, absolutetime_t timeout)
+{
+	timeout_hal_disable_overflow();
 
 	// If this timer is already active, replace it
 	scheduler_timeout_delete(timer);
 
+#if SCHEDULER_TIMER_HEAP
+	// SCHEDULER_HEAP_SIZE is too small if this ever happens
+	if (scheduler_heap_full()) {
+		scheduler_sleep_stats.lost_timers++;
+		if (scheduler_is_running)
+			timeout_hal_enable_overflow();
+		return false;
+	}
+#endif
+
 	timer->absolute_time = scheduler_make_absolute(timeout);
 
 	// We only have to start the timer at head if the insert was at the head
@@ -317,26 +696,33 @@ void scheduler_timeout_create(timer_struct_t *timer, absolutetime_t timeout)
 		scheduler_start_timer_at_head();
 	} else {
 		if (scheduler_is_running)
-			RTC.INTCTRL |= RTC_OVF_bm;
+			timeout_hal_enable_overflow();
 	}
+
+	return true;
 }
 
+// Counter overflow, called from the interrupt handler of the clock backend
 // NOTE: assumes the callback completes before the next timer tick
-ISR(RTC_CNT_vect)
+void scheduler_timeout_isr(void)
 {
-	timer_struct_t *next                    = scheduler_list_head->next;
-	scheduler_absolute_time_of_last_timeout = scheduler_list_head->absolute_time;
-	scheduler_last_timer_load               = 0;
+	timer_struct_t *expired = scheduler_pending_head();
 
-	if (scheduler_list_head != &scheduler_dummy)
-		scheduler_enqueue_callback(scheduler_list_head);
+	// The time of the head, or a tick later if the head was already due when the counter was loaded
+	scheduler_absolute_time_of_last_timeout += 65536 - scheduler_last_timer_load;
+	scheduler_last_timer_load = 0;
 
-	// Remove expired timer for the list now (it is always the one at the head)
-	scheduler_list_head = next;
+	// Every timer due by now expires, not one per tick. Expired timers always are at the head.
+	while (expired != NULL && (int32_t)(expired->absolute_time - scheduler_absolute_time_of_last_timeout) <= 0) {
+		scheduler_pending_remove_head();
 
-	scheduler_start_timer_at_head();
+		if (expired != &scheduler_dummy)
+			scheduler_enqueue_callback(expired);
 
-	RTC.INTFLAGS = RTC_OVF_bm;
+		expired = scheduler_pending_head();
+	}
+
+	scheduler_start_timer_at_head();
 }
 
 // These methods are for calculating the elapsed time in stopwatch mode.
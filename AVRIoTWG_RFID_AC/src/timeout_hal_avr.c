@@ -0,0 +1,48 @@
+/**
+ * \file
+ *
+ * \brief RTC backend of the timeout driver clock.
+ *
+ * The RTC counts the internal 32 kHz oscillator divided by 32, a tick is
+ * 1/1024 s. Only the overflow interrupt is used.
+ */
+
+#include <avr/interrupt.h>
+#include "timeout_hal.h"
+
+void timeout_hal_init(void)
+{
+
+	while (RTC.STATUS > 0) { /* Wait for all register to be synchronized */
+	}
+
+	// RTC.CMP = 0x0; /* Compare: 0x0 */
+
+	// RTC.CNT = 0x0; /* Counter: 0x0 */
+
+	RTC.CTRLA = RTC_PRESCALER_DIV1_gc   /* 1 */
+	            | 1 << RTC_RTCEN_bp     /* Enable: enabled */
+	            | 0 << RTC_RUNSTDBY_bp; /* Run In Standby: disabled */
+
+	// RTC.PER = 0xffff; /* Period: 0xffff */
+
+	RTC.CLKSEL = RTC_CLKSEL_INT1K_gc; /* 32KHz divided by 32 */
+
+	// RTC.DBGCTRL = 0 << RTC_DBGRUN_bp; /* Run in debug: disabled */
+
+	RTC.INTCTRL = 0 << RTC_CMP_bp    /* Compare Match Interrupt enable: disabled */
+	              | 1 << RTC_OVF_bp; /* Overflow Interrupt enable: enabled */
+
+	// RTC.PITCTRLA = RTC_PERIOD_OFF_gc /* Off */
+	//		 | 0 << RTC_PITEN_bp; /* Enable: disabled */
+
+	// RTC.PITDBGCTRL = 0 << RTC_DBGRUN_bp; /* Run in debug: disabled */
+
+	// RTC.PITINTCTRL = 0 << RTC_PI_bp; /* Periodic Interrupt: disabled */
+}
+
+ISR(RTC_CNT_vect)
+{
+	scheduler_timeout_isr();
+	timeout_hal_clear_overflow();
+}
@@ -0,0 +1,164 @@
+/**
+ * \file
+ *
+ * \brief Virtual clock backend of the timeout driver, for host builds.
+ *
+ * Behaves like the RTC: a 16-bit counter that keeps running, an overflow
+ * flag that is set when it wraps and an overflow interrupt that runs
+ * scheduler_timeout_isr() as long as it is enabled and not held back by a
+ * critical section. An overflow that is held back runs as soon as that ends,
+ * just like a pending interrupt on the AVR.
+ */
+
+#ifndef __AVR__
+
+#include <time.h>
+#include "timeout_hal.h"
+
+#define TIMEOUT_HAL_TICKS_PER_SECOND 1024
+
+static uint16_t timeout_hal_counter;
+static uint32_t timeout_hal_ticks;
+static uint32_t timeout_hal_overflows;
+static bool     timeout_hal_overflow_enabled;
+static bool     timeout_hal_overflow_flag;
+static uint8_t  timeout_hal_lock_depth;
+
+static bool            timeout_hal_realtime;
+static struct timespec timeout_hal_realtime_start;
+static uint32_t        timeout_hal_realtime_ticks; // ticks at timeout_hal_realtime_start
+
+static void timeout_hal_run_pending(void)
+{
+	while (timeout_hal_overflow_flag && timeout_hal_overflow_enabled && timeout_hal_lock_depth == 0) {
+		timeout_hal_lock_depth++;
+		scheduler_timeout_isr();
+		timeout_hal_overflow_flag = false;
+		timeout_hal_lock_depth--;
+	}
+}
+
+void timeout_hal_init(void)
+{
+	timeout_hal_counter          = 0;
+	timeout_hal_ticks            = 0;
+	timeout_hal_overflow_enabled = true;
+	timeout_hal_overflow_flag    = false;
+	timeout_hal_lock_depth       = 0;
+	timeout_hal_set_realtime(timeout_hal_realtime);
+}
+
+uint16_t timeout_hal_get_counter(void)
+{
+	return timeout_hal_counter;
+}
+
+void timeout_hal_set_counter(uint16_t value)
+{
+	timeout_hal_counter = value;
+}
+
+void timeout_hal_enable_overflow(void)
+{
+	timeout_hal_overflow_enabled = true;
+	timeout_hal_run_pending();
+}
+
+void timeout_hal_disable_overflow(void)
+{
+	timeout_hal_overflow_enabled = false;
+}
+
+void timeout_hal_clear_overflow(void)
+{
+	timeout_hal_overflow_flag = false;
+}
+
+void timeout_hal_lock(void)
+{
+	timeout_hal_lock_depth++;
+}
+
+void timeout_hal_unlock(void)
+{
+	if (timeout_hal_lock_depth > 0)
+		timeout_hal_lock_depth--;
+	timeout_hal_run_pending();
+}
+
+void timeout_hal_advance(uint32_t ticks)
+{
+	while (ticks > 0) {
+		uint32_t to_overflow = 65536 - (uint32_t)timeout_hal_counter;
+
+		if (ticks < to_overflow) {
+			timeout_hal_counter += ticks;
+			timeout_hal_ticks += ticks;
+			return;
+		}
+
+		// The interrupt may reload the counter, so go one overflow at a time
+		ticks -= to_overflow;
+		timeout_hal_ticks += to_overflow;
+		timeout_hal_counter       = 0;
+		timeout_hal_overflow_flag = true;
+		timeout_hal_overflows++;
+		timeout_hal_run_pending();
+	}
+}
+
+uint32_t timeout_hal_get_ticks(void)
+{
+	return timeout_hal_ticks;
+}
+
+void timeout_hal_set_realtime(bool realtime)
+{
+	timeout_hal_realtime = realtime;
+	if (realtime) {
+		clock_gettime(CLOCK_MONOTONIC, &timeout_hal_realtime_start);
+		timeout_hal_realtime_ticks = timeout_hal_ticks;
+	}
+}
+
+void timeout_hal_poll(void)
+{
+	struct timespec now;
+	uint64_t        elapsed;
+
+	if (!timeout_hal_realtime)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = (uint64_t)(now.tv_sec - timeout_hal_realtime_start.tv_sec) * TIMEOUT_HAL_TICKS_PER_SECOND
+	          + ((int64_t)now.tv_nsec - timeout_hal_realtime_start.tv_nsec) * TIMEOUT_HAL_TICKS_PER_SECOND
+	                / 1000000000;
+
+	timeout_hal_advance((uint32_t)elapsed - (timeout_hal_ticks - timeout_hal_realtime_ticks));
+}
+
+// Nothing but the counter can wake us up, so sleep until it overflows
+void timeout_hal_sleep(void)
+{
+	uint32_t overflows = timeout_hal_overflows;
+
+	timeout_hal_unlock();
+
+	if (!timeout_hal_realtime) {
+		timeout_hal_advance(65536 - (uint32_t)timeout_hal_counter);
+		return;
+	}
+
+	// The counter may have overflowed while the scheduler was busy, that wakes us up at once
+	timeout_hal_poll();
+	if (timeout_hal_overflows == overflows) {
+		struct timespec duration;
+		uint32_t        to_overflow = 65536 - (uint32_t)timeout_hal_counter;
+		duration.tv_sec             = to_overflow / TIMEOUT_HAL_TICKS_PER_SECOND;
+		duration.tv_nsec            = (long)(to_overflow % TIMEOUT_HAL_TICKS_PER_SECOND) * (1000000000 / TIMEOUT_HAL_TICKS_PER_SECOND);
+		nanosleep(&duration, NULL);
+		timeout_hal_poll();
+	}
+}
+
+#endif
@@ -0,0 +1,60 @@
+/*
+ * Host stand-in for <avr/eeprom.h>. The EEPROM is the array eeprom_host[],
+ * which the test defines and fills with 0xFF for a blank EEPROM.
+ */
+
+#ifndef HOST_AVR_EEPROM_H
+#define HOST_AVR_EEPROM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <avr/io.h>
+
+extern uint8_t eeprom_host[EEPROM_SIZE];
+
+static inline void eeprom_read_block(void *data, const void *address, size_t length)
+{
+	memcpy(data, &eeprom_host[(uintptr_t)address], length);
+}
+
+static inline void eeprom_update_block(const void *data, void *address, size_t length)
+{
+	memcpy(&eeprom_host[(uintptr_t)address], data, length);
+}
+
+static inline uint8_t eeprom_read_byte(const uint8_t *address)
+{
+	return eeprom_host[(uintptr_t)address];
+}
+
+static inline uint16_t eeprom_read_word(const uint16_t *address)
+{
+	uint16_t value;
+	eeprom_read_block(&value, address, sizeof(value));
+	return value;
+}
+
+static inline uint32_t eeprom_read_dword(const uint32_t *address)
+{
+	uint32_t value;
+	eeprom_read_block(&value, address, sizeof(value));
+	return value;
+}
+
+static inline void eeprom_update_byte(uint8_t *address, uint8_t value)
+{
+	eeprom_host[(uintptr_t)address] = value;
+}
+
+static inline void eeprom_update_word(uint16_t *address, uint16_t value)
+{
+	eeprom_update_block(&value, address, sizeof(value));
+}
+
+static inline void eeprom_update_dword(uint32_t *address, uint32_t value)
+{
+	eeprom_update_block(&value, address, sizeof(value));
+}
+
+#endif /* HOST_AVR_EEPROM_H */
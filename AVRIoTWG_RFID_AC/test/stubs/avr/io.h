@@ -0,0 +1,15 @@
+/*
+ * Host stand-in for <avr/io.h>, only what the modules under test use.
+ */
+
+#ifndef HOST_AVR_IO_H
+#define HOST_AVR_IO_H
+
+#include <stdint.h>
+
+// A test can make the EEPROM larger than the 256 bytes of the ATmega4809
+#ifndef EEPROM_SIZE
+#define EEPROM_SIZE 256
+#endif
+
+#endif /* HOST_AVR_IO_H */
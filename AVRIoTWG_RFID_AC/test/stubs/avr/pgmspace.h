@@ -0,0 +1,15 @@
+/*
+ * avr/pgmspace.h for the host tests: there is a single address space, so a
+ * program memory read is a plain read.
+ */
+
+#ifndef PGMSPACE_H_
+#define PGMSPACE_H_
+
+#include <stdint.h>
+
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t *)(address))
+#define pgm_read_word(address) (*(const uint16_t *)(address))
+
+#endif /* PGMSPACE_H_ */
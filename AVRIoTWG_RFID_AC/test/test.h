@@ -0,0 +1,48 @@
+/*
+ * test.h
+ *
+ * Checks and timing for the host tests in this directory. Every test is a
+ * program of its own that prints what it measured and exits with 1 if a
+ * check failed. Build and run them all from this directory with "make".
+ */
+
+#ifndef TEST_H_
+#define TEST_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+static unsigned test_failures;
+
+#define CHECK(condition)                                                                                               \
+	do {                                                                                                               \
+		if (!(condition)) {                                                                                            \
+			printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);                                      \
+			test_failures++;                                                                                           \
+		}                                                                                                              \
+	} while (0)
+
+// Exit code of main()
+#define TEST_RESULT() (test_failures ? (printf("FAILED: %u checks\n", test_failures), 1) : (printf("OK\n"), 0))
+
+static inline uint64_t test_now_ns(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// xorshift, every run of a test uses the same random sequence
+static uint32_t test_random_state = 2463534242U;
+
+static inline uint32_t test_random(void)
+{
+	test_random_state ^= test_random_state << 13;
+	test_random_state ^= test_random_state >> 17;
+	test_random_state ^= test_random_state << 5;
+	return test_random_state;
+}
+
+#endif /* TEST_H_ */
@@ -0,0 +1,117 @@
+/*
+ * test_access_list.c
+ *
+ * Commands of the allow-list and the cost of ACCESS_LIST_contains() with 1k
+ * and 10k UIDs. The ATmega4809 EEPROM only holds 23 UIDs, the host EEPROM is
+ * made large enough for the benchmark:
+ *
+ *     gcc -O2 -DEEPROM_SIZE=131072 -Itest/stubs -I. -Iinclude -Iutils test/test_access_list.c access_list.c debug_print.c
+ */
+
+#include <string.h>
+#include "test.h"
+#include "access_list.h"
+
+#define BENCH_LOOKUPS 1000000
+
+uint8_t eeprom_host[EEPROM_SIZE];
+
+static uint32_t version;
+
+static access_list_result_t command(const char *operation, const uint8_t *uid)
+{
+	char text[48];
+
+	// Printed MSB first, like RFID_Scan() publishes it
+	sprintf(text, "%s %u %02X%02X%02X%02X%02X%02X%02X%02X", operation, (unsigned)++version, uid[7], uid[6], uid[5],
+	        uid[4], uid[3], uid[2], uid[1], uid[0]);
+	return ACCESS_LIST_processCommand(text);
+}
+
+static void random_uid(uint8_t *uid)
+{
+	uint8_t i;
+
+	for (i = 0; i < ACCESS_LIST_UID_LENGTH; i++) {
+		uid[i] = test_random();
+	}
+	uid[7] = 0xE0; // ISO15693 UIDs all start with E0
+}
+
+static void test_commands(void)
+{
+	uint8_t uid[ACCESS_LIST_UID_LENGTH] = {0xEF, 0xCD, 0xAB, 0x89, 0x67, 0x45, 0x23, 0x01};
+	char    text[48];
+
+	memset(eeprom_host, 0xFF, sizeof(eeprom_host));
+	ACCESS_LIST_init();
+	CHECK(ACCESS_LIST_getCount() == 0);
+
+	strcpy(text, "ADD 5 0123456789ABCDEF");
+	CHECK(ACCESS_LIST_processCommand(text) == ACCESS_LIST_OK);
+	CHECK(ACCESS_LIST_contains(uid));
+	strcpy(text, "ADD 5 0000000000000001");
+	CHECK(ACCESS_LIST_processCommand(text) == ACCESS_LIST_STALE);
+	strcpy(text, "ADD 6 01234567");
+	CHECK(ACCESS_LIST_processCommand(text) == ACCESS_LIST_INVALID);
+	strcpy(text, "MOVE 6");
+	CHECK(ACCESS_LIST_processCommand(text) == ACCESS_LIST_INVALID);
+
+	// The list survives a power cycle
+	ACCESS_LIST_init();
+	CHECK(ACCESS_LIST_contains(uid));
+	CHECK(ACCESS_LIST_getVersion() == 5);
+
+	strcpy(text, "DEL 6 0123456789ABCDEF");
+	CHECK(ACCESS_LIST_processCommand(text) == ACCESS_LIST_OK);
+	CHECK(!ACCESS_LIST_contains(uid));
+	CHECK(ACCESS_LIST_getCount() == 0);
+
+	strcpy(text, "SYNC 7");
+	CHECK(ACCESS_LIST_processCommand(text) == ACCESS_LIST_OK);
+	version = 7;
+}
+
+static void bench_lookup(uint16_t count)
+{
+	static uint8_t uids[10000][ACCESS_LIST_UID_LENGTH];
+	uint8_t        miss[ACCESS_LIST_UID_LENGTH];
+	uint16_t       i;
+	uint32_t       lookup;
+	uint32_t       found = 0;
+	uint64_t       start;
+	char           text[16];
+
+	sprintf(text, "SYNC %u", (unsigned)++version);
+	CHECK(ACCESS_LIST_processCommand(text) == ACCESS_LIST_OK);
+	for (i = 0; i < count; i++) {
+		random_uid(uids[i]);
+		CHECK(command("ADD", uids[i]) == ACCESS_LIST_OK);
+	}
+	CHECK(ACCESS_LIST_getCount() == count);
+
+	start = test_now_ns();
+	for (lookup = 0; lookup < BENCH_LOOKUPS; lookup++) {
+		found += ACCESS_LIST_contains(uids[lookup % count]);
+	}
+	printf("%5u UIDs: %.1f ns per hit", count, (double)(test_now_ns() - start) / BENCH_LOOKUPS);
+	CHECK(found == BENCH_LOOKUPS);
+
+	found = 0;
+	start = test_now_ns();
+	for (lookup = 0; lookup < BENCH_LOOKUPS; lookup++) {
+		memcpy(miss, uids[lookup % count], sizeof(miss));
+		miss[0] ^= 0x80; // random UIDs, a neighbour of a stored one is almost never stored
+		found += ACCESS_LIST_contains(miss);
+	}
+	printf(", %.1f ns per miss\n", (double)(test_now_ns() - start) / BENCH_LOOKUPS);
+	CHECK(found < BENCH_LOOKUPS / 1000);
+}
+
+int main(void)
+{
+	test_commands();
+	bench_lookup(1000);
+	bench_lookup(10000);
+	return TEST_RESULT();
+}
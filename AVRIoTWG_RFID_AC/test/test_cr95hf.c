@@ -0,0 +1,311 @@
+/*
+ * test_cr95hf.c
+ *
+ * The reader stack on the CR95HF model of drv_CR95HF_host.c: power up,
+ * inventories with 0, 1 and several tags, replies that are late, garbled or
+ * longer than the buffer, the tag detector calibrated on an empty field and
+ * woken up by a badge, then a benchmark of thousands of scans reporting SPI
+ * bytes, simulated time and failure rates:
+ *
+ *     gcc -O2 -Itest/stubs -I. -Iinclude -Iutils -IConfig -Icr95hf test/test_cr95hf.c cr95hf/lib_CR95HF.c
+ *         cr95hf/lib_iso15693.c cr95hf/drv_CR95HF_host.c src/timeout.c src/timeout_hal_host.c debug_print.c
+ */
+
+#include <string.h>
+#include "test.h"
+#include "lib_iso15693.h"
+#include "drv_CR95HF_host.h"
+
+#define BENCH_SCANS 5000
+
+ReaderConfigStruct ReaderConfig;
+uint8_t            GloParameterSelected;
+
+typedef enum { SCAN_GETUID, SCAN_GETUID_ASYNC, SCAN_INVENTORY_ASYNC } scan_t;
+
+static int8_t  async_status;
+static uint8_t async_uids[ISO15693_MAX_INVENTORY_UIDS][ISO15693_NBBYTE_UID];
+static uint8_t async_count;
+
+static void uid_done(int8_t status, const uint8_t *uid)
+{
+	async_status = status;
+	async_count  = (status == RESULTOK) ? 1 : 0;
+	if (status == RESULTOK)
+		memcpy(async_uids[0], uid, ISO15693_NBBYTE_UID);
+}
+
+static void inventory_done(int8_t status, uint8_t count, const uint8_t *uids)
+{
+	async_status = status;
+	async_count  = count;
+	memcpy(async_uids, uids, (size_t)count * ISO15693_NBBYTE_UID);
+}
+
+static void detect_done(int8_t status, uint8_t *response)
+{
+	async_status = status;
+	async_count  = response[IDLE_OFFSET_WAKEUPSOURCE];
+}
+
+// Run the scheduler until the asynchronous scan is over, 100 us at a time
+static void wait_async(void)
+{
+	while (ISO15693_IsBusy()) {
+		scheduler_timeout_call_next_callback();
+		CR95HF_HOST_Advance(100);
+	}
+}
+
+static int8_t scan(scan_t type, uint8_t *uid)
+{
+	switch (type) {
+	case SCAN_GETUID:
+		return ISO15693_GetUID(uid);
+
+	case SCAN_GETUID_ASYNC:
+		if (ISO15693_GetUIDAsync(uid_done) != RESULTOK)
+			return ERRORCODE_GENERIC;
+		wait_async();
+		break;
+
+	default:
+		if (ISO15693_InventoryAsync(inventory_done) != RESULTOK)
+			return ERRORCODE_GENERIC;
+		wait_async();
+		break;
+	}
+
+	memcpy(uid, async_uids[0], ISO15693_NBBYTE_UID);
+	return async_status;
+}
+
+static void power_up(SPI_MODE mode)
+{
+	scheduler_timeout_init();
+	CR95HF_HOST_Init();
+	ReaderConfig.Interface       = CR95HF_INTERFACE_SPI;
+	ReaderConfig.SpiMode         = mode;
+	ReaderConfig.CurrentProtocol = PROTOCOL_TAG_FIELDOFF;
+	ISO15693_SetRFSetting(ISO15693_RFSETTING_53_SINGLE, true);
+	CHECK(CR95HF_PORsequence() == CR95HF_SUCCESS_CODE);
+}
+
+static void random_uid(uint8_t *uid)
+{
+	uint8_t i;
+
+	for (i = 0; i < ISO15693_NBBYTE_UID; i++)
+		uid[i] = test_random();
+	uid[7] = 0xE0;
+}
+
+static void test_getuid(SPI_MODE mode)
+{
+	uint8_t          tag_uid[ISO15693_NBBYTE_UID] = {0x01, 0x23, 0x45, 0x67, 0x89, 0xAB, 0xCD, 0xE0};
+	uint8_t          other_uid[ISO15693_NBBYTE_UID];
+	uint8_t          uid[ISO15693_NBBYTE_UID];
+	uint8_t          oversized[CR95HF_DATA_OFFSET + 40] = {SENDRECV_RESULTSCODE_OK, 40};
+	uint8_t          response[CR95HF_DATA_OFFSET + 1];
+	uint32_t         commands;
+	CR95HF_HOST_Tag *tag;
+
+	power_up(mode);
+
+	// An empty field, then one tag. The protocol stays selected from one scan to the next.
+	CHECK(ISO15693_GetUID(uid) == ERRORCODE_GENERIC);
+	tag = CR95HF_HOST_AddTag(tag_uid);
+	commands = CR95HF_HOST_GetStats()->Commands;
+	CHECK(ISO15693_GetUID(uid) == RESULTOK);
+	CHECK(memcmp(uid, tag_uid, sizeof(uid)) == 0);
+	CHECK(CR95HF_HOST_GetStats()->Commands == commands + 1);
+
+	// Garbled or late replies are not a UID
+	memcpy(other_uid, tag_uid, sizeof(other_uid));
+	other_uid[0] ^= 0x10;
+	CHECK(CR95HF_HOST_AddTag(other_uid) != NULL);
+	CHECK(ISO15693_GetUID(uid) == ERRORCODE_GENERIC);
+	CHECK(CR95HF_HOST_GetStats()->Collisions != 0);
+	CR95HF_HOST_RemoveTags();
+	tag = CR95HF_HOST_AddTag(tag_uid);
+	tag->CRCErrors[ISO15693_TRANSMISSION_53] = 100;
+	CHECK(ISO15693_GetUID(uid) == ERRORCODE_GENERIC);
+	tag->CRCErrors[ISO15693_TRANSMISSION_53] = 0;
+	tag->ReplyDelay                          = 5000;
+	CHECK(ISO15693_GetUID(uid) == ERRORCODE_GENERIC);
+	tag->ReplyDelay = 320;
+
+	// A reply longer than the buffer is dropped and the next frame is read from its start
+	CR95HF_HOST_QueueResponse(oversized, sizeof(oversized));
+	CHECK(ISO15693_GetUID(uid) == ERRORCODE_GENERIC);
+	CHECK(CR95HF_Echo(response, sizeof(response)) == CR95HF_SUCCESS_CODE);
+	CHECK(response[0] == ECHORESPONSE);
+	CHECK(ISO15693_GetUID(uid) == RESULTOK);
+	CHECK(memcmp(uid, tag_uid, sizeof(uid)) == 0);
+}
+
+// Idle until the chip wakes up, the badge enters the field after badge_us. Returns the wake up source.
+static uint8_t tag_detect(const uint8_t *badge, uint32_t badge_us)
+{
+	uint64_t start = CR95HF_HOST_GetTime();
+
+	async_count = 0;
+	if (CR95HF_TagDetectAsync(detect_done) != CR95HF_SUCCESS_CODE)
+		return 0;
+	while (CR95HF_IsBusy()) {
+		if (badge != NULL && CR95HF_HOST_GetTime() - start >= badge_us) {
+			CHECK(CR95HF_HOST_AddTag(badge) != NULL);
+			badge = NULL;
+		}
+		scheduler_timeout_call_next_callback();
+		CR95HF_HOST_Advance(1000);
+	}
+	return (async_status == CR95HF_SUCCESS_CODE) ? async_count : 0;
+}
+
+static void test_tag_detect(SPI_MODE mode)
+{
+	uint8_t  badge[ISO15693_NBBYTE_UID] = {0x10, 0x32, 0x54, 0x76, 0x98, 0xBA, 0xDC, 0xE0};
+	uint8_t  uid[ISO15693_NBBYTE_UID];
+	uint8_t  dac, dac_low, dac_high;
+	uint16_t wake_ups;
+	uint32_t detections;
+	uint64_t time;
+
+	power_up(mode);
+
+	CHECK(CR95HF_CalibrateTagDetector() == CR95HF_SUCCESS_CODE);
+	CHECK(CR95HF_GetTagDetector(&dac, &dac_low, &dac_high, &wake_ups));
+	CHECK(dac_low <= CR95HF_HOST_DAC_NOTAG && CR95HF_HOST_DAC_NOTAG <= dac_high);
+	CHECK(CR95HF_HOST_DAC_TAG < dac_low);
+	CHECK(wake_ups == 0);
+
+	// Nobody comes, the chip wakes up on its own after 32 checks of 96 ms
+	time = CR95HF_HOST_GetTime();
+	CHECK(tag_detect(NULL, 0) == IDLE_WAKEUP_TIMEOUT);
+	time = CR95HF_HOST_GetTime() - time;
+	CHECK(time >= 3072000 && time < 3100000);
+
+	// A badge 1 s in is seen at the next check
+	detections = CR95HF_HOST_GetStats()->TagDetections;
+	time       = CR95HF_HOST_GetTime();
+	CHECK(tag_detect(badge, 1000000) == IDLE_WAKEUP_TAGDETECT);
+	time = CR95HF_HOST_GetTime() - time;
+	CHECK(time >= 1000000 && time < 1000000 + 96000 + 2000);
+	CHECK(CR95HF_GetTagDetector(&dac, &dac_low, &dac_high, &wake_ups) && wake_ups == 1);
+	CHECK(CR95HF_HOST_GetStats()->TagDetections == detections + 1);
+
+	// The field is off after Idle, reading the badge selects the protocol again
+	CHECK(ISO15693_GetUID(uid) == RESULTOK);
+	CHECK(memcmp(uid, badge, sizeof(uid)) == 0);
+
+	// Still in the field, the next Idle wakes up at its first check
+	CHECK(tag_detect(NULL, 0) == IDLE_WAKEUP_TAGDETECT);
+}
+
+static void test_async(void)
+{
+	// Same first nibble, so the anticollision has to go one level down
+	uint8_t uids[3][ISO15693_NBBYTE_UID] = {{0x15, 0x01, 0, 0, 0, 0, 0, 0xE0},
+	                                        {0x25, 0x02, 0, 0, 0, 0, 0, 0xE0},
+	                                        {0x07, 0x03, 0, 0, 0, 0, 0, 0xE0}};
+	uint8_t uid[ISO15693_NBBYTE_UID];
+	uint8_t i, j, found;
+
+	power_up(SPI_INTERRUPT);
+
+	CHECK(scan(SCAN_GETUID_ASYNC, uid) == ERRORCODE_GENERIC);
+	CHECK(CR95HF_HOST_AddTag(uids[0]) != NULL);
+	CHECK(scan(SCAN_GETUID_ASYNC, uid) == RESULTOK);
+	CHECK(memcmp(uid, uids[0], sizeof(uid)) == 0);
+
+	CHECK(CR95HF_HOST_AddTag(uids[1]) != NULL);
+	CHECK(CR95HF_HOST_AddTag(uids[2]) != NULL);
+	CHECK(scan(SCAN_INVENTORY_ASYNC, uid) == RESULTOK);
+	CHECK(async_count == 3);
+	for (i = 0, found = 0; i < 3; i++) {
+		for (j = 0; j < async_count; j++)
+			found += memcmp(uids[i], async_uids[j], ISO15693_NBBYTE_UID) == 0;
+	}
+	CHECK(found == 3);
+}
+
+/*
+ * Each scan sees a new field: mostly one badge, sometimes none, two at once
+ * or one that only reads reliably at 26 kbps, and reply delays from 300 us
+ * to 2 ms.
+ */
+static void bench_scans(const char *name, scan_t type, SPI_MODE mode)
+{
+	uint8_t          tag_uid[ISO15693_NBBYTE_UID];
+	uint8_t          uid[ISO15693_NBBYTE_UID];
+	uint32_t         ok = 0, empty = 0, missed = 0, wrong = 0;
+	uint32_t         spi_bytes, scans;
+	uint64_t         start, time, max_time = 0;
+	uint8_t          kind;
+	int8_t           status;
+	CR95HF_HOST_Tag *tag;
+
+	test_random_state = 2463534242U;
+	power_up(mode);
+	spi_bytes = SPI_GetByteCount();
+	start     = CR95HF_HOST_GetTime();
+
+	for (scans = 0; scans < BENCH_SCANS; scans++) {
+		CR95HF_HOST_RemoveTags();
+		kind = test_random() % 10;
+		if (kind != 0) {
+			random_uid(tag_uid);
+			tag             = CR95HF_HOST_AddTag(tag_uid);
+			tag->ReplyDelay = 300 + test_random() % 1700;
+			if (kind == 1) {
+				random_uid(uid);
+				CR95HF_HOST_AddTag(uid);
+			} else if (kind == 2) {
+				tag->CRCErrors[ISO15693_TRANSMISSION_53] = 50;
+			}
+		}
+
+		time   = CR95HF_HOST_GetTime();
+		status = scan(type, uid);
+		time   = CR95HF_HOST_GetTime() - time;
+		if (time > max_time)
+			max_time = time;
+
+		if (kind == 0 && status != RESULTOK)
+			empty++;
+		else if (kind == 0)
+			wrong++;
+		else if (status != RESULTOK)
+			missed++;
+		else if (kind != 1 && memcmp(uid, tag_uid, sizeof(uid)) == 0)
+			ok++;
+		else if (kind != 1)
+			wrong++;
+		else
+			ok++; // either of the two badges
+	}
+
+	printf("%-20s %5u scans: %5.1f%% read, %4.1f%% missed, %u wrong UIDs, %5.1f SPI bytes and %5.2f ms per scan, "
+	       "%5.2f ms max\n",
+	       name, (unsigned)scans, 100.0 * ok / scans, 100.0 * missed / scans, (unsigned)wrong,
+	       (double)(SPI_GetByteCount() - spi_bytes) / scans, (double)(CR95HF_HOST_GetTime() - start) / scans / 1000,
+	       (double)max_time / 1000);
+	CHECK(wrong == 0);
+	CHECK(ok + empty + missed == BENCH_SCANS);
+}
+
+int main(void)
+{
+	test_getuid(SPI_POLLING);
+	test_getuid(SPI_INTERRUPT);
+	test_async();
+	test_tag_detect(SPI_POLLING);
+	test_tag_detect(SPI_INTERRUPT);
+
+	bench_scans("GetUID, polling", SCAN_GETUID, SPI_POLLING);
+	bench_scans("GetUID, IRQ_OUT", SCAN_GETUID, SPI_INTERRUPT);
+	bench_scans("GetUIDAsync", SCAN_GETUID_ASYNC, SPI_INTERRUPT);
+	bench_scans("InventoryAsync", SCAN_INVENTORY_ASYNC, SPI_INTERRUPT);
+	return TEST_RESULT();
+}
@@ -0,0 +1,119 @@
+/*
+ * test_crc16.c
+ *
+ * Known answers and residue check of ISO15693_CRC16(), the variant picked by
+ * ISO15693_CRC16_METHOD checked bit for bit against the bit serial
+ * definition, and its cost per byte. Built once per variant:
+ *
+ *     gcc -O2 -DISO15693_CRC16_METHOD=ISO15693_CRC16_NIBBLE -Itest/stubs -I. -Iinclude -Iutils -IConfig -Icr95hf
+ *         test/test_crc16.c cr95hf/lib_CR95HF.c cr95hf/lib_iso15693.c cr95hf/drv_CR95HF_host.c src/timeout.c
+ *         src/timeout_hal_host.c debug_print.c
+ *
+ * The host only gives the relative cost of the variants. On the AVR each
+ * table word is read from flash with two LPM instructions.
+ */
+
+#include <string.h>
+#include "test.h"
+#include "lib_iso15693.h"
+
+#define RANDOM_BUFFERS 100000
+#define BENCH_BYTES    50000000
+
+ReaderConfigStruct ReaderConfig;
+uint8_t            GloParameterSelected;
+
+static const char *const method_names[] = {"bitwise", "nibble table", "byte table"};
+
+// ISO/IEC 13239, one bit at a time
+static uint16_t crc16_reference(const uint8_t *data, uint16_t length)
+{
+	uint16_t crc = ISO15693_PRELOADCRC16;
+	uint16_t i;
+	uint8_t  bit;
+
+	for (i = 0; i < length; i++) {
+		crc ^= data[i];
+		for (bit = 0; bit < 8; bit++)
+			crc = (crc & 1) ? (crc >> 1) ^ ISO15693_POLYCRC16 : crc >> 1;
+	}
+	return ~crc;
+}
+
+static uint16_t crc16(const void *data, uint8_t length)
+{
+	return (uint16_t)ISO15693_CRC16(data, length);
+}
+
+static void test_known_answers(void)
+{
+	static const uint8_t iso15693_example[] = {0x01, 0x02, 0x03, 0x04};
+	uint8_t              frame[sizeof(iso15693_example) + ISO15693_NBBYTE_CRC16];
+	uint8_t              longest[255];
+	uint16_t             crc, i;
+
+	// The example of ISO/IEC 15693-3 and the usual check value of this CRC (X.25)
+	CHECK(crc16(iso15693_example, sizeof(iso15693_example)) == 0x3991);
+	CHECK(crc16("123456789", 9) == 0x906E);
+	CHECK(crc16("", 0) == 0x0000);
+	CHECK(crc16("\x00", 1) == 0xF078);
+	CHECK(crc16("\xFF", 1) == 0xFF00);
+	for (i = 0; i < sizeof(longest); i++)
+		longest[i] = i;
+	CHECK(crc16(longest, sizeof(longest)) == 0x7859);
+
+	// The CRC goes out LSB first, a frame followed by its CRC leaves the residue
+	crc = crc16(iso15693_example, sizeof(iso15693_example));
+	memcpy(frame, iso15693_example, sizeof(iso15693_example));
+	frame[sizeof(iso15693_example)]     = crc & 0xFF;
+	frame[sizeof(iso15693_example) + 1] = crc >> 8;
+	CHECK(ISO15693_IsCorrectCRC16Residue(frame, sizeof(frame)) == RESULTOK);
+	frame[1] ^= 0x40;
+	CHECK(ISO15693_IsCorrectCRC16Residue(frame, sizeof(frame)) == ERRORCODE_GENERIC);
+}
+
+static void test_random_buffers(void)
+{
+	uint8_t  data[255];
+	uint8_t  length;
+	uint32_t n, i, mismatches = 0;
+
+	for (n = 0; n < RANDOM_BUFFERS; n++) {
+		length = test_random() % (sizeof(data) + 1);
+		for (i = 0; i < length; i++)
+			data[i] = test_random();
+		mismatches += crc16(data, length) != crc16_reference(data, length);
+	}
+	CHECK(mismatches == 0);
+}
+
+// A 1 slot inventory reply is checked over 12 bytes, the longest frame is 255
+static double bench(uint8_t length)
+{
+	static uint8_t    data[255];
+	volatile uint16_t sink;
+	uint32_t          n, rounds = BENCH_BYTES / length;
+	uint64_t          start;
+	uint16_t          i;
+
+	for (i = 0; i < length; i++)
+		data[i] = test_random();
+
+	start = test_now_ns();
+	for (n = 0; n < rounds; n++) {
+		data[0] = n;
+		sink    = crc16(data, length);
+	}
+	(void)sink;
+	return (double)(test_now_ns() - start) / rounds / length;
+}
+
+int main(void)
+{
+	test_known_answers();
+	test_random_buffers();
+
+	printf("%-13s %5.2f ns per byte over 12 bytes, ", method_names[ISO15693_CRC16_METHOD], bench(12));
+	printf("%5.2f over 255 bytes\n", bench(255));
+	return TEST_RESULT();
+}
@@ -0,0 +1,346 @@
+/*
+ * test_event_log.c
+ *
+ * The offline event log on the NOR flash stand-in of event_log_flash_host.c:
+ * taps only count as published once their message was acknowledged, taps in
+ * RAM wait behind the ones left in flash, random appends, WINC restarts,
+ * PUBACKs and resets against a model of the broker, then what appending and
+ * draining cost:
+ *
+ *     gcc -O2 -Itest/stubs -I. -Iinclude -Iutils test/test_event_log.c event_log.c event_log_flash_host.c
+ *         debug_print.c
+ *
+ * The host only gives the cost of the log itself. On the board the WINC
+ * flash dominates: a 16 byte program per tap, a one byte program per
+ * published tap and a sector erase every 255 taps.
+ */
+
+#include <string.h>
+#include "test.h"
+#include "event_log.h"
+#include "event_log_flash.h"
+
+#define RANDOM_ROUNDS 200000
+#define BENCH_TAPS    1000000
+#define TIME_BASE     1600000000 // ten digits, as many taps as EVENT_LOG_JSON_SIZE allows fit in a message
+
+// Published messages the broker did not acknowledge yet, oldest first
+static uint32_t broker_taps[EVENT_LOG_INFLIGHT_MESSAGES][EVENT_LOG_JSON_ENTRIES];
+static uint8_t  broker_counts[EVENT_LOG_INFLIGHT_MESSAGES];
+static uint8_t  broker_messages;
+
+// A tap is numbered by its time, the UID and the decision follow from the number
+static bool append(uint32_t number)
+{
+	uint8_t uid[ACCESS_LIST_UID_LENGTH] = {number, number >> 8, number >> 16, number >> 24, 0x04, 0x03, 0x02, 0xE0};
+
+	return EVENT_LOG_append(uid, TIME_BASE + number, number % 3 == 0);
+}
+
+// Publishes one message, returns the number of taps in it, 0 if there was nothing to publish
+static uint8_t publish(void)
+{
+	char       json[EVENT_LOG_JSON_SIZE];
+	char       uid[2 * ACCESS_LIST_UID_LENGTH + 1];
+	const char *p = json;
+	uint32_t   *taps = broker_taps[broker_messages];
+	uint16_t   length;
+	uint8_t    count, n = 0;
+
+	length = EVENT_LOG_printJson(json, sizeof(json), &count);
+	if (length == 0) {
+		CHECK(broker_messages == EVENT_LOG_INFLIGHT_MESSAGES || count == 0);
+		return 0;
+	}
+	CHECK(length == strlen(json) && length < sizeof(json));
+	CHECK(strncmp(json, "{\"offline\":[", 12) == 0 && strcmp(json + length - 2, "]}") == 0);
+
+	while ((p = strstr(p, "[\"")) != NULL && n < EVENT_LOG_JSON_ENTRIES) {
+		unsigned long time, number;
+		unsigned      granted;
+		char          expected[sizeof(uid)];
+
+		sscanf(p, "[\"%16[0-9A-F]\",%lu,%u]", uid, &time, &granted);
+		number = time - TIME_BASE;
+		sprintf(expected, "E0020304%02X%02X%02X%02X", (unsigned)(number >> 24) & 0xFF,
+		        (unsigned)(number >> 16) & 0xFF, (unsigned)(number >> 8) & 0xFF, (unsigned)number & 0xFF);
+		CHECK(strcmp(uid, expected) == 0);
+		CHECK(granted == (number % 3 == 0));
+		taps[n++] = number;
+		p += 2;
+	}
+	CHECK(n == count);
+
+	EVENT_LOG_consume(count);
+	broker_counts[broker_messages++] = count;
+	return count;
+}
+
+// The PUBACK of the oldest message, returns its taps
+static uint8_t acknowledge(uint32_t *taps)
+{
+	uint8_t count = broker_counts[0];
+
+	memcpy(taps, broker_taps[0], sizeof(broker_taps[0]));
+	memmove(broker_taps, broker_taps[1], sizeof(broker_taps) - sizeof(broker_taps[0]));
+	memmove(broker_counts, broker_counts + 1, sizeof(broker_counts) - 1);
+	broker_messages--;
+	EVENT_LOG_acknowledge();
+	return count;
+}
+
+// Publishes and acknowledges everything, with a WINC restart whenever the log asks for one
+static uint32_t drain(void)
+{
+	uint32_t taps[EVENT_LOG_JSON_ENTRIES];
+	uint32_t drained = 0;
+
+	EVENT_LOG_sync();
+	for (;;) {
+		while (publish() != 0)
+			;
+		if (broker_messages != 0) {
+			drained += acknowledge(taps);
+		} else if (EVENT_LOG_needsSync()) {
+			EVENT_LOG_sync();
+		} else {
+			return drained;
+		}
+	}
+}
+
+static void test_acknowledge(void)
+{
+	uint32_t taps[EVENT_LOG_JSON_ENTRIES];
+	uint32_t number;
+
+	// A blank flash
+	EVENT_LOG_init();
+	for (number = 100; number < 106; number++)
+		CHECK(append(number));
+	EVENT_LOG_sync();
+
+	// In flight until the PUBACK, also across a WINC restart, and never published twice
+	CHECK(publish() == EVENT_LOG_JSON_ENTRIES);
+	CHECK(publish() == 2);
+	CHECK(publish() == 0);
+	EVENT_LOG_sync();
+	CHECK(publish() == 0);
+	CHECK(acknowledge(taps) == EVENT_LOG_JSON_ENTRIES);
+	CHECK(taps[0] == 100 && taps[3] == 103);
+
+	// Only the acknowledged taps were marked, the others come back after a reset
+	EVENT_LOG_sync();
+	broker_messages = 0;
+	EVENT_LOG_init();
+	EVENT_LOG_sync();
+	CHECK(publish() == 2);
+	CHECK(broker_taps[0][0] == 104 && broker_taps[0][1] == 105);
+	CHECK(acknowledge(taps) == 2);
+	EVENT_LOG_sync();
+	EVENT_LOG_init();
+	CHECK(drain() == 0);
+
+	// Taps published from RAM before they got to the flash
+	CHECK(append(200) && append(201));
+	CHECK(publish() == 2);
+	CHECK(append(202));
+	EVENT_LOG_sync();
+	CHECK(publish() == 1);
+	CHECK(broker_taps[1][0] == 202);
+	CHECK(acknowledge(taps) == 2 && taps[0] == 200);
+	CHECK(acknowledge(taps) == 1 && taps[0] == 202);
+	EVENT_LOG_sync();
+	EVENT_LOG_init();
+	CHECK(drain() == 0);
+	CHECK(EVENT_LOG_getDropped() == 0);
+}
+
+// More taps in flash than one sync reads back, new ones arrive in RAM meanwhile
+static void test_backlog(void)
+{
+	uint32_t taps[EVENT_LOG_JSON_ENTRIES];
+	uint32_t number = 1000, next = 1000, syncs = 0;
+	uint8_t  i, count;
+
+	while (number < 1000 + 3 * EVENT_LOG_BATCH_ENTRIES) {
+		for (i = 0; i < EVENT_LOG_PENDING_ENTRIES; i++)
+			CHECK(append(number++));
+		EVENT_LOG_sync();
+	}
+	EVENT_LOG_sync();
+	CHECK(append(number++));
+
+	// Everything in order, the one in RAM last, one WINC restart per EVENT_LOG_BATCH_ENTRIES taps
+	for (;;) {
+		while (publish() != 0)
+			;
+		if (broker_messages != 0) {
+			count = acknowledge(taps);
+			for (i = 0; i < count; i++)
+				CHECK(taps[i] == next++);
+		} else if (EVENT_LOG_needsSync()) {
+			CHECK(!EVENT_LOG_needsSync());
+			EVENT_LOG_sync();
+			syncs++;
+		} else {
+			break;
+		}
+	}
+	CHECK(next == number);
+	CHECK(syncs == 3);
+	CHECK(EVENT_LOG_getDropped() == 0);
+}
+
+// What the broker acknowledged so far
+static uint32_t delivered_next, delivered_twice, delivered_gaps;
+
+static void deliver(void)
+{
+	uint32_t taps[EVENT_LOG_JSON_ENTRIES];
+	uint8_t  i, count = acknowledge(taps);
+
+	for (i = 0; i < count; i++) {
+		if (taps[i] < delivered_next) {
+			delivered_twice++;
+		} else {
+			delivered_gaps += taps[i] != delivered_next;
+			delivered_next = taps[i] + 1;
+		}
+	}
+}
+
+/*
+ * Random appends, WINC restarts, publishes and PUBACKs, and now and then a
+ * reset that loses the PUBACKs in flight. The broker has to see every tap
+ * in order, and a tap twice only when a reset came before its PUBACK.
+ */
+static void test_random_taps(void)
+{
+	uint32_t round, number = 10000, refused = 0, resets = 0, dropped = 0;
+	uint8_t  i;
+
+	delivered_next = number;
+	for (round = 0; round < RANDOM_ROUNDS; round++) {
+		switch (test_random() % 8) {
+		case 0:
+		case 1:
+			for (i = test_random() % 4; i > 0; i--) {
+				if (append(number))
+					number++;
+				else
+					refused++;
+			}
+			break;
+		case 2:
+			EVENT_LOG_sync();
+			break;
+		case 3:
+		case 4:
+			publish();
+			break;
+		case 5:
+		case 6:
+			if (broker_messages != 0)
+				deliver();
+			if (EVENT_LOG_needsSync())
+				EVENT_LOG_sync();
+			break;
+		default:
+			if (test_random() % 64 == 0) {
+				// Reset right after a WINC restart, nothing is left in RAM, and the WINC start after it.
+				// The broker got some of the messages in flight, but the log never learns of it.
+				EVENT_LOG_sync();
+				while (broker_messages != 0 && test_random() % 2)
+					deliver();
+				broker_messages = 0;
+				dropped += EVENT_LOG_getDropped();
+				EVENT_LOG_init();
+				EVENT_LOG_sync();
+				resets++;
+			}
+			break;
+		}
+	}
+
+	EVENT_LOG_sync();
+	for (;;) {
+		while (publish() != 0)
+			;
+		if (broker_messages != 0)
+			deliver();
+		else if (EVENT_LOG_needsSync())
+			EVENT_LOG_sync();
+		else
+			break;
+	}
+	CHECK(delivered_next == number);
+	CHECK(delivered_gaps == 0);
+	CHECK(delivered_twice == 0 || resets != 0);
+	CHECK(refused != 0 && dropped + EVENT_LOG_getDropped() == refused);
+	printf("%u taps, %u refused with RAM full, %u resets, %u published twice\n", (unsigned)(number - 10000),
+	       (unsigned)refused, (unsigned)resets, (unsigned)delivered_twice);
+
+	// Wear leveling, every sector erased as often as the others, give or take one
+	{
+		uint32_t least = UINT32_MAX, most = 0, erases;
+		uint8_t  sector;
+
+		for (sector = 0; sector < EVENT_LOG_FLASH_SECTORS; sector++) {
+			erases = event_log_flash_get_erase_count(sector);
+			least  = erases < least ? erases : least;
+			most   = erases > most ? erases : most;
+		}
+		CHECK(least != 0 && most - least <= 1);
+	}
+}
+
+// Taps appended and synced the way the WINC restarts write them, then drained
+static void bench(void)
+{
+	uint64_t start, appended, drained;
+	uint32_t number, taps;
+	uint8_t  i;
+
+	EVENT_LOG_init();
+	drain();
+
+	start = test_now_ns();
+	for (number = 0; number < BENCH_TAPS;) {
+		for (i = 0; i < EVENT_LOG_PENDING_ENTRIES; i++)
+			append(number++);
+		EVENT_LOG_sync();
+
+		// The log holds a little less than 16 sectors
+		if (number % 2048 == 0) {
+			appended = test_now_ns() - start;
+			taps     = drain();
+		CHECK(taps == 2048);
+			start = test_now_ns() - appended;
+		}
+	}
+	appended = test_now_ns() - start;
+	drain();
+
+	for (number = 0; number < 2048;) {
+		for (i = 0; i < EVENT_LOG_PENDING_ENTRIES; i++)
+			append(number++);
+		EVENT_LOG_sync();
+	}
+	start   = test_now_ns();
+	taps    = drain();
+	drained = test_now_ns() - start;
+	CHECK(taps == 2048);
+
+	printf("%5.0f ns per tap appended and synced, %5.0f ns per tap published, acknowledged and marked\n",
+	       (double)appended / BENCH_TAPS, (double)drained / taps);
+}
+
+int main(void)
+{
+	test_acknowledge();
+	test_backlog();
+	test_random_taps();
+	bench();
+	return TEST_RESULT();
+}
@@ -0,0 +1,245 @@
+/*
+ * test_exchange_buffer.c
+ *
+ * The MQTT exchange buffer against a plain byte queue: random writes, reads,
+ * peeks and span accesses from every wrap position, with guard bytes around
+ * the buffer, then the throughput of the bulk copies against a byte by byte
+ * copy at every position of the 400 byte Tx buffer:
+ *
+ *     gcc -O2 -Itest/stubs -I. test/test_exchange_buffer.c mqtt/mqtt_exchange_buffer/mqtt_exchange_buffer.c
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include "test.h"
+#include "mqtt/mqtt_exchange_buffer/mqtt_exchange_buffer.h"
+
+#define TEST_SIZE    100
+#define GUARD        4
+#define RANDOM_OPS   2000000
+#define BENCH_SIZE   400
+#define BENCH_ROUNDS 5000
+
+static uint8_t        memory[GUARD + TEST_SIZE + GUARD];
+static exchangeBuffer buffer = {memory + GUARD, memory + GUARD, TEST_SIZE, 0};
+
+// What the buffer must hold, model[model_head] on
+static uint8_t  model[4 * TEST_SIZE];
+static uint16_t model_head, model_tail;
+
+static uint16_t min16(uint16_t a, uint16_t b)
+{
+	return a < b ? a : b;
+}
+
+static void model_append(const uint8_t *data, uint16_t length)
+{
+	if (model_tail + length > sizeof(model)) {
+		memmove(model, &model[model_head], model_tail - model_head);
+		model_tail -= model_head;
+		model_head = 0;
+	}
+	memcpy(&model[model_tail], data, length);
+	model_tail += length;
+}
+
+// One random operation, returns the number of mismatches with the model
+static unsigned random_op(void)
+{
+	uint8_t  data[TEST_SIZE + 10];
+	uint16_t stored = model_tail - model_head;
+	uint16_t length = test_random() % (sizeof(data) + 1);
+	uint16_t offset, n, i;
+	uint8_t *span;
+	unsigned wrong = 0;
+
+	switch (test_random() % 6) {
+	case 0:
+		for (i = 0; i < length; i++)
+			data[i] = test_random();
+		n = MQTT_ExchangeBufferWrite(&buffer, data, length);
+		wrong += n != min16(length, TEST_SIZE - stored);
+		model_append(data, n);
+		break;
+
+	case 1:
+		n = MQTT_ExchangeBufferRead(&buffer, data, length);
+		wrong += n != min16(length, stored);
+		wrong += memcmp(data, &model[model_head], n) != 0;
+		model_head += n;
+		break;
+
+	case 2:
+		offset = test_random() % (TEST_SIZE + 2);
+		n      = MQTT_ExchangeBufferPeekAt(&buffer, offset, data, length);
+		wrong += n != (offset >= stored ? 0 : min16(length, stored - offset));
+		wrong += memcmp(data, &model[model_head + offset], n) != 0;
+		break;
+
+	case 3:
+		n = MQTT_ExchangeBufferGetWriteSpan(&buffer, &span);
+		wrong += n > TEST_SIZE - stored || span < buffer.start || span + n > buffer.start + TEST_SIZE;
+		wrong += stored < TEST_SIZE && n == 0;
+		length = n ? test_random() % (n + 1) : 0;
+		for (i = 0; i < length; i++)
+			span[i] = test_random();
+		model_append(span, length);
+		MQTT_ExchangeBufferCommit(&buffer, length);
+		break;
+
+	case 4:
+		n = MQTT_ExchangeBufferGetReadSpan(&buffer, &span);
+		wrong += n > stored || (stored != 0 && n == 0);
+		wrong += memcmp(span, &model[model_head], n) != 0;
+		length = n ? test_random() % (n + 1) : 0;
+		MQTT_ExchangeBufferConsume(&buffer, length);
+		model_head += length;
+		break;
+
+	default:
+		offset = test_random() % (TEST_SIZE + 2);
+		n      = MQTT_ExchangeBufferGetReadSpanAt(&buffer, offset, &span);
+		wrong += n > (offset >= stored ? 0 : stored - offset);
+		wrong += offset < stored && n == 0;
+		wrong += memcmp(span, &model[model_head + offset], n) != 0;
+		break;
+	}
+
+	wrong += buffer.dataLength != model_tail - model_head;
+	return wrong;
+}
+
+static void test_random_ops(void)
+{
+	unsigned wrong = 0;
+	uint32_t n;
+	uint8_t  i;
+
+	memset(memory, 0xEE, sizeof(memory));
+	MQTT_ExchangeBufferInit(&buffer);
+	for (n = 0; n < RANDOM_OPS; n++)
+		wrong += random_op();
+	CHECK(wrong == 0);
+
+	for (i = 0; i < GUARD; i++) {
+		CHECK(memory[i] == 0xEE);
+		CHECK(memory[GUARD + TEST_SIZE + i] == 0xEE);
+	}
+}
+
+// A full buffer, a write that does not fit and a packet that wraps, from every position
+static void test_wrap(void)
+{
+	uint8_t  data[TEST_SIZE], out[TEST_SIZE];
+	uint8_t *span;
+	uint16_t position, i;
+
+	for (i = 0; i < TEST_SIZE; i++)
+		data[i] = i + 1;
+
+	for (position = 0; position < TEST_SIZE; position++) {
+		MQTT_ExchangeBufferInit(&buffer);
+		buffer.currentLocation = buffer.start + position;
+
+		CHECK(MQTT_ExchangeBufferWrite(&buffer, data, 60) == 60);
+		CHECK(MQTT_ExchangeBufferWrite(&buffer, data + 60, 60) == 40);
+		CHECK(MQTT_ExchangeBufferWrite(&buffer, data, 1) == 0);
+		CHECK(MQTT_ExchangeBufferGetWriteSpan(&buffer, &span) == 0);
+
+		// Read back in the two spans a send takes
+		CHECK(MQTT_ExchangeBufferGetReadSpan(&buffer, &span) == TEST_SIZE - position);
+		CHECK(memcmp(span, data, TEST_SIZE - position) == 0);
+		CHECK(MQTT_ExchangeBufferGetReadSpanAt(&buffer, TEST_SIZE - position, &span) == position);
+
+		CHECK(MQTT_ExchangeBufferPeekAt(&buffer, 30, out, TEST_SIZE) == TEST_SIZE - 30);
+		CHECK(memcmp(out, data + 30, TEST_SIZE - 30) == 0);
+		CHECK(MQTT_ExchangeBufferRead(&buffer, out, TEST_SIZE) == TEST_SIZE);
+		CHECK(memcmp(out, data, TEST_SIZE) == 0);
+
+		// Empty again, the next write starts at the beginning
+		CHECK(buffer.currentLocation == buffer.start);
+		CHECK(MQTT_ExchangeBufferGetWriteSpan(&buffer, &span) == TEST_SIZE);
+	}
+}
+
+// The copy loops of the exchange buffer before the bulk copies
+static void bytewise_write(exchangeBuffer *b, const uint8_t *data, uint16_t length)
+{
+	uint8_t *end = b->start + b->bufferLength;
+	uint8_t *p   = b->currentLocation + b->dataLength;
+
+	if (p >= end)
+		p -= b->bufferLength;
+	while (length--) {
+		*p++ = *data++;
+		if (p == end)
+			p = b->start;
+		b->dataLength++;
+	}
+}
+
+static void bytewise_read(exchangeBuffer *b, uint8_t *data, uint16_t length)
+{
+	uint8_t *end = b->start + b->bufferLength;
+
+	while (length--) {
+		*data++ = *b->currentLocation++;
+		if (b->currentLocation == end)
+			b->currentLocation = b->start;
+		b->dataLength--;
+	}
+}
+
+/*
+ * A PUBLISH of a tap (155 bytes) written and read back at every position of
+ * the Tx buffer, the ones that wrap take two copies each way.
+ */
+static void bench(bool bytewise, double *wrapped, double *straight)
+{
+	static uint8_t bench_memory[BENCH_SIZE];
+	exchangeBuffer b = {bench_memory, bench_memory, BENCH_SIZE, 0};
+	uint8_t        in[155], out[155];
+	uint64_t       start, time;
+	uint32_t       rounds, wraps = 0;
+	uint16_t       position;
+
+	*wrapped = *straight = 0;
+	for (position = 0; position < BENCH_SIZE; position++) {
+		bool wraps_here = position + sizeof(in) > BENCH_SIZE;
+
+		start = test_now_ns();
+		for (rounds = 0; rounds < BENCH_ROUNDS; rounds++) {
+			b.currentLocation = bench_memory + position;
+			in[0]             = rounds;
+			if (bytewise) {
+				bytewise_write(&b, in, sizeof(in));
+				bytewise_read(&b, out, sizeof(out));
+			} else {
+				MQTT_ExchangeBufferWrite(&b, in, sizeof(in));
+				MQTT_ExchangeBufferRead(&b, out, sizeof(out));
+			}
+		}
+		time = test_now_ns() - start;
+		CHECK(out[0] == (uint8_t)(rounds - 1));
+
+		*(wraps_here ? wrapped : straight) += time;
+		wraps += wraps_here;
+	}
+	// MB/s of data through the buffer, written and read once
+	*wrapped  = (double)wraps * BENCH_ROUNDS * sizeof(in) * 1000 / *wrapped;
+	*straight = (double)(BENCH_SIZE - wraps) * BENCH_ROUNDS * sizeof(in) * 1000 / *straight;
+}
+
+int main(void)
+{
+	double wrapped, straight, old_wrapped, old_straight;
+
+	test_random_ops();
+	test_wrap();
+
+	bench(false, &wrapped, &straight);
+	bench(true, &old_wrapped, &old_straight);
+	printf("155 bytes in and out of 400: %6.0f MB/s in one piece, %6.0f MB/s wrapped, byte by byte %4.0f and %4.0f\n",
+	       straight, wrapped, old_straight, old_wrapped);
+	return TEST_RESULT();
+}
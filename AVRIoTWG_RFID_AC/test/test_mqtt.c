@@ -0,0 +1,513 @@
+/*
+ * test_mqtt.c
+ *
+ * The MQTT client of mqtt_core.c and mqtt_comm_layer.c on a socket that
+ * keeps what is sent: a PUBLISH gathered from its parts is byte for byte the
+ * one copied into the Tx buffer before and leaves in one block, the PUBLISH
+ * queue against a model of it over random bursts, PUBACKs and lost
+ * connections, PUBACKs that arrive together and in pieces, and what a
+ * PUBLISH costs copied and queued.
+ *
+ *     gcc -O2 -DTCPIP_BSD -Itest/stubs -I. -Iinclude -Iutils -Imqtt test/test_mqtt.c mqtt/mqtt_core/mqtt_core.c
+ *         mqtt/mqtt_comm_bsd/mqtt_comm_layer.c mqtt/mqtt_exchange_buffer/mqtt_exchange_buffer.c
+ *         mqtt/mqtt_packetTransfer_interface.c src/timeout.c src/timeout_hal_host.c debug_print.c
+ */
+
+#include <string.h>
+#include "test.h"
+#include "mqtt/mqtt_core/mqtt_core.h"
+#include "cloud/bsd_adapter/bsdWINC.h"
+#include "timeout.h"
+
+#define QUEUE_ROUNDS    3000
+#define BENCH_PUBLISHES 1000000
+
+static uint8_t  wire[4096]; // what was sent since wire_reset()
+static uint16_t wire_length;
+static bool     wire_capture = true;
+static bool     socket_fail; // the next send fails
+static uint32_t socket_sends;
+static int      socket_segments; // of the last send, the WINC writes each one over SPI on its own
+
+int BSD_sendv(int socket, const struct bsd_iovec *iov, int iovcnt, int flags)
+{
+	int sent = 0;
+	int i;
+
+	if (socket_fail) {
+		socket_fail = false;
+		return BSD_ERROR;
+	}
+	for (i = 0; i < iovcnt; i++) {
+		if (wire_capture && wire_length + iov[i].iov_len <= sizeof(wire)) {
+			memcpy(&wire[wire_length], iov[i].iov_base, iov[i].iov_len);
+			wire_length += iov[i].iov_len;
+		}
+		sent += iov[i].iov_len;
+	}
+	socket_sends++;
+	socket_segments = iovcnt;
+	return sent;
+}
+
+int BSD_close(int socket)
+{
+	return BSD_SUCCESS;
+}
+
+static void wire_reset(void)
+{
+	wire_length = 0;
+}
+
+static void receive(const uint8_t *data, uint8_t length)
+{
+	MQTT_GetReceivedData((uint8_t *)data, length);
+	MQTT_ReceptionHandler(MQTT_GetClientConnectionInfo());
+}
+
+// CONNECT and CONNACK, the PUBLISH queue is kept
+static void reconnect(void)
+{
+	static const uint8_t connack[] = {0x20, 0x02, 0x00, 0x00};
+	mqttConnectPacket    packet;
+
+	memset(&packet, 0, sizeof(packet));
+	packet.clientID                             = (uint8_t *)"projects/p/locations/l/registries/r/devices/d";
+	packet.connectVariableHeader.keepAliveTimer = 120;
+	CHECK(MQTT_CreateConnectPacket(&packet));
+	MQTT_TransmissionHandler(MQTT_GetClientConnectionInfo());
+	receive(connack, sizeof(connack));
+	CHECK(MQTT_GetConnectionState() == CONNECTED);
+	wire_reset();
+}
+
+static void connect_client(void)
+{
+	scheduler_timeout_init();
+	MQTT_ClientInitialise();
+	reconnect();
+}
+
+static void puback(uint16_t identifier)
+{
+	uint8_t packet[] = {PUBACK << 4, 0x02, identifier >> 8, identifier & 0xFF};
+
+	receive(packet, sizeof(packet));
+}
+
+// A tap as the cloud service sends it
+static uint8_t topic[] = "/devices/d0123C4A5B6D7E8F9AB/events";
+static uint8_t payload[120];
+
+static void init_publish(mqttPublishPacket *packet)
+{
+	memset(packet, 0, sizeof(*packet));
+	packet->topic         = topic;
+	packet->payload       = payload;
+	packet->payloadLength = sizeof(payload);
+}
+
+// The gathered PUBLISH, created and sent by the MQTT core
+static void send_gathered(mqttPublishPacket *packet)
+{
+	MQTT_CreatePublishPacket(packet);
+	MQTT_TransmissionHandler(MQTT_GetClientConnectionInfo());
+}
+
+// The same QoS 0 PUBLISH copied into the Tx buffer and sent from there, as before the gather
+static void send_copied(void)
+{
+	mqttContext *   context = MQTT_GetClientConnectionInfo();
+	exchangeBuffer *txbuff  = &context->mqttDataExchangeBuffers.txbuff;
+	uint16_t        topicLength     = sizeof(topic) - 1;
+	uint16_t        remainingLength = 2 + topicLength + sizeof(payload);
+	uint8_t         header[5]       = {PUBLISH << 4};
+	uint8_t         headerLength    = 1;
+
+	do {
+		header[headerLength] = (remainingLength & 0x7F) | (remainingLength > 0x7F ? 0x80 : 0);
+		remainingLength >>= 7;
+		headerLength++;
+	} while (remainingLength);
+	header[headerLength++] = topicLength >> 8;
+	header[headerLength++] = topicLength & 0xFF;
+
+	MQTT_ExchangeBufferInit(txbuff);
+	MQTT_ExchangeBufferWrite(txbuff, header, headerLength);
+	MQTT_ExchangeBufferWrite(txbuff, topic, topicLength);
+	MQTT_ExchangeBufferWrite(txbuff, payload, sizeof(payload));
+	MQTT_Send(context);
+}
+
+static void test_gather(void)
+{
+	mqttPublishPacket packet;
+	uint8_t           copied[sizeof(wire)];
+	uint16_t          copiedLength;
+	uint16_t          i;
+
+	for (i = 0; i < sizeof(payload); i++)
+		payload[i] = test_random();
+
+	connect_client();
+	send_copied();
+	memcpy(copied, wire, wire_length);
+	copiedLength = wire_length;
+
+	wire_reset();
+	init_publish(&packet);
+	send_gathered(&packet);
+	CHECK(wire_length == copiedLength);
+	CHECK(memcmp(wire, copied, copiedLength) == 0);
+	CHECK(socket_segments == 1);
+	CHECK(!MQTT_IsPublishPending());
+}
+
+// What the queue must hold, the oldest packet first
+enum { MODEL_WAITING, MODEL_INFLIGHT, MODEL_DONE };
+
+typedef struct {
+	uint8_t  qos;
+	uint8_t  duplicate;
+	uint8_t  state;
+	uint16_t identifier;
+	uint16_t length;
+	uint8_t  payload[200];
+} model_packet;
+
+static model_packet model[MQTT_PUBLISH_QUEUE_SIZE];
+static uint8_t      model_count;
+static uint16_t     model_identifier;
+static uint16_t     model_pool_start; // index of the oldest payload in the pool of the queue
+static uint8_t      expected[sizeof(wire)];
+static uint16_t     expected_length;
+
+static uint16_t model_pool_used(void)
+{
+	uint16_t used = 0;
+	uint8_t  i;
+
+	for (i = 0; i < model_count; i++)
+		used += model[i].length;
+	return used;
+}
+
+static bool model_create(uint8_t qos, const uint8_t *payload, uint16_t length)
+{
+	model_packet *packet = &model[model_count];
+
+	if (model_count == MQTT_PUBLISH_QUEUE_SIZE || length > MQTT_PUBLISH_QUEUE_BYTES - model_pool_used())
+		return false;
+	packet->qos       = qos;
+	packet->duplicate = 0;
+	packet->state     = MODEL_WAITING;
+	packet->length    = length;
+	memcpy(packet->payload, payload, length);
+	if (qos) {
+		if (++model_identifier == 0)
+			model_identifier = 1;
+		packet->identifier = model_identifier;
+	}
+	model_count++;
+	return true;
+}
+
+// Frees the packets at the head that are done, like the queue does with its pool
+static void model_release(void)
+{
+	while (model_count && model[0].state == MODEL_DONE) {
+		if (model[0].length >= model_pool_used())
+			model_pool_start = 0;
+		else
+			model_pool_start = (model_pool_start + model[0].length) % MQTT_PUBLISH_QUEUE_BYTES;
+		memmove(&model[0], &model[1], --model_count * sizeof(model[0]));
+	}
+}
+
+static void model_encode(const model_packet *packet)
+{
+	uint8_t *out         = &expected[expected_length];
+	uint16_t topicLength = sizeof(topic) - 1;
+	uint16_t remaining   = 2 + topicLength + (packet->qos ? 2 : 0) + packet->length;
+
+	*out++ = PUBLISH << 4 | packet->duplicate << 3 | packet->qos << 1;
+	do {
+		*out++ = (remaining & 0x7F) | (remaining > 0x7F ? 0x80 : 0);
+		remaining >>= 7;
+	} while (remaining);
+	*out++ = topicLength >> 8;
+	*out++ = topicLength & 0xFF;
+	memcpy(out, topic, topicLength);
+	out += topicLength;
+	if (packet->qos) {
+		*out++ = packet->identifier >> 8;
+		*out++ = packet->identifier & 0xFF;
+	}
+	memcpy(out, packet->payload, packet->length);
+	out += packet->length;
+	expected_length = out - expected;
+}
+
+// The packets one send takes: waiting ones in order, while the window and the segments last
+static uint8_t model_send(void)
+{
+	uint16_t offset   = 0;
+	uint8_t  segments = 0;
+	uint8_t  inFlight = 0;
+	uint8_t  sent     = 0;
+	uint16_t start;
+	uint8_t  i, needed;
+
+	for (i = 0; i < model_count; i++)
+		inFlight += model[i].state == MODEL_INFLIGHT;
+
+	expected_length = 0;
+	for (i = 0; i < model_count; offset += model[i++].length) {
+		if (model[i].state != MODEL_WAITING)
+			continue;
+		if (model[i].qos && inFlight == MQTT_PUBLISH_INFLIGHT)
+			break;
+		// Header and topic, the packet identifier, the payload in one or two pieces
+		start  = (model_pool_start + offset) % MQTT_PUBLISH_QUEUE_BYTES;
+		needed = 2 + model[i].qos;
+		if (model[i].length)
+			needed += start + model[i].length > MQTT_PUBLISH_QUEUE_BYTES ? 2 : 1;
+		if (segments + needed > MQTT_MAX_SEGMENTS)
+			break;
+		segments += needed;
+		model_encode(&model[i]);
+		if (model[i].qos) {
+			model[i].state     = MODEL_INFLIGHT;
+			model[i].duplicate = 1;
+			inFlight++;
+		} else {
+			model[i].state = MODEL_DONE;
+		}
+		sent++;
+	}
+	return sent;
+}
+
+// The PUBACK for a packet in flight, to the client and to the model
+static void acknowledge(model_packet *packet)
+{
+	puback(packet->identifier);
+	packet->state = MODEL_DONE;
+}
+
+/*
+ * Random bursts of QoS 0 and 1 PUBLISH packets of up to 200 bytes, the
+ * caller's buffer scribbled over right after each one. Between the bursts
+ * the transmission handler runs, sends fail now and then and PUBACKs come
+ * for some of the packets in flight. Every send has to carry exactly the
+ * packets the model picks, byte for byte, in one socket send, as one block
+ * unless it is larger than the Tx buffer.
+ */
+static void test_queue(void)
+{
+	mqttContext *     context = MQTT_GetClientConnectionInfo();
+	mqttPublishPacket packet;
+	uint8_t           buffer[200];
+	uint16_t          drops = MQTT_GetPublishDropCount();
+	uint32_t          round, sends, created = 0, dropped = 0, packets = 0, flushes = 0, split = 0;
+	unsigned          wrong = 0;
+	uint16_t          length, i;
+	uint8_t           burst, sent, waiting;
+	bool              queued;
+
+	connect_client();
+
+	for (round = 0; round < QUEUE_ROUNDS; round++) {
+		for (burst = test_random() % 5; burst > 0; burst--) {
+			length = test_random() % (sizeof(buffer) + 1);
+			for (i = 0; i < length; i++)
+				buffer[i] = test_random();
+			init_publish(&packet);
+			packet.payload                = buffer;
+			packet.payloadLength          = length;
+			packet.publishHeaderFlags.qos = test_random() % 2;
+
+			queued = model_create(packet.publishHeaderFlags.qos, buffer, length);
+			wrong += MQTT_CreatePublishPacket(&packet) != queued;
+			memset(buffer, 0xA5, sizeof(buffer));
+			created++;
+			dropped += !queued;
+		}
+
+		if (test_random() % 8 == 0) {
+			// The send fails, the packets stay queued and the ones in flight go out again after the CONNACK
+			socket_fail = true;
+			MQTT_TransmissionHandler(context);
+			if (!socket_fail) {
+				wrong += MQTT_GetConnectionState() != DISCONNECTED;
+				for (i = 0; i < model_count; i++) {
+					if (model[i].state == MODEL_INFLIGHT)
+						model[i].state = MODEL_WAITING;
+				}
+				reconnect();
+			}
+			socket_fail = false;
+		}
+
+		if (test_random() % 4 != 0) {
+			sends = socket_sends;
+			sent  = model_send();
+			MQTT_TransmissionHandler(context);
+			wrong += socket_sends - sends != (sent != 0);
+			wrong += wire_length != expected_length || memcmp(wire, expected, wire_length) != 0;
+			if (sent != 0) {
+				wrong += (socket_segments == 1) != (wire_length <= context->mqttDataExchangeBuffers.txbuff.bufferLength);
+				split += socket_segments != 1;
+			}
+			packets += sent;
+			flushes += sent != 0;
+			wire_reset();
+		}
+
+		for (i = 0; i < model_count; i++) {
+			if (model[i].state == MODEL_INFLIGHT && test_random() % 2)
+				acknowledge(&model[i]);
+		}
+		model_release();
+
+		for (waiting = 0, i = 0; i < model_count; i++)
+			waiting += model[i].state == MODEL_WAITING;
+		wrong += MQTT_IsPublishPending() != (waiting != 0);
+	}
+	CHECK(wrong == 0);
+	CHECK(MQTT_GetPublishDropCount() - drops == dropped);
+	CHECK(dropped != 0 && dropped < created / 2);
+	CHECK(packets > flushes); // several packets went out together
+	CHECK(split != 0);
+	printf("%u PUBLISH queued, %u dropped, %u sent in %u socket sends, %u of them larger than the Tx buffer\n",
+	       (unsigned)(created - dropped), (unsigned)dropped, (unsigned)packets, (unsigned)flushes, (unsigned)split);
+
+	// Leave the queue empty for the benchmark
+	while (model_count) {
+		model_send();
+		MQTT_TransmissionHandler(context);
+		for (i = 0; i < model_count; i++) {
+			if (model[i].state == MODEL_INFLIGHT)
+				acknowledge(&model[i]);
+		}
+		model_release();
+	}
+	CHECK(!MQTT_IsPublishPending());
+	wire_reset();
+}
+
+static uint8_t acks;
+
+static void count_ack(void)
+{
+	acks++;
+}
+
+/*
+ * The PUBACKs of a full window of QoS 1 packets in two TCP segments, the first
+ * one ends inside a PUBACK. Every packet is acknowledged once and nothing is
+ * sent again, the next PUBLISH goes out alone and without DUP.
+ */
+static void test_coalesced(void)
+{
+	mqttContext *     context = MQTT_GetClientConnectionInfo();
+	mqttPublishPacket packet;
+	uint8_t           pubacks[4 * MQTT_PUBLISH_INFLIGHT];
+	uint16_t          offset = 0, identifier;
+	uint32_t          sends;
+	uint8_t           i;
+
+	connect_client();
+	acks = 0;
+	for (i = 0; i < MQTT_PUBLISH_INFLIGHT; i++) {
+		init_publish(&packet);
+		packet.payloadLength          = 20;
+		packet.publishHeaderFlags.qos = 1;
+		packet.ackHandler             = count_ack;
+		CHECK(MQTT_CreatePublishPacket(&packet));
+	}
+	// They take more segments than one send has
+	while (MQTT_IsPublishPending())
+		MQTT_TransmissionHandler(context);
+
+	// Header, remaining length, topic, then the packet identifier
+	for (i = 0; i < MQTT_PUBLISH_INFLIGHT; i++) {
+		CHECK(wire[offset] == (PUBLISH << 4 | 1 << 1));
+		identifier = wire[offset + 4 + sizeof(topic) - 1] << 8 | wire[offset + 5 + sizeof(topic) - 1];
+		offset += 2 + wire[offset + 1];
+
+		pubacks[4 * i]     = PUBACK << 4;
+		pubacks[4 * i + 1] = 0x02;
+		pubacks[4 * i + 2] = identifier >> 8;
+		pubacks[4 * i + 3] = identifier & 0xFF;
+	}
+	CHECK(offset == wire_length);
+	wire_reset();
+
+	receive(pubacks, 6);
+	CHECK(acks == 1);
+	receive(pubacks + 6, sizeof(pubacks) - 6);
+	CHECK(acks == MQTT_PUBLISH_INFLIGHT);
+	CHECK(context->mqttDataExchangeBuffers.rxbuff.dataLength == 0);
+
+	sends = socket_sends;
+	MQTT_TransmissionHandler(context);
+	CHECK(socket_sends == sends && wire_length == 0);
+
+	init_publish(&packet);
+	packet.payloadLength          = 20;
+	packet.publishHeaderFlags.qos = 1;
+	CHECK(MQTT_CreatePublishPacket(&packet));
+	MQTT_TransmissionHandler(context);
+	CHECK(socket_sends == sends + 1);
+	CHECK(wire_length == 2 + wire[1] && wire[0] == (PUBLISH << 4 | 1 << 1));
+	identifier = wire[4 + sizeof(topic) - 1] << 8 | wire[5 + sizeof(topic) - 1];
+	puback(identifier);
+	CHECK(acks == MQTT_PUBLISH_INFLIGHT && !MQTT_IsPublishPending());
+	wire_reset();
+}
+
+/*
+ * Cost of one QoS 0 PUBLISH down to the socket. The queued one is copied into
+ * the PUBLISH queue, then gathered from it into the Tx buffer, the copied one
+ * is written to the Tx buffer straight away. Both leave in one block.
+ */
+static void bench_gather(void)
+{
+	mqttPublishPacket packet;
+	uint64_t          start, gathered, copied;
+	uint32_t          sends, n;
+
+	connect_client();
+	wire_capture = false;
+	sends        = socket_sends;
+
+	start = test_now_ns();
+	for (n = 0; n < BENCH_PUBLISHES; n++)
+		send_copied();
+	copied = test_now_ns() - start;
+
+	start = test_now_ns();
+	for (n = 0; n < BENCH_PUBLISHES; n++) {
+		init_publish(&packet);
+		send_gathered(&packet);
+	}
+	gathered = test_now_ns() - start;
+
+	wire_capture = true;
+	printf("%u byte PUBLISH: %5.1f ns copied into the Tx buffer, %5.1f ns queued and gathered into it\n",
+	       (unsigned)(sizeof(topic) - 1 + sizeof(payload)), (double)copied / BENCH_PUBLISHES,
+	       (double)gathered / BENCH_PUBLISHES);
+	CHECK(socket_sends - sends == 2 * BENCH_PUBLISHES);
+	CHECK(socket_segments == 1);
+}
+
+int main(void)
+{
+	test_gather();
+	test_queue();
+	test_coalesced();
+	bench_gather();
+	return TEST_RESULT();
+}
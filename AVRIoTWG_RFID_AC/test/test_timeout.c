@@ -0,0 +1,421 @@
+/*
+ * test_timeout.c
+ *
+ * The scheduler of timeout.c on the virtual clock of timeout_hal_host.c:
+ * timers expire on their tick, never early, also past the 16-bit range of the
+ * counter and with a full heap, timers re-created or deleted at the head,
+ * sleeping on the virtual and on the host clock, the conversions between
+ * ticks and time against 64-bit arithmetic, a critical task under a flood of background
+ * tasks, then the cost of expiring and re-creating
+ * timers with 8, 32 and 128 of them pending. Built once per container of the
+ * pending timers:
+ *
+ *     gcc -O2 -DSCHEDULER_TIMER_HEAP=1 -DSCHEDULER_HEAP_SIZE=129 -Itest/stubs -Iinclude -Iutils
+ *         test/test_timeout.c src/timeout.c src/timeout_hal_host.c
+ */
+
+#include <string.h>
+#include "test.h"
+#include "timeout.h"
+#include "timeout_hal.h"
+
+#define TEST_TIMERS    128
+#define RANDOM_TICKS   300000
+#define BENCH_EXPIRIES 2000000
+#define BENCH_CREATES  2000000
+#define CONVERSIONS    1000000
+#define FLOOD_TIMERS   30
+#define FLOOD_TICKS    200000
+
+#if SCHEDULER_TIMER_HEAP && SCHEDULER_HEAP_SIZE <= TEST_TIMERS
+#error "The tests need SCHEDULER_HEAP_SIZE above TEST_TIMERS"
+#endif
+
+typedef struct {
+	timer_struct_t timer;
+	bool           active;
+	uint32_t       due;       // virtual clock tick the timer must expire on
+	uint32_t       max_delay; // reschedule after 1 to max_delay ticks, one-shot if 0
+} test_timer_t;
+
+static test_timer_t timers[TEST_TIMERS];
+static uint32_t     expiries, early, late, stale;
+
+static absolutetime_t test_callback(void *payload)
+{
+	test_timer_t *t   = payload;
+	uint32_t      now = timeout_hal_get_ticks();
+	uint32_t      delay;
+
+	expiries++;
+	if (!t->active)
+		stale++;
+	else if ((int32_t)(now - t->due) < 0)
+		early++;
+	else if (now != t->due)
+		late++;
+
+	if (t->max_delay == 0) {
+		t->active = false;
+		return 0;
+	}
+	delay  = 1 + test_random() % t->max_delay;
+	t->due = now + delay;
+	return delay;
+}
+
+static bool start(test_timer_t *t, uint32_t delay, uint32_t max_delay)
+{
+	t->timer.callback_ptr = test_callback;
+	t->timer.payload      = t;
+	t->max_delay          = max_delay;
+	t->due                = timeout_hal_get_ticks() + (delay ? delay : 1);
+	t->active             = scheduler_timeout_create(&t->timer, delay);
+	return t->active;
+}
+
+static void stop(test_timer_t *t)
+{
+	scheduler_timeout_delete(&t->timer);
+	t->active = false;
+}
+
+static void reset(void)
+{
+	scheduler_timeout_flush_all();
+	scheduler_timeout_init();
+	memset(timers, 0, sizeof(timers));
+	expiries = early = late = stale = 0;
+	test_random_state = 2463534242U;
+}
+
+// One tick at a time, the callbacks run on the tick their timer expired
+static void run(uint32_t ticks)
+{
+	while (ticks--) {
+		timeout_hal_advance(1);
+		scheduler_timeout_call_next_callback();
+	}
+}
+
+// Timers created, re-created and deleted at random, some of them beyond 65535 ticks
+static void test_random_timers(void)
+{
+	uint32_t tick, created = 0, i;
+
+	reset();
+	for (tick = 0; tick < RANDOM_TICKS; tick++) {
+		test_timer_t *t = &timers[test_random() % 32];
+
+		switch (test_random() % 64) {
+		case 0:
+			stop(t);
+			break;
+		case 1:
+			created += start(t, test_random() % 200000, 0);
+			break;
+		case 2:
+		case 3:
+			created += start(t, test_random() % 64, 0);
+			break;
+		}
+		run(1);
+	}
+
+	// Whatever is still pending expires too
+	run(200000);
+	for (i = 0; i < TEST_TIMERS; i++)
+		CHECK(!timers[i].active);
+
+	printf("%u timers created, %u expired\n", (unsigned)created, (unsigned)expiries);
+	CHECK(expiries > created / 2);
+	CHECK(stale == 0);
+	CHECK(early == 0);
+	CHECK(late == 0);
+}
+
+// The clock itself: the counter wraps, the overflow waits for the end of a critical section
+static void test_clock(void)
+{
+	reset();
+	timeout_hal_set_counter(65530);
+	timeout_hal_advance(10);
+	CHECK(timeout_hal_get_counter() == 4);
+	CHECK(timeout_hal_get_ticks() == 10);
+
+	// A timer due in the middle of a critical section starts once it ends, on the tick it expired
+	start(&timers[0], 20, 0);
+	timeout_hal_lock();
+	timeout_hal_advance(30);
+	scheduler_timeout_call_next_callback();
+	CHECK(expiries == 0);
+	timeout_hal_unlock();
+	scheduler_timeout_call_next_callback();
+	CHECK(expiries == 1);
+	CHECK(late == 1);
+
+	// Up to 65535 ticks in one period of the counter, beyond that through the dummy timer
+	reset();
+	start(&timers[0], 65535, 0);
+	start(&timers[1], 65536, 0);
+	start(&timers[2], 200000, 0);
+	start(&timers[3], 3 * 65536 + 7, 0);
+	run(200000);
+	CHECK(expiries == 4);
+	CHECK(early == 0);
+	CHECK(late == 0);
+	CHECK(stale == 0);
+}
+
+// Deleting or re-creating the timer at the head arms the counter for the next one
+static void test_head(void)
+{
+	reset();
+	start(&timers[0], 100, 0);
+	start(&timers[1], 300, 0);
+	start(&timers[2], 70000, 0);
+	run(50);
+
+	// Later, the next timer takes the head
+	start(&timers[0], 500, 0);
+	run(250);
+	CHECK(expiries == 1);
+	CHECK(!timers[1].active);
+
+	// Sooner, then later than the dummy, while it is the head
+	start(&timers[0], 10, 0);
+	run(10);
+	CHECK(expiries == 2);
+	start(&timers[0], 80000, 0);
+	stop(&timers[2]);
+	start(&timers[1], 5, 0);
+	stop(&timers[1]);
+	run(80000);
+	CHECK(expiries == 3);
+	CHECK(!timers[0].active);
+
+	CHECK(early == 0);
+	CHECK(late == 0);
+	CHECK(stale == 0);
+}
+
+// The scheduler sleeps until the next timer, on the virtual clock and on the host clock
+static void test_sleep(void)
+{
+	uint64_t       start_ns;
+	absolutetime_t slept;
+
+	reset();
+	slept = scheduler_timeout_get_sleep_stats()->sleep_time;
+	start(&timers[0], 1000, 0);
+	start(&timers[1], 100000, 0);
+	while (expiries < 2) {
+		scheduler_timeout_sleep();
+		scheduler_timeout_call_next_callback();
+	}
+	CHECK(timeout_hal_get_ticks() == 100000);
+	CHECK(scheduler_timeout_get_sleep_stats()->sleep_time - slept == 100000);
+	CHECK(late == 0);
+
+	// On the host clock the process can be descheduled past the tick, only early counts
+	reset();
+	timeout_hal_set_realtime(true);
+	start_ns = test_now_ns();
+	start(&timers[0], 50, 0);
+	while (expiries < 1) {
+		scheduler_timeout_sleep();
+		scheduler_timeout_call_next_callback();
+	}
+	timeout_hal_set_realtime(false);
+	CHECK(test_now_ns() - start_ns >= 50 * 1000000000ULL / SCHEDULER_TICKS_PER_SECOND);
+	CHECK(test_now_ns() - start_ns < 1000000000);
+	CHECK(early == 0);
+}
+
+static uint32_t saturate(uint64_t value)
+{
+	return value > UINT32_MAX ? UINT32_MAX : value;
+}
+
+static unsigned check_conversions(uint32_t value)
+{
+	unsigned wrong = 0;
+
+	wrong += scheduler_ms_to_ticks(value) != saturate((uint64_t)value * 1024 / 1000);
+	wrong += scheduler_ticks_to_ms(value) != (uint64_t)value * 1000 / 1024;
+	wrong += scheduler_us_to_ticks(value) != ((uint64_t)value * 1024 + 999999) / 1000000;
+	wrong += scheduler_ticks_to_us(value) != saturate((uint64_t)value * 1000000 / 1024);
+	return wrong;
+}
+
+// Exact over the whole range, no overflow on the way, saturated where the result does not fit
+static void test_conversions(void)
+{
+	static const uint32_t edges[] = {0, 1, 124, 125, 127, 128, 999, 1000, 1023, 1024, 15624, 15625, 1000000,
+	                                 4194303, 4194304, 4194304000U, 4194304999U, 4194305000U, 0x7FFFFFFF,
+	                                 UINT32_MAX - 1, UINT32_MAX};
+	unsigned              wrong = 0;
+	uint32_t              i;
+
+	for (i = 0; i < sizeof(edges) / sizeof(edges[0]); i++)
+		wrong += check_conversions(edges[i]);
+	// The last value that does not saturate and the first that does
+	for (i = 0; i < 4096; i++) {
+		wrong += check_conversions(4194303999U - 2048 + i);
+		wrong += check_conversions(4398046U - 2048 + i);
+	}
+	for (i = 0; i < CONVERSIONS; i++)
+		wrong += check_conversions(test_random() >> (test_random() % 32));
+	CHECK(wrong == 0);
+
+	CHECK(scheduler_ms_to_ticks(1000) == SCHEDULER_TICKS_PER_SECOND);
+	CHECK(scheduler_ticks_to_ms(SCHEDULER_TICKS_PER_SECOND) == 1000);
+	CHECK(scheduler_us_to_ticks(1) == 1);
+	CHECK(scheduler_ms_to_ticks(UINT32_MAX) == UINT32_MAX);
+	CHECK(scheduler_ticks_to_us(UINT32_MAX) == UINT32_MAX);
+}
+
+// Every slot taken by timers beyond one period of the counter, the scheduler still needs its dummy
+static void test_full(void)
+{
+	test_timer_t extra;
+	uint32_t     lost, i;
+
+	reset();
+	for (i = 0; i < TEST_TIMERS; i++)
+		CHECK(start(&timers[i], 70000 + i, 0));
+
+#if SCHEDULER_TIMER_HEAP && SCHEDULER_HEAP_SIZE == TEST_TIMERS + 1
+	// No room left, the create fails and is counted instead of losing the timer silently
+	memset(&extra, 0, sizeof(extra));
+	lost = scheduler_timeout_get_sleep_stats()->lost_timers;
+	CHECK(!start(&extra, 10, 0));
+	CHECK(scheduler_timeout_get_sleep_stats()->lost_timers == lost + 1);
+#else
+	(void)extra;
+	(void)lost;
+#endif
+	// Re-creating a pending timer takes its own slot
+	CHECK(start(&timers[0], 70000, 0));
+
+	run(70000 - 1);
+	CHECK(expiries == 0);
+	run(TEST_TIMERS);
+	CHECK(expiries == TEST_TIMERS);
+	CHECK(early == 0);
+	CHECK(late == 0);
+	CHECK(stale == 0);
+}
+
+// Every 1 to 3 ticks, 2 ticks of work
+static absolutetime_t flood_callback(void *payload)
+{
+	timeout_hal_advance(2);
+	return 1 + test_random() % 3;
+}
+
+static uint32_t flood_worst;
+
+// Every 97 ticks, notes how late it starts
+static absolutetime_t critical_callback(void *payload)
+{
+	test_timer_t *t = payload;
+
+	if (timeout_hal_get_ticks() - t->due > flood_worst)
+		flood_worst = timeout_hal_get_ticks() - t->due;
+	t->due = timeout_hal_get_ticks() + 97;
+	return 97;
+}
+
+// Worst time from the critical timer expiring to its callback starting
+static uint32_t flood(uint8_t priority)
+{
+	test_timer_t *critical = &timers[FLOOD_TIMERS];
+	uint32_t      i;
+
+	reset();
+	for (i = 0; i < FLOOD_TIMERS; i++) {
+		timers[i].timer.callback_ptr = flood_callback;
+		timers[i].timer.priority     = SCHEDULER_PRIORITY_BACKGROUND;
+		scheduler_timeout_create(&timers[i].timer, 1 + i % 3);
+	}
+	critical->timer.callback_ptr = critical_callback;
+	critical->timer.payload      = critical;
+	critical->timer.priority     = priority;
+	critical->due                = 97;
+	scheduler_timeout_create(&critical->timer, 97);
+
+	flood_worst = 0;
+	run(FLOOD_TICKS);
+	return flood_worst;
+}
+
+static void test_priorities(void)
+{
+	uint32_t fifo, critical;
+
+	// At worst the critical timer expires just as a background task starts
+	fifo     = flood(SCHEDULER_PRIORITY_BACKGROUND);
+	critical = flood(SCHEDULER_PRIORITY_CRITICAL);
+	printf("%u background timers: critical timer late by up to %u ticks, %u in the same queue\n", FLOOD_TIMERS,
+	       (unsigned)critical, (unsigned)fifo);
+	CHECK(critical <= 2);
+	CHECK(fifo > 2 * critical);
+}
+
+/*
+ * Cost of the expiry and of the re-create of a timer that is pending, with n
+ * timers pending all the time. The delays average n ticks, about one expiry
+ * per tick.
+ */
+static void bench(uint8_t n)
+{
+	uint64_t start_ns, expire_ns, create_ns;
+	uint32_t expired, i;
+
+	reset();
+	for (i = 0; i < n; i++)
+		start(&timers[i], 1 + test_random() % (2 * n), 2 * n);
+
+	start_ns = test_now_ns();
+	while (expiries < BENCH_EXPIRIES) {
+		timeout_hal_advance(1);
+		scheduler_timeout_call_next_callback();
+	}
+	expire_ns = test_now_ns() - start_ns;
+	expired   = expiries;
+
+	start_ns = test_now_ns();
+	for (i = 0; i < BENCH_CREATES; i++) {
+		test_timer_t *t = &timers[test_random() % n];
+		uint32_t      delay = 1 + test_random() % (2 * n);
+
+		t->due = timeout_hal_get_ticks() + delay;
+		scheduler_timeout_create(&t->timer, delay);
+		if ((i & 15) == 0)
+			run(1);
+	}
+	create_ns = test_now_ns() - start_ns;
+
+	printf("%-4s %3u timers pending: %6.1f ns per expiry, %6.1f ns per re-create\n",
+	       SCHEDULER_TIMER_HEAP ? "heap" : "list", n, (double)expire_ns / expired, (double)create_ns / BENCH_CREATES);
+	CHECK(early == 0);
+	CHECK(late == 0);
+	CHECK(stale == 0);
+}
+
+int main(void)
+{
+	test_random_timers();
+	test_conversions();
+	test_clock();
+	test_head();
+	test_sleep();
+	test_full();
+	test_priorities();
+
+	bench(8);
+	bench(32);
+	bench(128);
+	return TEST_RESULT();
+}
@@ -269,6 +269,24 @@ void nm_bsp_sleep(uint32 u32TimeMsec);
 void nm_bsp_register_isr(tpfNmBspIsr pfIsr);
 /**@}*/
 
+/** @defgroup NmBspRegisterEventFn nm_bsp_register_event_isr
+ *     @ingroup BSPAPI
+ *   Register an application function called from the WINC interrupt.
+ */
+/**@{*/
+/*!
+ * @fn           void nm_bsp_register_event_isr(tpfNmBspIsr);
+ * @param [in]   tpfNmBspIsr  pfIsr
+ *               Pointer to the function, NULL to remove it
+ * @brief		 The function is called inside the interrupt, after the ISR registered by the HIF layer. The
+ *				 application uses it to run m2m_wifi_handle_events() as soon as the WINC has a message, instead
+ *				 of polling.
+ * @see          tpfNmBspIsr, nm_bsp_register_isr
+ * @return       None
+ */
+void nm_bsp_register_event_isr(tpfNmBspIsr pfIsr);
+/**@}*/
+
 /** @defgroup NmBspInterruptCtrl nm_bsp_interrupt_ctrl
  *     @ingroup BSPAPI
  *    Synchronous enable/disable interrupts function
@@ -48,11 +48,16 @@
 #include "port.h"
 
 static tpfNmBspIsr gpfIsr;
+static tpfNmBspIsr gpfEventIsr;
 
 ISR(CONF_WIFI_M2M_INT_vect)
 {
 	if (!(CONF_WIFI_M2M_INT_PIN_get_level()) && gpfIsr) {
 		gpfIsr();
+
+		if (gpfEventIsr) {
+			gpfEventIsr();
+		}
 	}
 
 	/* Insert your PORTF interrupt handling code here */
@@ -150,6 +155,17 @@ void nm_bsp_register_isr(tpfNmBspIsr pfIsr)
 	CONF_WIFI_M2M_INT_PIN_set_isc(PORT_ISC_FALLING_gc);
 }
 
+/*
+ *	@fn		nm_bsp_register_event_isr
+ *	@brief	Register a function called from the interrupt after the HIF ISR
+ *	@param[IN]	pfIsr
+ *				Pointer to the function, NULL to remove it
+ */
+void nm_bsp_register_event_isr(tpfNmBspIsr pfIsr)
+{
+	gpfEventIsr = pfIsr;
+}
+
 /*
  *	@fn		nm_bsp_interrupt_ctrl
  *	@brief	Enable/Disable interrupts
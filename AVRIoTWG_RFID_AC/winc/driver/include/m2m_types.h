@@ -2329,6 +2329,21 @@ typedef struct {
 	uint32 u32CsBMP;
 } tstrSslSetActiveCsList;
 
+/*!
+@struct	\
+    tstrM2mDataSegment
+
+@brief
+    One part of a packet written to the WINC by hif_send_segments() or sendv(), the parts are
+    written back to back in the order given.
+ */
+typedef struct {
+	uint8 *pu8Data;
+	/*!< Data of the segment.	*/
+	uint16 u16Size;
+	/*!< Size of the segment in bytes, may be 0.	*/
+} tstrM2mDataSegment;
+
 /**@}*/
 
 #endif
@@ -284,14 +284,35 @@ sint8 hif_deinit(void *arg)
 
 sint8 hif_send(uint8 u8Gid, uint8 u8Opcode, uint8 *pu8CtrlBuf, uint16 u16CtrlBufSize, uint8 *pu8DataBuf,
                uint16 u16DataSize, uint16 u16DataOffset)
+{
+	tstrM2mDataSegment strSegment;
+
+	strSegment.pu8Data = pu8DataBuf;
+	strSegment.u16Size = u16DataSize;
+	return hif_send_segments(
+	    u8Gid, u8Opcode, pu8CtrlBuf, u16CtrlBufSize, (pu8DataBuf != NULL) ? &strSegment : NULL, 1, u16DataOffset);
+}
+/**
+*	@fn		NMI_API sint8 hif_send_segments(uint8 u8Gid,uint8 u8Opcode,uint8 *pu8CtrlBuf,uint16 u16CtrlBufSize,
+                       tstrM2mDataSegment *pstrSegments,uint8 u8SegmentCount, uint16 u16DataOffset)
+*	@brief	Send packet using host interface, the data segments are written one after the other
+*			to the buffer allocated in the WINC so the caller does not have to assemble the packet.
+*/
+sint8 hif_send_segments(uint8 u8Gid, uint8 u8Opcode, uint8 *pu8CtrlBuf, uint16 u16CtrlBufSize,
+                        tstrM2mDataSegment *pstrSegments, uint8 u8SegmentCount, uint16 u16DataOffset)
 {
 	sint8               ret = M2M_ERR_SEND;
 	volatile tstrHifHdr strHif;
+	uint16              u16DataSize = 0;
+	uint8               u8Segment;
 
 	strHif.u8Opcode  = u8Opcode & (~NBIT7);
 	strHif.u8Gid     = u8Gid;
 	strHif.u16Length = M2M_HIF_HDR_OFFSET;
-	if (pu8DataBuf != NULL) {
+	if (pstrSegments != NULL) {
+		for (u8Segment = 0; u8Segment < u8SegmentCount; u8Segment++) {
+			u16DataSize += pstrSegments[u8Segment].u16Size;
+		}
 		strHif.u16Length += u16DataOffset + u16DataSize;
 	} else {
 		strHif.u16Length += u16CtrlBufSize;
@@ -368,12 +389,16 @@ sint8 hif_send(uint8 u8Gid, uint8 u8Opcode, uint8 *pu8CtrlBuf, uint16 u16CtrlBuf
 					goto ERR1;
 				u32CurrAddr += u16CtrlBufSize;
 			}
-			if (pu8DataBuf != NULL) {
+			if (pstrSegments != NULL) {
 				u32CurrAddr += (u16DataOffset - u16CtrlBufSize);
-				ret = nm_write_block(u32CurrAddr, pu8DataBuf, u16DataSize);
-				if (M2M_SUCCESS != ret)
-					goto ERR1;
-				u32CurrAddr += u16DataSize;
+				for (u8Segment = 0; u8Segment < u8SegmentCount; u8Segment++) {
+					if (pstrSegments[u8Segment].u16Size == 0)
+						continue;
+					ret = nm_write_block(u32CurrAddr, pstrSegments[u8Segment].pu8Data, pstrSegments[u8Segment].u16Size);
+					if (M2M_SUCCESS != ret)
+						goto ERR1;
+					u32CurrAddr += pstrSegments[u8Segment].u16Size;
+				}
 			}
 
 			reg = dma_addr << 2;
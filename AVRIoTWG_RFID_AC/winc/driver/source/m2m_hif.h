@@ -47,6 +47,7 @@ INCLUDES
 *=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*=*/
 
 #include "../../common/include/nm_common.h"
+#include "../include/m2m_types.h"
 /*!< Include depends on UNO Board is used or not*/
 #ifdef ENABLE_UNO_BOARD
 #include "m2m_uno_hif.h"
@@ -132,6 +133,29 @@ NMI_API sint8 hif_deinit(void *arg);
 */
 NMI_API sint8 hif_send(uint8 u8Gid, uint8 u8Opcode, uint8 *pu8CtrlBuf, uint16 u16CtrlBufSize, uint8 *pu8DataBuf,
                        uint16 u16DataSize, uint16 u16DataOffset);
+/**
+*	@fn		NMI_API sint8 hif_send_segments(uint8 u8Gid,uint8 u8Opcode,uint8 *pu8CtrlBuf,uint16 u16CtrlBufSize,
+                       tstrM2mDataSegment *pstrSegments,uint8 u8SegmentCount, uint16 u16DataOffset)
+*	@brief	Send packet using host interface, gathering the packet data from several buffers.
+
+*	@param [in]	u8Gid
+*				Group ID.
+*	@param [in]	u8Opcode
+*				Operation ID.
+*	@param [in]	pu8CtrlBuf
+*				Pointer to the Control buffer.
+*	@param [in]	u16CtrlBufSize
+                Control buffer size.
+*	@param [in]	pstrSegments
+*				Segments of the packet data, NULL if there is no data.
+*	@param [in]	u8SegmentCount
+                Number of segments.
+*	@param [in]	u16DataOffset
+                Packet Data offset.
+*    @return	The function shall return ZERO for successful operation and a negative value otherwise.
+*/
+NMI_API sint8 hif_send_segments(uint8 u8Gid, uint8 u8Opcode, uint8 *pu8CtrlBuf, uint16 u16CtrlBufSize,
+                                tstrM2mDataSegment *pstrSegments, uint8 u8SegmentCount, uint16 u16DataOffset);
 /*
 *	@fn		hif_receive
 *	@brief	Host interface interrupt serviece routine
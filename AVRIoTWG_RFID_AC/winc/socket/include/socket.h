@@ -1672,6 +1672,34 @@ the firmware.
 error) otherwise.
 */
 NMI_API sint16 send(SOCKET sock, void *pvSendBuffer, uint16 u16SendLength, uint16 u16Flags);
+/*!
+@fn	\
+    NMI_API sint16 sendv(SOCKET sock, tstrM2mDataSegment *pstrSegments, uint8 u8SegmentCount, uint16 u16Flags);
+
+@brief
+    Same as @ref send for a packet split over several buffers. The segments are written to the WINC in order,
+    without being copied into one buffer first.
+
+@param [in]	sock
+            Socket ID, must hold a non negative value.
+
+@param [in]	pstrSegments
+    Segments of the data to be transmitted, none of them may have a NULL buffer pointer.
+
+@param [in]	u8SegmentCount
+    Number of segments, at least one.
+
+@param [in]	u16Flags
+    Not used in the current implementation.
+
+@warning
+    The sum of the segment sizes must not exceed @ref SOCKET_BUFFER_MAX_LENGTH.
+
+@return
+    The function shall return @ref SOCK_ERR_NO_ERROR for successful operation and a negative value (indicating the
+error) otherwise.
+*/
+NMI_API sint16 sendv(SOCKET sock, tstrM2mDataSegment *pstrSegments, uint8 u8SegmentCount, uint16 u16Flags);
 /** @} */
 /** @defgroup SendToSocketFn sendto
  *  @ingroup SocketAPI
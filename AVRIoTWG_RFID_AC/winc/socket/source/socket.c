@@ -69,6 +69,9 @@ MACROS
 #define SOCKET_REQUEST(reqID, reqArgs, reqSize, reqPayload, reqPayloadSize, reqPayloadOffset)                          \
 	hif_send(M2M_REQ_GROUP_IP, reqID, reqArgs, reqSize, reqPayload, reqPayloadSize, reqPayloadOffset)
 
+#define SOCKET_REQUEST_SEGMENTS(reqID, reqArgs, reqSize, reqSegments, reqSegmentCount, reqPayloadOffset)               \
+	hif_send_segments(M2M_REQ_GROUP_IP, reqID, reqArgs, reqSize, reqSegments, reqSegmentCount, reqPayloadOffset)
+
 #define SSL_FLAGS_ACTIVE NBIT0
 #define SSL_FLAGS_BYPASS_X509 NBIT1
 #define SSL_FLAGS_2_RESERVD NBIT2
@@ -678,10 +681,45 @@ Date
 *********************************************************************/
 sint16 send(SOCKET sock, void *pvSendBuffer, uint16 u16SendLength, uint16 flags)
 {
-	sint16 s16Ret = SOCK_ERR_INVALID_ARG;
+	tstrM2mDataSegment strSegment;
 
-	if ((sock >= 0) && (pvSendBuffer != NULL) && (u16SendLength <= SOCKET_BUFFER_MAX_LENGTH)
-	    && (gastrSockets[sock].bIsUsed == 1)) {
+	if (pvSendBuffer == NULL) {
+		return SOCK_ERR_INVALID_ARG;
+	}
+
+	strSegment.pu8Data = (uint8 *)pvSendBuffer;
+	strSegment.u16Size = u16SendLength;
+	return sendv(sock, &strSegment, 1, flags);
+}
+/*********************************************************************
+Function
+        sendv
+
+Description
+        send() for a packet split over several buffers, the segments are
+        written to the WINC one after the other without being copied into
+        one buffer first.
+
+Return
+        SOCK_ERR_NO_ERROR or a negative error, same as send()
+*********************************************************************/
+sint16 sendv(SOCKET sock, tstrM2mDataSegment *pstrSegments, uint8 u8SegmentCount, uint16 flags)
+{
+	sint16 s16Ret        = SOCK_ERR_INVALID_ARG;
+	uint32 u32SendLength = 0;
+	uint8  u8Segment;
+
+	if ((pstrSegments == NULL) || (u8SegmentCount == 0)) {
+		return s16Ret;
+	}
+	for (u8Segment = 0; u8Segment < u8SegmentCount; u8Segment++) {
+		if (pstrSegments[u8Segment].pu8Data == NULL) {
+			return s16Ret;
+		}
+		u32SendLength += pstrSegments[u8Segment].u16Size;
+	}
+
+	if ((sock >= 0) && (u32SendLength <= SOCKET_BUFFER_MAX_LENGTH) && (gastrSockets[sock].bIsUsed == 1)) {
 		uint16      u16DataOffset;
 		tstrSendCmd strSend;
 		uint8       u8Cmd;
@@ -690,7 +728,7 @@ sint16 send(SOCKET sock, void *pvSendBuffer, uint16 u16SendLength, uint16 flags)
 		u16DataOffset = TCP_TX_PACKET_OFFSET;
 
 		strSend.sock         = sock;
-		strSend.u16DataSize  = NM_BSP_B_L_16(u16SendLength);
+		strSend.u16DataSize  = NM_BSP_B_L_16((uint16)u32SendLength);
 		strSend.u16SessionID = gastrSockets[sock].u16SessionID;
 
 		if (sock >= TCP_SOCK_MAX) {
@@ -701,12 +739,12 @@ sint16 send(SOCKET sock, void *pvSendBuffer, uint16 u16SendLength, uint16 flags)
 			u16DataOffset = gastrSockets[sock].u16DataOffset;
 		}
 
-		s16Ret = SOCKET_REQUEST(u8Cmd | M2M_REQ_DATA_PKT,
-		                        (uint8 *)&strSend,
-		                        sizeof(tstrSendCmd),
-		                        pvSendBuffer,
-		                        u16SendLength,
-		                        u16DataOffset);
+		s16Ret = SOCKET_REQUEST_SEGMENTS(u8Cmd | M2M_REQ_DATA_PKT,
+		                                 (uint8 *)&strSend,
+		                                 sizeof(tstrSendCmd),
+		                                 pstrSegments,
+		                                 u8SegmentCount,
+		                                 u16DataOffset);
 		if (s16Ret != SOCK_ERR_NO_ERROR) {
 			s16Ret = SOCK_ERR_BUFFER_FULL;
 		}